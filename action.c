@@ -120,6 +120,12 @@
 
 /* forward definitions */
 static rsRetVal processBatchMain(action_t *pAction, batch_t *pBatch, int*);
+static void actionDestructWrkrInfo(action_t *pThis, actWrkrInfo_t *pWrkrInfo);
+static rsRetVal actionConstructWrkrInfo(action_t *pThis, actWrkrInfo_t **ppWrkrInfo);
+static rsRetVal actionWrkrInfoAddStats(action_t *pThis, actWrkrInfo_t *pWrkrInfo);
+static void actionCompleteCommit(actWrkrInfo_t *pWrkrInfo, batch_t *pBatch);
+static void actionDiscardCommit(actWrkrInfo_t *pWrkrInfo);
+static void actionAbandonCommit(void *pCommitPending);
 static rsRetVal doSubmitToActionQComplexBatch(action_t *pAction, batch_t *pBatch);
 static rsRetVal doSubmitToActionQNotAllMarkBatch(action_t *pAction, batch_t *pBatch);
 static rsRetVal doSubmitToActionQBatch(action_t *pAction, batch_t *pBatch);
@@ -143,6 +149,9 @@ typedef struct configSettings_s {
 	int glbliActionResumeInterval;
 	int glbliActionResumeRetryCount;		/* how often should suspended actions be retried? */
 	int bActionRepMsgHasMsg;			/* last messsage repeated... has msg fragment in it */
+	int iActDedupWindow;				/* window for duplicate suppression (0 = off) */
+	int iActDedupMaxEntries;			/* max number of fingerprints kept for it */
+	uchar *pszActDedupTpl;				/* template to build the dedup key */
 	uchar *pszActionName;				/* short name for the action */
 	/* action queue and its configuration parameters */
 	queueType_t ActionQueType;			/* type of the main message queue above */
@@ -190,6 +199,9 @@ static struct cnfparamdescr cnfparamdescr[] = {
 	{ "action.execonlyonceeveryinterval", eCmdHdlrInt, 0 }, /* legacy: actionexeconlyonceeveryinterval */
 	{ "action.execonlywhenpreviousissuspended", eCmdHdlrInt, 0 }, /* legacy: actionexeconlywhenpreviousissuspended */
 	{ "action.repeatedmsgcontainsoriginalmsg", eCmdHdlrBinary, 0 }, /* legacy: repeatedmsgcontainsoriginalmsg */
+	{ "action.dedupwindow", eCmdHdlrInt, 0 }, /* legacy: actiondedupwindow */
+	{ "action.dedupmaxentries", eCmdHdlrInt, 0 }, /* legacy: actiondedupmaxentries */
+	{ "action.dedupkeytemplate", eCmdHdlrGetWord, 0 }, /* legacy: actiondedupkeytemplate */
 	{ "action.resumeretrycount", eCmdHdlrInt, 0 }, /* legacy: actionresumeretrycount */
 	{ "action.resumeinterval", eCmdHdlrInt, 0 }
 };
@@ -286,6 +298,8 @@ actionResetQueueParams(void)
  */
 rsRetVal actionDestruct(action_t *pThis)
 {
+	actWrkrInfo_t *pWrkrInfo;
+	actWrkrInfo_t *pWrkrInfoDel;
 	DEFiRet;
 	ASSERT(pThis != NULL);
 
@@ -304,14 +318,23 @@ rsRetVal actionDestruct(action_t *pThis)
 	if(pThis->statsobj != NULL)
 		statsobj.Destruct(&pThis->statsobj);
 
+	for(pWrkrInfo = pThis->pWrkrInfoRoot ; pWrkrInfo != NULL ; ) {
+		pWrkrInfoDel = pWrkrInfo;
+		pWrkrInfo = pWrkrInfo->pNext;
+		actionDestructWrkrInfo(pThis, pWrkrInfoDel);
+	}
+
 	if(pThis->pMod != NULL)
 		pThis->pMod->freeInstance(pThis->pModData);
 
 	if(pThis->f_pMsg != NULL)
 		msgDestruct(&pThis->f_pMsg);
+	dedupDestruct(&pThis->pDedup);
+	free(pThis->pDedupBuf);
+	free(pThis->pszDedupTpl);
 
 	pthread_mutex_destroy(&pThis->mutAction);
-	pthread_mutex_destroy(&pThis->mutActExec);
+	pthread_mutex_destroy(&pThis->mutWrkrInfo);
 	d_free(pThis->pszName);
 	d_free(pThis->ppTpl);
 
@@ -343,8 +366,10 @@ rsRetVal actionConstruct(action_t **ppThis)
 	pThis->iSecsExecOnceInterval = 0;
 	pThis->bExecWhenPrevSusp = 0;
 	pThis->bRepMsgHasMsg = 0;
+	pThis->iDedupWindow = 0;
+	pThis->iDedupMaxEntries = DEDUP_DFLT_MAX_ENTRIES;
 	pThis->tLastOccur = datetime.GetTime(NULL);	/* done once per action on startup only */
-	pthread_mutex_init(&pThis->mutActExec, NULL);
+	pthread_mutex_init(&pThis->mutWrkrInfo, NULL);
 	pthread_mutex_init(&pThis->mutAction, NULL);
 	INIT_ATOMIC_HELPER_MUT(pThis->mutCAS);
 
@@ -391,7 +416,17 @@ actionConstructFinalize(action_t *pThis, struct cnfparamvals *queueParams)
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("failed"),
 		ctrType_IntCtr, &pThis->ctrFail));
 
+	STATSCOUNTER_INIT(pThis->ctrRenderShared, pThis->mutCtrRenderShared);
+	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("rendershared"),
+		ctrType_IntCtr, &pThis->ctrRenderShared));
+
+	STATSCOUNTER_INIT(pThis->ctrDedup, pThis->mutCtrDedup);
+	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("deduplicated"),
+		ctrType_IntCtr, &pThis->ctrDedup));
+
 	CHKiRet(statsobj.ConstructFinalize(pThis->statsobj));
+	if(pThis->pMod->mod.om.createWrkrInstance != NULL)
+		CHKiRet(actionWrkrInfoAddStats(pThis, pThis->pWrkrInfoRoot));
 
 	/* create our queue */
 
@@ -411,13 +446,16 @@ actionConstructFinalize(action_t *pThis, struct cnfparamvals *queueParams)
 	 */
 	if(   pThis->iExecEveryNthOccur > 1
 	   || pThis->f_ReduceRepeated
+	   || pThis->pDedup != NULL
 	   || pThis->iSecsExecOnceInterval
 	  ) {
 		DBGPRINTF("info: firehose mode disabled for action because "
 		          "iExecEveryNthOccur=%d, "
 		          "ReduceRepeated=%d, "
+		          "DedupWindow=%d, "
 		          "iSecsExecOnceInterval=%d\n",
 			  pThis->iExecEveryNthOccur, pThis->f_ReduceRepeated,
+			  (pThis->pDedup == NULL) ? 0 : pThis->iDedupWindow,
 			  pThis->iSecsExecOnceInterval
 			  );
 		pThis->submitToActQ = doSubmitToActionQComplexBatch;
@@ -438,10 +476,10 @@ actionConstructFinalize(action_t *pThis, struct cnfparamvals *queueParams)
 		MsgEnableThreadSafety();
 
 	/* create queue */
-	/* action queues always (for now) have just one worker. This may change when
-	 * we begin to implement an interface the enable output modules to request
-	 * to be run on multiple threads. So far, this is forbidden by the interface
-	 * spec. -- rgerhards, 2008-01-30
+	/* action queues by default have just one worker. If more are configured,
+	 * they are serialized on the action, except if the output module provides
+	 * worker instances (createWrkrInstance()), in which case each of them
+	 * runs on an instance of its own.
 	 */
 	CHKiRet(qqueueConstruct(&pThis->pQueue, cs.ActionQueType, 1, cs.iActionQueueSize,
 					(rsRetVal (*)(void*, batch_t*, int*))processBatchMain));
@@ -514,9 +552,9 @@ rsRetVal actionSetGlobalResumeInterval(int iNewVal)
  * returned string must not be modified.
  * rgerhards, 2009-05-07
  */
-static uchar *getActStateName(action_t *pThis)
+static uchar *getActStateName(action_state_t eState)
 {
-	switch(pThis->eState) {
+	switch(eState) {
 		case ACT_STATE_RDY:
 			return (uchar*) "rdy";
 		case ACT_STATE_ITX:
@@ -538,18 +576,18 @@ static uchar *getActStateName(action_t *pThis)
 /* returns a suitable return code based on action state
  * rgerhards, 2009-05-07
  */
-static rsRetVal getReturnCode(action_t *pThis)
+static rsRetVal getReturnCode(actWrkrInfo_t *pWrkrInfo)
 {
 	DEFiRet;
 
-	ASSERT(pThis != NULL);
-	switch(pThis->eState) {
+	ASSERT(pWrkrInfo != NULL);
+	switch(pWrkrInfo->eState) {
 		case ACT_STATE_RDY:
 			iRet = RS_RET_OK;
 			break;
 		case ACT_STATE_ITX:
-			if(pThis->bHadAutoCommit) {
-				pThis->bHadAutoCommit = 0; /* auto-reset */
+			if(pWrkrInfo->bHadAutoCommit) {
+				pWrkrInfo->bHadAutoCommit = 0; /* auto-reset */
 				iRet = RS_RET_PREVIOUS_COMMITTED;
 			} else {
 				iRet = RS_RET_DEFER_COMMIT;
@@ -564,7 +602,7 @@ static rsRetVal getReturnCode(action_t *pThis)
 			break;
 		default:
 			DBGPRINTF("Invalid action engine state %d, program error\n",
-					(int) pThis->eState);
+					(int) pWrkrInfo->eState);
 			iRet = RS_RET_ERR;
 			break;
 	}
@@ -576,40 +614,43 @@ static rsRetVal getReturnCode(action_t *pThis)
 /* set the action to a new state
  * rgerhards, 2007-08-02
  */
-static inline void actionSetState(action_t *pThis, action_state_t newState)
+static inline void actionSetState(actWrkrInfo_t *pWrkrInfo, action_state_t newState)
 {
-	pThis->eState = newState;
-	DBGPRINTF("Action %p transitioned to state: %s\n", pThis, getActStateName(pThis));
+	pWrkrInfo->eState = newState;
+	DBGPRINTF("Action %p[%d] transitioned to state: %s\n", pWrkrInfo->pAction,
+		  pWrkrInfo->iNbr, getActStateName(newState));
 }
 
 /* Handles the transient commit state. So far, this is
  * mostly a dummy...
  * rgerhards, 2007-08-02
  */
-static void actionCommitted(action_t *pThis)
+static void actionCommitted(actWrkrInfo_t *pWrkrInfo)
 {
-	actionSetState(pThis, ACT_STATE_RDY);
+	actionSetState(pWrkrInfo, ACT_STATE_RDY);
 }
 
 
 /* set action to "rtry" state.
  * rgerhards, 2007-08-02
  */
-static void actionRetry(action_t *pThis)
+static void actionRetry(actWrkrInfo_t *pWrkrInfo)
 {
-	actionSetState(pThis, ACT_STATE_RTRY);
-	pThis->iResumeOKinRow++;
+	actionSetState(pWrkrInfo, ACT_STATE_RTRY);
+	pWrkrInfo->iResumeOKinRow++;
 }
 
 
 /* Disable action, this means it will never again be usable
  * until rsyslog is reloaded. Use only as a last resort, but
- * depends on output module.
+ * depends on output module. This affects the action as a whole,
+ * not only the worker instance that requested it.
  * rgerhards, 2007-08-02
  */
-static void actionDisable(action_t *pThis)
+static void actionDisable(actWrkrInfo_t *pWrkrInfo)
 {
-	actionSetState(pThis, ACT_STATE_DIED);
+	actionSetState(pWrkrInfo, ACT_STATE_DIED);
+	pWrkrInfo->pAction->eState = ACT_STATE_DIED;
 }
 
 
@@ -621,13 +662,14 @@ static void actionDisable(action_t *pThis)
  * CPU time. TODO: maybe a config option for that?
  * rgerhards, 2007-08-02
  */
-static inline void actionSuspend(action_t *pThis, time_t ttNow)
+static inline void actionSuspend(actWrkrInfo_t *pWrkrInfo, time_t ttNow)
 {
 	if(ttNow == NO_TIME_PROVIDED)
 		datetime.GetTime(&ttNow);
-	pThis->ttResumeRtry = ttNow + pThis->iResumeInterval * (pThis->iNbrResRtry / 10 + 1);
-	actionSetState(pThis, ACT_STATE_SUSP);
-	DBGPRINTF("earliest retry=%d\n", (int) pThis->ttResumeRtry);
+	pWrkrInfo->ttResumeRtry = ttNow + pWrkrInfo->pAction->iResumeInterval
+				  * (pWrkrInfo->iNbrResRtry / 10 + 1);
+	actionSetState(pWrkrInfo, ACT_STATE_SUSP);
+	DBGPRINTF("earliest retry=%d\n", (int) pWrkrInfo->ttResumeRtry);
 }
 
 
@@ -647,32 +689,34 @@ static inline void actionSuspend(action_t *pThis, time_t ttNow)
  * of its inability to recover. -- rgerhards, 2010-04-26.
  */
 static inline rsRetVal
-actionDoRetry(action_t *pThis, time_t ttNow, int *pbShutdownImmediate)
+actionDoRetry(actWrkrInfo_t *pWrkrInfo, time_t ttNow, int *pbShutdownImmediate)
 {
 	int iRetries;
 	int iSleepPeriod;
 	int bTreatOKasSusp;
+	action_t *pThis;
 	DEFiRet;
 
-	ASSERT(pThis != NULL);
+	ASSERT(pWrkrInfo != NULL);
+	pThis = pWrkrInfo->pAction;
 
 	iRetries = 0;
-	while((*pbShutdownImmediate == 0) && pThis->eState == ACT_STATE_RTRY) {
-		iRet = pThis->pMod->tryResume(pThis->pModData);
-		if((pThis->iResumeOKinRow > 9) && (pThis->iResumeOKinRow % 10 == 0)) {
+	while((*pbShutdownImmediate == 0) && pWrkrInfo->eState == ACT_STATE_RTRY) {
+		iRet = pThis->pMod->tryResume(pWrkrInfo->pModData);
+		if((pWrkrInfo->iResumeOKinRow > 9) && (pWrkrInfo->iResumeOKinRow % 10 == 0)) {
 			bTreatOKasSusp = 1;
-			pThis->iResumeOKinRow = 0;
+			pWrkrInfo->iResumeOKinRow = 0;
 		} else {
 			bTreatOKasSusp = 0;
 		}
 		if((iRet == RS_RET_OK) && (!bTreatOKasSusp)) {
-			actionSetState(pThis, ACT_STATE_RDY);
+			actionSetState(pWrkrInfo, ACT_STATE_RDY);
 		} else if(iRet == RS_RET_SUSPENDED || bTreatOKasSusp) {
 			/* max retries reached? */
 			if((pThis->iResumeRetryCount != -1 && iRetries >= pThis->iResumeRetryCount)) {
-				actionSuspend(pThis, ttNow);
+				actionSuspend(pWrkrInfo, ttNow);
 			} else {
-				++pThis->iNbrResRtry;
+				++pWrkrInfo->iNbrResRtry;
 				++iRetries;
 				iSleepPeriod = pThis->iResumeInterval;
 				ttNow += iSleepPeriod; /* not truly exact, but sufficiently... */
@@ -682,12 +726,12 @@ actionDoRetry(action_t *pThis, time_t ttNow, int *pbShutdownImmediate)
 				}
 			}
 		} else if(iRet == RS_RET_DISABLE_ACTION) {
-			actionDisable(pThis);
+			actionDisable(pWrkrInfo);
 		}
 	}
 
-	if(pThis->eState == ACT_STATE_RDY) {
-		pThis->iNbrResRtry = 0;
+	if(pWrkrInfo->eState == ACT_STATE_RDY) {
+		pWrkrInfo->iNbrResRtry = 0;
 	}
 
 finalize_it:
@@ -698,14 +742,14 @@ finalize_it:
 /* try to resume an action -- rgerhards, 2007-08-02
  * changed to new action state engine -- rgerhards, 2009-05-07
  */
-static rsRetVal actionTryResume(action_t *pThis, int *pbShutdownImmediate)
+static rsRetVal actionTryResume(actWrkrInfo_t *pWrkrInfo, int *pbShutdownImmediate)
 {
 	DEFiRet;
 	time_t ttNow = NO_TIME_PROVIDED;
 
-	ASSERT(pThis != NULL);
+	ASSERT(pWrkrInfo != NULL);
 
-	if(pThis->eState == ACT_STATE_SUSP) {
+	if(pWrkrInfo->eState == ACT_STATE_SUSP) {
 		/* if we are suspended, we need to check if the timeout expired.
 		 * for this handling, we must always obtain a fresh timestamp. We used
 		 * to use the action timestamp, but in this case we will never reach a
@@ -714,20 +758,21 @@ static rsRetVal actionTryResume(action_t *pThis, int *pbShutdownImmediate)
 		 * here. -- rgerhards, 2009-03-18
 		 */
 		datetime.GetTime(&ttNow); /* cache "now" */
-		if(ttNow >= pThis->ttResumeRtry) {
-			actionSetState(pThis, ACT_STATE_RTRY); /* back to retries */
+		if(ttNow >= pWrkrInfo->ttResumeRtry) {
+			actionSetState(pWrkrInfo, ACT_STATE_RTRY); /* back to retries */
 		}
 	}
 
-	if(pThis->eState == ACT_STATE_RTRY) {
+	if(pWrkrInfo->eState == ACT_STATE_RTRY) {
 		if(ttNow == NO_TIME_PROVIDED) /* use cached result if we have it */
 			datetime.GetTime(&ttNow);
-		CHKiRet(actionDoRetry(pThis, ttNow, pbShutdownImmediate));
+		CHKiRet(actionDoRetry(pWrkrInfo, ttNow, pbShutdownImmediate));
 	}
 
-	if(Debug && (pThis->eState == ACT_STATE_RTRY ||pThis->eState == ACT_STATE_SUSP)) {
-		DBGPRINTF("actionTryResume: action %p state: %s, next retry (if applicable): %u [now %u]\n",
-			pThis, getActStateName(pThis), (unsigned) pThis->ttResumeRtry, (unsigned) ttNow);
+	if(Debug && (pWrkrInfo->eState == ACT_STATE_RTRY ||pWrkrInfo->eState == ACT_STATE_SUSP)) {
+		DBGPRINTF("actionTryResume: action %p[%d] state: %s, next retry (if applicable): %u [now %u]\n",
+			pWrkrInfo->pAction, pWrkrInfo->iNbr, getActStateName(pWrkrInfo->eState),
+			(unsigned) pWrkrInfo->ttResumeRtry, (unsigned) ttNow);
 	}
 
 finalize_it:
@@ -739,27 +784,35 @@ finalize_it:
  * depending on its current state.
  * rgerhards, 2009-05-07
  */
-static inline rsRetVal actionPrepare(action_t *pThis, int *pbShutdownImmediate)
+static inline rsRetVal actionPrepare(actWrkrInfo_t *pWrkrInfo, int *pbShutdownImmediate)
 {
 	DEFiRet;
 
-	assert(pThis != NULL);
-	CHKiRet(actionTryResume(pThis, pbShutdownImmediate));
+	assert(pWrkrInfo != NULL);
+	/* a pending commit must be completed before we use the instance again. This
+	 * only happens here if a batch is split up, otherwise the commit of the
+	 * previous batch is completed by processBatchMain().
+	 */
+	if(pWrkrInfo->pPendingBatch != NULL)
+		actionCompleteCommit(pWrkrInfo, pWrkrInfo->pPendingBatch);
+	if(pWrkrInfo->bCommitAbandoned)
+		actionDiscardCommit(pWrkrInfo);
+	CHKiRet(actionTryResume(pWrkrInfo, pbShutdownImmediate));
 
 	/* if we are now ready, we initialize the transaction and advance
 	 * action state accordingly
 	 */
-	if(pThis->eState == ACT_STATE_RDY) {
-		iRet = pThis->pMod->mod.om.beginTransaction(pThis->pModData);
+	if(pWrkrInfo->eState == ACT_STATE_RDY) {
+		iRet = pWrkrInfo->pAction->pMod->mod.om.beginTransaction(pWrkrInfo->pModData);
 		switch(iRet) {
 			case RS_RET_OK:
-				actionSetState(pThis, ACT_STATE_ITX);
+				actionSetState(pWrkrInfo, ACT_STATE_ITX);
 				break;
 			case RS_RET_SUSPENDED:
-				actionRetry(pThis);
+				actionRetry(pWrkrInfo);
 				break;
 			case RS_RET_DISABLE_ACTION:
-				actionDisable(pThis);
+				actionDisable(pWrkrInfo);
 				break;
 			default:FINALIZE;
 		}
@@ -770,6 +823,87 @@ finalize_it:
 }
 
 
+/* count a message that permanently failed, both for the action and,
+ * if there are multiple ones, for the worker instance.
+ */
+static inline void
+actionCountFail(actWrkrInfo_t *pWrkrInfo)
+{
+	STATSCOUNTER_INC(pWrkrInfo->pAction->ctrFail, pWrkrInfo->pAction->mutCtrFail);
+	if(pWrkrInfo->statsobj != NULL) {
+		STATSCOUNTER_INC(pWrkrInfo->ctrFail, pWrkrInfo->mutCtrFail);
+	}
+}
+
+
+/* complete a commit that the module left pending (see waitCommit()). pBatch
+ * is the batch that was submitted with it. That is passed in by the caller,
+ * because the queue may have moved the batch since the commit was started.
+ * On success, the messages submitted with it are flagged as committed. If the
+ * action was suspended, we do not know which of them made it, so they are
+ * left in "submitted" state. The queue then enqueues them again, which may
+ * lead to duplicates, but never to message loss. Must be called with the
+ * instance's mutExec locked.
+ */
+static void
+actionCompleteCommit(actWrkrInfo_t *pWrkrInfo, batch_t *pBatch)
+{
+	int i;
+	rsRetVal localRet;
+
+	pWrkrInfo->pPendingBatch = NULL;
+	pWrkrInfo->bCommitPending = 0;
+	pBatch->pCommitPending = NULL;
+	pBatch->pfAbandonCommit = NULL;
+
+	localRet = pWrkrInfo->pAction->pMod->mod.om.waitCommit(pWrkrInfo->pModData);
+	DBGPRINTF("action %p[%d]: pending commit completed, iRet %d\n", pWrkrInfo->pAction,
+		  pWrkrInfo->iNbr, localRet);
+	for(i = 0 ; i < pBatch->nElem ; ++i) {
+		if(pBatch->pElem[i].state != BATCH_STATE_SUB)
+			continue;
+		switch(localRet) {
+			case RS_RET_OK:
+			case RS_RET_DEFER_COMMIT:
+			case RS_RET_PREVIOUS_COMMITTED:
+				batchSetElemState(pBatch, i, BATCH_STATE_COMM);
+				pBatch->pElem[i].bPrevWasSuspended = 0;
+				break;
+			case RS_RET_SUSPENDED:
+				pBatch->pElem[i].bPrevWasSuspended = 1;
+				break;
+			default:
+				batchSetElemState(pBatch, i, BATCH_STATE_BAD);
+				actionCountFail(pWrkrInfo);
+				break;
+		}
+	}
+
+	if(localRet == RS_RET_SUSPENDED)
+		actionRetry(pWrkrInfo);
+	else if(localRet == RS_RET_DISABLE_ACTION)
+		actionDisable(pWrkrInfo);
+}
+
+
+/* wait for a pending commit whose batch was dropped by the queue (see
+ * actionAbandonCommit()). Its messages are re-enqueued by the queue in any
+ * case, so the outcome does not matter. We just need to make sure the module
+ * is done with it before the instance is used again or freed. Must be called
+ * with the instance's mutExec locked (or during destruction).
+ */
+static void
+actionDiscardCommit(actWrkrInfo_t *pWrkrInfo)
+{
+	rsRetVal localRet;
+
+	pWrkrInfo->bCommitAbandoned = 0;
+	localRet = pWrkrInfo->pAction->pMod->mod.om.waitCommit(pWrkrInfo->pModData);
+	DBGPRINTF("action %p[%d]: abandoned commit completed, iRet %d - ignored\n",
+		  pWrkrInfo->pAction, pWrkrInfo->iNbr, localRet);
+}
+
+
 /* debug-print the contents of an action object
  * rgerhards, 2007-08-02
  */
@@ -777,18 +911,28 @@ rsRetVal actionDbgPrint(action_t *pThis)
 {
 	DEFiRet;
 	char *sz;
+	actWrkrInfo_t *pWrkrInfo;
 
 	dbgprintf("%s: ", module.GetStateName(pThis->pMod));
 	pThis->pMod->dbgPrintInstInfo(pThis->pModData);
 	dbgprintf("\n");
 	dbgprintf("\tInstance data: 0x%lx\n", (unsigned long) pThis->pModData);
 	dbgprintf("\tRepeatedMsgReduction: %d\n", pThis->f_ReduceRepeated);
+	if(pThis->pDedup != NULL) {
+		dbgprintf("\tDedup window: %d sec, max entries %d, key template: %s\n",
+			  pThis->iDedupWindow, pThis->iDedupMaxEntries,
+			  (pThis->pszDedupTpl == NULL) ? "(default)" : (char*) pThis->pszDedupTpl);
+	}
 	dbgprintf("\tResume Interval: %d\n", pThis->iResumeInterval);
-	if(pThis->eState == ACT_STATE_SUSP) {
-		dbgprintf("\tresume next retry: %u, number retries: %d",
-			  (unsigned) pThis->ttResumeRtry, pThis->iNbrResRtry);
+	dbgprintf("\tState: %s\n", getActStateName(pThis->eState));
+	for(pWrkrInfo = pThis->pWrkrInfoRoot ; pWrkrInfo != NULL ; pWrkrInfo = pWrkrInfo->pNext) {
+		dbgprintf("\tWorker instance %d state: %s\n", pWrkrInfo->iNbr,
+			  getActStateName(pWrkrInfo->eState));
+		if(pWrkrInfo->eState == ACT_STATE_SUSP) {
+			dbgprintf("\t\tresume next retry: %u, number retries: %d\n",
+				  (unsigned) pWrkrInfo->ttResumeRtry, pWrkrInfo->iNbrResRtry);
+		}
 	}
-	dbgprintf("\tState: %s\n", getActStateName(pThis));
 	dbgprintf("\tExec only when previous is suspended: %d\n", pThis->bExecWhenPrevSusp);
 	if(pThis->submitToActQ == doSubmitToActionQComplexBatch) {
 			sz = "slow, but feature-rich";
@@ -808,6 +952,11 @@ rsRetVal actionDbgPrint(action_t *pThis)
 
 /* prepare the calling parameters for doAction()
  * rgerhards, 2009-05-07
+ * In string passing mode, the string is not rendered again if the previous
+ * action processing this batch element already did so with the same
+ * template (a typical case when forwarding to multiple destinations).
+ * In iovec passing mode, only the templates requested as iovec are rendered
+ * into a scatter list, all others are passed as strings.
  */
 static rsRetVal prepareDoActionParams(action_t *pAction, batch_obj_t *pElem)
 {
@@ -823,9 +972,22 @@ static rsRetVal prepareDoActionParams(action_t *pAction, batch_obj_t *pElem)
 	/* here we must loop to process all requested strings */
 	for(i = 0 ; i < pAction->iNumTpls ; ++i) {
 		switch(pAction->eParamPassing) {
+			case ACT_IOVEC_PASSING:
+				if(pAction->bTplIov[i]) {
+					CHKiRet(tplToIovec(pAction->ppTpl[i], pMsg, &(pElem->staticActIov[i])));
+					pElem->staticActParams[i] = pElem->staticActIov[i];
+					break;
+				}
+				/* FALLTHROUGH - this entry is passed as string */
 			case ACT_STRING_PASSING:
-				CHKiRet(tplToString(pAction->ppTpl[i], pMsg, &(pElem->staticActStrings[i]),
-					&pElem->staticLenStrings[i]));
+				if(pElem->pTplRendered[i] == pAction->ppTpl[i]) {
+					STATSCOUNTER_INC(pAction->ctrRenderShared, pAction->mutCtrRenderShared);
+				} else {
+					pElem->pTplRendered[i] = NULL; /* in case tplToString() fails */
+					CHKiRet(tplToString(pAction->ppTpl[i], pMsg, &(pElem->staticActStrings[i]),
+						&pElem->staticLenStrings[i]));
+					pElem->pTplRendered[i] = pAction->ppTpl[i];
+				}
 				pElem->staticActParams[i] = pElem->staticActStrings[i];
 				break;
 			case ACT_ARRAY_PASSING:
@@ -838,6 +1000,13 @@ static rsRetVal prepareDoActionParams(action_t *pAction, batch_obj_t *pElem)
 				CHKiRet(tplToJSON(pAction->ppTpl[i], pMsg, &json));
 				pElem->staticActParams[i] = (void*) json;
 				break;
+			case ACT_JSONSTR_PASSING:
+				/* uses the string buffer, but its content can not be shared */
+				pElem->pTplRendered[i] = NULL;
+				CHKiRet(tplToJSONString(pAction->ppTpl[i], pMsg, &(pElem->staticActStrings[i]),
+					&pElem->staticLenStrings[i]));
+				pElem->staticActParams[i] = pElem->staticActStrings[i];
+				break;
 			default:dbgprintf("software bug/error: unknown pAction->eParamPassing %d in prepareDoActionParams\n",
 					   (int) pAction->eParamPassing);
 				assert(0); /* software bug if this happens! */
@@ -887,7 +1056,18 @@ static rsRetVal releaseBatch(action_t *pAction, batch_t *pBatch)
 					}
 				}
 				break;
+			case ACT_IOVEC_PASSING:
+				/* free what was generated during rendering, but keep
+				 * the lists for the next batch.
+				 */
+				for(j = 0 ; j < pAction->iNumTpls ; ++j) {
+					if(pAction->bTplIov[j])
+						tplIovReset(pElem->staticActIov[j]);
+					pElem->staticActParams[j] = NULL;
+				}
+				break;
 			case ACT_STRING_PASSING:
+			case ACT_JSONSTR_PASSING:
 			case ACT_MSG_PASSING:
 				/* nothing to do in that case */
 				/* TODO ... and yet we do something ;) This is considered not
@@ -919,43 +1099,43 @@ static rsRetVal releaseBatch(action_t *pAction, batch_t *pBatch)
  * rgerhards, 2008-01-28
  */
 rsRetVal
-actionCallDoAction(action_t *pThis, msg_t *pMsg, void *actParams)
+actionCallDoAction(actWrkrInfo_t *pWrkrInfo, msg_t *pMsg, void *actParams)
 {
 	DEFiRet;
 
-	ASSERT(pThis != NULL);
+	ASSERT(pWrkrInfo != NULL);
 	ISOBJ_TYPE_assert(pMsg, msg);
 
-	DBGPRINTF("entering actionCalldoAction(), state: %s\n", getActStateName(pThis));
+	DBGPRINTF("entering actionCalldoAction(), state: %s\n", getActStateName(pWrkrInfo->eState));
 
-	pThis->bHadAutoCommit = 0;
-	iRet = pThis->pMod->mod.om.doAction(actParams, pMsg->msgFlags, pThis->pModData);
+	pWrkrInfo->bHadAutoCommit = 0;
+	iRet = pWrkrInfo->pAction->pMod->mod.om.doAction(actParams, pMsg->msgFlags, pWrkrInfo->pModData);
 	switch(iRet) {
 		case RS_RET_OK:
-			actionCommitted(pThis);
-			pThis->iResumeOKinRow = 0; /* we had a successful call! */
+			actionCommitted(pWrkrInfo);
+			pWrkrInfo->iResumeOKinRow = 0; /* we had a successful call! */
 			break;
 		case RS_RET_DEFER_COMMIT:
-			pThis->iResumeOKinRow = 0; /* we had a successful call! */
+			pWrkrInfo->iResumeOKinRow = 0; /* we had a successful call! */
 			/* we are done, action state remains the same */
 			break;
 		case RS_RET_PREVIOUS_COMMITTED:
 			/* action state remains the same, but we had a commit. */
-			pThis->bHadAutoCommit = 1;
-			pThis->iResumeOKinRow = 0; /* we had a successful call! */
+			pWrkrInfo->bHadAutoCommit = 1;
+			pWrkrInfo->iResumeOKinRow = 0; /* we had a successful call! */
 			break;
 		case RS_RET_SUSPENDED:
-			actionRetry(pThis);
+			actionRetry(pWrkrInfo);
 			break;
 		case RS_RET_DISABLE_ACTION:
-			actionDisable(pThis);
+			actionDisable(pWrkrInfo);
 			break;
 		default:/* permanent failure of this message - no sense in retrying. This is
 			 * not yet handled (but easy TODO)
 			 */
 			FINALIZE;
 	}
-	iRet = getReturnCode(pThis);
+	iRet = getReturnCode(pWrkrInfo);
 
 finalize_it:
 	RETiRet;
@@ -967,18 +1147,18 @@ finalize_it:
  * rgerhards, 2008-01-28
  */
 static inline rsRetVal
-actionProcessMessage(action_t *pThis, msg_t *pMsg, void *actParams, int *pbShutdownImmediate)
+actionProcessMessage(actWrkrInfo_t *pWrkrInfo, msg_t *pMsg, void *actParams, int *pbShutdownImmediate)
 {
 	DEFiRet;
 
-	ASSERT(pThis != NULL);
+	ASSERT(pWrkrInfo != NULL);
 	ISOBJ_TYPE_assert(pMsg, msg);
 
-	CHKiRet(actionPrepare(pThis, pbShutdownImmediate));
-	if(pThis->eState == ACT_STATE_ITX)
-		CHKiRet(actionCallDoAction(pThis, pMsg, actParams));
+	CHKiRet(actionPrepare(pWrkrInfo, pbShutdownImmediate));
+	if(pWrkrInfo->eState == ACT_STATE_ITX)
+		CHKiRet(actionCallDoAction(pWrkrInfo, pMsg, actParams));
 
-	iRet = getReturnCode(pThis);
+	iRet = getReturnCode(pWrkrInfo);
 finalize_it:
 	RETiRet;
 }
@@ -989,45 +1169,72 @@ finalize_it:
  * rgerhards, 2008-01-28
  */
 static rsRetVal
-finishBatch(action_t *pThis, batch_t *pBatch)
+finishBatch(actWrkrInfo_t *pWrkrInfo, batch_t *pBatch)
 {
 	int i;
 	DEFiRet;
 
-	ASSERT(pThis != NULL);
+	ASSERT(pWrkrInfo != NULL);
 
-	if(pThis->eState == ACT_STATE_RDY) {
+	if(pWrkrInfo->eState == ACT_STATE_RDY) {
 		/* we just need to flag the batch as commited */
 		FINALIZE; /* nothing to do */
 	}
 
-	CHKiRet(actionPrepare(pThis, pBatch->pbShutdownImmediate));
-	if(pThis->eState == ACT_STATE_ITX) {
-		iRet = pThis->pMod->mod.om.endTransaction(pThis->pModData);
+	CHKiRet(actionPrepare(pWrkrInfo, pBatch->pbShutdownImmediate));
+	if(pWrkrInfo->eState == ACT_STATE_ITX) {
+		iRet = pWrkrInfo->pAction->pMod->mod.om.endTransaction(pWrkrInfo->pModData);
+		if(   iRet == RS_RET_COMMIT_PENDING
+		   && pWrkrInfo->pAction->pMod->mod.om.waitCommit != NULL
+		   && !(pBatch->bCanPend && pWrkrInfo->bPooled)) {
+			/* the commit can not be left pending, so we wait for it */
+			iRet = pWrkrInfo->pAction->pMod->mod.om.waitCommit(pWrkrInfo->pModData);
+		}
 		switch(iRet) {
 			case RS_RET_OK:
-				actionCommitted(pThis);
-				/* flag messages as committed */
+				actionCommitted(pWrkrInfo);
+				/* flag messages as committed (but not those doActionBatch()
+				 * reported as failed, they were not part of the transaction)
+				 */
 				for(i = 0 ; i < pBatch->nElem ; ++i) {
+					if(pBatch->pElem[i].state == BATCH_STATE_BAD)
+						continue;
 					batchSetElemState(pBatch, i, BATCH_STATE_COMM);
 					pBatch->pElem[i].bPrevWasSuspended = 0; /* we had success! */
 				}
 				break;
 			case RS_RET_SUSPENDED:
-				actionRetry(pThis);
+				actionRetry(pWrkrInfo);
 				break;
 			case RS_RET_DISABLE_ACTION:
-				actionDisable(pThis);
+				actionDisable(pWrkrInfo);
 				break;
 			case RS_RET_DEFER_COMMIT:
 				DBGPRINTF("output plugin error: endTransaction() returns RS_RET_DEFER_COMMIT "
 					  "- ignored\n");
-				actionCommitted(pThis);
+				actionCommitted(pWrkrInfo);
 				break;
 			case RS_RET_PREVIOUS_COMMITTED:
 				DBGPRINTF("output plugin error: endTransaction() returns RS_RET_PREVIOUS_COMMITTED "
 					  "- ignored\n");
-				actionCommitted(pThis);
+				actionCommitted(pWrkrInfo);
+				break;
+			case RS_RET_COMMIT_PENDING:
+				if(pWrkrInfo->pAction->pMod->mod.om.waitCommit == NULL) {
+					DBGPRINTF("output plugin error: endTransaction() returns "
+						  "RS_RET_COMMIT_PENDING, but there is no waitCommit() - ignored\n");
+					actionCommitted(pWrkrInfo);
+					break;
+				}
+				/* the messages stay in "submitted" state until the commit is
+				 * completed while the next batch is processed. The instance is
+				 * ready for the next transaction then.
+				 */
+				pWrkrInfo->pPendingBatch = pBatch;
+				pWrkrInfo->bCommitPending = 1;
+				pBatch->pCommitPending = pWrkrInfo;
+				pBatch->pfAbandonCommit = actionAbandonCommit;
+				actionCommitted(pWrkrInfo);
 				break;
 			default:/* permanent failure of this message - no sense in retrying. This is
 				 * not yet handled (but easy TODO)
@@ -1035,7 +1242,7 @@ finishBatch(action_t *pThis, batch_t *pBatch)
 				FINALIZE;
 		}
 	}
-	iRet = getReturnCode(pThis);
+	iRet = getReturnCode(pWrkrInfo);
 
 finalize_it:
 	RETiRet;
@@ -1046,7 +1253,7 @@ finalize_it:
  * rgerhards, 2009-05-12
  */
 static inline rsRetVal
-tryDoAction(action_t *pAction, batch_t *pBatch, int *pnElem)
+tryDoAction(actWrkrInfo_t *pWrkrInfo, batch_t *pBatch, int *pnElem)
 {
 	int i;
 	int iElemProcessed;
@@ -1061,7 +1268,7 @@ tryDoAction(action_t *pAction, batch_t *pBatch, int *pnElem)
 	i = pBatch->iDoneUpTo;	/* all messages below that index are processed */
 	iElemProcessed = 0;
 	iCommittedUpTo = i;
-	DBGPRINTF("tryDoAction %p, pnElem %d, nElem %d\n", pAction, *pnElem, pBatch->nElem);
+	DBGPRINTF("tryDoAction %p[%d], pnElem %d, nElem %d\n", pWrkrInfo->pAction, pWrkrInfo->iNbr, *pnElem, pBatch->nElem);
 	while(iElemProcessed <= *pnElem && i < pBatch->nElem) {
 		if(*(pBatch->pbShutdownImmediate))
 			ABORT_FINALIZE(RS_RET_FORCE_TERM);
@@ -1070,9 +1277,12 @@ tryDoAction(action_t *pAction, batch_t *pBatch, int *pnElem)
 		 */
 		if(batchIsValidElem(pBatch, i)) {
 			pMsg = (msg_t*) pBatch->pElem[i].pUsrp;
-			localRet = actionProcessMessage(pAction, pMsg, pBatch->pElem[i].staticActParams,
+			if(pWrkrInfo->statsobj != NULL) {
+				STATSCOUNTER_INC(pWrkrInfo->ctrProcessed, pWrkrInfo->mutCtrProcessed);
+			}
+			localRet = actionProcessMessage(pWrkrInfo, pMsg, pBatch->pElem[i].staticActParams,
 							pBatch->pbShutdownImmediate);
-			DBGPRINTF("action %p call returned %d\n", pAction, localRet);
+			DBGPRINTF("action %p[%d] call returned %d\n", pWrkrInfo->pAction, pWrkrInfo->iNbr, localRet);
 			/* Note: we directly modify the batch object state, because we know that
 			 * wo do not overwrite BATCH_STATE_DISC indicators!
 			 */
@@ -1115,6 +1325,197 @@ finalize_it:
 	RETiRet;
 }
 
+/* make sure the doActionBatch() work arrays can hold nElem elements */
+static inline rsRetVal
+actionExtendBatchArrays(actWrkrInfo_t *pWrkrInfo, int nElem)
+{
+	void ***pppParams;
+	unsigned *pMsgOpts;
+	rsRetVal *pRet;
+	int *pIdx;
+	DEFiRet;
+
+	if(nElem <= pWrkrInfo->maxBatchElem)
+		FINALIZE;
+	CHKmalloc(pppParams = realloc(pWrkrInfo->pppBatchParams, nElem * sizeof(void**)));
+	pWrkrInfo->pppBatchParams = pppParams;
+	CHKmalloc(pMsgOpts = realloc(pWrkrInfo->pBatchMsgOpts, nElem * sizeof(unsigned)));
+	pWrkrInfo->pBatchMsgOpts = pMsgOpts;
+	CHKmalloc(pRet = realloc(pWrkrInfo->pBatchRet, nElem * sizeof(rsRetVal)));
+	pWrkrInfo->pBatchRet = pRet;
+	CHKmalloc(pIdx = realloc(pWrkrInfo->pBatchIdx, nElem * sizeof(int)));
+	pWrkrInfo->pBatchIdx = pIdx;
+	pWrkrInfo->maxBatchElem = nElem;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* mark batch elements from *piCommittedUpTo up to (excluding) iUpTo as
+ * committed. Failed elements keep their state.
+ */
+static inline void
+commitBatchUpTo(batch_t *pBatch, int *piCommittedUpTo, int iUpTo)
+{
+	while(*piCommittedUpTo < iUpTo) {
+		if(pBatch->pElem[*piCommittedUpTo].state != BATCH_STATE_BAD) {
+			pBatch->pElem[*piCommittedUpTo].bPrevWasSuspended = 0; /* we had success! */
+			batchSetElemState(pBatch, *piCommittedUpTo, BATCH_STATE_COMM);
+		}
+		++(*piCommittedUpTo);
+	}
+}
+
+
+/* the same as tryDoAction(), but for modules that provide doActionBatch().
+ * All valid elements of the partial batch are passed to the module in a
+ * single call. The per-element results are evaluated just like the return
+ * code of doAction() is in tryDoAction(). In addition, a message can be
+ * reported as permanently failed, in which case it is flagged as such
+ * without the need to search for it by splitting the batch.
+ * A module may process elements concurrently (omfile's dynafile shards), so
+ * elements after a suspended one may have been processed as well. Only the
+ * suspended ones are retried then. Elements the module reports as committed
+ * (RS_RET_OK) after a suspended one are flagged individually and are not
+ * submitted again.
+ */
+static inline rsRetVal
+tryDoActionBatch(actWrkrInfo_t *pWrkrInfo, batch_t *pBatch, int *pnElem)
+{
+	int i;
+	int j;
+	int iEnd;
+	int nParams;
+	int iCommittedUpTo;
+	int bDeferred;
+	int bSuspended;
+	rsRetVal localRet;
+	DEFiRet;
+
+	assert(pBatch != NULL);
+	assert(pnElem != NULL);
+
+	iCommittedUpTo = pBatch->iDoneUpTo;
+	iEnd = pBatch->iDoneUpTo + *pnElem;
+	if(iEnd > pBatch->nElem)
+		iEnd = pBatch->nElem;
+	DBGPRINTF("tryDoActionBatch %p[%d], pnElem %d, nElem %d\n", pWrkrInfo->pAction, pWrkrInfo->iNbr, *pnElem, pBatch->nElem);
+	if(*(pBatch->pbShutdownImmediate))
+		ABORT_FINALIZE(RS_RET_FORCE_TERM);
+
+	CHKiRet(actionExtendBatchArrays(pWrkrInfo, iEnd - pBatch->iDoneUpTo));
+	nParams = 0;
+	for(i = pBatch->iDoneUpTo ; i < iEnd ; ++i) {
+		if(   batchIsValidElem(pBatch, i)
+		   && pBatch->pElem[i].state != BATCH_STATE_BAD
+		   && pBatch->pElem[i].state != BATCH_STATE_COMM) {
+			pWrkrInfo->pBatchIdx[nParams] = i;
+			pWrkrInfo->pppBatchParams[nParams] = pBatch->pElem[i].staticActParams;
+			pWrkrInfo->pBatchMsgOpts[nParams] = ((msg_t*)pBatch->pElem[i].pUsrp)->msgFlags;
+			pWrkrInfo->pBatchRet[nParams] = RS_RET_SUSPENDED;
+			++nParams;
+			if(pWrkrInfo->statsobj != NULL) {
+				STATSCOUNTER_INC(pWrkrInfo->ctrProcessed, pWrkrInfo->mutCtrProcessed);
+			}
+		}
+	}
+	if(nParams == 0)
+		FINALIZE;
+
+	CHKiRet(actionPrepare(pWrkrInfo, pBatch->pbShutdownImmediate));
+	if(pWrkrInfo->eState != ACT_STATE_ITX) {
+		iRet = getReturnCode(pWrkrInfo);
+		FINALIZE;
+	}
+
+	pWrkrInfo->bHadAutoCommit = 0;
+	localRet = pWrkrInfo->pAction->pMod->mod.om.doActionBatch(pWrkrInfo->pModData, nParams,
+			pWrkrInfo->pppBatchParams, pWrkrInfo->pBatchMsgOpts, pWrkrInfo->pBatchRet);
+	DBGPRINTF("action %p[%d] batch call with %d elements returned %d\n", pWrkrInfo->pAction,
+		  pWrkrInfo->iNbr, nParams, localRet);
+
+	bDeferred = 0;
+	bSuspended = 0;
+	for(j = 0 ; j < nParams ; ++j) {
+		i = pWrkrInfo->pBatchIdx[j];
+		/* Note: we directly modify the batch object state, because we know that
+		 * wo do not overwrite BATCH_STATE_DISC indicators!
+		 */
+		switch(pWrkrInfo->pBatchRet[j]) {
+		case RS_RET_OK:
+			if(bSuspended) {
+				/* we must not commit the suspended elements before it */
+				pBatch->pElem[i].bPrevWasSuspended = 0;
+				batchSetElemState(pBatch, i, BATCH_STATE_COMM);
+			} else {
+				commitBatchUpTo(pBatch, &iCommittedUpTo, i + 1);
+				bDeferred = 0;
+			}
+			break;
+		case RS_RET_PREVIOUS_COMMITTED:
+			if(!bSuspended) {
+				commitBatchUpTo(pBatch, &iCommittedUpTo, i);
+				pWrkrInfo->bHadAutoCommit = 1;
+			}
+			pBatch->pElem[i].state = BATCH_STATE_SUB;
+			bDeferred = 1;
+			break;
+		case RS_RET_DEFER_COMMIT:
+			pBatch->pElem[i].state = BATCH_STATE_SUB;
+			bDeferred = 1;
+			break;
+		case RS_RET_DISCARDMSG:
+			pBatch->pElem[i].state = BATCH_STATE_DISC;
+			if(iCommittedUpTo == i)
+				++iCommittedUpTo;
+			break;
+		case RS_RET_SUSPENDED:
+			/* this message was not processed, it is retried */
+			if(localRet == RS_RET_OK || localRet == RS_RET_DEFER_COMMIT
+			   || localRet == RS_RET_PREVIOUS_COMMITTED)
+				localRet = RS_RET_SUSPENDED;
+			bSuspended = 1;
+			break;
+		default:/* permanent failure of this message, no need to search for it */
+			DBGPRINTF("tryDoActionBatch: message %d failed with %d, flagged as bad\n",
+				  i, pWrkrInfo->pBatchRet[j]);
+			pBatch->pElem[i].state = BATCH_STATE_BAD;
+			actionCountFail(pWrkrInfo);
+			if(iCommittedUpTo == i)
+				++iCommittedUpTo;
+			break;
+		}
+	}
+
+	switch(localRet) {
+		case RS_RET_OK:
+		case RS_RET_DEFER_COMMIT:
+		case RS_RET_PREVIOUS_COMMITTED:
+			pWrkrInfo->iResumeOKinRow = 0; /* we had a successful call! */
+			if(!bDeferred && !pWrkrInfo->bHadAutoCommit)
+				actionCommitted(pWrkrInfo);
+			break;
+		case RS_RET_SUSPENDED:
+			actionRetry(pWrkrInfo);
+			break;
+		case RS_RET_DISABLE_ACTION:
+			actionDisable(pWrkrInfo);
+			break;
+		default:/* let the caller search for the culprit */
+			iRet = localRet;
+			FINALIZE;
+	}
+	iRet = getReturnCode(pWrkrInfo);
+
+finalize_it:
+	if(pBatch->iDoneUpTo != iCommittedUpTo) {
+		pBatch->iDoneUpTo = iCommittedUpTo;
+	}
+	RETiRet;
+}
+
+
 /* submit a batch for actual action processing.
  * The first nElem elements are processed. This function calls itself
  * recursively if it needs to handle errors.
@@ -1123,7 +1524,7 @@ finalize_it:
  * rgerhards, 2009-05-12
  */
 static rsRetVal
-submitBatch(action_t *pAction, batch_t *pBatch, int nElem)
+submitBatch(actWrkrInfo_t *pWrkrInfo, batch_t *pBatch, int nElem)
 {
 	int i;
 	int bDone;
@@ -1136,7 +1537,10 @@ submitBatch(action_t *pAction, batch_t *pBatch, int nElem)
 	wasDoneTo = pBatch->iDoneUpTo;
 	bDone = 0;
 	do {
-		localRet = tryDoAction(pAction, pBatch, &nElem);
+		if(pWrkrInfo->pAction->pMod->mod.om.doActionBatch == NULL)
+			localRet = tryDoAction(pWrkrInfo, pBatch, &nElem);
+		else
+			localRet = tryDoActionBatch(pWrkrInfo, pBatch, &nElem);
 		if(localRet == RS_RET_FORCE_TERM) {
 			ABORT_FINALIZE(RS_RET_FORCE_TERM);
 		}
@@ -1146,7 +1550,7 @@ submitBatch(action_t *pAction, batch_t *pBatch, int nElem)
 			/* try commit transaction, once done, we can simply do so as if
 			 * that return state was returned from tryDoAction().
 			 */
-			localRet = finishBatch(pAction, pBatch);
+			localRet = finishBatch(pWrkrInfo, pBatch);
 		}
 
 		if(   localRet == RS_RET_OK
@@ -1162,7 +1566,7 @@ submitBatch(action_t *pAction, batch_t *pBatch, int nElem)
 				   && pBatch->pElem[i].state != BATCH_STATE_COMM ) {
 					pBatch->pElem[i].state = BATCH_STATE_BAD;
 					pBatch->pElem[i].bPrevWasSuspended = 1;
-					STATSCOUNTER_INC(pAction->ctrFail, pAction->mutCtrFail);
+					actionCountFail(pWrkrInfo);
 				}
 			}
 			bDone = 1;
@@ -1174,8 +1578,8 @@ submitBatch(action_t *pAction, batch_t *pBatch, int nElem)
 				/* retry with half as much. Depth is log_2 batchsize, so recursion is not too deep */
 				DBGPRINTF("submitBatch recursing trying to find and exclude the culprit "
 				          "for iRet %d\n", localRet);
-				submitBatch(pAction, pBatch, nElem / 2);
-				submitBatch(pAction, pBatch, nElem - (nElem / 2));
+				submitBatch(pWrkrInfo, pBatch, nElem / 2);
+				submitBatch(pWrkrInfo, pBatch, nElem - (nElem / 2));
 				bDone = 1;
 			}
 		}
@@ -1251,22 +1655,208 @@ prepareBatch(action_t *pAction, batch_t *pBatch, sbool **activeSave, int *bMustR
  * rgerhards, 2009-05-12
  */
 static inline rsRetVal
-processAction(action_t *pAction, batch_t *pBatch)
+processAction(actWrkrInfo_t *pWrkrInfo, batch_t *pBatch)
 {
 	DEFiRet;
 
 	assert(pBatch != NULL);
-	CHKiRet(submitBatch(pAction, pBatch, pBatch->nElem));
-	iRet = finishBatch(pAction, pBatch);
+	CHKiRet(submitBatch(pWrkrInfo, pBatch, pBatch->nElem));
+	iRet = finishBatch(pWrkrInfo, pBatch);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* destruct a worker instance. The module data of the first one is the
+ * action's pModData, which is freed by the action itself.
+ */
+static void
+actionDestructWrkrInfo(action_t *pThis, actWrkrInfo_t *pWrkrInfo)
+{
+	if(pWrkrInfo->bCommitAbandoned && pWrkrInfo->pModData != NULL)
+		actionDiscardCommit(pWrkrInfo);
+	if(pWrkrInfo->iNbr != 0 && pWrkrInfo->pModData != NULL)
+		pThis->pMod->mod.om.freeWrkrInstance(pWrkrInfo->pModData);
+	if(pWrkrInfo->statsobj != NULL)
+		statsobj.Destruct(&pWrkrInfo->statsobj);
+	pthread_mutex_destroy(&pWrkrInfo->mutExec);
+	free(pWrkrInfo->pppBatchParams);
+	free(pWrkrInfo->pBatchMsgOpts);
+	free(pWrkrInfo->pBatchRet);
+	free(pWrkrInfo->pBatchIdx);
+	free(pWrkrInfo);
+}
+
+
+/* set up the stats counters of a worker instance. We provide these only
+ * if the module supports worker instances, otherwise they would just
+ * duplicate the action counters.
+ */
+static rsRetVal
+actionWrkrInfoAddStats(action_t *pThis, actWrkrInfo_t *pWrkrInfo)
+{
+	uchar pszWName[96];
+	DEFiRet;
+
+	snprintf((char*) pszWName, sizeof(pszWName), "%s worker %d",
+		 (char*) pThis->statsobj->name, pWrkrInfo->iNbr);
+	CHKiRet(statsobj.Construct(&pWrkrInfo->statsobj));
+	CHKiRet(statsobj.SetName(pWrkrInfo->statsobj, pszWName));
+	STATSCOUNTER_INIT(pWrkrInfo->ctrProcessed, pWrkrInfo->mutCtrProcessed);
+	CHKiRet(statsobj.AddCounter(pWrkrInfo->statsobj, UCHAR_CONSTANT("processed"),
+		ctrType_IntCtr, &pWrkrInfo->ctrProcessed));
+	STATSCOUNTER_INIT(pWrkrInfo->ctrFail, pWrkrInfo->mutCtrFail);
+	CHKiRet(statsobj.AddCounter(pWrkrInfo->statsobj, UCHAR_CONSTANT("failed"),
+		ctrType_IntCtr, &pWrkrInfo->ctrFail));
+	CHKiRet(statsobj.ConstructFinalize(pWrkrInfo->statsobj));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* create a new worker instance for an action. The first one uses the
+ * action's pModData and is created together with the action, all others
+ * are created on demand via the module's createWrkrInstance() entry point.
+ * Must be called with mutWrkrInfo locked (or during construction).
+ */
+static rsRetVal
+actionConstructWrkrInfo(action_t *pThis, actWrkrInfo_t **ppWrkrInfo)
+{
+	actWrkrInfo_t *pWrkrInfo;
+	DEFiRet;
+
+	CHKmalloc(pWrkrInfo = calloc(1, sizeof(actWrkrInfo_t)));
+	pWrkrInfo->pAction = pThis;
+	pWrkrInfo->iNbr = pThis->nWrkrInfo;
+	pWrkrInfo->eState = ACT_STATE_RDY;
+	pthread_mutex_init(&pWrkrInfo->mutExec, NULL);
+	if(pWrkrInfo->iNbr == 0) {
+		/* the first instance is initially available to all threads */
+		pWrkrInfo->pModData = pThis->pModData;
+		if(pThis->pMod->mod.om.createWrkrInstance != NULL)
+			pThis->pWrkrInfoFree = pWrkrInfo;
+	} else {
+		CHKiRet(pThis->pMod->mod.om.createWrkrInstance(&pWrkrInfo->pModData, pThis->pModData));
+		if(pThis->statsobj != NULL)
+			CHKiRet(actionWrkrInfoAddStats(pThis, pWrkrInfo));
+		DBGPRINTF("action %p: created worker instance %d\n", pThis, pWrkrInfo->iNbr);
+	}
+	pWrkrInfo->pNext = pThis->pWrkrInfoRoot;
+	pThis->pWrkrInfoRoot = pWrkrInfo;
+	++pThis->nWrkrInfo;
+	*ppWrkrInfo = pWrkrInfo;
 
 finalize_it:
+	if(iRet != RS_RET_OK && pWrkrInfo != NULL)
+		actionDestructWrkrInfo(pThis, pWrkrInfo);
 	RETiRet;
 }
 
 
+/* obtain a worker instance to process a batch with. Modules without
+ * worker instance support always use the first instance (and are thus
+ * serialized by its mutex). All others obtain an instance that is not
+ * in use by another thread, or a new one if all are busy. As there can
+ * never be more instances in use than threads executing the action, their
+ * number is naturally bounded by the number of queue workers. If a new
+ * instance can not be created, we fall back to the first one, so that
+ * processing continues (serialized) instead of failing.
+ * *pbPooled tells if the instance must be returned to the free list.
+ */
+static inline void
+actionGetWrkrInfo(action_t *pThis, actWrkrInfo_t **ppWrkrInfo, sbool *pbPooled)
+{
+	actWrkrInfo_t *pWrkrInfo;
+	rsRetVal localRet;
+
+	*pbPooled = 0;
+	if(pThis->pMod->mod.om.createWrkrInstance != NULL) {
+		pthread_mutex_lock(&pThis->mutWrkrInfo);
+		if(pThis->pWrkrInfoFree != NULL) {
+			*ppWrkrInfo = pThis->pWrkrInfoFree;
+			pThis->pWrkrInfoFree = pThis->pWrkrInfoFree->pNextFree;
+			*pbPooled = 1;
+		} else {
+			localRet = actionConstructWrkrInfo(pThis, ppWrkrInfo);
+			if(localRet == RS_RET_OK) {
+				*pbPooled = 1;
+			} else {
+				DBGPRINTF("action %p: could not create worker instance, error %d - "
+					  "using first instance\n", pThis, localRet);
+			}
+		}
+		pthread_mutex_unlock(&pThis->mutWrkrInfo);
+		if(*pbPooled)
+			return;
+	}
+
+	/* the first instance is the one created last, thus at the end of the list */
+	for(pWrkrInfo = pThis->pWrkrInfoRoot ; pWrkrInfo->pNext != NULL ; pWrkrInfo = pWrkrInfo->pNext)
+		/* just search */;
+	*ppWrkrInfo = pWrkrInfo;
+}
+
+
+/* return a worker instance obtained by actionGetWrkrInfo() */
+static inline void
+actionReleaseWrkrInfo(action_t *pThis, actWrkrInfo_t *pWrkrInfo, sbool bPooled)
+{
+	if(!bPooled)
+		return;
+
+	pthread_mutex_lock(&pThis->mutWrkrInfo);
+	pWrkrInfo->pNextFree = pThis->pWrkrInfoFree;
+	pThis->pWrkrInfoFree = pWrkrInfo;
+	pthread_mutex_unlock(&pThis->mutWrkrInfo);
+}
+
+
 #pragma GCC diagnostic ignored "-Wempty-body"
+/* complete the pending commit of the previous batch pPending and return
+ * the worker instance that did it to the free list.
+ */
+static void
+actionFinishPendingCommit(action_t *pAction, batch_t *pPending)
+{
+	actWrkrInfo_t *pWrkrInfo = (actWrkrInfo_t*) pPending->pCommitPending;
+
+	d_pthread_mutex_lock(&pWrkrInfo->mutExec);
+	pthread_cleanup_push(mutexCancelCleanup, &pWrkrInfo->mutExec);
+	if(pWrkrInfo->bCommitPending)
+		actionCompleteCommit(pWrkrInfo, pPending);
+	pthread_cleanup_pop(1); /* unlock mutex */
+	actionReleaseWrkrInfo(pAction, pWrkrInfo, pWrkrInfo->bPooled);
+}
+
+
+/* called by the queue if it deletes a batch whose commit is still pending,
+ * e.g. because its worker terminates. We can not wait for the outcome here
+ * (we may be called from a cancel cleanup handler), so we just note that
+ * the commit must be waited for before the instance is used again and
+ * return it to the free list.
+ */
+static void
+actionAbandonCommit(void *pCommitPending)
+{
+	actWrkrInfo_t *pWrkrInfo = (actWrkrInfo_t*) pCommitPending;
+
+	d_pthread_mutex_lock(&pWrkrInfo->mutExec);
+	pWrkrInfo->pPendingBatch = NULL;
+	pWrkrInfo->bCommitPending = 0;
+	pWrkrInfo->bCommitAbandoned = 1;
+	d_pthread_mutex_unlock(&pWrkrInfo->mutExec);
+	DBGPRINTF("action %p[%d]: pending commit abandoned by queue\n", pWrkrInfo->pAction,
+		  pWrkrInfo->iNbr);
+	actionReleaseWrkrInfo(pWrkrInfo->pAction, pWrkrInfo, pWrkrInfo->bPooled);
+}
+
+
 /* receive an array of to-process user pointers and submit them
- * for processing.
+ * for processing. If the queue permits, the commit of the batch may
+ * be left pending. In that case, it is completed during the next call,
+ * after that batch has been prepared (so commit and preparation overlap).
  * rgerhards, 2009-04-22
  */
 static rsRetVal
@@ -1275,6 +1865,9 @@ processBatchMain(action_t *pAction, batch_t *pBatch, int *pbShutdownImmediate)
 	int *pbShutdownImmdtSave;
 	sbool *activeSave;
 	int bMustRestoreActivePtr = 0;
+	actWrkrInfo_t *pWrkrInfo;
+	sbool bPooled;
+	sbool bCommitPending;
 	rsRetVal localRet;
 	DEFiRet;
 
@@ -1282,19 +1875,34 @@ processBatchMain(action_t *pAction, batch_t *pBatch, int *pbShutdownImmediate)
 
 	pbShutdownImmdtSave = pBatch->pbShutdownImmediate;
 	pBatch->pbShutdownImmediate = pbShutdownImmediate;
-	CHKiRet(prepareBatch(pAction, pBatch, &activeSave, &bMustRestoreActivePtr));
+	iRet = prepareBatch(pAction, pBatch, &activeSave, &bMustRestoreActivePtr);
+
+	/* we need the outcome of the previous commit before we can go on */
+	if(pBatch->pPending != NULL && pBatch->pPending->pCommitPending != NULL)
+		actionFinishPendingCommit(pAction, pBatch->pPending);
+	if(iRet != RS_RET_OK || batchNumMsgs(pBatch) == 0)
+		FINALIZE;
 
 	/* We now must guard the output module against execution by multiple threads. The
-	 * plugin interface specifies that output modules must not be thread-safe (except
-	 * if they notify us they are - functionality not yet implemented...).
+	 * plugin interface specifies that output modules must not be thread-safe, except
+	 * if they provide worker instances. In that case, each thread works on an instance
+	 * of its own and the mutex is only contended during HUP processing.
 	 * rgerhards, 2008-01-30
 	 */
-	d_pthread_mutex_lock(&pAction->mutActExec);
-	pthread_cleanup_push(mutexCancelCleanup, &pAction->mutActExec);
+	actionGetWrkrInfo(pAction, &pWrkrInfo, &bPooled);
+	d_pthread_mutex_lock(&pWrkrInfo->mutExec);
+	pthread_cleanup_push(mutexCancelCleanup, &pWrkrInfo->mutExec);
 
-	iRet = processAction(pAction, pBatch);
+	pWrkrInfo->bPooled = bPooled;
+	iRet = processAction(pWrkrInfo, pBatch);
+	/* from now on, the queue owns the batch and may move it */
+	pWrkrInfo->pPendingBatch = NULL;
+	bCommitPending = pWrkrInfo->bCommitPending;
 
 	pthread_cleanup_pop(1); /* unlock mutex */
+	/* an instance with a pending commit is released when the commit is complete */
+	if(!bCommitPending)
+		actionReleaseWrkrInfo(pAction, pWrkrInfo, bPooled);
 
 	/* even if processAction failed, we need to release the batch (else we
 	 * have a memory leak). So we do this first, and then check if we need to
@@ -1305,13 +1913,12 @@ processBatchMain(action_t *pAction, batch_t *pBatch, int *pbShutdownImmediate)
 
 	if(iRet == RS_RET_OK)
 		iRet = localRet;
-	
+
+finalize_it:
 	if(bMustRestoreActivePtr) {
 		free(pBatch->active);
 		pBatch->active = activeSave;
 	}
-
-finalize_it:
 	pBatch->pbShutdownImmediate = pbShutdownImmdtSave;
 	RETiRet;
 }
@@ -1320,13 +1927,15 @@ finalize_it:
 
 /* call the HUP handler for a given action, if such a handler is defined. The
  * action mutex is locked, because the HUP handler most probably needs to modify
- * some internal state information.
+ * some internal state information. With multiple worker instances, the handler
+ * is called for each of them.
  * rgerhards, 2008-10-22
  */
 #pragma GCC diagnostic ignored "-Wempty-body"
 rsRetVal
 actionCallHUPHdlr(action_t *pAction)
 {
+	actWrkrInfo_t *pWrkrInfo;
 	DEFiRet;
 
 	ASSERT(pAction != NULL);
@@ -1336,10 +1945,18 @@ actionCallHUPHdlr(action_t *pAction)
 		FINALIZE;	/* no HUP handler, so we are done ;) */
 	}
 
-	d_pthread_mutex_lock(&pAction->mutActExec);
-	pthread_cleanup_push(mutexCancelCleanup, &pAction->mutActExec);
-	CHKiRet(pAction->pMod->doHUP(pAction->pModData));
-	pthread_cleanup_pop(1); /* unlock mutex */
+	/* the list only grows at its root, so we can walk it from the current root */
+	pthread_mutex_lock(&pAction->mutWrkrInfo);
+	pWrkrInfo = pAction->pWrkrInfoRoot;
+	pthread_mutex_unlock(&pAction->mutWrkrInfo);
+	for( ; pWrkrInfo != NULL ; pWrkrInfo = pWrkrInfo->pNext) {
+		d_pthread_mutex_lock(&pWrkrInfo->mutExec);
+		pthread_cleanup_push(mutexCancelCleanup, &pWrkrInfo->mutExec);
+		iRet = pAction->pMod->doHUP(pWrkrInfo->pModData);
+		pthread_cleanup_pop(1); /* unlock mutex */
+		if(iRet != RS_RET_OK)
+			FINALIZE;
+	}
 
 finalize_it:
 	RETiRet;
@@ -1404,6 +2021,41 @@ finalize_it:
 }
 
 
+/* create the "message repeated n times" message for pMsgOrig. The
+ * original message object must not be modified, because it is also
+ * used by other actions, so we work on a copy. Returns NULL on failure.
+ */
+static msg_t *
+actionBuildRepeatMsg(msg_t *pMsgOrig, int nRepeats, sbool bHasMsg)
+{
+	msg_t *pMsg;
+	size_t lenRepMsg;
+	uchar szRepMsg[1024];
+
+	if((pMsg = MsgDup(pMsgOrig)) == NULL) {
+		/* it failed - nothing we can do against it... */
+		DBGPRINTF("Message duplication failed, dropping repeat message.\n");
+		return NULL;
+	}
+
+	if(bHasMsg == 0) { /* old format repeat message? */
+		lenRepMsg = snprintf((char*)szRepMsg, sizeof(szRepMsg), " last message repeated %d times",
+		    nRepeats);
+	} else {
+		lenRepMsg = snprintf((char*)szRepMsg, sizeof(szRepMsg), " message repeated %d times: [%.800s]",
+		    nRepeats, getMSG(pMsgOrig));
+	}
+
+	/* We now need to update the other message properties. Please note that digital
+	 * signatures inside the message are also invalidated.
+	 */
+	datetime.getCurrTime(&(pMsg->tRcvdAt), &(pMsg->ttGenTime));
+	memcpy(&pMsg->tTIMESTAMP, &pMsg->tRcvdAt, sizeof(struct syslogTime));
+	MsgReplaceMSG(pMsg, szRepMsg, lenRepMsg);
+	return pMsg;
+}
+
+
 /* This function builds up a batch of messages to be (later)
  * submitted to the action queue.
  * Important: this function MUST not be called with messages that are to
@@ -1456,29 +2108,11 @@ actionWriteToAction(action_t *pAction)
 	 */
 	if(pAction->f_prevcount > 1) {
 		msg_t *pMsg;
-		size_t lenRepMsg;
-		uchar szRepMsg[1024];
 
-		if((pMsg = MsgDup(pAction->f_pMsg)) == NULL) {
-			/* it failed - nothing we can do against it... */
-			DBGPRINTF("Message duplication failed, dropping repeat message.\n");
+		if((pMsg = actionBuildRepeatMsg(pAction->f_pMsg, pAction->f_prevcount,
+						pAction->bRepMsgHasMsg)) == NULL) {
 			ABORT_FINALIZE(RS_RET_ERR);
 		}
-
-		if(pAction->bRepMsgHasMsg == 0) { /* old format repeat message? */
-			lenRepMsg = snprintf((char*)szRepMsg, sizeof(szRepMsg), " last message repeated %d times",
-			    pAction->f_prevcount);
-		} else {
-			lenRepMsg = snprintf((char*)szRepMsg, sizeof(szRepMsg), " message repeated %d times: [%.800s]",
-			    pAction->f_prevcount, getMSG(pAction->f_pMsg));
-		}
-
-		/* We now need to update the other message properties. Please note that digital
-		 * signatures inside the message are also invalidated.
-		 */
-		datetime.getCurrTime(&(pMsg->tRcvdAt), &(pMsg->ttGenTime));
-		memcpy(&pMsg->tTIMESTAMP, &pMsg->tRcvdAt, sizeof(struct syslogTime));
-		MsgReplaceMSG(pMsg, szRepMsg, lenRepMsg);
 		pMsgSave = pAction->f_pMsg;	/* save message pointer for later restoration */
 		pAction->f_pMsg = pMsg;	/* use the new msg (pointer will be restored below) */
 	}
@@ -1532,6 +2166,71 @@ finalize_it:
 }
 
 
+/* emit the summary for messages suppressed by the windowed dedup. The
+ * summary always contains the message text, as it may not refer to the
+ * last message written. Called with mutAction locked.
+ */
+static rsRetVal
+actionDedupEmit(void *pUsr, msg_t *pMsgOrig, int nRepeats)
+{
+	action_t *pAction = (action_t*) pUsr;
+	msg_t *pMsg;
+	DEFiRet;
+
+	DBGPRINTF("action %p: dedup summary, message repeated %d times\n", pAction, nRepeats);
+	if((pMsg = actionBuildRepeatMsg(pMsgOrig, nRepeats, 1)) == NULL)
+		ABORT_FINALIZE(RS_RET_ERR);
+	iRet = doSubmitToActionQ(pAction, pMsg);
+	msgDestruct(&pMsg);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* check if a message was already written within the dedup window. The
+ * key is either built via the configured template or consists of the same
+ * properties the classic repeated message reduction compares.
+ * Returns 1 if the message is to be suppressed.
+ */
+static inline int
+actionDedupCheck(action_t *pAction, msg_t *pMsg)
+{
+	uint64 fp;
+	char *psz;
+
+	if(pAction->pDedupTpl != NULL) {
+		if(tplToString(pAction->pDedupTpl, pMsg, &pAction->pDedupBuf,
+			       &pAction->lenDedupBuf) != RS_RET_OK)
+			return 0; /* better write too much than too little */
+		fp = dedupHash(DEDUP_HASH_INIT, pAction->pDedupBuf, ustrlen(pAction->pDedupBuf));
+	} else {
+		/* we include the terminating \0 as field separator */
+		psz = getHOSTNAME(pMsg);
+		fp = dedupHash(DEDUP_HASH_INIT, (uchar*) psz, strlen(psz) + 1);
+		psz = getAPPNAME(pMsg, LOCK_MUTEX);
+		fp = dedupHash(fp, (uchar*) psz, strlen(psz) + 1);
+		psz = getPROCID(pMsg, LOCK_MUTEX);
+		fp = dedupHash(fp, (uchar*) psz, strlen(psz) + 1);
+		fp = dedupHash(fp, getMSG(pMsg), getMSGLen(pMsg));
+	}
+
+	return dedupCheck(pAction->pDedup, fp, pMsg, getActNow(pAction), actionDedupEmit, pAction);
+}
+
+
+/* emit the summaries of all dedup entries whose window has expired. This
+ * is called periodically (together with the flush of repeated messages),
+ * with mutAction locked.
+ */
+void
+actionDedupFlush(action_t *pAction)
+{
+	if(pAction->pDedup != NULL)
+		dedupFlush(pAction->pDedup, datetime.GetTime(NULL), actionDedupEmit, pAction);
+}
+
+
 /* helper to actonCallAction, mostly needed because of this damn
  * pthread_cleanup_push() POSIX macro...
  */
@@ -1550,6 +2249,19 @@ doActionCallAction(action_t *pAction, batch_t *pBatch, int idxBtch)
 		ABORT_FINALIZE(RS_RET_OK);
 	}
 
+	/* windowed duplicate suppression, if configured (replaces the classic one) */
+	if(pAction->pDedup != NULL) {
+		if((pMsg->msgFlags & MARK) == 0 && actionDedupCheck(pAction, pMsg)) {
+			STATSCOUNTER_INC(pAction->ctrDedup, pAction->mutCtrDedup);
+			FINALIZE;
+		}
+		if(pAction->f_pMsg != NULL)
+			msgDestruct(&pAction->f_pMsg);
+		pAction->f_pMsg = MsgAddRef(pMsg);
+		iRet = actionWriteToAction(pAction);
+		FINALIZE;
+	}
+
 	/* suppress duplicate messages */
 	if ((pAction->f_ReduceRepeated == 1) && pAction->f_pMsg != NULL &&
 	    (pMsg->msgFlags & MARK) == 0 && getMSGLen(pMsg) == getMSGLen(pAction->f_pMsg) &&
@@ -1614,7 +2326,7 @@ DEFFUNC_llExecFunc(doActivateActions)
 			errmsg.LogError(0, localRet, "file prefix (work directory?) "
 					"is missing");
 		}
-		actionDisable(pThis);
+		actionDisable(pThis->pWrkrInfoRoot); /* only the first instance exists yet */
 	}
 	DBGPRINTF("Action %s[%p]: queue %p started\n", modGetName(pThis->pMod),
 		  pThis, pThis->pQueue);
@@ -1863,6 +2575,12 @@ actionApplyCnfParam(action_t *pAction, struct cnfparamvals *pvals)
 			pAction->bExecWhenPrevSusp = pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "action.repeatedmsgcontainsoriginalmsg")) {
 			pAction->bRepMsgHasMsg = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "action.dedupwindow")) {
+			pAction->iDedupWindow = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "action.dedupmaxentries")) {
+			pAction->iDedupMaxEntries = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "action.dedupkeytemplate")) {
+			pAction->pszDedupTpl = (uchar*) es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(pblk.descr[i].name, "action.resumeretrycount")) {
 			pAction->iResumeRetryCount = pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "action.resumeinterval")) {
@@ -1877,6 +2595,37 @@ actionApplyCnfParam(action_t *pAction, struct cnfparamvals *pvals)
 
 
 
+/* set up windowed duplicate suppression, if configured. It replaces the
+ * classic repeated message reduction for this action.
+ */
+static rsRetVal
+actionSetupDedup(action_t *pAction)
+{
+	DEFiRet;
+
+	if(pAction->iDedupWindow <= 0)
+		FINALIZE;
+
+	if(pAction->pszDedupTpl != NULL) {
+		pAction->pDedupTpl = tplFind(loadConf, (char*) pAction->pszDedupTpl,
+					     ustrlen(pAction->pszDedupTpl));
+		if(pAction->pDedupTpl == NULL) {
+			errmsg.LogError(0, RS_RET_NOT_FOUND, "dedup key template '%s' not found",
+					pAction->pszDedupTpl);
+			ABORT_FINALIZE(RS_RET_NOT_FOUND);
+		}
+	}
+	CHKiRet(dedupConstruct(&pAction->pDedup, pAction->iDedupMaxEntries, pAction->iDedupWindow));
+	pAction->f_ReduceRepeated = 0;
+	++loadConf->actions.nbrDedup;
+	DBGPRINTF("action %p: dedup window %d sec, max %d entries\n", pAction,
+		  pAction->iDedupWindow, pAction->iDedupMaxEntries);
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* add an Action to the current selector
  * The pOMSR is freed, as it is not needed after this function.
  * Note: this function pulls global data that specifies action config state.
@@ -1892,6 +2641,7 @@ addAction(action_t **ppAction, modInfo_t *pMod, void *pModData,
 	int iTplOpts;
 	uchar *pTplName;
 	action_t *pAction;
+	actWrkrInfo_t *pWrkrInfo;
 	char errMsg[512];
 
 	assert(ppAction != NULL);
@@ -1902,6 +2652,7 @@ addAction(action_t **ppAction, modInfo_t *pMod, void *pModData,
 	CHKiRet(actionConstruct(&pAction)); /* create action object first */
 	pAction->pMod = pMod;
 	pAction->pModData = pModData;
+	CHKiRet(actionConstructWrkrInfo(pAction, &pWrkrInfo));
 	if(actParams == NULL) { /* use legacy systemn */
 		pAction->pszName = cs.pszActionName;
 		pAction->iResumeInterval = cs.glbliActionResumeInterval;
@@ -1912,9 +2663,17 @@ addAction(action_t **ppAction, modInfo_t *pMod, void *pModData,
 		pAction->iExecEveryNthOccur = cs.iActExecEveryNthOccur;
 		pAction->iExecEveryNthOccurTO = cs.iActExecEveryNthOccurTO;
 		pAction->bRepMsgHasMsg = cs.bActionRepMsgHasMsg;
+		pAction->iDedupWindow = cs.iActDedupWindow;
+		pAction->iDedupMaxEntries = cs.iActDedupMaxEntries;
+		if(cs.pszActDedupTpl != NULL)
+			CHKmalloc(pAction->pszDedupTpl = ustrdup(cs.pszActDedupTpl));
 		cs.iActExecEveryNthOccur = 0; /* auto-reset */
 		cs.iActExecEveryNthOccurTO = 0; /* auto-reset */
 		cs.bActionWriteAllMarkMsgs = RSFALSE; /* auto-reset */
+		cs.iActDedupWindow = 0; /* auto-reset */
+		cs.iActDedupMaxEntries = DEDUP_DFLT_MAX_ENTRIES; /* auto-reset */
+		free(cs.pszActDedupTpl); /* auto-reset */
+		cs.pszActDedupTpl = NULL;
 		cs.pszActionName = NULL;	/* free again! */
 	} else {
 		actionApplyCnfParam(pAction, actParams);
@@ -1963,7 +2722,13 @@ addAction(action_t **ppAction, modInfo_t *pMod, void *pModData,
 			pAction->eParamPassing = ACT_MSG_PASSING;
 		} else if(iTplOpts & OMSR_TPL_AS_JSON) {
 			pAction->eParamPassing = ACT_JSON_PASSING;
-		} else {
+		} else if(iTplOpts & OMSR_TPL_AS_JSONSTR) {
+			pAction->eParamPassing = ACT_JSONSTR_PASSING;
+		} else if(iTplOpts & OMSR_TPL_AS_IOVEC) {
+			/* string entries of this action are still passed as strings */
+			pAction->eParamPassing = ACT_IOVEC_PASSING;
+			pAction->bTplIov[i] = 1;
+		} else if(pAction->eParamPassing != ACT_IOVEC_PASSING) {
 			pAction->eParamPassing = ACT_STRING_PASSING;
 		}
 
@@ -1975,6 +2740,7 @@ addAction(action_t **ppAction, modInfo_t *pMod, void *pModData,
 	/* now check if the module is compatible with select features */
 	if(pMod->isCompatibleWithFeature(sFEATURERepeatedMsgReduction) == RS_RET_OK) {
 		pAction->f_ReduceRepeated = loadConf->globals.bReduceRepeatMsgs;
+		CHKiRet(actionSetupDedup(pAction));
 	} else {
 		DBGPRINTF("module is incompatible with RepeatedMsgReduction - turned off\n");
 		pAction->f_ReduceRepeated = 0;
@@ -1982,7 +2748,7 @@ addAction(action_t **ppAction, modInfo_t *pMod, void *pModData,
 	pAction->eState = ACT_STATE_RDY; /* action is enabled */
 
 	if(bSuspended)
-		actionSuspend(pAction, datetime.GetTime(NULL)); /* "good" time call, only during init and unavoidable */
+		actionSuspend(pWrkrInfo, datetime.GetTime(NULL)); /* "good" time call, only during init and unavoidable */
 
 	CHKiRet(actionConstructFinalize(pAction, queueParams));
 	
@@ -2031,6 +2797,10 @@ initConfigVariables(void)
 	cs.glbliActionResumeInterval = 30;
 	cs.glbliActionResumeRetryCount = 0;
 	cs.bActionRepMsgHasMsg = 0;
+	cs.iActDedupWindow = 0;
+	cs.iActDedupMaxEntries = DEDUP_DFLT_MAX_ENTRIES;
+	free(cs.pszActDedupTpl);
+	cs.pszActDedupTpl = NULL;
 	if(cs.pszActionName != NULL) {
 		free(cs.pszActionName);
 		cs.pszActionName = NULL;
@@ -2079,7 +2849,8 @@ actionNewInst(struct nvlst *lst, action_t **ppAction)
 	if((iRet = addAction(&pAction, pMod, pModData, pOMSR, paramvals, queueParams,
 	                    (iRet == RS_RET_SUSPENDED)? 1 : 0)) == RS_RET_OK) {
 		/* now check if the module is compatible with select features */
-		if(pMod->isCompatibleWithFeature(sFEATURERepeatedMsgReduction) == RS_RET_OK)
+		if(   pMod->isCompatibleWithFeature(sFEATURERepeatedMsgReduction) == RS_RET_OK
+		   && pAction->pDedup == NULL)
 			pAction->f_ReduceRepeated = loadConf->globals.bReduceRepeatMsgs;
 		else {
 			DBGPRINTF("module is incompatible with RepeatedMsgReduction - turned off\n");
@@ -2137,6 +2908,9 @@ rsRetVal actionClassInit(void)
 	CHKiRet(regCfSysLineHdlr((uchar *)"actionexeconlyeverynthtimetimeout", 0, eCmdHdlrInt, NULL, &cs.iActExecEveryNthOccurTO, NULL));
 	CHKiRet(regCfSysLineHdlr((uchar *)"actionexeconlyonceeveryinterval", 0, eCmdHdlrInt, NULL, &cs.iActExecOnceInterval, NULL));
 	CHKiRet(regCfSysLineHdlr((uchar *)"repeatedmsgcontainsoriginalmsg", 0, eCmdHdlrBinary, NULL, &cs.bActionRepMsgHasMsg, NULL));
+	CHKiRet(regCfSysLineHdlr((uchar *)"actiondedupwindow", 0, eCmdHdlrInt, NULL, &cs.iActDedupWindow, NULL));
+	CHKiRet(regCfSysLineHdlr((uchar *)"actiondedupmaxentries", 0, eCmdHdlrInt, NULL, &cs.iActDedupMaxEntries, NULL));
+	CHKiRet(regCfSysLineHdlr((uchar *)"actiondedupkeytemplate", 0, eCmdHdlrGetWord, NULL, &cs.pszActDedupTpl, NULL));
 	CHKiRet(regCfSysLineHdlr((uchar *)"actionexeconlywhenpreviousissuspended", 0, eCmdHdlrBinary, NULL, &cs.bActExecWhenPrevSusp, NULL));
 	CHKiRet(regCfSysLineHdlr((uchar *)"actionresumeretrycount", 0, eCmdHdlrInt, NULL, &cs.glbliActionResumeRetryCount, NULL));
 	CHKiRet(regCfSysLineHdlr((uchar *)"resetconfigvariables", 1, eCmdHdlrCustomHandler, resetConfigVariables, NULL, NULL));
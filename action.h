@@ -27,6 +27,7 @@
 
 #include "syslogd-types.h"
 #include "queue.h"
+#include "dedup.h"
 
 /* external data - this is to be removed when we change the action
  * object interface (will happen some time..., at latest when the
@@ -44,9 +45,46 @@ typedef enum {
 	ACT_STATE_SUSP = 5	/* suspended due to failure (return fail until timeout expired) */
 } action_state_t;
 
+typedef struct action_s action_t;
+
+/* execution state of an action. There is one of these for each instance
+ * of the output module that is able to process messages. Modules which
+ * provide createWrkrInstance() get an instance for each action queue
+ * worker that is concurrently active, all others just have the one that
+ * uses the action's pModData (and thus are still serialized).
+ */
+typedef struct actWrkrInfo_s actWrkrInfo_t;
+struct actWrkrInfo_s {
+	action_t *pAction;	/* action we belong to */
+	void	*pModData;	/* module data used by this instance */
+	actWrkrInfo_t *pNext;	/* next instance of this action */
+	actWrkrInfo_t *pNextFree;/* next instance not currently in use */
+	int	iNbr;		/* instance number (0 is the action's pModData) */
+	pthread_mutex_t mutExec; /* guards actual execution of the module entry points */
+	action_state_t eState;	/* current state of this instance */
+	sbool	bHadAutoCommit;	/* did an auto-commit happen during doAction()? */
+	time_t	ttResumeRtry;	/* when is it time to retry the resume? */
+	int	iResumeOKinRow;	/* number of times in a row that resume said OK with an immediate failure following */
+	int	iNbrResRtry;	/* number of retries since last suspend */
+	batch_t *pPendingBatch;	/* batch whose commit is still in progress, NULL if none. Only valid
+				 * while the consumer processes that batch, the queue moves it later */
+	sbool	bCommitPending;	/* commit in progress, instance is released when it is complete */
+	sbool	bCommitAbandoned; /* queue dropped the batch of the pending commit */
+	sbool	bPooled;	/* must the instance be returned to the free list? */
+	/* work arrays for modules with doActionBatch() */
+	void ***pppBatchParams;	/* parameters of each element passed */
+	unsigned *pBatchMsgOpts;/* msg flags of each element passed */
+	rsRetVal *pBatchRet;	/* result for each element passed */
+	int *pBatchIdx;		/* batch index of each element passed */
+	int maxBatchElem;	/* size of the arrays above */
+	/* for statistics subsystem (only if there are multiple instances) */
+	statsobj_t *statsobj;
+	STATSCOUNTER_DEF(ctrProcessed, mutCtrProcessed);
+	STATSCOUNTER_DEF(ctrFail, mutCtrFail);
+};
+
 /* the following struct defines the action object data structure
  */
-typedef struct action_s action_t;
 struct action_s {
 	time_t	f_time;		/* used for "message repeated n times" - be careful, old, old code */
 	time_t	tActNow;	/* the current time for an action execution. Initially set to -1 and
@@ -55,13 +93,9 @@ struct action_s {
 	sbool	bExecWhenPrevSusp;/* execute only when previous action is suspended? */
 	sbool	bWriteAllMarkMsgs;/* should all mark msgs be written (not matter how recent the action was executed)? */
 	int	iSecsExecOnceInterval; /* if non-zero, minimum seconds to wait until action is executed again */
-	action_state_t eState;	/* current state of action */
-	sbool	bHadAutoCommit;	/* did an auto-commit happen during doAction()? */
-	time_t	ttResumeRtry;	/* when is it time to retry the resume? */
-	int	iResumeOKinRow;	/* number of times in a row that resume said OK with an immediate failure following */
+	action_state_t eState;	/* RDY or DIED, execution state is kept in actWrkrInfo_t */
 	int	iResumeInterval;/* resume interval for this action */
 	int	iResumeRetryCount;/* how often shall we retry a suspended action? (-1 --> eternal) */
-	int	iNbrResRtry;	/* number of retries since last suspend */
 	int	iNbrNoExec;	/* number of matches that did not yet yield to an exec */
 	int	iExecEveryNthOccur;/* execute this action only every n-th occurence (with n=0,1 -> always) */
 	int  	iExecEveryNthOccurTO;/* timeout for n-th occurence feature */
@@ -72,11 +106,20 @@ struct action_s {
 	short	f_ReduceRepeated;/* reduce repeated lines 0 - no, 1 - yes */
 	int	f_prevcount;	/* repetition cnt of prevline */
 	int	f_repeatcount;	/* number of "repeated" msgs */
+	int	iDedupWindow;	/* windowed duplicate suppression: window in seconds, 0 = off */
+	int	iDedupMaxEntries;/* max number of fingerprints kept */
+	uchar	*pszDedupTpl;	/* name of template for the dedup key, NULL = default key */
+	struct template *pDedupTpl; /* ... and the template itself */
+	dedup_t	*pDedup;	/* recently written messages, NULL if not used */
+	uchar	*pDedupBuf;	/* buffer to render the dedup key */
+	size_t	lenDedupBuf;
 	rsRetVal (*submitToActQ)(action_t *, batch_t *);/* function submit message to action queue */
 	rsRetVal (*qConstruct)(struct queue_s *pThis);
 	enum 	{ ACT_STRING_PASSING = 0, ACT_ARRAY_PASSING = 1, ACT_MSG_PASSING = 2,
-		  ACT_JSON_PASSING = 3}
+		  ACT_JSON_PASSING = 3, ACT_JSONSTR_PASSING = 4, ACT_IOVEC_PASSING = 5}
 		eParamPassing;	/* mode of parameter passing to action */
+	sbool	bTplIov[CONF_OMOD_NUMSTRINGS_MAXSIZE];
+				/* ACT_IOVEC_PASSING: template is passed as tplIov_t, else as string */
 	int	iNumTpls;	/* number of array entries for template element below */
 	struct template **ppTpl;/* array of template to use - strings must be passed to doAction
 				 * in this order. */
@@ -86,13 +129,18 @@ struct action_s {
 				 */
 	qqueue_t *pQueue;	/* action queue */
 	pthread_mutex_t mutAction; /* primary action mutex */
-	pthread_mutex_t mutActExec; /* mutex to guard actual execution of doAction for single-threaded modules */
+	pthread_mutex_t mutWrkrInfo; /* guards the worker instance lists below */
+	actWrkrInfo_t *pWrkrInfoRoot; /* all worker instances, the first one uses pModData */
+	actWrkrInfo_t *pWrkrInfoFree; /* worker instances not currently in use */
+	int	nWrkrInfo;	/* number of worker instances created */
 	uchar *pszName;		/* action name (for documentation) */
 	DEF_ATOMIC_HELPER_MUT(mutCAS);
 	/* for statistics subsystem */
 	statsobj_t *statsobj;
 	STATSCOUNTER_DEF(ctrProcessed, mutCtrProcessed);
 	STATSCOUNTER_DEF(ctrFail, mutCtrFail);
+	STATSCOUNTER_DEF(ctrRenderShared, mutCtrRenderShared);
+	STATSCOUNTER_DEF(ctrDedup, mutCtrDedup);
 };
 
 
@@ -106,6 +154,7 @@ rsRetVal actionSetGlobalResumeInterval(int iNewVal);
 rsRetVal actionDoAction(action_t *pAction);
 rsRetVal actionWriteToAction(action_t *pAction);
 rsRetVal actionCallHUPHdlr(action_t *pAction);
+void actionDedupFlush(action_t *pAction);
 rsRetVal actionClassInit(void);
 rsRetVal addAction(action_t **ppAction, modInfo_t *pMod, void *pModData, omodStringRequest_t *pOMSR, struct cnfparamvals *actParams, struct cnfparamvals *queueParams, int bSuspended);
 rsRetVal activateActions(void);
@@ -46,6 +46,8 @@
 #include "obj.h"
 #include "modules.h"
 #include "ruleset.h"
+#include "acmatch.h"
+#include "hashtable.h"
 
 DEFobjCurrIf(obj)
 DEFobjCurrIf(regexp)
@@ -54,6 +56,13 @@ void cnfexprOptimize(struct cnfexpr *expr);
 static void cnfstmtOptimizePRIFilt(struct cnfstmt *stmt);
 static void cnfarrayPrint(struct cnfarray *ar, int indent);
 
+/* minimum number of sibling PROPFILTs for which grouping is done */
+#define PROPGRP_MIN_MEMBERS 2
+/* minimum number of equality compares for which a hash dispatch is done */
+#define SWITCH_MIN_CASES 3
+/* minimum array size for which "==" uses a hash table lookup */
+#define ARRAY_HASH_MIN_MEMB 8
+
 char*
 getFIOPName(unsigned iFIOP)
 {
@@ -1088,7 +1097,7 @@ doFuncCall(struct cnffunc *func, struct var *ret, void* usrptr)
 	case CNFFUNC_RE_MATCH:
 		cnfexprEval(func->expr[0], &r[0], usrptr);
 		str = (char*) var2CString(&r[0], &bMustFree);
-		retval = regexp.regexec(func->funcdata, str, 0, NULL, 0);
+		retval = regexp.exec(func->funcdata, str, 0, NULL, 0);
 		if(retval == 0)
 			ret->d.n = 1;
 		else {
@@ -1168,6 +1177,78 @@ evalVar(struct cnfvar *var, void *usrptr, struct var *ret)
 
 }
 
+/* hash table helpers for string lookups (arrays and SWITCH). Keys are
+ * es_str_t objects, values are case numbers (int). Note that the hash table
+ * frees keys via free(), which is fine for es_str_t.
+ */
+static unsigned int
+hashEStr(void *k)
+{
+	es_str_t *estr = (es_str_t*) k;
+	unsigned char *p = es_getBufAddr(estr);
+	unsigned int hash = 5381;
+	es_size_t i;
+
+	for(i = 0 ; i < es_strlen(estr) ; ++i)
+		hash = ((hash << 5) + hash) + p[i]; /* hash * 33 + c */
+	return hash;
+}
+
+static int
+keyEqualsEStr(void *key1, void *key2)
+{
+	return !es_strcmp((es_str_t*) key1, (es_str_t*) key2);
+}
+
+/* add a key to an estr hash table if it is not yet present (so the first
+ * one added wins).
+ */
+static rsRetVal
+estrHashAdd(struct hashtable *ht, es_str_t *key, int val)
+{
+	es_str_t *k = NULL;
+	int *v = NULL;
+	DEFiRet;
+
+	if(hashtable_search(ht, key) != NULL)
+		FINALIZE;
+	CHKmalloc(k = es_strdup(key));
+	CHKmalloc(v = malloc(sizeof(int)));
+	*v = val;
+	if(!hashtable_insert(ht, k, v))
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+	k = NULL;
+	v = NULL;
+finalize_it:
+	if(k != NULL)
+		es_deleteStr(k);
+	free(v);
+	RETiRet;
+}
+
+/* build a hash table for a larger constant array, so that "==" can be
+ * evaluated with a single lookup. If that fails, we simply keep
+ * the linear search.
+ */
+static void
+cnfarrayBuildHash(struct cnfarray *ar)
+{
+	int i;
+
+	if(ar->ht != NULL || ar->nmemb < ARRAY_HASH_MIN_MEMB)
+		return;
+	if((ar->ht = create_hashtable(ar->nmemb, hashEStr, keyEqualsEStr, NULL)) == NULL)
+		return;
+	for(i = 0 ; i < ar->nmemb ; ++i) {
+		if(estrHashAdd(ar->ht, ar->arr[i], 1) != RS_RET_OK) {
+			hashtable_destroy(ar->ht, 1);
+			ar->ht = NULL;
+			return;
+		}
+	}
+	DBGPRINTF("optimizer: using hash lookup for array with %d members\n", ar->nmemb);
+}
+
 /* perform a string comparision operation against a while array. Semantic is
  * that one one comparison is true, the whole construct is true.
  * TODO: we can obviously optimize this process. One idea is to
@@ -1180,6 +1261,8 @@ evalStrArrayCmp(es_str_t *estr_l, struct cnfarray* ar, int cmpop)
 {
 	int i;
 	int r = 0;
+	if(cmpop == CMP_EQ && ar->ht != NULL)
+		return hashtable_search(ar->ht, estr_l) != NULL;
 	for(i = 0 ; (r == 0) && (i < ar->nmemb) ; ++i) {
 		switch(cmpop) {
 		case CMP_EQ:
@@ -1627,11 +1710,14 @@ cnfarrayContentDestruct(struct cnfarray *ar)
 		es_deleteStr(ar->arr[i]);
 	}
 	free(ar->arr);
+	if(ar->ht != NULL)
+		hashtable_destroy(ar->ht, 1);
 }
 
 static inline void
 cnffuncDestruct(struct cnffunc *func)
 {
+	rsregex_t *re;
 	unsigned short i;
 
 	for(i = 0 ; i < func->nParams ; ++i) {
@@ -1640,8 +1726,11 @@ cnffuncDestruct(struct cnffunc *func)
 	/* some functions require special destruction */
 	switch(func->fID) {
 		case CNFFUNC_RE_MATCH:
-			if(func->funcdata != NULL)
-				regexp.regfree(func->funcdata);
+			if(func->funcdata != NULL) {
+				re = func->funcdata;
+				regexp.destruct(&re);
+				func->funcdata = NULL;
+			}
 			break;
 		default:break;
 	}
@@ -1957,8 +2046,25 @@ cnfstmtPrint(struct cnfstmt *root, int indent)
 			}
 			doIndent(indent); dbgprintf("THEN\n");
 			cnfstmtPrint(stmt->d.s_propfilt.t_then, indent+1);
+			if(stmt->d.s_propfilt.t_else != NULL) {
+				doIndent(indent); dbgprintf("ELSE\n");
+				cnfstmtPrint(stmt->d.s_propfilt.t_else, indent+1);
+			}
 			doIndent(indent); dbgprintf("END PROPFILT\n");
 			break;
+		case S_PROPGRP:
+			doIndent(indent); dbgprintf("PROPGRP (%d members)\n",
+				stmt->d.s_propgrp.nMembers);
+			cnfstmtPrint(stmt->d.s_propgrp.members, indent+1);
+			doIndent(indent); dbgprintf("END PROPGRP\n");
+			break;
+		case S_SWITCH:
+			doIndent(indent); dbgprintf("SWITCH '%s' (%d cases, %s)\n",
+				stmt->d.s_switch.var->name, stmt->d.s_switch.nCases,
+				stmt->d.s_switch.bElseChain ? "else-chain" : "siblings");
+			cnfstmtPrint(stmt->d.s_switch.members, indent+1);
+			doIndent(indent); dbgprintf("END SWITCH\n");
+			break;
 		default:
 			dbgprintf("error: unknown stmt type %u\n",
 				(unsigned) stmt->nodetype);
@@ -1997,6 +2103,7 @@ cnfarrayNew(es_str_t *val)
 	if((ar = malloc(sizeof(struct cnfarray))) != NULL) {
 		ar->nodetype = 'A';
 		ar->nmemb = 1;
+		ar->ht = NULL;
 		if((ar->arr = malloc(sizeof(es_str_t*))) == NULL) {
 			free(ar);
 			ar = NULL;
@@ -2101,6 +2208,16 @@ cnfstmtDestruct(struct cnfstmt *root)
 			if(stmt->d.s_propfilt.pCSCompValue != NULL)
 				cstrDestruct(&stmt->d.s_propfilt.pCSCompValue);
 			cnfstmtDestruct(stmt->d.s_propfilt.t_then);
+			cnfstmtDestruct(stmt->d.s_propfilt.t_else);
+			break;
+		case S_PROPGRP:
+			acmatchDestruct(&stmt->d.s_propgrp.matcher);
+			cnfstmtDestruct(stmt->d.s_propgrp.members);
+			break;
+		case S_SWITCH:
+			hashtable_destroy(stmt->d.s_switch.ht, 1);
+			free(stmt->d.s_switch.cases);
+			cnfstmtDestruct(stmt->d.s_switch.members);
 			break;
 		default:
 			dbgprintf("error: unknown stmt type during destruct %u\n",
@@ -2172,6 +2289,7 @@ cnfstmtNewPROPFILT(char *propfilt, struct cnfstmt *t_then)
 	if((cnfstmt = cnfstmtNew(S_PROPFILT)) != NULL) {
 		cnfstmt->printable = (uchar*)propfilt;
 		cnfstmt->d.s_propfilt.t_then = t_then;
+		cnfstmt->d.s_propfilt.t_else = NULL;
 		cnfstmt->d.s_propfilt.propName = NULL;
 		cnfstmt->d.s_propfilt.regex_cache = NULL;
 		cnfstmt->d.s_propfilt.pCSCompValue = NULL;
@@ -2378,6 +2496,8 @@ cnfexprOptimize(struct cnfexpr *expr)
 				expr->r = exprswap;
 			}
 		}
+		if(expr->nodetype == CMP_EQ && expr->r->nodetype == 'A')
+			cnfarrayBuildHash((struct cnfarray*) expr->r);
 	default:/* nodetype we cannot optimize */
 		break;
 	}
@@ -2416,6 +2536,219 @@ done:	return newRoot;
 }
 
 
+/* Check if an IF can be turned into a PROPFILT. This is the case for
+ * simple "contains" and "startswith" compares of a message property
+ * against a string constant, like
+ *     if $msg contains 'error' then ...
+ * The conversion saves the string object creation during evaluation and,
+ * more importantly, enables grouping with neighbouring property filters
+ * (see cnfstmtGroupPROPFILT()). If the IF is not eligible, nothing is
+ * changed.
+ */
+static inline void
+cnfstmtOptimizeIfToPROPFILT(struct cnfstmt *stmt)
+{
+	struct cnfexpr *expr;
+	struct cnfvar *var;
+	struct cnfstmt *t_then, *t_else;
+	cstr_t *pCSPropName = NULL;
+	cstr_t *pCSCompValue = NULL;
+	propid_t propID;
+	fiop_t operation;
+
+	expr = stmt->d.s_if.expr;
+	if(expr->nodetype == CMP_CONTAINS)
+		operation = FIOP_CONTAINS;
+	else if(expr->nodetype == CMP_STARTSWITH)
+		operation = FIOP_STARTSWITH;
+	else
+		goto done;
+	if(expr->l->nodetype != 'V' || expr->r->nodetype != 'S')
+		goto done;
+	var = (struct cnfvar*) expr->l;
+	/* only "regular" message properties, not $! (CEE) and $$ (system) */
+	if(var->name[0] != '$' || var->name[1] == '$' || var->name[1] == '!')
+		goto done;
+	if(rsCStrConstructFromszStr(&pCSPropName, (uchar*)var->name+1) != RS_RET_OK)
+		goto done;
+	if(   propNameToID(pCSPropName, &propID) != RS_RET_OK
+	   || propID == PROP_INVALID || propID == PROP_CEE)
+		goto done;
+	if(cstrConstructFromESStr(&pCSCompValue,
+			((struct cnfstringval*)expr->r)->estr) != RS_RET_OK)
+		goto done;
+
+	DBGPRINTF("optimizer: change IF to PROPFILT\n");
+	t_then = stmt->d.s_if.t_then;
+	t_else = stmt->d.s_if.t_else;
+	cnfexprDestruct(expr);
+	stmt->nodetype = S_PROPFILT;
+	stmt->d.s_propfilt.operation = operation;
+	stmt->d.s_propfilt.regex_cache = NULL;
+	stmt->d.s_propfilt.pCSCompValue = pCSCompValue;
+	stmt->d.s_propfilt.isNegated = 0;
+	stmt->d.s_propfilt.propID = propID;
+	stmt->d.s_propfilt.propName = NULL;
+	stmt->d.s_propfilt.t_then = t_then;
+	stmt->d.s_propfilt.t_else = t_else;
+	pCSCompValue = NULL;
+
+done:
+	if(pCSPropName != NULL)
+		cstrDestruct(&pCSPropName);
+	if(pCSCompValue != NULL)
+		cstrDestruct(&pCSCompValue);
+}
+
+/* check if expr is an equality compare of a (non-CEE) variable against a
+ * string constant or constant array, and return the variable if so.
+ * CEE variables are excluded, because they evaluate to JSON and are thus
+ * compared with different rules.
+ */
+static inline struct cnfvar *
+getEqCmpVar(struct cnfexpr *expr)
+{
+	struct cnfvar *var;
+
+	if(   expr->nodetype != CMP_EQ || expr->l->nodetype != 'V'
+	   || (expr->r->nodetype != 'S' && expr->r->nodetype != 'A'))
+		return NULL;
+	var = (struct cnfvar*) expr->l;
+	if(var->name[0] == '$' && var->name[1] == '!')
+		return NULL;
+	return var;
+}
+
+/* add the compare value(s) of an equality expression to a SWITCH
+ * hash table.
+ */
+static rsRetVal
+switchAddKeys(struct hashtable *ht, struct cnfexpr *expr, int caseNum)
+{
+	struct cnfarray *ar;
+	int i;
+	DEFiRet;
+
+	if(expr->r->nodetype == 'S') {
+		CHKiRet(estrHashAdd(ht, ((struct cnfstringval*)expr->r)->estr, caseNum));
+	} else {
+		ar = (struct cnfarray*) expr->r;
+		for(i = 0 ; i < ar->nmemb ; ++i)
+			CHKiRet(estrHashAdd(ht, ar->arr[i], caseNum));
+	}
+finalize_it:
+	RETiRet;
+}
+
+/* check if any of the compare value(s) is already in the hash table */
+static int
+switchHasKey(struct hashtable *ht, struct cnfexpr *expr)
+{
+	struct cnfarray *ar;
+	int i;
+
+	if(expr->r->nodetype == 'S')
+		return hashtable_search(ht, ((struct cnfstringval*)expr->r)->estr) != NULL;
+	ar = (struct cnfarray*) expr->r;
+	for(i = 0 ; i < ar->nmemb ; ++i)
+		if(hashtable_search(ht, ar->arr[i]) != NULL)
+			return 1;
+	return 0;
+}
+
+/* turn stmt into a SWITCH statement. The (already filled) hash table and
+ * case array are taken over. The original statement is moved to the
+ * member list, so that the caller's list pointers remain valid.
+ */
+static rsRetVal
+cnfstmtMakeSWITCH(struct cnfstmt *stmt, struct hashtable *ht,
+		  struct cnfstmt **cases, int nCases, sbool bElseChain)
+{
+	struct cnfstmt *first;
+	DEFiRet;
+
+	CHKmalloc(first = malloc(sizeof(struct cnfstmt)));
+	memcpy(first, stmt, sizeof(struct cnfstmt));
+	cases[0] = first;
+	DBGPRINTF("optimizer: change %d IFs on '%s' to SWITCH (%s)\n", nCases,
+		  ((struct cnfvar*)first->d.s_if.expr->l)->name,
+		  bElseChain ? "else-chain" : "siblings");
+	stmt->nodetype = S_SWITCH;
+	stmt->printable = NULL;
+	stmt->d.s_switch.var = (struct cnfvar*) first->d.s_if.expr->l;
+	stmt->d.s_switch.ht = ht;
+	stmt->d.s_switch.nCases = nCases;
+	stmt->d.s_switch.cases = cases;
+	stmt->d.s_switch.bElseChain = bElseChain;
+	stmt->d.s_switch.members = first;
+finalize_it:
+	RETiRet;
+}
+
+/* Check if an IF is the head of an if/else-if chain that compares the
+ * same variable for equality against constants, like
+ *     if $programname == 'a' then ... else if $programname == 'b' then ...
+ * If the chain is long enough, it is turned into a SWITCH, where the
+ * variable is evaluated once and the matching case is found via a hash
+ * table lookup. As each message takes exactly one path through such a
+ * chain, no message can be affected by another case's then-part, so this
+ * is always safe. Returns 1 if the IF was converted (and optimized).
+ */
+static int
+cnfstmtOptimizeIfToSWITCH(struct cnfstmt *stmt)
+{
+	struct cnfvar *var, *var2;
+	struct cnfstmt *memb, *next;
+	struct cnfstmt **cases = NULL;
+	struct hashtable *ht = NULL;
+	int nCases;
+	int k;
+	int bConverted = 0;
+
+	if((var = getEqCmpVar(stmt->d.s_if.expr)) == NULL)
+		goto done;
+	nCases = 1;
+	for(memb = stmt ; ; memb = next) {
+		next = memb->d.s_if.t_else;
+		if(next == NULL || next->nodetype != S_IF || next->next != NULL)
+			break;
+		cnfexprOptimize(next->d.s_if.expr);
+		if(   (var2 = getEqCmpVar(next->d.s_if.expr)) == NULL
+		   || strcmp(var->name, var2->name))
+			break;
+		++nCases;
+	}
+	if(nCases < SWITCH_MIN_CASES)
+		goto done;
+
+	if(   (ht = create_hashtable(nCases, hashEStr, keyEqualsEStr, NULL)) == NULL
+	   || (cases = malloc(sizeof(struct cnfstmt*) * nCases)) == NULL)
+		goto done;
+	for(memb = stmt, k = 0 ; k < nCases ; memb = memb->d.s_if.t_else, ++k) {
+		cases[k] = memb;
+		if(switchAddKeys(ht, memb->d.s_if.expr, k + 1) != RS_RET_OK)
+			goto done;
+	}
+	if(cnfstmtMakeSWITCH(stmt, ht, cases, nCases, 1) != RS_RET_OK)
+		goto done;
+	ht = NULL;
+	bConverted = 1;
+
+	for(k = 0 ; k < nCases ; ++k) {
+		cases[k]->d.s_if.t_then = removeNOPs(cases[k]->d.s_if.t_then);
+		cnfstmtOptimize(cases[k]->d.s_if.t_then);
+	}
+	cases[nCases-1]->d.s_if.t_else = removeNOPs(cases[nCases-1]->d.s_if.t_else);
+	cnfstmtOptimize(cases[nCases-1]->d.s_if.t_else);
+	cases = NULL;
+
+done:
+	if(ht != NULL)
+		hashtable_destroy(ht, 1);
+	free(cases);
+	return bConverted;
+}
+
 static inline void
 cnfstmtOptimizeIf(struct cnfstmt *stmt)
 {
@@ -2426,6 +2759,8 @@ cnfstmtOptimizeIf(struct cnfstmt *stmt)
 
 	expr = stmt->d.s_if.expr;
 	cnfexprOptimize(expr);
+	if(cnfstmtOptimizeIfToSWITCH(stmt))
+		return;
 	stmt->d.s_if.t_then = removeNOPs(stmt->d.s_if.t_then);
 	stmt->d.s_if.t_else = removeNOPs(stmt->d.s_if.t_else);
 	cnfstmtOptimize(stmt->d.s_if.t_then);
@@ -2448,6 +2783,8 @@ cnfstmtOptimizeIf(struct cnfstmt *stmt)
 			cnfexprDestruct(expr);
 			cnfstmtOptimizePRIFilt(stmt);
 		}
+	} else {
+		cnfstmtOptimizeIfToPROPFILT(stmt);
 	}
 }
 
@@ -2531,6 +2868,267 @@ done:
 	free(rsName);
 	return;
 }
+/* Check that a statement subtree does not modify message properties
+ * (other than CEE ones, which are never grouped). Only actions that
+ * receive the message object itself (message modification modules) can
+ * do that. A called ruleset may contain anything, so we conservatively
+ * treat CALL as unsafe.
+ */
+static int
+cnfstmtIsPropSafe(struct cnfstmt *root)
+{
+	struct cnfstmt *stmt;
+	for(stmt = root ; stmt != NULL ; stmt = stmt->next) {
+		switch(stmt->nodetype) {
+		case S_CALL:
+			return 0;
+		case S_ACT:
+			if(stmt->d.act->eParamPassing == ACT_MSG_PASSING)
+				return 0;
+			break;
+		case S_IF:
+			if(   !cnfstmtIsPropSafe(stmt->d.s_if.t_then)
+			   || !cnfstmtIsPropSafe(stmt->d.s_if.t_else))
+				return 0;
+			break;
+		case S_PRIFILT:
+			if(   !cnfstmtIsPropSafe(stmt->d.s_prifilt.t_then)
+			   || !cnfstmtIsPropSafe(stmt->d.s_prifilt.t_else))
+				return 0;
+			break;
+		case S_PROPFILT:
+			if(   !cnfstmtIsPropSafe(stmt->d.s_propfilt.t_then)
+			   || !cnfstmtIsPropSafe(stmt->d.s_propfilt.t_else))
+				return 0;
+			break;
+		case S_PROPGRP:
+			if(!cnfstmtIsPropSafe(stmt->d.s_propgrp.members))
+				return 0;
+			break;
+		case S_SWITCH:
+			if(!cnfstmtIsPropSafe(stmt->d.s_switch.members))
+				return 0;
+			break;
+		default:
+			break;
+		}
+	}
+	return 1;
+}
+
+static inline int
+isGroupablePROPFILT(struct cnfstmt *stmt)
+{
+	return    stmt->nodetype == S_PROPFILT
+	       && (   stmt->d.s_propfilt.operation == FIOP_CONTAINS
+	           || stmt->d.s_propfilt.operation == FIOP_STARTSWITH)
+	       && stmt->d.s_propfilt.propID != PROP_INVALID
+	       && stmt->d.s_propfilt.propID != PROP_CEE
+	       && stmt->d.s_propfilt.pCSCompValue != NULL;
+}
+
+/* turn the nMembers PROPFILTs starting at stmt and ending at last into a
+ * PROPGRP. The group node takes the place of the first member (so that the
+ * list pointers of the caller remain valid), the members are moved to the
+ * group's member list.
+ */
+static rsRetVal
+cnfstmtMakePROPGRP(struct cnfstmt *stmt, struct cnfstmt *last, int nMembers)
+{
+	struct cnfstmt *first;
+	struct cnfstmt *memb;
+	acmatch_t *matcher = NULL;
+	int i;
+	DEFiRet;
+
+	CHKiRet(acmatchConstruct(&matcher));
+	for(memb = stmt, i = 0 ; i < nMembers ; memb = memb->next, ++i) {
+		CHKiRet(acmatchAddPattern(matcher,
+			rsCStrGetBufBeg(memb->d.s_propfilt.pCSCompValue),
+			rsCStrLen(memb->d.s_propfilt.pCSCompValue),
+			memb->d.s_propfilt.operation == FIOP_STARTSWITH));
+	}
+	CHKiRet(acmatchConstructFinalize(matcher));
+	CHKmalloc(first = malloc(sizeof(struct cnfstmt)));
+	memcpy(first, stmt, sizeof(struct cnfstmt));
+
+	DBGPRINTF("optimizer: grouping %d PROPFILTs on property '%s'\n", nMembers,
+		  propIDToName(stmt->d.s_propfilt.propID));
+	stmt->nodetype = S_PROPGRP;
+	stmt->printable = NULL;
+	stmt->next = last->next;
+	last->next = NULL;
+	stmt->d.s_propgrp.matcher = matcher;
+	stmt->d.s_propgrp.nMembers = nMembers;
+	stmt->d.s_propgrp.members = first;
+	matcher = NULL;
+
+finalize_it:
+	if(matcher != NULL)
+		acmatchDestruct(&matcher);
+	RETiRet;
+}
+
+/* Group runs of sibling "contains" and "startswith" PROPFILTs that check
+ * the same property. A group is evaluated by a single scan over the
+ * property (Aho-Corasick), instead of one scan per filter, which makes a
+ * big difference for rulesets with hundreds of such filters.
+ * The members' then/else parts are executed in order, exactly as if
+ * they were not grouped. This is only valid if the property cannot change
+ * between the evaluation of the first and the last member, so a member
+ * only becomes part of a group if all previous members' subtrees are
+ * known not to modify message properties.
+ */
+static void
+cnfstmtGroupPROPFILT(struct cnfstmt *root)
+{
+	struct cnfstmt *stmt, *last;
+	int nMembers;
+
+	for(stmt = root ; stmt != NULL ; stmt = stmt->next) {
+		if(!isGroupablePROPFILT(stmt))
+			continue;
+		nMembers = 1;
+		for(last = stmt ; last->next != NULL ; last = last->next) {
+			if(   !isGroupablePROPFILT(last->next)
+			   || last->next->d.s_propfilt.propID != stmt->d.s_propfilt.propID
+			   || !cnfstmtIsPropSafe(last->d.s_propfilt.t_then)
+			   || !cnfstmtIsPropSafe(last->d.s_propfilt.t_else))
+				break;
+			++nMembers;
+		}
+		if(   nMembers < PROPGRP_MIN_MEMBERS
+		   || cnfstmtMakePROPGRP(stmt, last, nMembers) != RS_RET_OK)
+			stmt = last;
+	}
+}
+
+/* Turn runs of sibling IFs that compare the same message property for
+ * equality into a SWITCH, like
+ *     if $programname == 'a' then { ... stop }
+ *     if $programname == 'b' then { ... stop }
+ * The property is evaluated once per message and the matching IF is
+ * found via a hash table lookup. The then/else parts are executed in
+ * order, as without grouping. As the property is evaluated up front,
+ * the same restrictions as for PROPFILT groups apply: a member only
+ * joins if the previous members' subtrees cannot modify message
+ * properties. System variables ($$) are not grouped, as they may change
+ * over time. A member comparing against an already used value ends the
+ * run, because a message may then match more than one member.
+ */
+static void
+cnfstmtGroupSWITCH(struct cnfstmt *root)
+{
+	struct cnfstmt *stmt, *last, *memb;
+	struct cnfstmt **cases;
+	struct cnfvar *var, *var2;
+	struct hashtable *ht;
+	int nCases;
+	int k;
+
+	for(stmt = root ; stmt != NULL ; stmt = stmt->next) {
+		if(   stmt->nodetype != S_IF
+		   || (var = getEqCmpVar(stmt->d.s_if.expr)) == NULL
+		   || var->name[1] == '$')
+			continue;
+		if((ht = create_hashtable(16, hashEStr, keyEqualsEStr, NULL)) == NULL)
+			continue;
+		nCases = 1;
+		if(switchAddKeys(ht, stmt->d.s_if.expr, nCases) != RS_RET_OK)
+			goto fail;
+		for(last = stmt ; last->next != NULL ; last = last->next) {
+			memb = last->next;
+			if(   memb->nodetype != S_IF
+			   || (var2 = getEqCmpVar(memb->d.s_if.expr)) == NULL
+			   || strcmp(var->name, var2->name)
+			   || !cnfstmtIsPropSafe(last->d.s_if.t_then)
+			   || !cnfstmtIsPropSafe(last->d.s_if.t_else)
+			   || switchHasKey(ht, memb->d.s_if.expr))
+				break;
+			if(switchAddKeys(ht, memb->d.s_if.expr, nCases + 1) != RS_RET_OK)
+				goto fail;
+			++nCases;
+		}
+		if(nCases < SWITCH_MIN_CASES)
+			goto fail;
+		if((cases = malloc(sizeof(struct cnfstmt*) * nCases)) == NULL)
+			goto fail;
+		for(memb = stmt, k = 0 ; k < nCases ; memb = memb->next, ++k)
+			cases[k] = memb;
+		memb = last->next;
+		last->next = NULL;
+		if(cnfstmtMakeSWITCH(stmt, ht, cases, nCases, 0) != RS_RET_OK) {
+			last->next = memb;
+			free(cases);
+			goto fail;
+		}
+		stmt->next = memb;
+		continue;
+fail:
+		hashtable_destroy(ht, 1);
+	}
+}
+
+/* find the case a message belongs to in a SWITCH statement. Returns the
+ * case number (1..nCases) or 0 if no case matches.
+ */
+int
+cnfstmtSwitchLookup(struct cnfstmt *stmt, void *usrptr)
+{
+	struct var val;
+	int *pCase;
+	int caseNum = 0;
+
+	evalVar(stmt->d.s_switch.var, usrptr, &val);
+	if(val.datatype == 'S') {
+		if((pCase = hashtable_search(stmt->d.s_switch.ht, val.d.estr)) != NULL)
+			caseNum = *pCase;
+	}
+	varDelete(&val);
+	return caseNum;
+}
+
+/* count the property references of the (already optimized) statements,
+ * so that properties used more than once can be memoized (see msg.c).
+ * Grouped filters fetch their property only once for the whole group.
+ */
+void
+cnfstmtCountMemoProps(struct cnfstmt *root)
+{
+	struct cnfstmt *stmt, *memb;
+	for(stmt = root ; stmt != NULL ; stmt = stmt->next) {
+		switch(stmt->nodetype) {
+		case S_IF:
+			cnfstmtCountMemoProps(stmt->d.s_if.t_then);
+			cnfstmtCountMemoProps(stmt->d.s_if.t_else);
+			break;
+		case S_PRIFILT:
+			cnfstmtCountMemoProps(stmt->d.s_prifilt.t_then);
+			cnfstmtCountMemoProps(stmt->d.s_prifilt.t_else);
+			break;
+		case S_PROPFILT:
+			msgMemoCountRef(stmt->d.s_propfilt.propID, stmt->d.s_propfilt.propName);
+			cnfstmtCountMemoProps(stmt->d.s_propfilt.t_then);
+			cnfstmtCountMemoProps(stmt->d.s_propfilt.t_else);
+			break;
+		case S_PROPGRP:
+			msgMemoCountRef(stmt->d.s_propgrp.members->d.s_propfilt.propID,
+					stmt->d.s_propgrp.members->d.s_propfilt.propName);
+			for(memb = stmt->d.s_propgrp.members ; memb != NULL ; memb = memb->next) {
+				cnfstmtCountMemoProps(memb->d.s_propfilt.t_then);
+				cnfstmtCountMemoProps(memb->d.s_propfilt.t_else);
+			}
+			break;
+		case S_SWITCH:
+			cnfstmtCountMemoProps(stmt->d.s_switch.members);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+
 /* (recursively) optimize a statement */
 void
 cnfstmtOptimize(struct cnfstmt *root)
@@ -2548,7 +3146,12 @@ dbgprintf("RRRR: stmtOptimize: stmt %p, nodetype %u\n", stmt, stmt->nodetype);
 			break;
 		case S_PROPFILT:
 			stmt->d.s_propfilt.t_then = removeNOPs(stmt->d.s_propfilt.t_then);
+			stmt->d.s_propfilt.t_else = removeNOPs(stmt->d.s_propfilt.t_else);
 			cnfstmtOptimize(stmt->d.s_propfilt.t_then);
+			cnfstmtOptimize(stmt->d.s_propfilt.t_else);
+			break;
+		case S_PROPGRP: /* created by us, already optimized */
+		case S_SWITCH:
 			break;
 		case S_SET:
 			cnfexprOptimize(stmt->d.s_set.expr);
@@ -2574,6 +3177,8 @@ dbgprintf("RRRR: stmtOptimize: stmt %p, nodetype %u\n", stmt, stmt->nodetype);
 			break;
 		}
 	}
+	cnfstmtGroupPROPFILT(root);
+	cnfstmtGroupSWITCH(root);
 done:	return;
 }
 
@@ -2632,9 +3237,9 @@ funcName2ID(es_str_t *fname, unsigned short nParams)
 		}
 		return CNFFUNC_CNUM;
 	} else if(!es_strbufcmp(fname, (unsigned char*)"re_match", sizeof("re_match") - 1)) {
-		if(nParams != 2) {
+		if(nParams != 2 && nParams != 3) {
 			parser_errmsg("number of parameters for re_match() must be two "
-				      "but is %d.", nParams);
+				      "or three but is %d.", nParams);
 			return CNFFUNC_INVALID;
 		}
 		return CNFFUNC_RE_MATCH;
@@ -2663,7 +3268,8 @@ initFunc_re_match(struct cnffunc *func)
 {
 	rsRetVal localRet;
 	char *regex = NULL;
-	regex_t *re;
+	rsregex_t *re;
+	int engine = RS_REGEX_ENGINE_DFLT;
 	DEFiRet;
 
 	func->funcdata = NULL;
@@ -2671,17 +3277,32 @@ initFunc_re_match(struct cnffunc *func)
 		parser_errmsg("param 2 of re_match() must be a constant string");
 		FINALIZE;
 	}
-
-	CHKmalloc(re = malloc(sizeof(regex_t)));
-	func->funcdata = re;
+	/* optional param 3 selects the engine for this expression */
+	if(func->nParams == 3) {
+		if(func->expr[2]->nodetype != 'S') {
+			parser_errmsg("param 3 of re_match() must be a constant string");
+			FINALIZE;
+		}
+		if(!es_strbufcmp(((struct cnfstringval*) func->expr[2])->estr,
+				 (unsigned char*)"posix", sizeof("posix") - 1)) {
+			engine = RS_REGEX_ENGINE_POSIX;
+		} else if(!es_strbufcmp(((struct cnfstringval*) func->expr[2])->estr,
+				 (unsigned char*)"dfa", sizeof("dfa") - 1)) {
+			engine = RS_REGEX_ENGINE_DFA;
+		} else {
+			parser_errmsg("param 3 of re_match() must be \"posix\" or \"dfa\"");
+			FINALIZE;
+		}
+	}
 
 	regex = es_str2cstr(((struct cnfstringval*) func->expr[1])->estr, NULL);
 	
 	if((localRet = objUse(regexp, LM_REGEXP_FILENAME)) == RS_RET_OK) {
-		if(regexp.regcomp(re, (char*) regex, REG_EXTENDED) != 0) {
+		if(regexp.compile(&re, (char*) regex, REG_EXTENDED, engine) != 0) {
 			parser_errmsg("cannot compile regex '%s'", regex);
 			ABORT_FINALIZE(RS_RET_ERR);
 		}
+		func->funcdata = re;
 	} else { /* regexp object could not be loaded */
 		parser_errmsg("could not load regex support - regex ignored");
 		ABORT_FINALIZE(RS_RET_ERR);
@@ -125,6 +125,8 @@ struct nvlst {
 #define S_SET 4006
 #define S_UNSET 4007
 #define S_CALL 4008
+#define S_PROPGRP 4009	/* group of PROPFILTs evaluated in one pass (optimizer-generated) */
+#define S_SWITCH 4010	/* hash dispatch of equality IFs (optimizer-generated) */
 
 enum cnfFiltType { CNFFILT_NONE, CNFFILT_PRI, CNFFILT_PROP, CNFFILT_SCRIPT };
 static inline char*
@@ -172,7 +174,7 @@ struct cnfstmt {
 		} s_prifilt;
 		struct {
 			fiop_t operation;
-			regex_t *regex_cache;/* cache for compiled REs, if used */
+			struct rsregex_s *regex_cache;/* cache for compiled REs, if used */
 			struct cstr_s *pCSCompValue;/* value to "compare" against */
 			sbool isNegated;
 			uintTiny propID;/* ID of the requested property */
@@ -180,6 +182,19 @@ struct cnfstmt {
 			struct cnfstmt *t_then;
 			struct cnfstmt *t_else;
 		} s_propfilt;
+		struct {
+			struct acmatch_s *matcher;/* matches all members in one pass */
+			int nMembers;
+			struct cnfstmt *members;/* list of S_PROPFILTs, same property */
+		} s_propgrp;
+		struct {
+			struct cnfvar *var;	/* var to switch on (owned by members) */
+			struct hashtable *ht;	/* compare value -> case number */
+			int nCases;
+			struct cnfstmt **cases;	/* the S_IFs forming the cases */
+			sbool bElseChain;	/* cases are an if/else-if chain? */
+			struct cnfstmt *members;/* original IF statement(s) */
+		} s_switch;
 		struct action_s *act;
 	} d;
 };
@@ -209,6 +224,7 @@ struct cnfarray {
 	unsigned nodetype;
 	int nmemb;
 	es_str_t **arr;
+	struct hashtable *ht;	/* for fast "==" lookup, built by optimizer (may be NULL) */
 };
 
 struct cnffparamlst {
@@ -330,6 +346,8 @@ struct cnfstmt * cnfstmtNewCall(es_str_t *name);
 struct cnfstmt * cnfstmtNewContinue(void);
 void cnfstmtDestruct(struct cnfstmt *root);
 void cnfstmtOptimize(struct cnfstmt *root);
+void cnfstmtCountMemoProps(struct cnfstmt *root);
+int cnfstmtSwitchLookup(struct cnfstmt *stmt, void *usrptr);
 struct cnfarray* cnfarrayNew(es_str_t *val);
 struct cnfarray* cnfarrayDup(struct cnfarray *old);
 struct cnfarray* cnfarrayAdd(struct cnfarray *ar, es_str_t *val);
@@ -68,6 +68,10 @@
 #include "msg.h"
 #include "statsobj.h"
 #include "net.h" /* for permittedPeers, may be removed when this is removed */
+#ifdef USE_NETZIP
+#include <zlib.h>
+#include "zlibw.h"
+#endif
 
 /* the define is from tcpsrv.h, we need to find a new (but easier!!!) abstraction layer some time ... */
 #define TCPSRV_NO_ADDTL_DELIMITER -1 /* specifies that no additional delimiter is to be used in TCP framing */
@@ -86,6 +90,10 @@ DEFobjCurrIf(datetime)
 DEFobjCurrIf(errmsg)
 DEFobjCurrIf(ruleset)
 DEFobjCurrIf(statsobj)
+#ifdef USE_NETZIP
+DEFobjCurrIf(zlibw)
+static sbool bHaveZlibw = 0; /* zlibw could be loaded, so we can decompress */
+#endif
 
 /* forward references */
 static void * wrkr(void *myself);
@@ -116,6 +124,7 @@ struct instanceConf_s {
 	int bEmitMsgOnClose;
 	int bSuppOctetFram;		/* support octet-counted framing? */
 	int iAddtlFrameDelim;
+	sbool bStreamDecompress;	/* compression.mode stream:always */
 	uchar *pszBindPort;		/* port to bind to */
 	uchar *pszBindAddr;		/* IP to bind socket to */
 	uchar *pszBindRuleset;		/* name of ruleset to bind to */
@@ -158,6 +167,7 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "keepalive.time", eCmdHdlrInt, 0 },
 	{ "keepalive.interval", eCmdHdlrInt, 0 },
 	{ "addtlframedelimiter", eCmdHdlrInt, 0 },
+	{ "compression.mode", eCmdHdlrGetWord, 0 },
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -195,6 +205,7 @@ struct ptcpsrv_s {
 	sbool bKeepAlive;		/* support keep-alive packets */
 	sbool bEmitMsgOnClose;
 	sbool bSuppOctetFram;
+	sbool bStreamDecompress;
 };
 
 /* the ptcp session object. Describes a single active session.
@@ -218,6 +229,9 @@ struct ptcpsess_s {
 	int iOctetsRemain;	/* Number of Octets remaining in message */
 	TCPFRAMINGMODE eFraming;
 	uchar *pMsg;		/* message (fragment) received */
+#	ifdef USE_NETZIP
+	z_stream *pZStrm;	/* decompression state for stream compression, NULL if not used */
+#	endif
 	prop_t *peerName;	/* host name we received messages from */
 	prop_t *peerIP;
 //--- END from tcps_sess.h
@@ -231,6 +245,7 @@ struct ptcplstn_s {
 	ptcplstn_t *prev, *next;
 	int sock;
 	sbool bSuppOctetFram;
+	sbool bStreamDecompress;
 	epolld_t *epd;
 	statsobj_t *stats;	/* listener stats */
 	STATSCOUNTER_DEF(ctrSubmit, mutCtrSubmit)
@@ -282,6 +297,12 @@ static rsRetVal addLstn(ptcpsrv_t *pSrv, int sock, int isIPv6);
 static void
 destructSess(ptcpsess_t *pSess)
 {
+#	ifdef USE_NETZIP
+	if(pSess->pZStrm != NULL) {
+		zlibw.InflateEnd(pSess->pZStrm);
+		free(pSess->pZStrm);
+	}
+#	endif
 	free(pSess->pMsg);
 	free(pSess->epd);
 	prop.Destruct(&pSess->peerName);
@@ -806,6 +827,72 @@ processDataRcvd(ptcpsess_t *pThis, char c, struct syslogTime *stTime, time_t ttG
  * EXTRACT from tcps_sess.c
  */
 #define NUM_MULTISUB 1024
+
+/* process data received on a session with stream compression. The whole
+ * session is a single zlib stream, so we decompress and process the output
+ * just like uncompressed data. Invalid data closes the session.
+ * EXTRACT from tcps_sess.c
+ */
+static rsRetVal
+DataRcvdCompressed(ptcpsess_t *pThis, char *pData, size_t iLen,
+		   struct syslogTime *stTime, time_t ttGenTime, multi_submit_t *pMultiSub)
+{
+#	ifdef USE_NETZIP
+	char zipBuf[32*1024];
+	char *pBuf;
+	char *pEnd;
+	int zRet;
+	uchar *pszPeer;
+	int lenPeer;
+#	endif
+	DEFiRet;
+
+#	ifdef USE_NETZIP
+	if(!bHaveZlibw) {
+		errmsg.LogError(0, RS_RET_ZLIB_ERR, "imptcp: compressed data received, but zlibw "
+				"module could not be loaded - closing session");
+		ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+	}
+	if(pThis->pZStrm == NULL) {
+		CHKmalloc(pThis->pZStrm = calloc(1, sizeof(z_stream)));
+		if(zlibw.InflateInit2(pThis->pZStrm, MAX_WBITS) != Z_OK) {
+			free(pThis->pZStrm);
+			pThis->pZStrm = NULL;
+			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+		}
+	}
+
+	pThis->pZStrm->next_in = (Bytef*) pData;
+	pThis->pZStrm->avail_in = iLen;
+	do {
+		pThis->pZStrm->next_out = (Bytef*) zipBuf;
+		pThis->pZStrm->avail_out = sizeof(zipBuf);
+		zRet = zlibw.Inflate(pThis->pZStrm, Z_SYNC_FLUSH);
+		if(zRet != Z_OK && zRet != Z_STREAM_END && zRet != Z_BUF_ERROR) {
+			prop.GetString(pThis->peerIP, &pszPeer, &lenPeer);
+			errmsg.LogError(0, RS_RET_ZLIB_ERR, "imptcp: invalid compressed data received "
+					"from %s (zlib error %d) - is the sender using stream compression?",
+					pszPeer, zRet);
+			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+		}
+		pEnd = zipBuf + sizeof(zipBuf) - pThis->pZStrm->avail_out;
+		for(pBuf = zipBuf ; pBuf < pEnd ; ++pBuf) {
+			CHKiRet(processDataRcvd(pThis, *pBuf, stTime, ttGenTime, pMultiSub));
+		}
+		if(zRet == Z_STREAM_END) /* the sender started a new stream */
+			zlibw.InflateReset(pThis->pZStrm);
+	} while(pThis->pZStrm->avail_in > 0 || pThis->pZStrm->avail_out == 0);
+#	else
+	errmsg.LogError(0, RS_RET_ZLIB_ERR, "imptcp: compressed data received, but rsyslog is not "
+			"compiled with zlib support - closing session");
+	ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+#	endif
+
+finalize_it:
+	RETiRet;
+}
+
+
 static rsRetVal
 DataRcvd(ptcpsess_t *pThis, char *pData, size_t iLen)
 {
@@ -824,11 +911,15 @@ DataRcvd(ptcpsess_t *pThis, char *pData, size_t iLen)
 	multiSub.maxElem = NUM_MULTISUB;
 	multiSub.nElem = 0;
 
-	 /* We now copy the message to the session buffer. */
-	pEnd = pData + iLen; /* this is one off, which is intensional */
+	if(pThis->pLstn->bStreamDecompress) {
+		CHKiRet(DataRcvdCompressed(pThis, pData, iLen, &stTime, ttGenTime, &multiSub));
+	} else {
+		 /* We now copy the message to the session buffer. */
+		pEnd = pData + iLen; /* this is one off, which is intensional */
 
-	while(pData < pEnd) {
-		CHKiRet(processDataRcvd(pThis, *pData++, &stTime, ttGenTime, &multiSub));
+		while(pData < pEnd) {
+			CHKiRet(processDataRcvd(pThis, *pData++, &stTime, ttGenTime, &multiSub));
+		}
 	}
 
 	if(multiSub.nElem > 0) {
@@ -930,6 +1021,7 @@ addLstn(ptcpsrv_t *pSrv, int sock, int isIPv6)
 	CHKmalloc(pLstn = malloc(sizeof(ptcplstn_t)));
 	pLstn->pSrv = pSrv;
 	pLstn->bSuppOctetFram = pSrv->bSuppOctetFram;
+	pLstn->bStreamDecompress = pSrv->bStreamDecompress;
 	pLstn->sock = sock;
 	/* support statistics gathering */
 	CHKiRet(statsobj.Construct(&(pLstn->stats)));
@@ -971,6 +1063,9 @@ addSess(ptcplstn_t *pLstn, int sock, prop_t *peerName, prop_t *peerIP)
 	pSess->pLstn = pLstn;
 	pSess->sock = sock;
 	pSess->bSuppOctetFram = pLstn->bSuppOctetFram;
+#	ifdef USE_NETZIP
+	pSess->pZStrm = NULL;
+#	endif
 	pSess->inputState = eAtStrtFram;
 	pSess->iMsg = 0;
 	pSess->bAtStrtOfFram = 1;
@@ -1050,6 +1145,7 @@ createInstance(instanceConf_t **pinst)
 	inst->iKeepAliveTime = 0;
 	inst->bEmitMsgOnClose = 0;
 	inst->iAddtlFrameDelim = TCPSRV_NO_ADDTL_DELIMITER;
+	inst->bStreamDecompress = 0;
 	inst->pBindRuleset = NULL;
 
 	/* node created, let's add to config */
@@ -1125,6 +1221,7 @@ addListner(modConfData_t __attribute__((unused)) *modConf, instanceConf_t *inst)
 	pSrv->pSess = NULL;
 	pSrv->pLstn = NULL;
 	pSrv->bSuppOctetFram = inst->bSuppOctetFram;
+	pSrv->bStreamDecompress = inst->bStreamDecompress;
 	pSrv->bKeepAlive = inst->bKeepAlive;
 	pSrv->iKeepAliveIntvl = inst->iKeepAliveTime;
 	pSrv->iKeepAliveProbes = inst->iKeepAliveProbes;
@@ -1458,6 +1555,19 @@ CODESTARTnewInpInst
 			inst->iAddtlFrameDelim = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "notifyonconnectionclose")) {
 			inst->bEmitMsgOnClose = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "compression.mode")) {
+			if(!es_strcasebufcmp(pvals[i].val.d.estr, (uchar*)"stream:always", 13)) {
+				inst->bStreamDecompress = 1;
+			} else if(!es_strcasebufcmp(pvals[i].val.d.estr, (uchar*)"none", 4)) {
+				inst->bStreamDecompress = 0;
+			} else {
+				uchar *str;
+				str = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+				errmsg.LogError(0, RS_RET_INVALID_PARAMS,
+						"imptcp: invalid compression.mode \"%s\"", str);
+				free(str);
+				ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+			}
 		} else {
 			dbgprintf("imptcp: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
@@ -1703,6 +1813,10 @@ CODESTARTmodExit
 	objRelease(datetime, CORE_COMPONENT);
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(ruleset, CORE_COMPONENT);
+#	ifdef USE_NETZIP
+	if(bHaveZlibw)
+		objRelease(zlibw, LM_ZLIBW_FILENAME);
+#	endif
 ENDmodExit
 
 
@@ -1752,6 +1866,13 @@ CODEmodInit_QueryRegCFSLineHdlr
 	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 	CHKiRet(objUse(prop, CORE_COMPONENT));
 	CHKiRet(objUse(net, LM_NET_FILENAME));
+#	ifdef USE_NETZIP
+	/* zlibw is only needed for stream decompression, so we can live without it */
+	if(objUse(zlibw, LM_ZLIBW_FILENAME) == RS_RET_OK)
+		bHaveZlibw = 1;
+	else
+		DBGPRINTF("imptcp: zlibw unavailable, stream decompression not supported\n");
+#	endif
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(datetime, CORE_COMPONENT));
 	CHKiRet(objUse(ruleset, CORE_COMPONENT));
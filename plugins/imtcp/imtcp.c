@@ -106,6 +106,7 @@ struct instanceConf_s {
 	ruleset_t *pBindRuleset;	/* ruleset to bind listener to (use system default if unspecified) */
 	uchar *pszInputName;		/* value for inputname property, NULL is OK and handled by core engine */
 	int bSuppOctetFram;
+	sbool bStreamDecompress;	/* compression.mode stream:always */
 	struct instanceConf_s *next;
 };
 
@@ -155,7 +156,8 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "port", eCmdHdlrString, CNFPARAM_REQUIRED }, /* legacy: InputTCPServerRun */
 	{ "name", eCmdHdlrString, 0 },
 	{ "ruleset", eCmdHdlrString, 0 },
-	{ "supportOctetCountedFraming", eCmdHdlrBinary, 0 }
+	{ "supportOctetCountedFraming", eCmdHdlrBinary, 0 },
+	{ "compression.mode", eCmdHdlrGetWord, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -251,6 +253,7 @@ createInstance(instanceConf_t **pinst)
 	inst->pszBindRuleset = NULL;
 	inst->pszInputName = NULL;
 	inst->bSuppOctetFram = 1;
+	inst->bStreamDecompress = 0;
 
 	/* node created, let's add to config */
 	if(loadModConf->tail == NULL) {
@@ -332,6 +335,7 @@ addListner(modConfData_t *modConf, instanceConf_t *inst)
 	/* initialized, now add socket and listener params */
 	DBGPRINTF("imtcp: trying to add port *:%s\n", inst->pszBindPort);
 	CHKiRet(tcpsrv.SetRuleset(pOurTcpsrv, inst->pBindRuleset));
+	CHKiRet(tcpsrv.SetStreamDecompress(pOurTcpsrv, inst->bStreamDecompress));
 	CHKiRet(tcpsrv.SetInputName(pOurTcpsrv, inst->pszInputName == NULL ?
 						UCHAR_CONSTANT("imtcp") : inst->pszInputName));
 	tcpsrv.configureTCPListen(pOurTcpsrv, inst->pszBindPort, inst->bSuppOctetFram);
@@ -376,6 +380,19 @@ CODESTARTnewInpInst
 			inst->pszBindRuleset = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(inppblk.descr[i].name, "supportOctetCountedFraming")) {
 			inst->bSuppOctetFram = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "compression.mode")) {
+			if(!es_strcasebufcmp(pvals[i].val.d.estr, (uchar*)"stream:always", 13)) {
+				inst->bStreamDecompress = 1;
+			} else if(!es_strcasebufcmp(pvals[i].val.d.estr, (uchar*)"none", 4)) {
+				inst->bStreamDecompress = 0;
+			} else {
+				uchar *str;
+				str = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+				errmsg.LogError(0, RS_RET_INVALID_PARAMS,
+						"imtcp: invalid compression.mode \"%s\"", str);
+				free(str);
+				ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+			}
 		} else {
 			dbgprintf("imtcp: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
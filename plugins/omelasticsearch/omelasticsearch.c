@@ -30,6 +30,8 @@
 #include <string.h>
 #include <curl/curl.h>
 #include <curl/easy.h>
+#include <curl/multi.h>
+#include <sys/select.h>
 #include <assert.h>
 #include <signal.h>
 #include <errno.h>
@@ -85,6 +87,8 @@ typedef struct _instanceData {
 	} batch;
 	CURL	*curlHandle;	/* libcurl session handle */
 	HEADER	*postHeader;	/* json POST request info */
+	CURLM	*curlMulti;	/* for asynchronous bulk posts, NULL if not used */
+	char	*postPending;	/* bulk request still in flight, NULL if none */
 } instanceData;
 
 
@@ -122,8 +126,26 @@ CODESTARTisCompatibleWithFeature
 		iRet = RS_RET_OK;
 ENDisCompatibleWithFeature
 
+/* abort a bulk request that may still be in flight and free the
+ * multi handle.
+ */
+static void
+curlMultiCleanup(instanceData *pData)
+{
+	if(pData->curlMulti == NULL)
+		return;
+	if(pData->postPending != NULL) {
+		curl_multi_remove_handle(pData->curlMulti, pData->curlHandle);
+		free(pData->postPending);
+		pData->postPending = NULL;
+	}
+	curl_multi_cleanup(pData->curlMulti);
+	pData->curlMulti = NULL;
+}
+
 BEGINfreeInstance
 CODESTARTfreeInstance
+	curlMultiCleanup(pData);
 	if (pData->postHeader) {
 		curl_slist_free_all(pData->postHeader);
 		pData->postHeader = NULL;
@@ -373,6 +395,26 @@ finalize_it:
 	RETiRet;
 }
 
+/* map the outcome of a post to our return code */
+static inline rsRetVal
+curlPostResult(CURLcode code)
+{
+	switch (code) {
+		case CURLE_COULDNT_RESOLVE_HOST:
+		case CURLE_COULDNT_RESOLVE_PROXY:
+		case CURLE_COULDNT_CONNECT:
+		case CURLE_WRITE_ERROR:
+			STATSCOUNTER_INC(indexConFail, mutIndexConFail);
+			DBGPRINTF("omelasticsearch: we are suspending ourselfs due "
+				  "to failure %lld of curl post\n",
+				  (long long) code);
+			return RS_RET_SUSPENDED;
+		default:
+			STATSCOUNTER_INC(indexSubmit, mutIndexSubmit);
+			return RS_RET_OK;
+	}
+}
+
 static rsRetVal
 curlPost(instanceData *instance, uchar *message, int msglen, uchar **tpls)
 {
@@ -389,20 +431,96 @@ curlPost(instanceData *instance, uchar *message, int msglen, uchar **tpls)
 dbgprintf("omelasticsearch: do curl_easy_perform()\n");
 	code = curl_easy_perform(curl);
 DBGPRINTF("omelasticsearch: curl_easy_perform() returned %lld\n", (long long) code);
-	switch (code) {
-		case CURLE_COULDNT_RESOLVE_HOST:
-		case CURLE_COULDNT_RESOLVE_PROXY:
-		case CURLE_COULDNT_CONNECT:
-		case CURLE_WRITE_ERROR:
-			STATSCOUNTER_INC(indexConFail, mutIndexConFail);
-			DBGPRINTF("omelasticsearch: we are suspending ourselfs due "
-				  "to failure %lld of curl_easy_perform()\n",
-				  (long long) code);
-			return RS_RET_SUSPENDED;
-		default:
-			STATSCOUNTER_INC(indexSubmit, mutIndexSubmit);
-			return RS_RET_OK;
+	iRet = curlPostResult(code);
+finalize_it:
+	RETiRet;
+}
+
+
+/* start posting a bulk request without waiting for its completion. The
+ * request buffer is now owned by us and freed when the post is complete,
+ * which is checked by curlPostWait().
+ */
+static rsRetVal
+curlPostStart(instanceData *pData, char *request)
+{
+	CURL *curl = pData->curlHandle;
+	int running;
+	DEFiRet;
+
+	pData->postPending = request;
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, request);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(request));
+	if(curl_multi_add_handle(pData->curlMulti, curl) != CURLM_OK) {
+		DBGPRINTF("omelasticsearch: curl_multi_add_handle() failed\n");
+		pData->postPending = NULL;
+		free(request);
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+	/* get the request going, the rest is done while we wait */
+	curl_multi_perform(pData->curlMulti, &running);
+	iRet = RS_RET_COMMIT_PENDING;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* wait until the bulk request started by curlPostStart() is complete
+ * and return its result.
+ */
+static rsRetVal
+curlPostWait(instanceData *pData)
+{
+	CURLMsg *msg;
+	CURLcode code = CURLE_OK;
+	fd_set fdread, fdwrite, fdexcep;
+	struct timeval tvSelect;
+	long timeout;
+	int maxfd;
+	int running;
+	int msgsLeft;
+	DEFiRet;
+
+	if(pData->postPending == NULL)
+		FINALIZE;
+
+	while(curl_multi_perform(pData->curlMulti, &running) == CURLM_CALL_MULTI_PERFORM)
+		/* just retry */;
+	while(running > 0) {
+		FD_ZERO(&fdread);
+		FD_ZERO(&fdwrite);
+		FD_ZERO(&fdexcep);
+		maxfd = -1;
+		curl_multi_fdset(pData->curlMulti, &fdread, &fdwrite, &fdexcep, &maxfd);
+		curl_multi_timeout(pData->curlMulti, &timeout);
+		if(timeout < 0 || timeout > 1000)
+			timeout = 1000;
+		tvSelect.tv_sec = timeout / 1000;
+		tvSelect.tv_usec = (timeout % 1000) * 1000;
+		if(maxfd == -1) {
+			/* curl has nothing to wait on yet, so we just sleep a bit */
+			if(tvSelect.tv_sec == 0 && tvSelect.tv_usec > 100000)
+				tvSelect.tv_usec = 100000;
+			select(0, NULL, NULL, NULL, &tvSelect);
+		} else {
+			select(maxfd + 1, &fdread, &fdwrite, &fdexcep, &tvSelect);
+		}
+		while(curl_multi_perform(pData->curlMulti, &running) == CURLM_CALL_MULTI_PERFORM)
+			/* just retry */;
 	}
+
+	while((msg = curl_multi_info_read(pData->curlMulti, &msgsLeft)) != NULL) {
+		if(msg->msg == CURLMSG_DONE && msg->easy_handle == pData->curlHandle)
+			code = msg->data.result;
+	}
+	curl_multi_remove_handle(pData->curlMulti, pData->curlHandle);
+	free(pData->postPending);
+	pData->postPending = NULL;
+DBGPRINTF("omelasticsearch: asynchronous post returned %lld\n", (long long) code);
+	iRet = curlPostResult(code);
+
 finalize_it:
 	RETiRet;
 }
@@ -433,18 +551,57 @@ dbgprintf("omelasticsearch: result doAction: %d (bulkmode %d)\n", iRet, pData->b
 ENDdoAction
 
 
+/* batch interface: in bulk mode, all messages of the batch are added to
+ * the bulk request, which is then posted by endTransaction(). A message
+ * that cannot be added does not affect the rest of the batch.
+ */
+BEGINdoActionBatch
+	int i;
+	uchar **tpls;
+CODESTARTdoActionBatch
+	for(i = 0 ; i < nElem ; ++i) {
+		tpls = (uchar**) pppParams[i];
+		if(pData->bulkmode) {
+			pRetElem[i] = buildBatch(pData, tpls[0], tpls);
+		} else {
+			pRetElem[i] = curlPost(pData, tpls[0], strlen((char*)tpls[0]), tpls);
+			if(pRetElem[i] == RS_RET_SUSPENDED)
+				ABORT_FINALIZE(RS_RET_SUSPENDED);
+		}
+	}
+finalize_it:
+dbgprintf("omelasticsearch: result doActionBatch: %d (%d messages, bulkmode %d)\n",
+	  iRet, nElem, pData->bulkmode);
+ENDdoActionBatch
+
+
+/* in bulk mode, the request is only started here. The core either continues
+ * with the next batch and calls waitCommit() later, or does so right away.
+ */
 BEGINendTransaction
 	char *cstr;
 CODESTARTendTransaction
 dbgprintf("omelasticsearch: endTransaction init\n");
 	cstr = es_str2cstr(pData->batch.data, NULL);
 	dbgprintf("omelasticsearch: endTransaction, batch: '%s'\n", cstr);
-	CHKiRet(curlPost(pData, (uchar*) cstr, strlen(cstr), NULL));
+	if(pData->curlMulti != NULL) {
+		iRet = curlPostStart(pData, cstr);
+		cstr = NULL; /* now owned by the pending post */
+	} else {
+		CHKiRet(curlPost(pData, (uchar*) cstr, strlen(cstr), NULL));
+	}
 finalize_it:
 	free(cstr);
 dbgprintf("omelasticsearch: endTransaction done with %d\n", iRet);
 ENDendTransaction
 
+
+BEGINwaitCommit
+CODESTARTwaitCommit
+	iRet = curlPostWait(pData);
+dbgprintf("omelasticsearch: waitCommit done with %d\n", iRet);
+ENDwaitCommit
+
 /* elasticsearch POST result string ... useful for debugging */
 size_t
 curlResult(void *ptr, size_t size, size_t nmemb, void *userdata)
@@ -500,6 +657,16 @@ curlSetup(instanceData *pData)
 
 	pData->curlHandle = handle;
 	pData->postHeader = header;
+	pData->postPending = NULL;
+	pData->curlMulti = NULL;
+	if(pData->bulkmode) {
+		/* bulk requests are posted asynchronously; if we can not do that,
+		 * we still can post them synchronously.
+		 */
+		pData->curlMulti = curl_multi_init();
+		if(pData->curlMulti == NULL)
+			DBGPRINTF("omelasticsearch: curl_multi_init() failed, posting synchronously\n");
+	}
 
 	if(    pData->bulkmode
 	   || (pData->dynSrchIdx == 0 && pData->dynSrchType == 0 && pData->dynParent == 0)) {
@@ -516,6 +683,38 @@ curlSetup(instanceData *pData)
 	return RS_RET_OK;
 }
 
+
+/* each worker instance has a curl session (and bulk request) of its own,
+ * so that multiple requests can be in flight for the same action.
+ */
+BEGINcreateWrkrInstance
+CODESTARTcreateWrkrInstance
+	pWrkrData->curlHandle = NULL;
+	pWrkrData->postHeader = NULL;
+	pWrkrData->curlMulti = NULL;
+	pWrkrData->postPending = NULL;
+	pWrkrData->batch.data = NULL;
+	if(pWrkrData->bulkmode) {
+		CHKmalloc(pWrkrData->batch.data = es_newStr(1024));
+	}
+	CHKiRet(curlSetup(pWrkrData));
+finalize_it:
+	if(iRet != RS_RET_OK && pWrkrData->batch.data != NULL)
+		es_deleteStr(pWrkrData->batch.data);
+ENDcreateWrkrInstance
+
+
+BEGINfreeWrkrInstance
+CODESTARTfreeWrkrInstance
+	curlMultiCleanup(pData);
+	if(pData->postHeader != NULL)
+		curl_slist_free_all(pData->postHeader);
+	if(pData->curlHandle != NULL)
+		curl_easy_cleanup(pData->curlHandle);
+	if(pData->batch.data != NULL)
+		es_deleteStr(pData->batch.data);
+ENDfreeWrkrInstance
+
 static inline void
 setInstParamDefaults(instanceData *pData)
 {
@@ -708,6 +907,9 @@ CODEqueryEtryPt_STD_OMOD_QUERIES
 CODEqueryEtryPt_IsCompatibleWithFeature_IF_OMOD_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
 CODEqueryEtryPt_TXIF_OMOD_QUERIES /* we support the transactional interface! */
+CODEqueryEtryPt_BATCHIF_OMOD_QUERIES
+CODEqueryEtryPt_WRKRINST_OMOD_QUERIES
+CODEqueryEtryPt_WAITCOMMIT_OMOD_QUERIES
 ENDqueryEtryPt
 
 
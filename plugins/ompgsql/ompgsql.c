@@ -109,6 +109,22 @@ CODESTARTfreeInstance
 ENDfreeInstance
 
 
+/* each worker instance uses a database connection of its own, which is
+ * opened on first use (the begin of its first transaction).
+ */
+BEGINcreateWrkrInstance
+CODESTARTcreateWrkrInstance
+	pWrkrData->f_hpgsql = NULL;
+	pWrkrData->eLastPgSQLStatus = CONNECTION_OK;
+ENDcreateWrkrInstance
+
+
+BEGINfreeWrkrInstance
+CODESTARTfreeWrkrInstance
+	closePgSQL(pData);
+ENDfreeWrkrInstance
+
+
 BEGINdbgPrintInstInfo
 CODESTARTdbgPrintInstInfo
 	/* nothing special here */
@@ -362,6 +378,7 @@ BEGINqueryEtryPt
 CODESTARTqueryEtryPt
 CODEqueryEtryPt_STD_OMOD_QUERIES
 CODEqueryEtryPt_TXIF_OMOD_QUERIES /* we support the transactional interface! */
+CODEqueryEtryPt_WRKRINST_OMOD_QUERIES
 ENDqueryEtryPt
 
 
@@ -57,11 +57,13 @@ DEF_OMOD_STATIC_DATA
 
 typedef struct _instanceData {
 	int bUseArrayInterface;		/* uses action use array instead of string template interface? */
+	int bUseJSONInterface;		/* uses action pre-serialized JSON instead of string template interface? */
 	int bEnsureLFEnding;		/* ensure that a linefeed is written at the end of EACH record (test aid for nettester) */
 } instanceData;
 
 typedef struct configSettings_s {
 	int bUseArrayInterface;		/* shall action use array instead of string template interface? */
+	int bUseJSONInterface;		/* shall action use pre-serialized JSON instead of string template interface? */
 	int bEnsureLFEnding;		/* shall action use array instead of string template interface? */
 } configSettings_t;
 static configSettings_t cs;
@@ -133,6 +135,9 @@ CODESTARTdoAction
 		szBuf[iBuf] = '\0';
 		toWrite = szBuf;
 	} else {
+		/* note: in JSON-passing mode, we receive the serialized JSON
+		 * object as a regular string, so nothing special to do.
+		 */
 		toWrite = (char*) ppString[0];
 	}
 	len = strlen(toWrite);
@@ -159,9 +164,15 @@ CODE_STD_STRING_REQUESTparseSelectorAct(1)
 	/* check if a non-standard template is to be applied */
 	if(*(p-1) == ';')
 		--p;
-	iTplOpts = (cs.bUseArrayInterface == 0) ? 0 : OMSR_TPL_AS_ARRAY;
+	if(cs.bUseArrayInterface)
+		iTplOpts = OMSR_TPL_AS_ARRAY;
+	else if(cs.bUseJSONInterface)
+		iTplOpts = OMSR_TPL_AS_JSONSTR;
+	else
+		iTplOpts = 0;
 	CHKiRet(cflineParseTemplateName(&p, *ppOMSR, 0, iTplOpts, (uchar*) "RSYSLOG_FileFormat"));
 	pData->bUseArrayInterface = cs.bUseArrayInterface;
+	pData->bUseJSONInterface = cs.bUseJSONInterface;
 	pData->bEnsureLFEnding = cs.bEnsureLFEnding;
 CODE_STD_FINALIZERparseSelectorAct
 ENDparseSelectorAct
@@ -185,6 +196,7 @@ static rsRetVal resetConfigVariables(uchar __attribute__((unused)) *pp, void __a
 {
 	DEFiRet;
 	cs.bUseArrayInterface = 0;
+	cs.bUseJSONInterface = 0;
 	cs.bEnsureLFEnding = 1;
 	RETiRet;
 }
@@ -195,18 +207,22 @@ BEGINmodInit()
 	rsRetVal (*pomsrGetSupportedTplOpts)(unsigned long *pOpts);
 	unsigned long opts;
 	int bArrayPassingSupported;		/* does core support template passing as an array? */
+	int bJSONPassingSupported;		/* does core support template passing as serialized JSON? */
 CODESTARTmodInit
 INITLegCnfVars
 	*ipIFVersProvided = CURR_MOD_IF_VERSION; /* we only support the current interface specification */
 CODEmodInit_QueryRegCFSLineHdlr
 	/* check if the rsyslog core supports parameter passing code */
 	bArrayPassingSupported = 0;
+	bJSONPassingSupported = 0;
 	localRet = pHostQueryEtryPt((uchar*)"OMSRgetSupportedTplOpts", &pomsrGetSupportedTplOpts);
 	if(localRet == RS_RET_OK) {
 		/* found entry point, so let's see if core supports array passing */
 		CHKiRet((*pomsrGetSupportedTplOpts)(&opts));
 		if(opts & OMSR_TPL_AS_ARRAY)
 			bArrayPassingSupported = 1;
+		if(opts & OMSR_TPL_AS_JSONSTR)
+			bJSONPassingSupported = 1;
 	} else if(localRet != RS_RET_ENTRY_POINT_NOT_FOUND) {
 		ABORT_FINALIZE(localRet); /* Something else went wrong, what is not acceptable */
 	}
@@ -217,6 +233,10 @@ CODEmodInit_QueryRegCFSLineHdlr
 		CHKiRet(omsdRegCFSLineHdlr((uchar *)"actionomstdoutarrayinterface", 0, eCmdHdlrBinary, NULL,
 			                   &cs.bUseArrayInterface, STD_LOADABLE_MODULE_ID));
 	}
+	if(bJSONPassingSupported) {
+		CHKiRet(omsdRegCFSLineHdlr((uchar *)"actionomstdoutjsoninterface", 0, eCmdHdlrBinary, NULL,
+			                   &cs.bUseJSONInterface, STD_LOADABLE_MODULE_ID));
+	}
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"actionomstdoutensurelfending", 0, eCmdHdlrBinary, NULL,
 				   &cs.bEnsureLFEnding, STD_LOADABLE_MODULE_ID));
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"resetconfigvariables", 1, eCmdHdlrCustomHandler,
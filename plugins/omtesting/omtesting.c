@@ -19,6 +19,12 @@
  * Must be specified exactly as above. Keep in mind milliseconds are a millionth
  * of a second!
  *
+ * :omtesting:pendingcommit <file>
+ *
+ * Buffers the messages of a transaction and leaves its commit pending. The
+ * messages are written to <file> when the core completes the commit via
+ * waitCommit(). Used to test overlapping commits.
+ *
  * NOTE: read comments in module-template.h to understand how this file
  *       works!
  *
@@ -49,6 +55,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "dirty.h"
 #include "syslogd-types.h"
 #include "module-template.h"
@@ -65,7 +73,7 @@ DEF_OMOD_STATIC_DATA
 
 
 typedef struct _instanceData {
-	enum { MD_SLEEP, MD_FAIL, MD_RANDFAIL, MD_ALWAYS_SUSPEND }
+	enum { MD_SLEEP, MD_FAIL, MD_RANDFAIL, MD_ALWAYS_SUSPEND, MD_PENDING_COMMIT }
 		mode;
 	int	bEchoStdout;
 	int	iWaitSeconds;
@@ -74,6 +82,10 @@ typedef struct _instanceData {
 	int	iFailFrequency;
 	int	iResumeAfter;
 	int	iCurrRetries;
+	char	*pszFile;	/* pendingcommit: file to write to */
+	uchar	*pBuf;		/* pendingcommit: messages of the pending transaction */
+	size_t	lenBuf;
+	size_t	sizeBuf;
 } instanceData;
 
 typedef struct configSettings_s {
@@ -152,6 +164,28 @@ static rsRetVal doSleep(instanceData *pData)
 }
 
 
+/* implement "pendingcommit" command: buffer the message until commit */
+static rsRetVal doPendingCommit(instanceData *pData, uchar *psz)
+{
+	size_t len;
+	uchar *pNewBuf;
+	DEFiRet;
+
+	len = strlen((char*) psz);
+	if(pData->lenBuf + len > pData->sizeBuf) {
+		CHKmalloc(pNewBuf = realloc(pData->pBuf, pData->sizeBuf + len + 4096));
+		pData->pBuf = pNewBuf;
+		pData->sizeBuf += len + 4096;
+	}
+	memcpy(pData->pBuf + pData->lenBuf, psz, len);
+	pData->lenBuf += len;
+	iRet = RS_RET_DEFER_COMMIT;
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* implement "randomfail" command */
 static rsRetVal doRandFail(void)
 {
@@ -181,6 +215,9 @@ CODESTARTtryResume
 			break;
 		case MD_ALWAYS_SUSPEND:
 			iRet = RS_RET_SUSPENDED;
+			break;
+		case MD_PENDING_COMMIT:
+			break;
 	}
 	dbgprintf("omtesting tryResume() returns iRet %d\n", iRet);
 ENDtryResume
@@ -202,6 +239,9 @@ CODESTARTdoAction
 		case MD_ALWAYS_SUSPEND:
 			iRet = RS_RET_SUSPENDED;
 			break;
+		case MD_PENDING_COMMIT:
+			iRet = doPendingCommit(pData, ppString[0]);
+			break;
 	}
 
 	if(iRet == RS_RET_OK && pData->bEchoStdout) {
@@ -212,11 +252,63 @@ CODESTARTdoAction
 ENDdoAction
 
 
+BEGINbeginTransaction
+CODESTARTbeginTransaction
+	pData->lenBuf = 0; /* a failed transaction is retried by the core */
+ENDbeginTransaction
+
+
+BEGINendTransaction
+CODESTARTendTransaction
+	if(pData->mode == MD_PENDING_COMMIT)
+		iRet = RS_RET_COMMIT_PENDING;
+ENDendTransaction
+
+
+/* complete the commit of "pendingcommit": write what we have buffered */
+BEGINwaitCommit
+	int fd;
+	ssize_t lenWritten;
+CODESTARTwaitCommit
+	if(pData->mode != MD_PENDING_COMMIT || pData->lenBuf == 0)
+		FINALIZE;
+	if((fd = open(pData->pszFile, O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, 0644)) == -1)
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	lenWritten = write(fd, pData->pBuf, pData->lenBuf);
+	close(fd);
+	if(lenWritten != (ssize_t) pData->lenBuf)
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	dbgprintf("omtesting: pending commit of %d bytes completed\n", (int) pData->lenBuf);
+	pData->lenBuf = 0;
+finalize_it:
+ENDwaitCommit
+
+
+/* Only "pendingcommit" uses worker instances. For all other modes, the
+ * counters must be shared by all threads, so we decline and the core
+ * uses the first instance.
+ */
+BEGINcreateWrkrInstance
+CODESTARTcreateWrkrInstance
+	if(pData->mode != MD_PENDING_COMMIT)
+		ABORT_FINALIZE(RS_RET_NOT_IMPLEMENTED);
+	pWrkrData->pBuf = NULL;
+	pWrkrData->lenBuf = 0;
+	pWrkrData->sizeBuf = 0;
+finalize_it:
+ENDcreateWrkrInstance
+
+
+BEGINfreeWrkrInstance
+CODESTARTfreeWrkrInstance
+	free(pData->pBuf);
+ENDfreeWrkrInstance
+
+
 BEGINfreeInstance
 CODESTARTfreeInstance
-	/* we do not have instance data, so we do not need to
-	 * do anything here. -- rgerhards, 2007-07-25
-	 */
+	free(pData->pszFile);
+	free(pData->pBuf);
 ENDfreeInstance
 
 
@@ -293,6 +385,16 @@ CODE_STD_STRING_REQUESTparseSelectorAct(1)
 		pData->mode = MD_RANDFAIL;
 	} else if(!strcmp((char*) szBuf, "always_suspend")) {
 		pData->mode = MD_ALWAYS_SUSPEND;
+	} else if(!strcmp((char*) szBuf, "pendingcommit")) {
+		/* parse file name */
+		for(i = 0 ; *p && !isspace(*p) && *p != ';' && ((unsigned) i < sizeof(szBuf) - 1) ; ++i) {
+			szBuf[i] = *p++;
+		}
+		szBuf[i] = '\0';
+		if(isspace(*p))
+			++p;
+		CHKmalloc(pData->pszFile = strdup((char*) szBuf));
+		pData->mode = MD_PENDING_COMMIT;
 	} else {
 		dbgprintf("invalid mode '%s', doing 'sleep 1 0' - fix your config\n", szBuf);
 	}
@@ -313,6 +415,9 @@ ENDmodExit
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
 CODEqueryEtryPt_STD_OMOD_QUERIES
+CODEqueryEtryPt_TXIF_OMOD_QUERIES
+CODEqueryEtryPt_WRKRINST_OMOD_QUERIES
+CODEqueryEtryPt_WAITCOMMIT_OMOD_QUERIES
 ENDqueryEtryPt
 
 
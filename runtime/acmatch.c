@@ -0,0 +1,289 @@
+/* acmatch.c
+ * A multi-pattern string matcher based on the Aho-Corasick algorithm.
+ * It is used by the rule engine to evaluate a larger number of
+ * "contains" and "startswith" filters on the same property with a
+ * single pass over the property value (instead of one pass per filter).
+ *
+ * Patterns are added first, then the automaton is built by
+ * acmatchConstructFinalize(). To keep the transition table small, the
+ * input bytes are mapped to "byte classes": every byte that occurs in
+ * one of the patterns gets its own class, all other bytes share class 0,
+ * which always leads back to the root state. With typical (ASCII)
+ * patterns this reduces the table size by a factor of 4 or more.
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rsyslog.h"
+#include "srUtils.h"
+#include "acmatch.h"
+
+typedef struct acpat_s {
+	uchar *pat;		/* pattern (not \0-terminated) */
+	size_t len;		/* length of pattern */
+	sbool bAnchored;	/* must match at the start of the string ("startswith")? */
+} acpat_t;
+
+struct acmatch_s {
+	int nPatterns;
+	int maxPatterns;	/* currently allocated size of pats */
+	acpat_t *pats;
+	int *alwaysMatch;	/* patterns of size zero - they always match */
+	int nAlwaysMatch;
+	sbool bHasUnanchored;	/* do we need to scan the whole string? */
+	size_t maxAnchoredLen;	/* if not, this is how far we need to look */
+	/* the automaton itself (valid after finalize) */
+	uchar cls[256];		/* byte -> byte class mapping */
+	int nClasses;
+	int nStates;
+	int *delta;		/* transition table, nStates * nClasses */
+	int *outHead;		/* first pattern ending in state, -1 if none */
+	int *outNext;		/* next pattern ending in the same state (per pattern) */
+	int *dictLink;		/* next state on fail chain with an output, -1 if none */
+};
+
+
+/* construct a (yet empty) matcher */
+rsRetVal
+acmatchConstruct(acmatch_t **ppThis)
+{
+	acmatch_t *pThis;
+	DEFiRet;
+
+	CHKmalloc(pThis = calloc(1, sizeof(acmatch_t)));
+	*ppThis = pThis;
+finalize_it:
+	RETiRet;
+}
+
+
+/* add a pattern. Patterns are numbered in the order they are added,
+ * starting at zero. This number is the index into the result array
+ * of acmatchScan(). The pattern is copied, so the caller may free
+ * its buffer after the call.
+ */
+rsRetVal
+acmatchAddPattern(acmatch_t *pThis, uchar *pat, size_t lenPat, sbool bAnchored)
+{
+	acpat_t *newpats;
+	acpat_t *pPat;
+	DEFiRet;
+
+	assert(pThis->delta == NULL); /* not yet finalized */
+	if(pThis->nPatterns == pThis->maxPatterns) {
+		CHKmalloc(newpats = realloc(pThis->pats,
+			  sizeof(acpat_t) * (pThis->maxPatterns + 16)));
+		pThis->pats = newpats;
+		pThis->maxPatterns += 16;
+	}
+	pPat = pThis->pats + pThis->nPatterns;
+	CHKmalloc(pPat->pat = malloc(lenPat + 1));
+	memcpy(pPat->pat, pat, lenPat);
+	pPat->len = lenPat;
+	pPat->bAnchored = bAnchored;
+	++pThis->nPatterns;
+
+	if(bAnchored) {
+		if(lenPat > pThis->maxAnchoredLen)
+			pThis->maxAnchoredLen = lenPat;
+	} else {
+		pThis->bHasUnanchored = 1;
+	}
+finalize_it:
+	RETiRet;
+}
+
+
+/* build the automaton. This is done in three steps: first, the byte
+ * classes are computed, then the patterns are inserted into a trie and
+ * finally the fail transitions are computed by a breadth-first walk of
+ * the trie. The fail transitions are folded into the transition table,
+ * so that scanning needs exactly one table lookup per input byte.
+ */
+rsRetVal
+acmatchConstructFinalize(acmatch_t *pThis)
+{
+	int i, c;
+	size_t j;
+	int maxStates;
+	int s, t;
+	int nCls;
+	int *fail = NULL;
+	int *queue = NULL;
+	int qHead, qTail;
+	acpat_t *pPat;
+	DEFiRet;
+
+	/* byte classes */
+	memset(pThis->cls, 0, sizeof(pThis->cls));
+	nCls = 1;
+	maxStates = 1;
+	for(i = 0 ; i < pThis->nPatterns ; ++i) {
+		pPat = pThis->pats + i;
+		for(j = 0 ; j < pPat->len ; ++j) {
+			if(pThis->cls[pPat->pat[j]] == 0)
+				pThis->cls[pPat->pat[j]] = nCls++;
+		}
+		maxStates += pPat->len;
+	}
+	pThis->nClasses = nCls;
+
+	CHKmalloc(pThis->delta = calloc(maxStates * nCls, sizeof(int)));
+	CHKmalloc(pThis->outHead = malloc(maxStates * sizeof(int)));
+	CHKmalloc(pThis->dictLink = malloc(maxStates * sizeof(int)));
+	CHKmalloc(pThis->outNext = malloc((pThis->nPatterns + 1) * sizeof(int)));
+	CHKmalloc(pThis->alwaysMatch = malloc((pThis->nPatterns + 1) * sizeof(int)));
+	CHKmalloc(fail = malloc(maxStates * sizeof(int)));
+	CHKmalloc(queue = malloc(maxStates * sizeof(int)));
+	for(s = 0 ; s < maxStates ; ++s)
+		pThis->outHead[s] = -1;
+
+	/* trie - a transition to state 0 means "no child" during this step,
+	 * as the root can never be a child.
+	 */
+	pThis->nStates = 1;
+	for(i = 0 ; i < pThis->nPatterns ; ++i) {
+		pPat = pThis->pats + i;
+		if(pPat->len == 0) {
+			pThis->alwaysMatch[pThis->nAlwaysMatch++] = i;
+			continue;
+		}
+		s = 0;
+		for(j = 0 ; j < pPat->len ; ++j) {
+			c = pThis->cls[pPat->pat[j]];
+			if(pThis->delta[s * nCls + c] == 0)
+				pThis->delta[s * nCls + c] = pThis->nStates++;
+			s = pThis->delta[s * nCls + c];
+		}
+		pThis->outNext[i] = pThis->outHead[s];
+		pThis->outHead[s] = i;
+	}
+
+	/* fail transitions. The root's children fail back to the root, all
+	 * other states are handled in BFS order, so that the (shallower) fail
+	 * state is always complete when it is used.
+	 */
+	qHead = qTail = 0;
+	fail[0] = 0;
+	pThis->dictLink[0] = -1;
+	for(c = 1 ; c < nCls ; ++c) {
+		t = pThis->delta[c];
+		if(t != 0) {
+			fail[t] = 0;
+			pThis->dictLink[t] = -1;
+			queue[qTail++] = t;
+		}
+	}
+	while(qHead < qTail) {
+		s = queue[qHead++];
+		for(c = 1 ; c < nCls ; ++c) {
+			t = pThis->delta[s * nCls + c];
+			if(t != 0) {
+				fail[t] = pThis->delta[fail[s] * nCls + c];
+				pThis->dictLink[t] = (pThis->outHead[fail[t]] != -1) ?
+							fail[t] : pThis->dictLink[fail[t]];
+				queue[qTail++] = t;
+			} else {
+				pThis->delta[s * nCls + c] = pThis->delta[fail[s] * nCls + c];
+			}
+		}
+	}
+	DBGPRINTF("acmatch %p: %d patterns, %d states, %d byte classes\n",
+		  pThis, pThis->nPatterns, pThis->nStates, nCls);
+
+finalize_it:
+	free(fail);
+	free(queue);
+	RETiRet;
+}
+
+
+void
+acmatchDestruct(acmatch_t **ppThis)
+{
+	acmatch_t *pThis = *ppThis;
+	int i;
+
+	if(pThis == NULL)
+		return;
+	for(i = 0 ; i < pThis->nPatterns ; ++i)
+		free(pThis->pats[i].pat);
+	free(pThis->pats);
+	free(pThis->alwaysMatch);
+	free(pThis->delta);
+	free(pThis->outHead);
+	free(pThis->outNext);
+	free(pThis->dictLink);
+	free(pThis);
+	*ppThis = NULL;
+}
+
+
+/* scan a \0-terminated string. For each pattern found, the corresponding
+ * entry in pbMatched is set to 1. The caller must have zeroed pbMatched,
+ * which must be able to hold one entry per pattern. Anchored patterns are
+ * only reported if they match at the start of the string. The scan stops
+ * as soon as all patterns have been found or, if there are only anchored
+ * patterns, when the longest of them has been checked.
+ * Returns the number of patterns found.
+ */
+int
+acmatchScan(acmatch_t *pThis, uchar *psz, sbool *pbMatched)
+{
+	uchar *p;
+	int s, o, k;
+	int nFound = 0;
+	const int nCls = pThis->nClasses;
+	const int *const delta = pThis->delta;
+
+	for(k = 0 ; k < pThis->nAlwaysMatch ; ++k) {
+		pbMatched[pThis->alwaysMatch[k]] = 1;
+		++nFound;
+	}
+	if(nFound == pThis->nPatterns)
+		goto done;
+
+	s = 0;
+	for(p = psz ; *p != '\0' ; ++p) {
+		if(!pThis->bHasUnanchored && (size_t) (p - psz) >= pThis->maxAnchoredLen)
+			break;
+		s = delta[s * nCls + pThis->cls[*p]];
+		o = (pThis->outHead[s] != -1) ? s : pThis->dictLink[s];
+		for( ; o != -1 ; o = pThis->dictLink[o]) {
+			for(k = pThis->outHead[o] ; k != -1 ; k = pThis->outNext[k]) {
+				if(pbMatched[k])
+					continue;
+				if(pThis->pats[k].bAnchored && (size_t) (p - psz) + 1 != pThis->pats[k].len)
+					continue;
+				pbMatched[k] = 1;
+				if(++nFound == pThis->nPatterns)
+					goto done;
+			}
+		}
+	}
+done:
+	return nFound;
+}
+
+/* vi:set ai:
+ */
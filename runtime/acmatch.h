@@ -0,0 +1,33 @@
+/* Definitions for the multi-pattern string matcher.
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDED_ACMATCH_H
+#define INCLUDED_ACMATCH_H
+
+typedef struct acmatch_s acmatch_t;
+
+rsRetVal acmatchConstruct(acmatch_t **ppThis);
+rsRetVal acmatchAddPattern(acmatch_t *pThis, uchar *pat, size_t lenPat, sbool bAnchored);
+rsRetVal acmatchConstructFinalize(acmatch_t *pThis);
+void acmatchDestruct(acmatch_t **ppThis);
+int acmatchScan(acmatch_t *pThis, uchar *psz, sbool *pbMatched);
+
+#endif /* #ifndef INCLUDED_ACMATCH_H */
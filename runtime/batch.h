@@ -27,6 +27,7 @@
 #define BATCH_H_INCLUDED
 
 #include <string.h>
+#include "template.h"
 #include "msg.h"
 
 /* enum for batch states. Actually, we violate a layer here, in that we assume that a batch is used
@@ -58,6 +59,12 @@ struct batch_obj_s {
 	void *staticActParams[CONF_OMOD_NUMSTRINGS_MAXSIZE]; /**< for anything else */
 	size_t staticLenStrings[CONF_OMOD_NUMSTRINGS_MAXSIZE];
 				/* and the same for the message length (if used) */
+	struct template *pTplRendered[CONF_OMOD_NUMSTRINGS_MAXSIZE];
+				/* template staticActStrings was rendered from (NULL if none).
+				 * Actions using the same template share this string read-only,
+				 * so a message is rendered only once for all of them. */
+	tplIov_t *staticActIov[CONF_OMOD_NUMSTRINGS_MAXSIZE];
+				/* scatter lists for iovec passing, allocated on first use */
 	/* end action work variables */
 };
 
@@ -84,6 +91,11 @@ struct batch_s {
 	int *pbShutdownImmediate;/* end processing of this batch immediately if set to 1 */
 	sbool *active;		/* which messages are active for processing, NULL=all */
 	sbool bSingleRuleset;	/* do all msgs of this batch use a single ruleset? */
+	sbool bCanPend;		/* may the consumer leave the commit of this batch pending? */
+	void *pCommitPending;	/* set by consumer if commit is still in progress (consumer handle) */
+	void (*pfAbandonCommit)(void *pCommitPending); /* called if the batch is deleted before
+				 * the consumer completed its pending commit */
+	struct batch_s *pPending; /* batch with pending commit, must be completed by the consumer */
 	batch_obj_t *pElem;	/* batch elements */
 };
 
@@ -150,6 +162,25 @@ batchCopyElem(batch_obj_t *pDest, batch_obj_t *pSrc) {
 }
 
 
+/* invalidate the rendered template strings of a batch element. This must
+ * be done whenever the element is re-used for another message or the
+ * message is modified.
+ */
+static inline void
+batchElemInvalidateRender(batch_obj_t *pElem) {
+	memset(pElem->pTplRendered, 0, sizeof(pElem->pTplRendered));
+}
+
+
+/* the same for all elements of a batch */
+static inline void
+batchInvalidateRender(batch_t *pBatch) {
+	int i;
+	for(i = 0 ; i < batchNumMsgs(pBatch) ; ++i)
+		batchElemInvalidateRender(&(pBatch->pElem[i]));
+}
+
+
 /* free members of a batch "object". Note that we can not do the usual
  * destruction as the object typically is allocated on the stack and so the
  * object itself cannot be freed! -- rgerhards, 2010-06-15
@@ -164,6 +195,7 @@ batchFree(batch_t *pBatch) {
 			 * so we do not need to do that!
 			 */
 			free(pBatch->pElem[i].staticActStrings[j]);
+			tplIovDestruct(pBatch->pElem[i].staticActIov[j]);
 		}
 	}
 	free(pBatch->pElem);
@@ -179,6 +211,10 @@ batchInit(batch_t *pBatch, int maxElem) {
 	DEFiRet;
 	pBatch->iDoneUpTo = 0;
 	pBatch->maxElem = maxElem;
+	pBatch->bCanPend = 0;
+	pBatch->pCommitPending = NULL;
+	pBatch->pfAbandonCommit = NULL;
+	pBatch->pPending = NULL;
 	CHKmalloc(pBatch->pElem = calloc((size_t)maxElem, sizeof(batch_obj_t)));
 	// TODO: replace calloc by inidividual writes?
 finalize_it:
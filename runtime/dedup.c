@@ -0,0 +1,181 @@
+/* Windowed duplicate suppression for actions.
+ *
+ * The classic $RepeatedMsgReduction only detects a message that is identical
+ * to the immediately preceding one, so interleaved floods from multiple
+ * sources are not reduced at all. Here, we keep the fingerprints of recently
+ * written messages in a bounded hash table instead. A message whose
+ * fingerprint was seen within the time window is suppressed and counted.
+ * Once the window has expired, a "message repeated n times" summary is
+ * emitted for it, either when the next duplicate arrives or by the periodic
+ * flush.
+ *
+ * The table has a fixed number of entries. We use open addressing and probe
+ * a small number of slots only. If all of them are in use, the entry that is
+ * oldest is evicted (after emitting its summary), so memory usage and
+ * lookup cost are bounded no matter how many different messages arrive.
+ *
+ * Callers must serialize access to a table (actions use mutAction).
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "rsyslog.h"
+#include "msg.h"
+#include "dedup.h"
+
+#define DEDUP_PROBES 8	/* max number of slots we look at for a fingerprint */
+
+
+/* construct a table with (at least) maxEntries entries for a window
+ * of iWindow seconds.
+ */
+rsRetVal
+dedupConstruct(dedup_t **ppThis, int maxEntries, int iWindow)
+{
+	dedup_t *pThis = NULL;
+	unsigned nEntries;
+	DEFiRet;
+
+	if(maxEntries < DEDUP_PROBES)
+		maxEntries = DEDUP_PROBES;
+	for(nEntries = 1 ; nEntries < (unsigned) maxEntries ; nEntries <<= 1)
+		/* just search */;
+
+	CHKmalloc(pThis = calloc(1, sizeof(dedup_t)));
+	CHKmalloc(pThis->pEntries = calloc(nEntries, sizeof(dedupEntry_t)));
+	pThis->mask = nEntries - 1;
+	pThis->iWindow = iWindow;
+	*ppThis = pThis;
+
+finalize_it:
+	if(iRet != RS_RET_OK && pThis != NULL)
+		free(pThis);
+	RETiRet;
+}
+
+
+/* destruct a table. Pending summaries are discarded, just like the
+ * classic repeated message reduction does on shutdown.
+ */
+void
+dedupDestruct(dedup_t **ppThis)
+{
+	dedup_t *pThis = *ppThis;
+	unsigned i;
+
+	if(pThis == NULL)
+		return;
+	for(i = 0 ; i <= pThis->mask ; ++i) {
+		if(pThis->pEntries[i].pMsg != NULL)
+			msgDestruct(&pThis->pEntries[i].pMsg);
+	}
+	free(pThis->pEntries);
+	free(pThis);
+	*ppThis = NULL;
+}
+
+
+/* add a buffer to a fingerprint (64 bit FNV-1a). Start with DEDUP_HASH_INIT
+ * if a key consists of multiple parts.
+ */
+uint64
+dedupHash(uint64 h, uchar *p, size_t len)
+{
+	size_t i;
+
+	for(i = 0 ; i < len ; ++i) {
+		h ^= p[i];
+		h *= 1099511628211ULL; /* FNV prime */
+	}
+	return h;
+}
+
+
+/* release an entry, emitting its summary if something was suppressed */
+static inline void
+dedupRelease(dedup_t *pThis, dedupEntry_t *pEntry, dedupEmit_t pEmit, void *pUsr)
+{
+	if(pEntry->nSuppressed > 0)
+		pEmit(pUsr, pEntry->pMsg, pEntry->nSuppressed);
+	msgDestruct(&pEntry->pMsg);
+	pEntry->nSuppressed = 0;
+	--pThis->nUsed;
+}
+
+
+/* check a message with fingerprint fp. Returns 1 if it is a duplicate
+ * within the window and must be suppressed, 0 if it must be written. In
+ * the latter case, the table keeps a reference to the message, which is
+ * used for the summary if duplicates follow.
+ */
+int
+dedupCheck(dedup_t *pThis, uint64 fp, msg_t *pMsg, time_t tNow, dedupEmit_t pEmit, void *pUsr)
+{
+	dedupEntry_t *pEntry;
+	dedupEntry_t *pVictim = NULL;
+	int i;
+
+	for(i = 0 ; i < DEDUP_PROBES ; ++i) {
+		pEntry = &pThis->pEntries[(fp + i) & pThis->mask];
+		if(pEntry->pMsg == NULL) {
+			if(pVictim == NULL || pVictim->pMsg != NULL)
+				pVictim = pEntry;
+			continue;
+		}
+		if(pEntry->fp == fp) {
+			if(tNow - pEntry->tFirst < pThis->iWindow) {
+				++pEntry->nSuppressed;
+				return 1;
+			}
+			/* window expired, write this one and start a new window */
+			pVictim = pEntry;
+			break;
+		}
+		if(   pVictim == NULL
+		   || (pVictim->pMsg != NULL && pEntry->tFirst < pVictim->tFirst))
+			pVictim = pEntry;
+	}
+
+	if(pVictim->pMsg != NULL)
+		dedupRelease(pThis, pVictim, pEmit, pUsr);
+	pVictim->fp = fp;
+	pVictim->tFirst = tNow;
+	pVictim->nSuppressed = 0;
+	pVictim->pMsg = MsgAddRef(pMsg);
+	++pThis->nUsed;
+	return 0;
+}
+
+
+/* emit the summaries of all entries whose window has expired and
+ * release them. This is called periodically.
+ */
+void
+dedupFlush(dedup_t *pThis, time_t tNow, dedupEmit_t pEmit, void *pUsr)
+{
+	unsigned i;
+
+	for(i = 0 ; i <= pThis->mask && pThis->nUsed > 0 ; ++i) {
+		if(   pThis->pEntries[i].pMsg != NULL
+		   && tNow - pThis->pEntries[i].tFirst >= pThis->iWindow)
+			dedupRelease(pThis, &pThis->pEntries[i], pEmit, pUsr);
+	}
+}
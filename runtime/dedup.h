@@ -0,0 +1,52 @@
+/* Definitions for the windowed duplicate suppression of actions.
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_DEDUP_H
+#define INCLUDED_DEDUP_H
+
+#define DEDUP_HASH_INIT 14695981039346656037ULL	/* FNV-1a offset basis */
+#define DEDUP_DFLT_MAX_ENTRIES 1024
+
+/* an entry of the table, one for each recently seen fingerprint */
+typedef struct dedupEntry_s {
+	uint64	fp;		/* fingerprint of the message key */
+	time_t	tFirst;		/* time the message was last written */
+	int	nSuppressed;	/* number of messages suppressed since then */
+	msg_t	*pMsg;		/* message that was written, NULL if entry is free */
+} dedupEntry_t;
+
+typedef struct dedup_s {
+	dedupEntry_t *pEntries;
+	unsigned mask;		/* number of entries - 1 (always a power of two) */
+	int	iWindow;	/* time window in seconds */
+	int	nUsed;		/* number of entries in use */
+} dedup_t;
+
+/* called to emit a "message repeated n times" summary for pMsg */
+typedef rsRetVal (*dedupEmit_t)(void *pUsr, msg_t *pMsg, int nRepeats);
+
+/* prototypes */
+rsRetVal dedupConstruct(dedup_t **ppThis, int maxEntries, int iWindow);
+void dedupDestruct(dedup_t **ppThis);
+uint64 dedupHash(uint64 h, uchar *p, size_t len);
+int dedupCheck(dedup_t *pThis, uint64 fp, msg_t *pMsg, time_t tNow, dedupEmit_t pEmit, void *pUsr);
+void dedupFlush(dedup_t *pThis, time_t tNow, dedupEmit_t pEmit, void *pUsr);
+
+#endif /* #ifndef INCLUDED_DEDUP_H */
@@ -0,0 +1,188 @@
+/* Escape kernels for template and JSON processing.
+ *
+ * Log messages seldom contain characters that need to be escaped. So the
+ * most important operation is to find out quickly that a (long) run of
+ * characters needs no escaping at all. This is done here 16 bytes at a
+ * time via SSE2 where available and 8 bytes at a time ("SIMD within a
+ * register") otherwise. Callers then copy clean runs in bulk instead of
+ * byte by byte, and do not need to copy at all if the whole string is
+ * clean.
+ *
+ * This file intentionally does not depend on any other part of rsyslog,
+ * so that it can also be used by the testbench (escapebench).
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <string.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#	include <emmintrin.h>
+#endif
+#include "escape.h"
+
+/* chars that need to be escaped in JSON strings (RFC 4627) */
+#define JSON_NEEDS_ESC(c) ((c) < 0x20 || (c) == '"' || (c) == '\\')
+
+#ifndef __SSE2__
+/* word-at-a-time helpers. HASZERO() is non-zero if any byte of the word is
+ * zero, HASLESS() if any byte is less than n (n <= 128). They may flag the
+ * wrong byte, but never flag a word that contains no such byte, so the
+ * exact position is found by the byte loop that follows.
+ */
+#define ONES ((uint64_t) 0x0101010101010101ULL)
+#define HIGHS (ONES * 0x80)
+#define HASZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+#define HASLESS(w, n) (((w) - ONES * (n)) & ~(w) & HIGHS)
+#endif
+
+
+/* return the offset of the first char that needs to be escaped in JSON or
+ * is cExtra, or len if there is none. cExtra may be '"' if no other char
+ * shall be escaped.
+ */
+static inline size_t
+scanJSON(const unsigned char *p, size_t len, unsigned char cExtra)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	const __m128i extra = _mm_set1_epi8(cExtra);
+	const __m128i ctl = _mm_set1_epi8(0x1f);
+	__m128i v;
+	int mask;
+
+	for( ; i + 16 <= len ; i += 16) {
+		v = _mm_loadu_si128((const __m128i*) (p + i));
+		/* unsigned v <= 0x1f is the same as max(v, 0x1f) == 0x1f */
+		mask = _mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, extra),
+				     _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl))));
+		if(mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+#else
+	uint64_t w;
+
+	for( ; i + 8 <= len ; i += 8) {
+		memcpy(&w, p + i, 8);
+		if(  HASZERO(w ^ (ONES * '"')) | HASZERO(w ^ (ONES * '\\'))
+		   | HASZERO(w ^ (ONES * cExtra)) | HASLESS(w, 0x20))
+			break;
+	}
+#endif
+	for( ; i < len ; ++i)
+		if(JSON_NEEDS_ESC(p[i]) || p[i] == cExtra)
+			return i;
+	return len;
+}
+
+
+/* return the offset of the first char that needs to be escaped in JSON,
+ * or len if there is none.
+ */
+size_t
+escScanJSON(const unsigned char *p, size_t len)
+{
+	return scanJSON(p, len, '"');
+}
+
+
+/* the same, but '/' is escaped as well. This is what json-c does, so
+ * output generated with it is the same as json-c's.
+ */
+size_t
+escScanJSONSlash(const unsigned char *p, size_t len)
+{
+	return scanJSON(p, len, '/');
+}
+
+
+/* return the offset of the first occurence of either c1 or c2, or len
+ * if there is none. c1 and c2 may be the same char.
+ */
+size_t
+escScanChars(const unsigned char *p, size_t len, unsigned char c1, unsigned char c2)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i v1 = _mm_set1_epi8(c1);
+	const __m128i v2 = _mm_set1_epi8(c2);
+	__m128i v;
+	int mask;
+
+	for( ; i + 16 <= len ; i += 16) {
+		v = _mm_loadu_si128((const __m128i*) (p + i));
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, v1), _mm_cmpeq_epi8(v, v2)));
+		if(mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+#else
+	uint64_t w;
+
+	for( ; i + 8 <= len ; i += 8) {
+		memcpy(&w, p + i, 8);
+		if(HASZERO(w ^ (ONES * c1)) | HASZERO(w ^ (ONES * c2)))
+			break;
+	}
+#endif
+	for( ; i < len ; ++i)
+		if(p[i] == c1 || p[i] == c2)
+			return i;
+	return len;
+}
+
+
+/* copy src to dst, putting cEsc in front of each c1 and c2. This covers
+ * all of the template escape modes (SQL, standard SQL and the simple
+ * JSON mode). dst must be able to hold 2 * len bytes. The number of bytes
+ * written is returned, dst is NOT terminated.
+ */
+size_t
+escPrefixChars(unsigned char *dst, const unsigned char *src, size_t len,
+	       unsigned char cEsc, unsigned char c1, unsigned char c2)
+{
+	size_t iSrc = 0;
+	size_t iDst = 0;
+	size_t iShort;
+	size_t lenRun;
+	unsigned char c;
+
+	while(iSrc < len) {
+		lenRun = escScanChars(src + iSrc, len - iSrc, c1, c2);
+		memcpy(dst + iDst, src + iSrc, lenRun);
+		iSrc += lenRun;
+		iDst += lenRun;
+		/* escapes often come in clusters (e.g. quoted strings), so we
+		 * check the next few bytes one by one before we go back to
+		 * the (then probably wasted) block scan.
+		 */
+		for(iShort = iSrc + 16 ; iSrc < len && iSrc < iShort ; ++iSrc) {
+			c = src[iSrc];
+			if(c == c1 || c == c2) {
+				dst[iDst++] = cEsc;
+				iShort = iSrc + 17;
+			}
+			dst[iDst++] = c;
+		}
+	}
+	return iDst;
+}
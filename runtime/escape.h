@@ -0,0 +1,31 @@
+/* Definitions for the escape kernels used by template and JSON processing.
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_ESCAPE_H
+#define INCLUDED_ESCAPE_H
+#include <stddef.h>
+
+size_t escScanJSON(const unsigned char *p, size_t len);
+size_t escScanJSONSlash(const unsigned char *p, size_t len);
+size_t escScanChars(const unsigned char *p, size_t len, unsigned char c1, unsigned char c2);
+size_t escPrefixChars(unsigned char *dst, const unsigned char *src, size_t len,
+		      unsigned char cEsc, unsigned char c1, unsigned char c2);
+
+#endif /* #ifndef INCLUDED_ESCAPE_H */
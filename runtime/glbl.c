@@ -44,6 +44,7 @@
 #include "errmsg.h"
 #include "rainerscript.h"
 #include "net.h"
+#include "regexp.h"
 
 /* some defaults */
 #ifndef DFLT_NETSTRM_DRVR
@@ -69,6 +70,7 @@ static int iDefPFFamily = PF_UNSPEC;     /* protocol family (IPv4, IPv6 or both)
 static int bDropMalPTRMsgs = 0;/* Drop messages which have malicious PTR records during DNS lookup */
 static int option_DisallowWarning = 1;	/* complain if message from disallowed sender is received */
 static int bDisableDNS = 0; /* don't look up IP addresses of remote messages */
+static int iRegexEngine = RS_REGEX_ENGINE_POSIX; /* default engine for regular expressions */
 static prop_t *propLocalIPIF = NULL;/* IP address to report for the local host (default is 127.0.0.1) */
 static prop_t *propLocalHostName = NULL;/* our hostname as FQDN - read-only after startup */
 static uchar *LocalHostName = NULL;/* our hostname  - read-only after startup, except HUP */
@@ -100,6 +102,7 @@ static struct cnfparamdescr cnfparamdescr[] = {
 	{ "defaultnetstreamdriverkeyfile", eCmdHdlrString, 0 },
 	{ "defaultnetstreamdriver", eCmdHdlrString, 0 },
 	{ "maxmessagesize", eCmdHdlrSize, 0 },
+	{ "regexengine", eCmdHdlrGetWord, 0 },
 };
 static struct cnfparamblk paramblk =
 	{ CNFPARAMBLK_VERSION,
@@ -140,6 +143,7 @@ SIMP_PROP(DefPFFamily, iDefPFFamily, int) /* note that in the future we may chec
 SIMP_PROP(DropMalPTRMsgs, bDropMalPTRMsgs, int)
 SIMP_PROP(Option_DisallowWarning, option_DisallowWarning, int)
 SIMP_PROP(DisableDNS, bDisableDNS, int)
+SIMP_PROP(RegexEngine, iRegexEngine, int)
 SIMP_PROP(StripDomains, StripDomains, char**)
 SIMP_PROP(LocalHosts, LocalHosts, char**)
 #ifdef USE_UNLIMITED_SELECT
@@ -278,6 +282,31 @@ finalize_it:
 	RETiRet;
 }
 
+
+/* set the default regex engine. Valid values are "posix" (the system's
+ * regexec()) and "dfa" (our own engine, falls back to posix for
+ * unsupported expressions).
+ */
+static rsRetVal
+setRegexEngine(void __attribute__((unused)) *pVal, uchar *pNewVal)
+{
+	DEFiRet;
+
+	if(!strcasecmp((char*) pNewVal, "posix")) {
+		iRegexEngine = RS_REGEX_ENGINE_POSIX;
+	} else if(!strcasecmp((char*) pNewVal, "dfa")) {
+		iRegexEngine = RS_REGEX_ENGINE_DFA;
+	} else {
+		errmsg.LogError(0, RS_RET_INVALID_VALUE, "regex engine '%s' unknown, "
+				"must be 'posix' or 'dfa' - directive ignored", pNewVal);
+		ABORT_FINALIZE(RS_RET_INVALID_VALUE);
+	}
+
+finalize_it:
+	free(pNewVal);
+	RETiRet;
+}
+
 /* return our local IP.
  * If no local IP is set, "127.0.0.1" is selected *and* set. This
  * is an intensional side effect that we do in order to keep things
@@ -486,6 +515,7 @@ CODESTARTobjQueryInterface(glbl)
 	SIMP_PROP(DropMalPTRMsgs);
 	SIMP_PROP(Option_DisallowWarning);
 	SIMP_PROP(DisableDNS);
+	SIMP_PROP(RegexEngine);
 	SIMP_PROP(LocalFQDNName)
 	SIMP_PROP(LocalHostName)
 	SIMP_PROP(LocalDomain)
@@ -524,6 +554,7 @@ static rsRetVal resetConfigVariables(uchar __attribute__((unused)) *pp, void __a
 	bOptimizeUniProc = 1;
 	bPreserveFQDN = 0;
 	iMaxLine = 8192;
+	iRegexEngine = RS_REGEX_ENGINE_POSIX;
 #ifdef USE_UNLIMITED_SELECT
 	iFdSetSize = howmany(FD_SETSIZE, __NFDBITS) * sizeof (fd_mask);
 #endif
@@ -591,6 +622,9 @@ glblDoneLoadCnf(void)
 			bDropMalPTRMsgs = (int) cnfparamvals[i].val.d.n;
 		} else if(!strcmp(paramblk.descr[i].name, "maxmessagesize")) {
 			iMaxLine = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "regexengine")) {
+			cstr = (uchar*) es_str2cstr(cnfparamvals[i].val.d.estr, NULL);
+			setRegexEngine(NULL, cstr);
 		} else {
 			dbgprintf("glblDoneLoadCnf: program error, non-handled "
 			  "param '%s'\n", paramblk.descr[i].name);
@@ -622,6 +656,7 @@ BEGINAbstractObjClassInit(glbl, 1, OBJ_IS_CORE_MODULE) /* class, version */
 	CHKiRet(regCfSysLineHdlr((uchar *)"preservefqdn", 0, eCmdHdlrBinary, NULL, &bPreserveFQDN, NULL));
 	CHKiRet(regCfSysLineHdlr((uchar *)"maxmessagesize", 0, eCmdHdlrSize,
 		NULL, &iMaxLine, NULL));
+	CHKiRet(regCfSysLineHdlr((uchar *)"regexengine", 0, eCmdHdlrGetWord, setRegexEngine, NULL, NULL));
 	CHKiRet(regCfSysLineHdlr((uchar *)"resetconfigvariables", 1, eCmdHdlrCustomHandler, resetConfigVariables, NULL, NULL));
 
 	INIT_ATOMIC_HELPER_MUT(mutTerminateInputs);
@@ -78,9 +78,11 @@ BEGINinterface(glbl) /* name must also be changed in ENDinterface macro! */
 	/* next change is v9! */
 	/* v8 - 2012-03-21 */
 	prop_t* (*GetLocalHostIP)(void);
+	/* v9 - 2012-10-15 */
+	SIMP_PROP(RegexEngine, int)
 #undef	SIMP_PROP
 ENDinterface(glbl)
-#define glblCURR_IF_VERSION 7 /* increment whenever you change the interface structure! */
+#define glblCURR_IF_VERSION 9 /* increment whenever you change the interface structure! */
 /* version 2 had PreserveFQDN added - rgerhards, 2008-12-08 */
 
 /* the remaining prototypes */
@@ -151,6 +151,60 @@ static rsRetVal createInstance(instanceData **ppData)\
 	RETiRet;\
 }
 
+/* createWrkrInstance()
+ * Optional entry point for output modules that can process messages on
+ * multiple threads concurrently. It creates an additional instance for
+ * the action described by pData, which the core then uses exclusively
+ * on one action queue worker thread at a time. The new instance starts
+ * as a copy of pData, so configuration settings are shared. The module
+ * must reset everything that is per-connection or per-handle and must
+ * take care not to free shared settings in freeWrkrInstance(). Note that
+ * pData may be in use by another thread while this is called, so only
+ * its settings can be relied upon.
+ * introduced in 7.2.2
+ */
+#define BEGINcreateWrkrInstance \
+static rsRetVal createWrkrInstance(instanceData **ppWrkrData, instanceData *pData)\
+{\
+	DEFiRet; /* store error code here */\
+	instanceData *pWrkrData; /* the new instance */
+
+#define CODESTARTcreateWrkrInstance \
+	if((pWrkrData = malloc(sizeof(instanceData))) == NULL) {\
+		*ppWrkrData = NULL;\
+		ENDfunc \
+		return RS_RET_OUT_OF_MEMORY;\
+	}\
+	memcpy(pWrkrData, pData, sizeof(instanceData));
+
+#define ENDcreateWrkrInstance \
+	if(iRet != RS_RET_OK) {\
+		free(pWrkrData);\
+		pWrkrData = NULL;\
+	}\
+	*ppWrkrData = pWrkrData;\
+	RETiRet;\
+}
+
+/* freeWrkrInstance()
+ * Counterpart of createWrkrInstance(), frees an instance created by it.
+ * Only the per-instance state must be freed here, settings are still
+ * owned by the original instance (freed in freeInstance()).
+ */
+#define BEGINfreeWrkrInstance \
+static rsRetVal freeWrkrInstance(void* pModData)\
+{\
+	DEFiRet;\
+	instanceData *pData;
+
+#define CODESTARTfreeWrkrInstance \
+	pData = (instanceData*) pModData;
+
+#define ENDfreeWrkrInstance \
+	free(pData);\
+	RETiRet;\
+}
+
 /* freeInstance()
  * This is the cleanup function for the module instance. It is called immediately before
  * the module instance is destroyed (unloaded). The module should do any cleanup
@@ -220,6 +274,32 @@ static rsRetVal endTransaction(instanceData __attribute__((unused)) *pData)\
 }
 
 
+/* waitCommit()
+ * Optional entry point for modules that can commit asynchronously. If
+ * endTransaction() returns RS_RET_COMMIT_PENDING, the commit has been
+ * started but not yet completed (e.g. a request is still in flight). The
+ * core then continues with the next batch and later calls waitCommit(),
+ * which must block until the commit is complete and return its outcome
+ * just like endTransaction() would have done. Except for doHUP(), no other
+ * entry point is called for this instance in between. The module must not
+ * reference any of the message parameters after endTransaction() returned.
+ * Note that the core uses pending commits only with modules that also
+ * support worker instances. For all others, waitCommit() is called right
+ * after endTransaction().
+ * introduced in 7.2.2
+ */
+#define BEGINwaitCommit \
+static rsRetVal waitCommit(instanceData __attribute__((unused)) *pData)\
+{\
+	DEFiRet;
+
+#define CODESTARTwaitCommit /* currently empty, but may be extended */
+
+#define ENDwaitCommit \
+	RETiRet;\
+}
+
+
 /* doAction()
  */
 #define BEGINdoAction \
@@ -235,6 +315,31 @@ static rsRetVal doAction(uchar __attribute__((unused)) **ppString, unsigned __at
 }
 
 
+/* doActionBatch()
+ * Optional entry point that receives all (active) messages of a batch in
+ * a single call, so that a module can e.g. build one bulk request. For each
+ * of the nElem messages, the parameters (the same that doAction() receives
+ * as ppString) and message options are passed. The module must store the
+ * result for each message inside pRetElem. The codes and their meaning are
+ * the same as for doAction(), messages not yet processed must be left at
+ * RS_RET_SUSPENDED (the value pRetElem is initialized to). The return value
+ * is the state of the action as a whole (e.g. RS_RET_SUSPENDED if the
+ * connection to the destination was lost).
+ * introduced in 7.2.2
+ */
+#define BEGINdoActionBatch \
+static rsRetVal doActionBatch(instanceData __attribute__((unused)) *pData, int nElem,\
+	void ***pppParams, unsigned *piMsgOpts, rsRetVal *pRetElem)\
+{\
+	DEFiRet;
+
+#define CODESTARTdoActionBatch /* currently empty, but may be extended */
+
+#define ENDdoActionBatch \
+	RETiRet;\
+}
+
+
 /* dbgPrintInstInfo()
  * Extra comments:
  * Print debug information about this instance.
@@ -479,6 +584,35 @@ static rsRetVal queryEtryPt(uchar *name, rsRetVal (**pEtryPoint)())\
 	}
 
 
+/* the following definition is queryEtryPt block that must be added
+ * if an output module supports the batch interface (doActionBatch).
+ */
+#define CODEqueryEtryPt_BATCHIF_OMOD_QUERIES \
+	  else if(!strcmp((char*) name, "doActionBatch")) {\
+		*pEtryPoint = doActionBatch;\
+	}
+
+
+/* the following definition is queryEtryPt block that must be added
+ * if an output module supports multiple concurrent worker instances.
+ */
+#define CODEqueryEtryPt_WRKRINST_OMOD_QUERIES \
+	  else if(!strcmp((char*) name, "createWrkrInstance")) {\
+		*pEtryPoint = createWrkrInstance;\
+	} else if(!strcmp((char*) name, "freeWrkrInstance")) {\
+		*pEtryPoint = freeWrkrInstance;\
+	}
+
+
+/* the following definition is queryEtryPt block that must be added
+ * if an output module supports asynchronous commits (waitCommit).
+ */
+#define CODEqueryEtryPt_WAITCOMMIT_OMOD_QUERIES \
+	  else if(!strcmp((char*) name, "waitCommit")) {\
+		*pEtryPoint = waitCommit;\
+	}
+
+
 /* the following definition is a queryEtryPt block that must be added
  * if a non-output module supports "isCompatibleWithFeature".
  * rgerhards, 2009-07-20
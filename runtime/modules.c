@@ -671,6 +671,35 @@ doModInit(rsRetVal (*modInit)(int, int*, rsRetVal(**)(), rsRetVal(*)(), modInfo_
 				ABORT_FINALIZE(localRet);
 			}
 
+			localRet = (*pNew->modQueryEtryPt)((uchar*)"doActionBatch",
+				   &pNew->mod.om.doActionBatch);
+			if(localRet == RS_RET_MODULE_ENTRY_POINT_NOT_FOUND) {
+				pNew->mod.om.doActionBatch = NULL;
+			} else if(localRet != RS_RET_OK) {
+				ABORT_FINALIZE(localRet);
+			}
+
+			/* worker instances are optional, but need both entry points */
+			localRet = (*pNew->modQueryEtryPt)((uchar*)"createWrkrInstance",
+				   &pNew->mod.om.createWrkrInstance);
+			if(localRet == RS_RET_MODULE_ENTRY_POINT_NOT_FOUND) {
+				pNew->mod.om.createWrkrInstance = NULL;
+			} else if(localRet != RS_RET_OK) {
+				ABORT_FINALIZE(localRet);
+			}
+			if(pNew->mod.om.createWrkrInstance != NULL) {
+				CHKiRet((*pNew->modQueryEtryPt)((uchar*)"freeWrkrInstance",
+					&pNew->mod.om.freeWrkrInstance));
+			}
+
+			localRet = (*pNew->modQueryEtryPt)((uchar*)"waitCommit",
+				   &pNew->mod.om.waitCommit);
+			if(localRet == RS_RET_MODULE_ENTRY_POINT_NOT_FOUND) {
+				pNew->mod.om.waitCommit = NULL;
+			} else if(localRet != RS_RET_OK) {
+				ABORT_FINALIZE(localRet);
+			}
+
 			localRet = (*pNew->modQueryEtryPt)((uchar*)"newActInst", &pNew->mod.om.newActInst);
 			if(localRet == RS_RET_MODULE_ENTRY_POINT_NOT_FOUND) {
 				pNew->mod.om.newActInst = dummynewActInst;
@@ -834,6 +863,9 @@ static void modPrintList(void)
 								   NULL :  pMod->mod.om.beginTransaction));
 			dbgprintf("\tEndTransaction:     %p\n", ((pMod->mod.om.endTransaction == dummyEndTransaction) ?
 								   NULL :  pMod->mod.om.endTransaction));
+			dbgprintf("\tdoActionBatch:      %p\n", pMod->mod.om.doActionBatch);
+			dbgprintf("\tcreateWrkrInstance: %p\n", pMod->mod.om.createWrkrInstance);
+			dbgprintf("\twaitCommit:         %p\n", pMod->mod.om.waitCommit);
 			break;
 		case eMOD_IN:
 			dbgprintf("Input Module Entry Points\n");
@@ -140,6 +140,11 @@ struct modInfo_s {
 			rsRetVal (*beginTransaction)(void*);
 			rsRetVal (*doAction)(uchar**, unsigned, void*);
 			rsRetVal (*endTransaction)(void*);
+			/* optional, NULL if not supported */
+			rsRetVal (*doActionBatch)(void*, int, void***, unsigned*, rsRetVal*);
+			rsRetVal (*createWrkrInstance)(void**, void*);
+			rsRetVal (*freeWrkrInstance)(void*);
+			rsRetVal (*waitCommit)(void*);
 			rsRetVal (*parseSelectorAct)(uchar**, void**,omodStringRequest_t**);
 			rsRetVal (*newActInst)(uchar *modName, struct nvlst *lst, void **, omodStringRequest_t **);
 		} om;
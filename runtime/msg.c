@@ -62,6 +62,7 @@
 #include "prop.h"
 #include "net.h"
 #include "rsconf.h"
+#include "escape.h"
 
 /* static data */
 DEFobjStaticHelpers
@@ -293,6 +294,43 @@ static char *syslog_number_names[24] = { "0", "1", "2", "3", "4", "5", "6", "7",
 static pthread_mutex_t mutTrimCtr;	 /* mutex to handle malloc trim */
 #endif
 
+/* Property memoization. Some properties, most importantly the CEE ones,
+ * require a lookup plus malloc()/free() each time they are fetched. If
+ * such a property is used by multiple filters and/or templates, it is
+ * fetched only once per message and the value is kept inside the message
+ * object. Which properties are memoized is decided at config load: the
+ * optimizer counts the references to these properties and all that are
+ * used more than once are memoized. Setting or unsetting a CEE variable
+ * invalidates the memo. As other threads may still use an invalidated
+ * value (action queues work on the same message object), it is only
+ * freed when the message is destructed.
+ */
+#define MEMO_MAX_PROPS 32
+static struct {
+	propid_t propid;
+	es_str_t *propName;	/* only for PROP_CEE */
+	int nRefs;
+} memoProps[MEMO_MAX_PROPS];
+static int nMemoCand = 0;	/* number of candidates during config load */
+static int nMemoProps = 0;	/* number of memoized properties after msgMemoFinalize() */
+
+typedef struct msgMemoSlot_s {
+	uchar *pVal;
+	rs_size_t lenVal;
+	sbool bValid;
+	sbool bMustFree;	/* pVal is owned by the memo */
+} msgMemoSlot_t;
+
+typedef struct msgMemoStale_s {
+	struct msgMemoStale_s *pNext;
+	uchar *pVal;
+} msgMemoStale_t;
+
+struct msgMemo_s {
+	msgMemoStale_t *pStale;	/* invalidated values, freed on destruction */
+	msgMemoSlot_t *slots;	/* one per memoized property */
+};
+
 /* some forward declarations */
 static int getAPPNAMELen(msg_t *pM, sbool bLockMutex);
 static rsRetVal jsonPathFindParent(msg_t *pM, uchar *name, uchar *leaf, struct json_object **parent, int bCreate);
@@ -750,6 +788,7 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	pM->rcvFrom.pRcvFrom = NULL;
 	pM->pRuleset = NULL;
 	pM->json = NULL;
+	pM->pMemo = NULL;
 	memset(&pM->tRcvdAt, 0, sizeof(pM->tRcvdAt));
 	memset(&pM->tTIMESTAMP, 0, sizeof(pM->tTIMESTAMP));
 	pM->TAG.pszTAG = NULL;
@@ -833,6 +872,26 @@ static inline void freeHOSTNAME(msg_t *pThis)
 }
 
 
+static void
+memoDestruct(struct msgMemo_s *pMemo)
+{
+	msgMemoStale_t *pStale, *pDel;
+	int i;
+
+	for(i = 0 ; i < nMemoProps ; ++i) {
+		if(pMemo->slots[i].bValid && pMemo->slots[i].bMustFree)
+			free(pMemo->slots[i].pVal);
+	}
+	for(pStale = pMemo->pStale ; pStale != NULL ; ) {
+		pDel = pStale;
+		pStale = pStale->pNext;
+		free(pDel->pVal);
+		free(pDel);
+	}
+	free(pMemo);
+}
+
+
 BEGINobjDestruct(msg) /* be sure to specify the object type also in END and CODESTART macros! */
 	int currRefCount;
 #	if HAVE_MALLOC_TRIM
@@ -890,6 +949,8 @@ CODESTARTobjDestruct(msg)
 			rsCStrDestruct(&pThis->pCSMSGID);
 		if(pThis->json != NULL)
 			json_object_put(pThis->json);
+		if(pThis->pMemo != NULL)
+			memoDestruct(pThis->pMemo);
 		if(pThis->pszUUID != NULL)
 			free(pThis->pszUUID);
 #	ifndef HAVE_ATOMIC_BUILTINS
@@ -2462,6 +2523,179 @@ finalize_it:
 }
 
 
+/* compare CEE property names. Depending on where the name came from,
+ * it may or may not contain the leading '!' (both denote the same path).
+ */
+static int
+memoNameEqual(es_str_t *s1, es_str_t *s2)
+{
+	uchar *p1 = es_getBufAddr(s1);
+	uchar *p2 = es_getBufAddr(s2);
+	es_size_t len1 = es_strlen(s1);
+	es_size_t len2 = es_strlen(s2);
+
+	if(len1 > 1 && p1[0] == '!') {
+		++p1;
+		--len1;
+	}
+	if(len2 > 1 && p2[0] == '!') {
+		++p2;
+		--len2;
+	}
+	return len1 == len2 && !memcmp(p1, p2, len1);
+}
+
+
+/* count a reference to a property during config load. Only properties
+ * that are expensive to obtain are considered for memoization.
+ */
+void
+msgMemoCountRef(propid_t propid, es_str_t *propName)
+{
+	int i;
+
+	if(propid != PROP_CEE && propid != PROP_CEE_ALL_JSON)
+		return;
+	for(i = 0 ; i < nMemoCand ; ++i) {
+		if(   memoProps[i].propid == propid
+		   && (propid != PROP_CEE || memoNameEqual(memoProps[i].propName, propName))) {
+			++memoProps[i].nRefs;
+			return;
+		}
+	}
+	if(nMemoCand == MEMO_MAX_PROPS)
+		return;
+	memoProps[nMemoCand].propid = propid;
+	memoProps[nMemoCand].propName = (propid == PROP_CEE) ? es_strdup(propName) : NULL;
+	memoProps[nMemoCand].nRefs = 1;
+	++nMemoCand;
+}
+
+
+/* finish counting: all properties referenced more than once are
+ * memoized from now on. Must be called before messages are processed.
+ */
+void
+msgMemoFinalize(void)
+{
+	int i;
+
+	nMemoProps = 0;
+	for(i = 0 ; i < nMemoCand ; ++i) {
+		if(memoProps[i].nRefs > 1) {
+			memoProps[nMemoProps++] = memoProps[i];
+		} else if(memoProps[i].propName != NULL) {
+			es_deleteStr(memoProps[i].propName);
+		}
+	}
+	nMemoCand = nMemoProps;
+	DBGPRINTF("msg: %d properties are memoized\n", nMemoProps);
+}
+
+
+static inline int
+memoFind(propid_t propid, es_str_t *propName)
+{
+	int i;
+	for(i = 0 ; i < nMemoProps ; ++i) {
+		if(   memoProps[i].propid == propid
+		   && (propid != PROP_CEE || memoNameEqual(memoProps[i].propName, propName)))
+			return i;
+	}
+	return -1;
+}
+
+
+/* get the whole CEE tree as string */
+static void
+getCEEAllJSON(msg_t *pM, uchar **pRes, rs_size_t *buflen, unsigned short *pbMustBeFreed)
+{
+	if(pM->json == NULL) {
+		*pRes = (uchar*) "{}";
+		*buflen = 2;
+		*pbMustBeFreed = 0;
+	} else {
+		*pRes = (uchar*)strdup(json_object_get_string(pM->json));
+		*pbMustBeFreed = 1;
+	}
+}
+
+
+/* get a memoized property value. If it is not yet in the memo, it is
+ * fetched and added. The returned value belongs to the message and must
+ * not be freed by the caller. Returns RS_RET_NOT_FOUND if the property
+ * is not memoized, in which case the caller must obtain it itself.
+ */
+static rsRetVal
+getMemoPropVal(msg_t *pM, propid_t propid, es_str_t *propName, uchar **pRes, rs_size_t *buflen)
+{
+	msgMemoSlot_t *pSlot;
+	unsigned short bMustBeFreed = 0;
+	uchar *pVal = NULL;
+	rs_size_t lenVal = -1;
+	int idx;
+	DEFiRet;
+
+	if(nMemoProps == 0 || (idx = memoFind(propid, propName)) == -1)
+		return RS_RET_NOT_FOUND;
+
+	MsgLock(pM);
+	if(pM->pMemo == NULL) {
+		CHKmalloc(pM->pMemo = calloc(1, sizeof(struct msgMemo_s)
+					       + nMemoProps * sizeof(msgMemoSlot_t)));
+		pM->pMemo->slots = (msgMemoSlot_t*) (pM->pMemo + 1);
+	}
+	pSlot = pM->pMemo->slots + idx;
+	if(!pSlot->bValid) {
+		if(propid == PROP_CEE)
+			getCEEPropVal(pM, propName, &pVal, &lenVal, &bMustBeFreed);
+		else
+			getCEEAllJSON(pM, &pVal, &lenVal, &bMustBeFreed);
+		if(pVal == NULL)
+			ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+		pSlot->pVal = pVal;
+		pSlot->lenVal = (lenVal == -1) ? (rs_size_t) ustrlen(pVal) : lenVal;
+		pSlot->bMustFree = bMustBeFreed;
+		pSlot->bValid = 1;
+	}
+	*pRes = pSlot->pVal;
+	*buflen = pSlot->lenVal;
+
+finalize_it:
+	MsgUnlock(pM);
+	RETiRet;
+}
+
+
+/* invalidate all memoized CEE values. Must be called with the message
+ * locked.
+ */
+static void
+memoInvalidateCEE(msg_t *pM)
+{
+	msgMemoSlot_t *pSlot;
+	msgMemoStale_t *pStale;
+	int i;
+
+	if(pM->pMemo == NULL)
+		return;
+	for(i = 0 ; i < nMemoProps ; ++i) {
+		pSlot = pM->pMemo->slots + i;
+		if(!pSlot->bValid)
+			continue;
+		pSlot->bValid = 0;
+		if(!pSlot->bMustFree)
+			continue;
+		/* if we cannot record the stale value, we must leak it */
+		if((pStale = malloc(sizeof(msgMemoStale_t))) != NULL) {
+			pStale->pVal = pSlot->pVal;
+			pStale->pNext = pM->pMemo->pStale;
+			pM->pMemo->pStale = pStale;
+		}
+	}
+}
+
+
 /* Get a CEE-Property as native json object
  */
 rsRetVal
@@ -2504,69 +2738,74 @@ jsonAddVal(uchar *pSrc, unsigned buflen, es_str_t **dst)
 {
 	unsigned char c;
 	es_size_t i;
+	es_size_t lenRun;
 	char numbuf[4];
 	int j;
 	DEFiRet;
 
-	for(i = 0 ; i < buflen ; ++i) {
-		c = pSrc[i];
-		if(   (c >= 0x23 && c <= 0x5b)
-		   || (c >= 0x5d /* && c <= 0x10FFFF*/)
-		   || c == 0x20 || c == 0x21) {
-			/* no need to escape */
+	i = 0;
+	while(i < buflen) {
+		/* chars that need no escaping come in long runs, so we find
+		 * (and, if needed, copy) them in bulk.
+		 */
+		lenRun = escScanJSON(pSrc + i, buflen - i);
+		if(lenRun > 0) {
 			if(*dst != NULL)
-				es_addChar(dst, c);
-		} else {
+				es_addBuf(dst, (char*)pSrc + i, lenRun);
+			i += lenRun;
+			if(i == buflen)
+				break;
+		}
+		c = pSrc[i++];
+		if(*dst == NULL) {
+			if(i == 1) {
+				/* we hope we have only few escapes... */
+				*dst = es_newStr(buflen+10);
+			} else {
+				*dst = es_newStrFromBuf((char*)pSrc, i - 1);
+			}
 			if(*dst == NULL) {
-				if(i == 0) {
-					/* we hope we have only few escapes... */
-					*dst = es_newStr(buflen+10);
-				} else {
-					*dst = es_newStrFromBuf((char*)pSrc, i);
-				}
-				if(*dst == NULL) {
-					ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
-				}
+				ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
 			}
-			/* we must escape, try RFC4627-defined special sequences first */
-			switch(c) {
-			case '\0':
-				es_addBuf(dst, "\\u0000", 6);
-				break;
-			case '\"':
-				es_addBuf(dst, "\\\"", 2);
-				break;
-			case '/':
-				es_addBuf(dst, "\\/", 2);
-				break;
-			case '\\':
-				es_addBuf(dst, "\\\\", 2);
-				break;
-			case '\010':
-				es_addBuf(dst, "\\b", 2);
-				break;
-			case '\014':
-				es_addBuf(dst, "\\f", 2);
-				break;
-			case '\n':
-				es_addBuf(dst, "\\n", 2);
-				break;
-			case '\r':
-				es_addBuf(dst, "\\r", 2);
-				break;
-			case '\t':
-				es_addBuf(dst, "\\t", 2);
-				break;
-			default:
-				/* TODO : proper Unicode encoding (see header comment) */
-				for(j = 0 ; j < 4 ; ++j) {
-					numbuf[3-j] = hexdigit[c % 16];
-					c = c / 16;
-				}
-				es_addBuf(dst, "\\u", 2);
-				es_addBuf(dst, numbuf, 4);
-				break;
+		}
+		/* we must escape, try RFC4627-defined special sequences first */
+		switch(c) {
+		case '\0':
+			es_addBuf(dst, "\\u0000", 6);
+			break;
+		case '\"':
+			es_addBuf(dst, "\\\"", 2);
+			break;
+		case '/':
+			es_addBuf(dst, "\\/", 2);
+			break;
+		case '\\':
+			es_addBuf(dst, "\\\\", 2);
+			break;
+		case '\010':
+			es_addBuf(dst, "\\b", 2);
+			break;
+		case '\014':
+			es_addBuf(dst, "\\f", 2);
+			break;
+		case '\n':
+			es_addBuf(dst, "\\n", 2);
+			break;
+		case '\r':
+			es_addBuf(dst, "\\r", 2);
+			break;
+		case '\t':
+			es_addBuf(dst, "\\t", 2);
+			break;
+		default:
+			/* TODO : proper Unicode encoding (see header comment) */
+			for(j = 0 ; j < 4 ; ++j) {
+				numbuf[3-j] = hexdigit[c % 16];
+				c = c / 16;
 			}
+			es_addBuf(dst, "\\u", 2);
+			es_addBuf(dst, numbuf, 4);
+			break;
 		}
 	}
 finalize_it:
@@ -2862,19 +3101,12 @@ uchar *MsgGetProp(msg_t *pMsg, struct templateEntry *pTpe,
 			pRes = glbl.GetLocalHostName();
 			break;
 		case PROP_CEE_ALL_JSON:
-			if(pMsg->json == NULL) {
-				if(*pbMustBeFreed == 1)
-					free(pRes);
-				pRes = (uchar*) "{}";
-				bufLen = 2;
-				*pbMustBeFreed = 0;
-			} else {
-				pRes = (uchar*)strdup(json_object_get_string(pMsg->json));
-				*pbMustBeFreed = 1;
-			}
+			if(getMemoPropVal(pMsg, propid, NULL, &pRes, &bufLen) != RS_RET_OK)
+				getCEEAllJSON(pMsg, &pRes, &bufLen, pbMustBeFreed);
 			break;
 		case PROP_CEE:
-			getCEEPropVal(pMsg, propName, &pRes, &bufLen, pbMustBeFreed);
+			if(getMemoPropVal(pMsg, propid, propName, &pRes, &bufLen) != RS_RET_OK)
+				getCEEPropVal(pMsg, propName, &pRes, &bufLen, pbMustBeFreed);
 			break;
 		case PROP_SYS_BOM:
 			if(*pbMustBeFreed == 1)
@@ -3016,7 +3248,7 @@ uchar *MsgGetProp(msg_t *pMsg, struct templateEntry *pTpe,
 				 */
 				while(!bFound) {
 					int iREstat;
-					iREstat = regexp.regexec(&pTpe->data.field.re, (char*)(pRes + iOffs), nmatch, pmatch, 0);
+					iREstat = regexp.exec(pTpe->data.field.re, (char*)(pRes + iOffs), nmatch, pmatch, 0);
 					dbgprintf("regexec return is %d\n", iREstat);
 					if(iREstat == 0) {
 						if(pmatch[0].rm_so == -1) {
@@ -3770,10 +4002,9 @@ jsonFind(msg_t *pM, es_str_t *propName, struct json_object **jsonres)
 	struct json_object *field;
 	DEFiRet;
 
-	if(pM->json == NULL) {
-		field = NULL;
-		goto finalize_it;
-	}
+	*jsonres = NULL; /* also if there is no such element or no JSON data at all */
+	if(pM->json == NULL)
+		FINALIZE;
 
 	if(!es_strbufcmp(propName, (uchar*)"!", 1)) {
 		field = pM->json;
@@ -3799,6 +4030,7 @@ msgAddJSON(msg_t *pM, uchar *name, struct json_object *json)
 	DEFiRet;
 
 	MsgLock(pM);
+	memoInvalidateCEE(pM);
 	if(name[0] == '!' && name[1] == '\0') {
 		if(pM->json == NULL)
 			pM->json = json;
@@ -3855,6 +4087,7 @@ msgDelJSON(msg_t *pM, uchar *name)
 
 dbgprintf("AAAA: unset variable '%s'\n", name);
 	MsgLock(pM);
+	memoInvalidateCEE(pM);
 	if(name[0] == '!' && name[1] == '\0') {
 		/* strange, but I think we should permit this. After all,
 		 * we trust rsyslog.conf to be written by the admin.
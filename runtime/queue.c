@@ -1006,6 +1006,7 @@ static rsRetVal qAddDirect(qqueue_t *pThis, void* pUsr)
 	/* delete the batch string params: TODO: create its own "class" for this */
 	for(i = 0 ; i < CONF_OMOD_NUMSTRINGS_MAXSIZE ; ++i) {
 		free(batchObj.staticActStrings[i]);
+		tplIovDestruct(batchObj.staticActIov[i]);
 	}
 	objDestruct(pUsr);
 
@@ -1017,6 +1018,8 @@ static rsRetVal qAddDirect(qqueue_t *pThis, void* pUsr)
  */
 rsRetVal qqueueEnqObjDirectBatch(qqueue_t *pThis, batch_t *pBatch)
 {
+	sbool bCanPendSave;
+	batch_t *pPendingSave;
 	DEFiRet;
 
 	ASSERT(pThis != NULL);
@@ -1029,7 +1032,16 @@ rsRetVal qqueueEnqObjDirectBatch(qqueue_t *pThis, batch_t *pBatch)
 	 * We use our knowledge about the batch_t structure below, but without that, we
 	 * pay a too-large performance toll... -- rgerhards, 2009-04-22
 	 */
+	/* the batch may be owned by another queue's worker, which does not expect
+	 * us to complete its pending commit or leave one of our own pending.
+	 */
+	bCanPendSave = pBatch->bCanPend;
+	pPendingSave = pBatch->pPending;
+	pBatch->bCanPend = 0;
+	pBatch->pPending = NULL;
 	iRet = pThis->pConsumer(pThis->pUsr, pBatch, &pThis->bShutdownImmediate);
+	pBatch->bCanPend = bCanPendSave;
+	pBatch->pPending = pPendingSave;
 
 	RETiRet;
 }
@@ -1582,8 +1594,14 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 	rsRetVal localRet;
 	DEFiRet;
 
-	nDeleted = pWti->batch.nElemDeq;
-	DeleteProcessedBatch(pThis, &pWti->batch);
+	if(pWti->bBatchDeleted) {
+		/* batch was swapped in from batchPending and is already deleted */
+		nDeleted = 0;
+		pWti->bBatchDeleted = 0;
+	} else {
+		nDeleted = pWti->batch.nElemDeq;
+		DeleteProcessedBatch(pThis, &pWti->batch);
+	}
 
 	nDequeued = nDiscarded = 0;
 	while((iQueueSize = getLogicalQueueSize(pThis)) > 0 && nDequeued < pThis->iDeqBatchSize) {
@@ -1601,6 +1619,7 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 		/* all well, use this element */
 		pWti->batch.pElem[nDequeued].pUsrp = pUsr;
 		pWti->batch.pElem[nDequeued].state = BATCH_STATE_RDY;
+		batchElemInvalidateRender(&(pWti->batch.pElem[nDequeued]));
 		++nDequeued;
 	}
 
@@ -1778,6 +1797,22 @@ finalize_it:
 }
 
 
+/* delete the batch of the previous transaction. If the consumer did not
+ * complete its commit (worker terminates or consumer failed), it is told
+ * to abandon it, so that it can release its resources.
+ */
+static inline void
+DeletePendingBatch(qqueue_t *pThis, wti_t *pWti)
+{
+	if(pWti->batchPending.pCommitPending != NULL) {
+		pWti->batchPending.pfAbandonCommit(pWti->batchPending.pCommitPending);
+		pWti->batchPending.pCommitPending = NULL;
+		pWti->batchPending.pfAbandonCommit = NULL;
+	}
+	DeleteProcessedBatch(pThis, &pWti->batchPending);
+}
+
+
 /* This is called when a batch is processed and the worker does not
  * ask for another batch (e.g. because it is to be terminated)
  * Note that we must not be terminated while we delete a processed
@@ -1799,14 +1834,51 @@ batchProcessed(qqueue_t *pThis, wti_t *pWti)
 	int iCancelStateSave;
 	/* at this spot, we must not be cancelled */
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &iCancelStateSave);
-	DeleteProcessedBatch(pThis, &pWti->batch);
-	qqueueChkPersist(pThis, pWti->batch.nElemDeq);
+	if(pWti->bBatchDeleted) {
+		pWti->bBatchDeleted = 0;
+	} else {
+		DeleteProcessedBatch(pThis, &pWti->batch);
+		qqueueChkPersist(pThis, pWti->batch.nElemDeq);
+	}
+	/* if a commit is still pending, we do not know its outcome. So we delete
+	 * the batch, which re-enqueues the uncommitted messages. These may thus be
+	 * delivered twice, but never get lost.
+	 */
+	if(pWti->batchPending.nElem > 0)
+		DeletePendingBatch(pThis, pWti);
 	pthread_setcancelstate(iCancelStateSave, NULL);
 
 	RETiRet;
 }
 
 
+/* Called after the regular consumer returned, with the queue mutex locked.
+ * The consumer has completed the commit of the previous batch (if there was
+ * one), so that batch can now be deleted. If the consumer left the commit of
+ * the current batch pending, it becomes the new pending batch. The batches
+ * are swapped, so the old pending one is deleted on the next dequeue (this
+ * keeps the delete order). Note that a pending commit always holds elements.
+ */
+static inline void
+FinishPendingBatch(qqueue_t *pThis, wti_t *pWti)
+{
+	batch_t batchTmp;
+
+	if(pWti->batch.pCommitPending == NULL) {
+		if(pWti->batchPending.nElem > 0)
+			DeletePendingBatch(pThis, pWti);
+		return;
+	}
+
+	DBGOPRINT((obj_t*) pThis, "commit of batch with %d elements is pending\n", pWti->batch.nElem);
+	if(pWti->batchPending.nElem == 0)
+		pWti->bBatchDeleted = 1;
+	memcpy(&batchTmp, &pWti->batchPending, sizeof(batch_t));
+	memcpy(&pWti->batchPending, &pWti->batch, sizeof(batch_t));
+	memcpy(&pWti->batch, &batchTmp, sizeof(batch_t));
+}
+
+
 /* This is the queue consumer in the regular (non-DA) case. It is 
  * protected by the queue mutex, but MUST release it as soon as possible.
  * rgerhards, 2008-01-21
@@ -1816,6 +1888,7 @@ ConsumerReg(qqueue_t *pThis, wti_t *pWti)
 {
 	int iCancelStateSave;
 	int bNeedReLock = 0;	/**< do we need to lock the mutex again? */
+	rsRetVal iRetIdle = RS_RET_OK;
 	DEFiRet;
 
 	ISOBJ_TYPE_assert(pThis, qqueue);
@@ -1830,6 +1903,14 @@ ConsumerReg(qqueue_t *pThis, wti_t *pWti)
 		// TODO: think about what to return as iRet -- keep RS_RET_FILE_NOT_FOUND?
 		d_pthread_mutex_lock(pThis->mut);
 	}
+	if(iRet == RS_RET_IDLE && pWti->batchPending.nElem > 0) {
+		/* no new work, but the commit of the previous batch is still pending.
+		 * We call the consumer with the empty batch so that it completes the
+		 * commit before we go idle.
+		 */
+		iRetIdle = RS_RET_IDLE;
+		iRet = RS_RET_OK;
+	}
 	if (iRet != RS_RET_OK) {
 		FINALIZE;
 	}
@@ -1841,7 +1922,18 @@ ConsumerReg(qqueue_t *pThis, wti_t *pWti)
 	/* at this spot, we may be cancelled */
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &iCancelStateSave);
 
-	CHKiRet(pThis->pConsumer(pThis->pUsr, &pWti->batch, &pThis->bShutdownImmediate));
+	/* the consumer may leave the commit of this batch pending, if it can.
+	 * In any case, it must complete the commit of the previous batch.
+	 */
+	pWti->batch.bCanPend = 1;
+	pWti->batch.pPending = (pWti->batchPending.nElem > 0) ? &pWti->batchPending : NULL;
+	iRet = pThis->pConsumer(pThis->pUsr, &pWti->batch, &pThis->bShutdownImmediate);
+	pWti->batch.bCanPend = 0;
+	pWti->batch.pPending = NULL;
+	if(iRet != RS_RET_OK) {
+		pthread_setcancelstate(iCancelStateSave, NULL);
+		FINALIZE;
+	}
 
 	/* we now need to check if we should deliberately delay processing a bit
 	 * and, if so, do that. -- rgerhards, 2008-01-30
@@ -1861,8 +1953,13 @@ finalize_it:
 	          getLogicalQueueSize(pThis), getPhysicalQueueSize(pThis));
 
 	/* now we are done, but potentially need to re-aquire the mutex */
-	if(bNeedReLock)
+	if(bNeedReLock) {
 		d_pthread_mutex_lock(pThis->mut);
+		FinishPendingBatch(pThis, pWti);
+	}
+
+	if(iRet == RS_RET_OK && iRetIdle != RS_RET_OK)
+		iRet = iRetIdle;
 
 	RETiRet;
 }
@@ -23,24 +23,120 @@
  */
 
 #include "config.h"
+#include <stdlib.h>
 #include <regex.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "rsyslog.h"
 #include "module-template.h"
 #include "obj.h"
+#include "glbl.h"
 #include "regexp.h"
+#include "rsregex.h"
 
 MODULE_TYPE_LIB
 MODULE_TYPE_NOKEEP
 
 /* static data */
 DEFobjStaticHelpers
+DEFobjCurrIf(glbl)
+
+/* per-thread scratch space for our own engine. It is only needed for
+ * expressions whose DFA would be too large. We keep it per thread, so
+ * that matching never needs to allocate memory nor lock.
+ */
+static pthread_key_t keyScratch;
 
 
 /* ------------------------------ methods ------------------------------ */
 
+static void
+scratchDestruct(void *pScratch)
+{
+	rsrxScratchFree((rsrxScratch_t*) pScratch);
+}
+
+
+/* compile a regex for the engine-independent interface. The engine may
+ * be RS_REGEX_ENGINE_DFLT, in which case the global setting is used at
+ * the time the regex is executed. Returns the regcomp() error code and
+ * sets *ppRe to NULL on error.
+ */
+static int
+compile(rsregex_t **ppRe, const char *regex, int cflags, int engine)
+{
+	rsregex_t *pRe;
+	int ret;
+
+	*ppRe = NULL;
+	if((pRe = calloc(1, sizeof(rsregex_t))) == NULL)
+		return REG_ESPACE;
+	if((ret = regcomp(&pRe->posix, regex, cflags)) != 0) {
+		free(pRe);
+		return ret;
+	}
+	pRe->engine = engine;
+	pRe->cflags = cflags;
+	if(engine != RS_REGEX_ENGINE_POSIX) {
+		if(rsrxCompile(&pRe->pFast, regex, cflags) == RSRX_OK) {
+			DBGPRINTF("regex '%s' compiled for dfa engine (%s)\n", regex,
+				  rsrxHasDFA(pRe->pFast) ? "dfa" : "nfa simulation");
+		} else {
+			DBGPRINTF("regex '%s' not supported by dfa engine, using posix\n", regex);
+		}
+	}
+	*ppRe = pRe;
+	return 0;
+}
+
+
+/* execute a regex compiled by compile(). Our own engine can only tell if
+ * the regex matches. So if submatches are requested, it is used as a
+ * pre-filter: only if it finds a match, the POSIX engine is called to
+ * obtain the positions. As most messages usually do not match, this
+ * still saves most of the work.
+ */
+static int
+exec(rsregex_t *pRe, const char *string, size_t nmatch, regmatch_t pmatch[], int eflags)
+{
+	rsrxScratch_t *pScratch;
+	rsrxScratch_t *pOldScratch;
+	int engine;
+	int ret;
+
+	if(pRe->pFast != NULL && eflags == 0) {
+		engine = (pRe->engine == RS_REGEX_ENGINE_DFLT) ? glbl.GetRegexEngine() : pRe->engine;
+		if(engine == RS_REGEX_ENGINE_DFA) {
+			pScratch = pOldScratch = pthread_getspecific(keyScratch);
+			ret = rsrxMatch(pRe->pFast, (const unsigned char*) string, &pScratch);
+			if(pScratch != pOldScratch)
+				(void) pthread_setspecific(keyScratch, pScratch);
+			if(ret == RSRX_NOMATCH)
+				return REG_NOMATCH;
+			if(ret == RSRX_OK && (nmatch == 0 || (pRe->cflags & REG_NOSUB)))
+				return 0;
+			/* we need submatches (or are out of memory) - let POSIX do it */
+		}
+	}
+	return regexec(&pRe->posix, string, nmatch, pmatch, eflags);
+}
+
+
+static void
+destruct(rsregex_t **ppRe)
+{
+	rsregex_t *pRe = *ppRe;
+
+	if(pRe == NULL)
+		return;
+	regfree(&pRe->posix);
+	rsrxFree(pRe->pFast);
+	free(pRe);
+	*ppRe = NULL;
+}
+
 
 
 /* queryInterface function
@@ -61,6 +157,9 @@ CODESTARTobjQueryInterface(regexp)
 	pIf->regexec = regexec;
 	pIf->regerror = regerror;
 	pIf->regfree = regfree;
+	pIf->compile = compile;
+	pIf->exec = exec;
+	pIf->destruct = destruct;
 finalize_it:
 ENDobjQueryInterface(regexp)
 
@@ -71,6 +170,9 @@ ENDobjQueryInterface(regexp)
  */
 BEGINAbstractObjClassInit(regexp, 1, OBJ_IS_LOADABLE_MODULE) /* class, version */
 	/* request objects we use */
+	CHKiRet(objUse(glbl, CORE_COMPONENT));
+	if(pthread_key_create(&keyScratch, scratchDestruct) != 0)
+		ABORT_FINALIZE(RS_RET_ERR);
 
 	/* set our own handlers */
 ENDObjClassInit(regexp)
@@ -81,6 +183,8 @@ ENDObjClassInit(regexp)
 
 BEGINmodExit
 CODESTARTmodExit
+	pthread_key_delete(keyScratch);
+	objRelease(glbl, CORE_COMPONENT);
 ENDmodExit
 
 
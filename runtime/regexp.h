@@ -25,14 +25,34 @@
 
 #include <regex.h>
 
+/* regex engines */
+#define RS_REGEX_ENGINE_DFLT	0	/* use global setting */
+#define RS_REGEX_ENGINE_POSIX	1	/* system regcomp()/regexec() */
+#define RS_REGEX_ENGINE_DFA	2	/* rsyslog's linear-time engine, see rsregex.c */
+
+/* a compiled regex for the engine-independent interface. The POSIX
+ * version is always compiled, because only it can provide submatches
+ * and it handles all the expressions our own engine does not support.
+ */
+typedef struct rsregex_s {
+	regex_t posix;
+	struct rsrx_s *pFast;	/* NULL if not supported by our engine */
+	int engine;		/* engine requested for this regex */
+	int cflags;
+} rsregex_t;
+
 /* interfaces */
 BEGINinterface(regexp) /* name must also be changed in ENDinterface macro! */
 	int (*regcomp)(regex_t *preg, const char *regex, int cflags);
 	int (*regexec)(const regex_t *preg, const char *string, size_t nmatch, regmatch_t pmatch[], int eflags);
 	size_t (*regerror)(int errcode, const regex_t *preg, char *errbuf, size_t errbuf_size);
 	void (*regfree)(regex_t *preg);
+	/* v2, 2012-10-15: engine-independent interface */
+	int (*compile)(rsregex_t **ppRe, const char *regex, int cflags, int engine);
+	int (*exec)(rsregex_t *pRe, const char *string, size_t nmatch, regmatch_t pmatch[], int eflags);
+	void (*destruct)(rsregex_t **ppRe);
 ENDinterface(regexp)
-#define regexpCURR_IF_VERSION 1 /* increment whenever you change the interface structure! */
+#define regexpCURR_IF_VERSION 2 /* increment whenever you change the interface structure! */
 
 
 /* prototypes */
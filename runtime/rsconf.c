@@ -124,6 +124,7 @@ BEGINobjConstruct(rsconf) /* be sure to specify the object type also in END macr
 	pThis->templates.last = NULL;
 	pThis->templates.lastStatic = NULL;
 	pThis->actions.nbrActions = 0;
+	pThis->actions.nbrDedup = 0;
 	CHKiRet(llInit(&pThis->rulesets.llRulesets, rulesetDestructForLinkedList,
 			rulesetKeyDestruct, strcasecmp));
 	/* queue params */
@@ -1292,6 +1293,9 @@ ourConf = loadConf; // TODO: remove, once ourConf is gone!
 	}
 	tellLexEndParsing();
 	rulesetOptimizeAll(loadConf);
+	tplCountMemoProps(loadConf);
+	msgMemoFinalize();
+	tplCompileAll(loadConf);
 
 	tellCoreConfigLoadDone();
 	tellModulesConfigLoadDone();
@@ -122,6 +122,7 @@ struct templates_s {
 
 struct actions_s {
 	unsigned nbrActions;		/* number of actions */
+	unsigned nbrDedup;		/* number of actions with windowed dedup */
 };
 
 
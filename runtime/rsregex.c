@@ -0,0 +1,1127 @@
+/* rsregex.c
+ * rsyslog's own regex engine. It supports the commonly used subset of
+ * POSIX basic and extended regular expressions and answers the question
+ * "does the regex match anywhere in the string" in time linear to the
+ * string length. It does NOT provide submatch positions; for those (and
+ * for all patterns we do not support, like back-references), the POSIX
+ * engine must be used. The regexp object takes care of that.
+ *
+ * The pattern is parsed into a syntax tree, which is then compiled into a
+ * Thompson NFA. From that NFA, a DFA is built by subset construction when
+ * the regex is compiled. As the DFA is immutable after that, it can be
+ * used by all threads without locking. If the DFA would grow too large,
+ * the NFA is simulated directly, which is still linear-time but needs some
+ * scratch memory. To avoid malloc() calls during matching, the caller
+ * provides that scratch space (usually one per thread).
+ * The DFA's transition table is indexed by "byte classes": bytes which
+ * are treated identically by all character sets of the pattern share a
+ * class, which keeps the table small.
+ * Most regexes have states which are only left by very few bytes (for
+ * example while looking for the first character of a literal). For such
+ * states, we do not process the string byte by byte but let strpbrk()
+ * find the next interesting byte, which libc does much faster.
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <regex.h>
+
+#include "rsregex.h"
+
+#define MAX_NFA_STATES	8192	/* larger patterns are left to the POSIX engine */
+#define MAX_DFA_STATES	1024	/* beyond that, the NFA is simulated directly */
+#define MAX_REPEAT	255	/* largest supported interval count */
+#define MAX_ACCEL_BYTES	16	/* max bytes leaving a state for it to be accelerated */
+
+typedef struct byteset_s {
+	unsigned int bits[8];
+} byteset_t;
+#define SET_HAS(s, c) ((s)->bits[(c) >> 5] & (1u << ((c) & 31)))
+#define SET_ADD(s, c) ((s)->bits[(c) >> 5] |= (1u << ((c) & 31)))
+
+/* syntax tree */
+enum { A_SET, A_CAT, A_ALT, A_STAR, A_PLUS, A_QUEST, A_REPEAT, A_EMPTY, A_BOL, A_EOL };
+typedef struct astnode_s {
+	int type;
+	int l, r;	/* children (index), r unused for unary nodes */
+	int set;	/* for A_SET: index into set table */
+	int min, max;	/* for A_REPEAT: max -1 means unlimited */
+} astnode_t;
+
+/* NFA */
+enum { N_SET, N_SPLIT, N_BOL, N_EOL, N_MATCH };
+typedef struct nfastate_s {
+	int type;
+	int out, out1;	/* out1 only for N_SPLIT */
+	int set;	/* for N_SET */
+} nfastate_t;
+
+/* flags for epsilon closure */
+#define AT_START	0x01
+#define AT_END		0x02
+
+/* DFA state flags */
+#define DFA_ACCEPT	0x01	/* a match has been found */
+#define DFA_DEAD	0x02	/* no match possible any longer */
+#define DFA_ENDACCEPT	0x04	/* match if the string ends here */
+#define DFA_ACCEL	0x08	/* only few bytes leave this state, see accel */
+
+struct rsrx_s {
+	nfastate_t *nfa;
+	int nNfa;
+	int start;
+	int match;		/* the (only) N_MATCH state */
+	byteset_t *sets;
+	int nSets;
+	/* the DFA - delta is NULL if it would have grown too large */
+	int *delta;		/* nDfa * nClasses */
+	unsigned char *dfaFlags;
+	char **accel;		/* per state: bytes leaving it, if DFA_ACCEL is set */
+	int nDfa;
+	int nClasses;
+	unsigned char cls[256];	/* byte -> byte class */
+};
+
+/* sparse set (Briggs/Torczon), permits O(1) clear and membership test */
+typedef struct sset_s {
+	int *dense;
+	int *sparse;
+	int n;
+} sset_t;
+
+struct rsrxScratch_s {
+	int cap;
+	sset_t a, b, tmp;
+	int *stack;
+};
+
+typedef struct parser_s {
+	const unsigned char *p;
+	int bExtended;
+	int bIcase;
+	int err;
+	int depth;
+	astnode_t *nodes;
+	int nNodes, maxNodes;
+	byteset_t *sets;
+	int nSets, maxSets;
+} parser_t;
+
+
+/* ------------------------------ parser ------------------------------ */
+
+static int
+newNode(parser_t *ps, int type, int l, int r)
+{
+	astnode_t *newnodes;
+	astnode_t *n;
+
+	if(ps->err)
+		return -1;
+	if(ps->nNodes == ps->maxNodes) {
+		if((newnodes = realloc(ps->nodes, sizeof(astnode_t) * (ps->maxNodes + 64))) == NULL) {
+			ps->err = RSRX_ESPACE;
+			return -1;
+		}
+		ps->nodes = newnodes;
+		ps->maxNodes += 64;
+	}
+	n = ps->nodes + ps->nNodes;
+	n->type = type;
+	n->l = l;
+	n->r = r;
+	n->set = -1;
+	n->min = n->max = 0;
+	return ps->nNodes++;
+}
+
+/* create a new (empty) byte set and a A_SET node for it */
+static int
+newSetNode(parser_t *ps, byteset_t **ppSet)
+{
+	byteset_t *newsets;
+	int node;
+
+	if(ps->err)
+		return -1;
+	if(ps->nSets == ps->maxSets) {
+		if((newsets = realloc(ps->sets, sizeof(byteset_t) * (ps->maxSets + 16))) == NULL) {
+			ps->err = RSRX_ESPACE;
+			return -1;
+		}
+		ps->sets = newsets;
+		ps->maxSets += 16;
+	}
+	if((node = newNode(ps, A_SET, -1, -1)) == -1)
+		return -1;
+	memset(ps->sets + ps->nSets, 0, sizeof(byteset_t));
+	ps->nodes[node].set = ps->nSets;
+	*ppSet = ps->sets + ps->nSets++;
+	return node;
+}
+
+static void
+foldCase(byteset_t *set)
+{
+	int c;
+	for(c = 'a' ; c <= 'z' ; ++c) {
+		if(SET_HAS(set, c) || SET_HAS(set, toupper(c))) {
+			SET_ADD(set, c);
+			SET_ADD(set, toupper(c));
+		}
+	}
+}
+
+static int
+literalNode(parser_t *ps, int c)
+{
+	byteset_t *set;
+	int node;
+
+	if((node = newSetNode(ps, &set)) == -1)
+		return -1;
+	SET_ADD(set, c);
+	if(ps->bIcase)
+		foldCase(set);
+	return node;
+}
+
+/* add a named character class (like "alpha") to a set, returns 0 if the
+ * name is not known.
+ */
+static int
+addClass(byteset_t *set, const char *name, size_t len)
+{
+	static const struct {
+		const char *name;
+		int (*isfunc)(int);
+	} classes[] = {
+		{ "alpha", isalpha }, { "upper", isupper }, { "lower", islower },
+		{ "digit", isdigit }, { "xdigit", isxdigit }, { "alnum", isalnum },
+		{ "space", isspace }, { "blank", isblank }, { "punct", ispunct },
+		{ "print", isprint }, { "graph", isgraph }, { "cntrl", iscntrl },
+		{ NULL, NULL }
+	};
+	int i, c;
+
+	for(i = 0 ; classes[i].name != NULL ; ++i) {
+		if(strlen(classes[i].name) == len && !strncmp(classes[i].name, name, len)) {
+			for(c = 1 ; c < 256 ; ++c)
+				if(classes[i].isfunc(c))
+					SET_ADD(set, c);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void
+invertSet(byteset_t *set)
+{
+	int i;
+	for(i = 0 ; i < 8 ; ++i)
+		set->bits[i] = ~set->bits[i];
+	set->bits[0] &= ~1u; /* \0 never matches */
+}
+
+/* parse a bracket expression, ps->p is on the opening '[' */
+static int
+parseBracket(parser_t *ps)
+{
+	const unsigned char *p = ps->p + 1;
+	const unsigned char *end;
+	byteset_t *set;
+	int node;
+	int bNegate = 0;
+	int bFirst = 1;
+	int lo, hi, c;
+
+	if((node = newSetNode(ps, &set)) == -1)
+		return -1;
+	if(*p == '^') {
+		bNegate = 1;
+		++p;
+	}
+	while(1) {
+		if(*p == '\0')
+			goto notsupp;
+		if(*p == ']' && !bFirst) {
+			++p;
+			break;
+		}
+		bFirst = 0;
+		if(p[0] == '[' && p[1] == ':') {
+			if((end = (const unsigned char*) strstr((const char*) p + 2, ":]")) == NULL)
+				goto notsupp;
+			if(!addClass(set, (const char*) p + 2, end - (p + 2)))
+				goto notsupp;
+			p = end + 2;
+		} else if(p[0] == '[' && (p[1] == '=' || p[1] == '.')) {
+			goto notsupp; /* equivalence classes and collating symbols */
+		} else {
+			lo = *p++;
+			if(p[0] == '-' && p[1] != ']' && p[1] != '\0') {
+				hi = p[1];
+				if(hi == '[' || lo > hi)
+					goto notsupp;
+				p += 2;
+				for(c = lo ; c <= hi ; ++c)
+					SET_ADD(set, c);
+			} else {
+				SET_ADD(set, lo);
+			}
+		}
+	}
+	if(ps->bIcase)
+		foldCase(set);
+	if(bNegate)
+		invertSet(set);
+	ps->p = p;
+	return node;
+
+notsupp:
+	ps->err = RSRX_NOTSUPP;
+	return -1;
+}
+
+/* operator detection, the syntax differs between BRE and ERE */
+static inline int
+isAltOp(parser_t *ps, const unsigned char *p)
+{
+	return ps->bExtended ? p[0] == '|' : (p[0] == '\\' && p[1] == '|');
+}
+
+static inline int
+isOpenOp(parser_t *ps, const unsigned char *p)
+{
+	return ps->bExtended ? p[0] == '(' : (p[0] == '\\' && p[1] == '(');
+}
+
+static inline int
+isCloseOp(parser_t *ps, const unsigned char *p)
+{
+	return ps->bExtended ? p[0] == ')' : (p[0] == '\\' && p[1] == ')');
+}
+
+static inline int
+isQuantOp(parser_t *ps, const unsigned char *p)
+{
+	if(p[0] == '*')
+		return 1;
+	if(ps->bExtended)
+		return p[0] == '+' || p[0] == '?' || p[0] == '{';
+	return p[0] == '\\' && (p[1] == '+' || p[1] == '?' || p[1] == '{');
+}
+
+static int parseAlt(parser_t *ps);
+
+static int
+parseAtom(parser_t *ps)
+{
+	const unsigned char *p = ps->p;
+	byteset_t *set;
+	int node;
+	int c;
+
+	if(isOpenOp(ps, p)) {
+		ps->p += ps->bExtended ? 1 : 2;
+		ps->depth++;
+		node = parseAlt(ps);
+		if(ps->err || !isCloseOp(ps, ps->p))
+			goto notsupp;
+		ps->p += ps->bExtended ? 1 : 2;
+		ps->depth--;
+		return node;
+	}
+	if(*p == '.') {
+		if((node = newSetNode(ps, &set)) == -1)
+			return -1;
+		invertSet(set);
+		ps->p++;
+		return node;
+	}
+	if(*p == '[')
+		return parseBracket(ps);
+	if(*p == '\\') {
+		c = p[1];
+		if(c == '\0' || isdigit(c) || strchr("bB<>`'", c) != NULL)
+			goto notsupp; /* back-references and word boundaries */
+		if(!ps->bExtended && strchr(")|{}+?", c) != NULL)
+			goto notsupp; /* BRE operator in wrong place */
+		ps->p += 2;
+		if(c == 'w' || c == 'W' || c == 's' || c == 'S') {
+			if((node = newSetNode(ps, &set)) == -1)
+				return -1;
+			if(c == 'w' || c == 'W') {
+				addClass(set, "alnum", 5);
+				SET_ADD(set, '_');
+			} else {
+				addClass(set, "space", 5);
+			}
+			if(c == 'W' || c == 'S')
+				invertSet(set);
+			return node;
+		}
+		return literalNode(ps, c);
+	}
+	if(ps->bExtended && *p == ')')
+		goto notsupp; /* unmatched ')' */
+	ps->p++;
+	return literalNode(ps, *p);
+
+notsupp:
+	ps->err = RSRX_NOTSUPP;
+	return -1;
+}
+
+/* parse the inside of an interval "{m}", "{m,}" or "{m,n}" */
+static int
+parseInterval(parser_t *ps, int *pMin, int *pMax)
+{
+	const unsigned char *p = ps->p;
+	int min = 0, max;
+
+	if(!isdigit(*p))
+		goto notsupp;
+	while(isdigit(*p) && min <= MAX_REPEAT)
+		min = min * 10 + *p++ - '0';
+	if(*p == ',') {
+		++p;
+		if(isdigit(*p)) {
+			max = 0;
+			while(isdigit(*p) && max <= MAX_REPEAT)
+				max = max * 10 + *p++ - '0';
+		} else {
+			max = -1;
+		}
+	} else {
+		max = min;
+	}
+	if(ps->bExtended) {
+		if(*p != '}')
+			goto notsupp;
+		++p;
+	} else {
+		if(p[0] != '\\' || p[1] != '}')
+			goto notsupp;
+		p += 2;
+	}
+	if(min > MAX_REPEAT || max > MAX_REPEAT || (max != -1 && min > max))
+		goto notsupp;
+	*pMin = min;
+	*pMax = max;
+	ps->p = p;
+	return 0;
+
+notsupp:
+	ps->err = RSRX_NOTSUPP;
+	return -1;
+}
+
+static int
+parseQuant(parser_t *ps, int atom)
+{
+	const unsigned char *p;
+	int min, max;
+	int opLen = ps->bExtended ? 1 : 2;
+
+	while(!ps->err) {
+		p = ps->p;
+		if(*p == '*') {
+			ps->p++;
+			atom = newNode(ps, A_STAR, atom, -1);
+		} else if(!isQuantOp(ps, p)) {
+			break;
+		} else {
+			ps->p += opLen;
+			switch(p[opLen - 1]) {
+			case '+':
+				atom = newNode(ps, A_PLUS, atom, -1);
+				break;
+			case '?':
+				atom = newNode(ps, A_QUEST, atom, -1);
+				break;
+			default: /* '{' */
+				if(parseInterval(ps, &min, &max) != 0)
+					return -1;
+				if((atom = newNode(ps, A_REPEAT, atom, -1)) != -1) {
+					ps->nodes[atom].min = min;
+					ps->nodes[atom].max = max;
+				}
+				break;
+			}
+		}
+	}
+	return atom;
+}
+
+static inline int
+atBranchEnd(parser_t *ps)
+{
+	return    *ps->p == '\0'
+	       || isAltOp(ps, ps->p)
+	       || (ps->depth > 0 && isCloseOp(ps, ps->p));
+}
+
+static int
+parseBranch(parser_t *ps)
+{
+	const unsigned char *p;
+	int node = -1;
+	int atom;
+	int bFirst = 1;
+
+	while(!ps->err && !atBranchEnd(ps)) {
+		p = ps->p;
+		/* in BRE, '^' is only an anchor at the start of a branch and '$'
+		 * only at its end. Anchors cannot be repeated.
+		 */
+		if(p[0] == '^' && (ps->bExtended || bFirst)) {
+			ps->p++;
+			atom = newNode(ps, A_BOL, -1, -1);
+		} else if(p[0] == '$' && (   ps->bExtended || p[1] == '\0'
+				          || (p[1] == '\\' && (p[2] == ')' || p[2] == '|')))) {
+			ps->p++;
+			atom = newNode(ps, A_EOL, -1, -1);
+		} else {
+			if(isQuantOp(ps, p)) {
+				/* a repetition operator where an atom is expected is a
+				 * literal '*' in BRE and invalid otherwise.
+				 */
+				if(ps->bExtended || p[0] != '*') {
+					ps->err = RSRX_NOTSUPP;
+					return -1;
+				}
+				ps->p++;
+				atom = literalNode(ps, '*');
+			} else {
+				atom = parseAtom(ps);
+			}
+			atom = parseQuant(ps, atom);
+		}
+		node = (node == -1) ? atom : newNode(ps, A_CAT, node, atom);
+		bFirst = 0;
+	}
+	if(node == -1)
+		node = newNode(ps, A_EMPTY, -1, -1);
+	return node;
+}
+
+static int
+parseAlt(parser_t *ps)
+{
+	int l, r;
+
+	l = parseBranch(ps);
+	while(!ps->err && isAltOp(ps, ps->p)) {
+		ps->p += ps->bExtended ? 1 : 2;
+		r = parseBranch(ps);
+		l = newNode(ps, A_ALT, l, r);
+	}
+	return l;
+}
+
+
+/* ------------------------------ NFA ------------------------------ */
+
+typedef struct compiler_s {
+	rsrx_t *re;
+	parser_t *ps;
+	int maxNfa;
+	int err;
+} compiler_t;
+
+static int
+emit(compiler_t *cc, int type, int out, int out1, int set)
+{
+	nfastate_t *newnfa;
+	nfastate_t *st;
+	rsrx_t *re = cc->re;
+
+	if(cc->err)
+		return -1;
+	if(re->nNfa == MAX_NFA_STATES) {
+		cc->err = RSRX_NOTSUPP;
+		return -1;
+	}
+	if(re->nNfa == cc->maxNfa) {
+		if((newnfa = realloc(re->nfa, sizeof(nfastate_t) * (cc->maxNfa + 128))) == NULL) {
+			cc->err = RSRX_ESPACE;
+			return -1;
+		}
+		re->nfa = newnfa;
+		cc->maxNfa += 128;
+	}
+	st = re->nfa + re->nNfa;
+	st->type = type;
+	st->out = out;
+	st->out1 = out1;
+	st->set = set;
+	return re->nNfa++;
+}
+
+/* emit the NFA for a syntax tree node, which continues at state next.
+ * Returns the node's start state or -1 on error. Nodes may be compiled
+ * multiple times (for intervals), each call emits a fresh copy.
+ */
+static int
+compileNode(compiler_t *cc, int node, int next)
+{
+	astnode_t *n = cc->ps->nodes + node;
+	int s, t, a, i;
+
+	if(cc->err || next == -1)
+		return -1;
+	switch(n->type) {
+	case A_SET:
+		return emit(cc, N_SET, next, -1, n->set);
+	case A_CAT:
+		return compileNode(cc, n->l, compileNode(cc, n->r, next));
+	case A_ALT:
+		a = compileNode(cc, n->l, next);
+		return emit(cc, N_SPLIT, a, compileNode(cc, n->r, next), -1);
+	case A_QUEST:
+		return emit(cc, N_SPLIT, compileNode(cc, n->l, next), next, -1);
+	case A_STAR:
+	case A_PLUS:
+		if((s = emit(cc, N_SPLIT, -1, next, -1)) == -1)
+			return -1;
+		a = compileNode(cc, n->l, s);
+		cc->re->nfa[s].out = a;
+		return (n->type == A_STAR) ? s : a;
+	case A_REPEAT:
+		if(n->max == -1) {
+			if((s = emit(cc, N_SPLIT, -1, next, -1)) == -1)
+				return -1;
+			cc->re->nfa[s].out = compileNode(cc, n->l, s);
+			t = s;
+		} else {
+			t = next;
+			for(i = 0 ; i < n->max - n->min ; ++i)
+				t = emit(cc, N_SPLIT, compileNode(cc, n->l, t), next, -1);
+		}
+		for(i = 0 ; i < n->min ; ++i)
+			t = compileNode(cc, n->l, t);
+		return t;
+	case A_EMPTY:
+		return next;
+	case A_BOL:
+		return emit(cc, N_BOL, next, -1, -1);
+	case A_EOL:
+		return emit(cc, N_EOL, next, -1, -1);
+	default:
+		cc->err = RSRX_NOTSUPP;
+		return -1;
+	}
+}
+
+
+/* ------------------------------ matching ------------------------------ */
+
+static inline void
+ssetClear(sset_t *set)
+{
+	set->n = 0;
+}
+
+static inline int
+ssetHas(sset_t *set, int s)
+{
+	return set->sparse[s] < set->n && set->dense[set->sparse[s]] == s;
+}
+
+static inline void
+ssetAdd(sset_t *set, int s)
+{
+	set->sparse[s] = set->n;
+	set->dense[set->n++] = s;
+}
+
+/* add the epsilon closure of state s to set */
+static void
+closure(rsrx_t *re, sset_t *set, int s, int flags, int *stack)
+{
+	nfastate_t *st;
+	int sp = 0;
+
+	stack[sp++] = s;
+	while(sp > 0) {
+		s = stack[--sp];
+		if(ssetHas(set, s))
+			continue;
+		ssetAdd(set, s);
+		st = re->nfa + s;
+		switch(st->type) {
+		case N_SPLIT:
+			stack[sp++] = st->out1;
+			stack[sp++] = st->out;
+			break;
+		case N_BOL:
+			if(flags & AT_START)
+				stack[sp++] = st->out;
+			break;
+		case N_EOL:
+			if(flags & AT_END)
+				stack[sp++] = st->out;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* advance from set cur over byte c to set next. As we look for a match
+ * anywhere in the string, a new match attempt is started at each position.
+ */
+static void
+step(rsrx_t *re, sset_t *cur, sset_t *next, int c, int *stack)
+{
+	nfastate_t *st;
+	int i;
+
+	ssetClear(next);
+	for(i = 0 ; i < cur->n ; ++i) {
+		st = re->nfa + cur->dense[i];
+		if(st->type == N_SET && SET_HAS(re->sets + st->set, c))
+			closure(re, next, st->out, 0, stack);
+	}
+	closure(re, next, re->start, 0, stack);
+}
+
+/* check if the string may end in state set cur */
+static int
+endAccept(rsrx_t *re, sset_t *cur, sset_t *tmp, int flags, int *stack)
+{
+	int i;
+
+	ssetClear(tmp);
+	for(i = 0 ; i < cur->n ; ++i) {
+		if(re->nfa[cur->dense[i]].type == N_EOL)
+			closure(re, tmp, re->nfa[cur->dense[i]].out, flags | AT_END, stack);
+	}
+	return ssetHas(tmp, re->match);
+}
+
+static int
+scratchEnsure(rsrxScratch_t **ppScratch, int n)
+{
+	rsrxScratch_t *sc = *ppScratch;
+
+	if(sc == NULL) {
+		if((sc = calloc(1, sizeof(rsrxScratch_t))) == NULL)
+			return RSRX_ESPACE;
+		*ppScratch = sc;
+	}
+	if(sc->cap >= n)
+		return RSRX_OK;
+	free(sc->a.dense); free(sc->a.sparse);
+	free(sc->b.dense); free(sc->b.sparse);
+	free(sc->tmp.dense); free(sc->tmp.sparse);
+	free(sc->stack);
+	sc->a.dense = malloc(n * sizeof(int));
+	sc->a.sparse = calloc(n, sizeof(int));
+	sc->b.dense = malloc(n * sizeof(int));
+	sc->b.sparse = calloc(n, sizeof(int));
+	sc->tmp.dense = malloc(n * sizeof(int));
+	sc->tmp.sparse = calloc(n, sizeof(int));
+	sc->stack = malloc((2 * n + 2) * sizeof(int));
+	if(   sc->a.dense == NULL || sc->a.sparse == NULL
+	   || sc->b.dense == NULL || sc->b.sparse == NULL
+	   || sc->tmp.dense == NULL || sc->tmp.sparse == NULL
+	   || sc->stack == NULL) {
+		sc->cap = 0;
+		return RSRX_ESPACE;
+	}
+	sc->cap = n;
+	return RSRX_OK;
+}
+
+/* match by simulating the NFA, used if there is no DFA */
+static int
+matchNFA(rsrx_t *re, const unsigned char *psz, rsrxScratch_t *sc)
+{
+	const unsigned char *p;
+	sset_t *cur = &sc->a, *next = &sc->b, *swap;
+
+	ssetClear(cur);
+	closure(re, cur, re->start, AT_START, sc->stack);
+	for(p = psz ; *p != '\0' ; ++p) {
+		if(ssetHas(cur, re->match))
+			return RSRX_OK;
+		step(re, cur, next, *p, sc->stack);
+		swap = cur;
+		cur = next;
+		next = swap;
+	}
+	if(ssetHas(cur, re->match))
+		return RSRX_OK;
+	return endAccept(re, cur, &sc->tmp, (p == psz) ? AT_START : 0, sc->stack)
+		? RSRX_OK : RSRX_NOMATCH;
+}
+
+static int
+matchDFA(rsrx_t *re, const unsigned char *psz)
+{
+	const int *const delta = re->delta;
+	const unsigned char *const flags = re->dfaFlags;
+	const int nCls = re->nClasses;
+	int s = 0;
+	int f = flags[0];
+
+	while(1) {
+		if(f & (DFA_ACCEPT | DFA_DEAD | DFA_ACCEL)) {
+			if(f & DFA_ACCEPT)
+				return RSRX_OK;
+			if(f & DFA_DEAD)
+				return RSRX_NOMATCH;
+			/* skip all bytes that keep us in this state */
+			psz = (const unsigned char*) strpbrk((const char*) psz, re->accel[s]);
+			if(psz == NULL)
+				break;
+		}
+		if(*psz == '\0')
+			break;
+		s = delta[s * nCls + re->cls[*psz++]];
+		f = flags[s];
+	}
+	return (flags[s] & DFA_ENDACCEPT) ? RSRX_OK : RSRX_NOMATCH;
+}
+
+
+/* ------------------------------ DFA construction ------------------------------ */
+
+/* compute byte classes: bytes that are members of exactly the same sets
+ * share a class.
+ */
+static void
+computeClasses(rsrx_t *re)
+{
+	int remap[512];
+	unsigned char newcls[256];
+	int i, b, key, n;
+
+	memset(re->cls, 0, sizeof(re->cls));
+	re->nClasses = 1;
+	for(i = 0 ; i < re->nSets ; ++i) {
+		for(b = 0 ; b < 512 ; ++b)
+			remap[b] = -1;
+		n = 0;
+		for(b = 0 ; b < 256 ; ++b) {
+			key = re->cls[b] * 2 + (SET_HAS(re->sets + i, b) ? 1 : 0);
+			if(remap[key] == -1)
+				remap[key] = n++;
+			newcls[b] = remap[key];
+		}
+		memcpy(re->cls, newcls, sizeof(re->cls));
+		re->nClasses = n;
+	}
+}
+
+static int
+cmpInt(const void *a, const void *b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+/* extract the sorted list of "important" states (those that matter for
+ * transitions, end checks and acceptance) from a state set.
+ */
+static int
+getKey(rsrx_t *re, sset_t *set, int *key)
+{
+	int i, n = 0, t;
+	for(i = 0 ; i < set->n ; ++i) {
+		t = re->nfa[set->dense[i]].type;
+		if(t == N_SET || t == N_EOL || t == N_MATCH)
+			key[n++] = set->dense[i];
+	}
+	qsort(key, n, sizeof(int), cmpInt);
+	return n;
+}
+
+static unsigned
+hashKey(int *key, int n)
+{
+	unsigned h = 2166136261u;
+	int i;
+	for(i = 0 ; i < n ; ++i)
+		h = (h ^ (unsigned) key[i]) * 16777619u;
+	return h;
+}
+
+static void
+freeDFA(rsrx_t *re)
+{
+	int i;
+
+	if(re->accel != NULL) {
+		for(i = 0 ; i < re->nDfa ; ++i)
+			free(re->accel[i]);
+		free(re->accel);
+	}
+	free(re->delta);
+	free(re->dfaFlags);
+	re->accel = NULL;
+	re->delta = NULL;
+	re->dfaFlags = NULL;
+	re->nDfa = 0;
+}
+
+
+/* find the states which are left by only a few bytes and record these
+ * bytes, so that matchDFA() can skip everything else quickly.
+ */
+static int
+computeAccel(rsrx_t *re)
+{
+	char leave[256];
+	int d, c, n;
+
+	if((re->accel = calloc(re->nDfa, sizeof(char*))) == NULL)
+		return RSRX_ESPACE;
+	for(d = 0 ; d < re->nDfa ; ++d) {
+		if(re->dfaFlags[d] & (DFA_ACCEPT | DFA_DEAD))
+			continue;
+		n = 0;
+		for(c = 1 ; c < 256 && n <= MAX_ACCEL_BYTES ; ++c) {
+			if(re->delta[d * re->nClasses + re->cls[c]] != d)
+				leave[n++] = c;
+		}
+		if(n > MAX_ACCEL_BYTES)
+			continue;
+		if((re->accel[d] = malloc(n + 1)) == NULL)
+			return RSRX_ESPACE;
+		memcpy(re->accel[d], leave, n);
+		re->accel[d][n] = '\0';
+		re->dfaFlags[d] |= DFA_ACCEL;
+	}
+	return RSRX_OK;
+}
+
+
+/* build the DFA. If it grows too large or we run out of memory, we
+ * simply do without it.
+ */
+static void
+buildDFA(rsrx_t *re)
+{
+	rsrxScratch_t *sc = NULL;
+	int **keys = NULL;
+	int *keyLen = NULL;
+	int *key = NULL;
+	int hashSlots[2 * MAX_DFA_STATES];
+	int rep[256];
+	unsigned h;
+	int d, c, i, n, id;
+	int bOK = 0;
+
+	computeClasses(re);
+	for(c = 255 ; c >= 0 ; --c)
+		rep[re->cls[c]] = c;
+	if(   scratchEnsure(&sc, re->nNfa) != RSRX_OK
+	   || (keys = calloc(MAX_DFA_STATES, sizeof(int*))) == NULL
+	   || (keyLen = malloc(MAX_DFA_STATES * sizeof(int))) == NULL
+	   || (key = malloc(re->nNfa * sizeof(int))) == NULL
+	   || (re->delta = malloc(MAX_DFA_STATES * re->nClasses * sizeof(int))) == NULL
+	   || (re->dfaFlags = malloc(MAX_DFA_STATES)) == NULL)
+		goto done;
+	for(i = 0 ; i < 2 * MAX_DFA_STATES ; ++i)
+		hashSlots[i] = -1;
+
+	/* the initial state is special, as it is computed with "at start"
+	 * semantics. So it is never entered into the hash table.
+	 */
+	ssetClear(&sc->a);
+	closure(re, &sc->a, re->start, AT_START, sc->stack);
+	n = getKey(re, &sc->a, key);
+	if((keys[0] = malloc((n + 1) * sizeof(int))) == NULL)
+		goto done;
+	memcpy(keys[0], key, n * sizeof(int));
+	keyLen[0] = n;
+	re->dfaFlags[0] =   (ssetHas(&sc->a, re->match) ? DFA_ACCEPT : 0)
+			  | (n == 0 ? DFA_DEAD : 0)
+			  | (endAccept(re, &sc->a, &sc->tmp, AT_START, sc->stack) ? DFA_ENDACCEPT : 0);
+	re->nDfa = 1;
+
+	for(d = 0 ; d < re->nDfa ; ++d) {
+		if(re->dfaFlags[d] & (DFA_ACCEPT | DFA_DEAD)) {
+			for(c = 0 ; c < re->nClasses ; ++c)
+				re->delta[d * re->nClasses + c] = d;
+			continue;
+		}
+		ssetClear(&sc->a);
+		for(i = 0 ; i < keyLen[d] ; ++i)
+			ssetAdd(&sc->a, keys[d][i]);
+		for(c = 0 ; c < re->nClasses ; ++c) {
+			step(re, &sc->a, &sc->b, rep[c], sc->stack);
+			n = getKey(re, &sc->b, key);
+			h = hashKey(key, n) % (2 * MAX_DFA_STATES);
+			while((id = hashSlots[h]) != -1) {
+				if(keyLen[id] == n && !memcmp(keys[id], key, n * sizeof(int)))
+					break;
+				h = (h + 1) % (2 * MAX_DFA_STATES);
+			}
+			if(id == -1) {
+				if(re->nDfa == MAX_DFA_STATES)
+					goto done; /* too large */
+				id = re->nDfa;
+				if((keys[id] = malloc((n + 1) * sizeof(int))) == NULL)
+					goto done;
+				memcpy(keys[id], key, n * sizeof(int));
+				keyLen[id] = n;
+				re->dfaFlags[id] =   (ssetHas(&sc->b, re->match) ? DFA_ACCEPT : 0)
+						   | (n == 0 ? DFA_DEAD : 0)
+						   | (endAccept(re, &sc->b, &sc->tmp, 0, sc->stack)
+						      ? DFA_ENDACCEPT : 0);
+				hashSlots[h] = id;
+				re->nDfa++;
+			}
+			re->delta[d * re->nClasses + c] = id;
+		}
+	}
+	if(computeAccel(re) != RSRX_OK)
+		goto done;
+	bOK = 1;
+
+done:
+	if(!bOK) {
+		freeDFA(re);
+	}
+	if(keys != NULL) {
+		for(i = 0 ; i < MAX_DFA_STATES ; ++i)
+			free(keys[i]);
+		free(keys);
+	}
+	free(keyLen);
+	free(key);
+	rsrxScratchFree(sc);
+}
+
+
+/* ------------------------------ interface ------------------------------ */
+
+/* compile a regex. cflags are the regcomp() flags. Returns RSRX_NOTSUPP
+ * if the pattern uses features we do not support. Note that the pattern
+ * must already have been checked by regcomp(), we do not try to detect
+ * all syntax errors.
+ */
+int
+rsrxCompile(rsrx_t **ppRe, const char *regex, int cflags)
+{
+	parser_t ps;
+	compiler_t cc;
+	rsrx_t *re = NULL;
+	int root;
+	int ret;
+
+	*ppRe = NULL;
+	if(cflags & REG_NEWLINE)
+		return RSRX_NOTSUPP;
+	memset(&ps, 0, sizeof(ps));
+	ps.p = (const unsigned char*) regex;
+	ps.bExtended = (cflags & REG_EXTENDED) ? 1 : 0;
+	ps.bIcase = (cflags & REG_ICASE) ? 1 : 0;
+	root = parseAlt(&ps);
+	if(!ps.err && *ps.p != '\0')
+		ps.err = RSRX_NOTSUPP;
+	if(ps.err) {
+		ret = ps.err;
+		goto done;
+	}
+
+	if((re = calloc(1, sizeof(rsrx_t))) == NULL) {
+		ret = RSRX_ESPACE;
+		goto done;
+	}
+	re->sets = ps.sets;
+	re->nSets = ps.nSets;
+	ps.sets = NULL;
+	memset(&cc, 0, sizeof(cc));
+	cc.re = re;
+	cc.ps = &ps;
+	re->match = emit(&cc, N_MATCH, -1, -1, -1);
+	re->start = compileNode(&cc, root, re->match);
+	if(cc.err) {
+		ret = cc.err;
+		goto done;
+	}
+	buildDFA(re);
+	*ppRe = re;
+	re = NULL;
+	ret = RSRX_OK;
+
+done:
+	if(re != NULL)
+		rsrxFree(re);
+	free(ps.nodes);
+	free(ps.sets);
+	return ret;
+}
+
+/* check if the regex matches anywhere inside the string. The scratch
+ * space is only needed if there is no DFA. It is allocated or grown as
+ * required; the caller must free it with rsrxScratchFree() when done.
+ * A scratch space must not be used by more than one thread concurrently.
+ */
+int
+rsrxMatch(rsrx_t *pRe, const unsigned char *psz, rsrxScratch_t **ppScratch)
+{
+	int ret;
+
+	if(pRe->delta != NULL)
+		return matchDFA(pRe, psz);
+	if((ret = scratchEnsure(ppScratch, pRe->nNfa)) != RSRX_OK)
+		return ret;
+	return matchNFA(pRe, psz, *ppScratch);
+}
+
+int
+rsrxHasDFA(rsrx_t *pRe)
+{
+	return pRe->delta != NULL;
+}
+
+void
+rsrxFree(rsrx_t *pRe)
+{
+	if(pRe == NULL)
+		return;
+	freeDFA(pRe);
+	free(pRe->nfa);
+	free(pRe->sets);
+	free(pRe);
+}
+
+void
+rsrxScratchFree(rsrxScratch_t *sc)
+{
+	if(sc == NULL)
+		return;
+	free(sc->a.dense); free(sc->a.sparse);
+	free(sc->b.dense); free(sc->b.sparse);
+	free(sc->tmp.dense); free(sc->tmp.sparse);
+	free(sc->stack);
+	free(sc);
+}
+
+/* vi:set ai:
+ */
@@ -0,0 +1,39 @@
+/* Definitions for rsyslog's own (linear-time) regex engine.
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_RSREGEX_H
+#define INCLUDED_RSREGEX_H
+
+/* return codes */
+#define RSRX_OK		0
+#define RSRX_NOMATCH	1
+#define RSRX_NOTSUPP	2	/* pattern not supported, use POSIX engine */
+#define RSRX_ESPACE	3	/* out of memory */
+
+typedef struct rsrx_s rsrx_t;
+typedef struct rsrxScratch_s rsrxScratch_t;
+
+int rsrxCompile(rsrx_t **ppRe, const char *regex, int cflags);
+int rsrxMatch(rsrx_t *pRe, const unsigned char *psz, rsrxScratch_t **ppScratch);
+int rsrxHasDFA(rsrx_t *pRe);
+void rsrxFree(rsrx_t *pRe);
+void rsrxScratchFree(rsrxScratch_t *pScratch);
+
+#endif /* #ifndef INCLUDED_RSREGEX_H */
@@ -48,6 +48,7 @@
 #include "rainerscript.h"
 #include "srUtils.h"
 #include "modules.h"
+#include "acmatch.h"
 #include "dirty.h" /* for main ruleset queue creation */
 
 /* static data */
@@ -68,7 +69,8 @@ static struct cnfparamblk rspblk =
 
 /* forward definitions */
 static rsRetVal processBatch(batch_t *pBatch);
-static rsRetVal scriptExec(struct cnfstmt *root, batch_t *pBatch, sbool *active);
+struct scriptExecCtx_s;
+static rsRetVal scriptExec(struct cnfstmt *root, struct scriptExecCtx_s *ctx, sbool *active);
 
 
 /* ---------- linked-list key handling functions (ruleset) ---------- */
@@ -118,6 +120,17 @@ scriptIterateAllActions(struct cnfstmt *root, rsRetVal (*pFunc)(void*, void*), v
 		case S_PROPFILT:
 			scriptIterateAllActions(stmt->d.s_propfilt.t_then,
 						pFunc, pParam);
+			if(stmt->d.s_propfilt.t_else != NULL)
+				scriptIterateAllActions(stmt->d.s_propfilt.t_else,
+							pFunc, pParam);
+			break;
+		case S_PROPGRP:
+			scriptIterateAllActions(stmt->d.s_propgrp.members,
+						pFunc, pParam);
+			break;
+		case S_SWITCH:
+			scriptIterateAllActions(stmt->d.s_switch.members,
+						pFunc, pParam);
 			break;
 		default:
 			dbgprintf("error: unknown stmt type %u during iterateAll\n",
@@ -214,13 +227,98 @@ finalize_it:
 	RETiRet;
 }
 
-/* return a new "active" structure for the batch. Free with freeActive(). */
-static inline sbool *newActive(batch_t *pBatch)
+/* Execution context for pushing a single batch through the rule engine.
+ * Filter statements need "active" arrays (one entry per batch element)
+ * to describe which messages take the then- and else-paths. Previously,
+ * each filter statement malloc()ed and free()d its own array, which is
+ * quite costly with deep rule trees. We now take these arrays from a pool
+ * that lives as long as the batch is processed. Arrays are handed out in
+ * stack order, which fits the recursive nature of scriptExec(). The pool
+ * also provides the property value column used by columnar filter
+ * evaluation (see execPROPFILT()).
+ */
+typedef struct propColElem_s {
+	uchar *pVal;			/* property value, NULL if not fetched */
+	rs_size_t lenVal;		/* its length */
+	unsigned short bMustBeFreed;	/* must pVal be freed? */
+} propColElem_t;
+
+typedef struct scriptExecCtx_s {
+	batch_t *pBatch;
+	int nElem;		/* size of each "active" array */
+	int nActive;		/* number of arrays currently allocated */
+	int iActiveTop;		/* index of next free array */
+	sbool **ppActive;	/* the arrays themselves */
+	propColElem_t *propCol;	/* property column, allocated on first use */
+} scriptExecCtx_t;
+
+static inline void
+scriptExecCtxInit(scriptExecCtx_t *ctx, batch_t *pBatch)
+{
+	ctx->pBatch = pBatch;
+	ctx->nElem = batchNumMsgs(pBatch);
+	ctx->nActive = 0;
+	ctx->iActiveTop = 0;
+	ctx->ppActive = NULL;
+	ctx->propCol = NULL;
+}
+
+static inline void
+scriptExecCtxExit(scriptExecCtx_t *ctx)
 {
-	return malloc(sizeof(sbool) * batchNumMsgs(pBatch));
-	
+	int i;
+	for(i = 0 ; i < ctx->nActive ; ++i)
+		free(ctx->ppActive[i]);
+	free(ctx->ppActive);
+	free(ctx->propCol);
+}
+
+/* return a new "active" structure for the batch. Free with freeActive().
+ * Must be freed in reverse order of allocation. Returns NULL if we run
+ * out of memory.
+ */
+static inline sbool *
+newActive(scriptExecCtx_t *ctx)
+{
+	sbool **ppNew;
+	sbool *newAct;
+
+	if(ctx->iActiveTop == ctx->nActive) {
+		if((newAct = malloc(sizeof(sbool) * ctx->nElem)) == NULL)
+			return NULL;
+		if((ppNew = realloc(ctx->ppActive, sizeof(sbool*) * (ctx->nActive + 1))) == NULL) {
+			free(newAct);
+			return NULL;
+		}
+		ctx->ppActive = ppNew;
+		ctx->ppActive[ctx->nActive++] = newAct;
+	}
+	return ctx->ppActive[ctx->iActiveTop++];
+}
+static inline void
+freeActive(scriptExecCtx_t *ctx, sbool __attribute__((unused)) *active)
+{
+	assert(ctx->ppActive[ctx->iActiveTop-1] == active);
+	--ctx->iActiveTop;
+}
+
+/* set elseAct to "active AND NOT thenAct" and return the number of messages
+ * that are active in the result. Note that thenAct is always a subset of
+ * active, as filter conditions are only evaluated for active messages.
+ */
+static inline int
+maskAndNot(sbool *elseAct, batch_t *pBatch, sbool *active, sbool *thenAct)
+{
+	int i;
+	int nActive = 0;
+	for(i = 0 ; i < batchNumMsgs(pBatch) ; ++i) {
+		elseAct[i] =    pBatch->pElem[i].state != BATCH_STATE_DISC
+			     && (active == NULL || active[i])
+			     && !thenAct[i];
+		nActive += elseAct[i];
+	}
+	return nActive;
 }
-static inline void freeActive(sbool *active) { free(active); }
 
 
 /* for details, see scriptExec() header comment! */
@@ -232,6 +330,11 @@ execAct(struct cnfstmt *stmt, batch_t *pBatch, sbool *active)
 dbgprintf("RRRR: execAct [%s]: batch of %d elements, active %p\n", modGetName(stmt->d.act->pMod), batchNumMsgs(pBatch), active);
 	pBatch->active = active;
 	stmt->d.act->submitToActQ(stmt->d.act, pBatch);
+	/* message modification modules may have changed the messages, so
+	 * strings rendered by previous actions can no longer be used.
+	 */
+	if(stmt->d.act->eParamPassing == ACT_MSG_PASSING)
+		batchInvalidateRender(pBatch);
 	RETiRet;
 }
 
@@ -248,6 +351,7 @@ execSet(struct cnfstmt *stmt, batch_t *pBatch, sbool *active)
 			msgSetJSONFromVar((msg_t*)pBatch->pElem[i].pUsrp, stmt->d.s_set.varname,
 					  &result);
 			varDelete(&result);
+			batchElemInvalidateRender(&(pBatch->pElem[i]));
 		}
 	}
 	RETiRet;
@@ -262,6 +366,7 @@ execUnset(struct cnfstmt *stmt, batch_t *pBatch, sbool *active)
 		if(   pBatch->pElem[i].state != BATCH_STATE_DISC
 		   && (active == NULL || active[i])) {
 			msgUnsetJSON((msg_t*)pBatch->pElem[i].pUsrp, stmt->d.s_unset.varname);
+			batchElemInvalidateRender(&(pBatch->pElem[i]));
 		}
 	}
 	RETiRet;
@@ -285,60 +390,85 @@ execStop(batch_t *pBatch, sbool *active)
 	RETiRet;
 }
 
+/* Run the then- and else-part of a filter. thenAct must already contain
+ * the evaluated filter condition (for active messages only), nThen is
+ * the number of messages that matched. Subtrees are only executed if at
+ * least one message takes the respective path, so messages that do not
+ * match do not cause any cost inside large rule trees.
+ * The else-mask is computed only after the then-part has been executed,
+ * because messages may have been discarded inside it.
+ */
+static rsRetVal
+execThenElse(scriptExecCtx_t *ctx, struct cnfstmt *t_then, struct cnfstmt *t_else,
+	     sbool *active, sbool *thenAct, int nThen)
+{
+	sbool *elseAct;
+	DEFiRet;
+
+	if(t_then != NULL && nThen > 0) {
+		CHKiRet(scriptExec(t_then, ctx, thenAct));
+	}
+	if(t_else != NULL && !*(ctx->pBatch->pbShutdownImmediate)) {
+		CHKmalloc(elseAct = newActive(ctx));
+		if(maskAndNot(elseAct, ctx->pBatch, active, thenAct) > 0)
+			iRet = scriptExec(t_else, ctx, elseAct);
+		freeActive(ctx, elseAct);
+	}
+finalize_it:
+	RETiRet;
+}
+
 /* for details, see scriptExec() header comment! */
 // save current filter, evaluate new one
 // perform then (if any message)
 // if ELSE given:
-//    set new filter, inverted
+//    set new filter to "active AND NOT then"
 //    perform else (if any messages)
 static rsRetVal
-execIf(struct cnfstmt *stmt, batch_t *pBatch, sbool *active)
+execIf(struct cnfstmt *stmt, scriptExecCtx_t *ctx, sbool *active)
 {
+	batch_t *pBatch = ctx->pBatch;
 	sbool *newAct;
 	int i;
+	int nThen = 0;
 	sbool bRet;
 	DEFiRet;
-	newAct = newActive(pBatch);
+	CHKmalloc(newAct = newActive(ctx));
 	for(i = 0 ; i < batchNumMsgs(pBatch) && !*(pBatch->pbShutdownImmediate) ; ++i) {
-		if(pBatch->pElem[i].state == BATCH_STATE_DISC)
-			continue; /* will be ignored in any case */
-		if(active == NULL || active[i]) {
+		if(   pBatch->pElem[i].state != BATCH_STATE_DISC
+		   && (active == NULL || active[i])) {
 			bRet = cnfexprEvalBool(stmt->d.s_if.expr,
-					       (msg_t*)(pBatch->pElem[i].pUsrp));
+					       (msg_t*)(pBatch->pElem[i].pUsrp)) ? 1 : 0;
 		} else 
 			bRet = 0;
 		newAct[i] = bRet;
+		nThen += bRet;
 		DBGPRINTF("batch: item %d: expr eval: %d\n", i, bRet);
 	}
 
-	if(stmt->d.s_if.t_then != NULL) {
-		scriptExec(stmt->d.s_if.t_then, pBatch, newAct);
-	}
-	if(stmt->d.s_if.t_else != NULL) {
-		for(i = 0 ; i < batchNumMsgs(pBatch) && !*(pBatch->pbShutdownImmediate)
-		    ; ++i)
-			if(pBatch->pElem[i].state != BATCH_STATE_DISC)
-				newAct[i] = !newAct[i];
-		scriptExec(stmt->d.s_if.t_else, pBatch, newAct);
-	}
-	freeActive(newAct);
+	iRet = execThenElse(ctx, stmt->d.s_if.t_then, stmt->d.s_if.t_else,
+			    active, newAct, nThen);
+	freeActive(ctx, newAct);
+finalize_it:
 	RETiRet;
 }
 
 /* for details, see scriptExec() header comment! */
-static void
-execPRIFILT(struct cnfstmt *stmt, batch_t *pBatch, sbool *active)
+static rsRetVal
+execPRIFILT(struct cnfstmt *stmt, scriptExecCtx_t *ctx, sbool *active)
 {
+	batch_t *pBatch = ctx->pBatch;
 	sbool *newAct;
 	msg_t *pMsg;
 	int bRet;
 	int i;
-	newAct = newActive(pBatch);
+	int nThen = 0;
+	DEFiRet;
+	CHKmalloc(newAct = newActive(ctx));
 	for(i = 0 ; i < batchNumMsgs(pBatch) && !*(pBatch->pbShutdownImmediate) ; ++i) {
-		if(pBatch->pElem[i].state == BATCH_STATE_DISC)
-			continue; /* will be ignored in any case */
 		pMsg = (msg_t*)(pBatch->pElem[i].pUsrp);
-		if(active == NULL || active[i]) {
+		if(   pBatch->pElem[i].state != BATCH_STATE_DISC
+		   && (active == NULL || active[i])) {
 			if( (stmt->d.s_prifilt.pmask[pMsg->iFacility] == TABLE_NOPRI) ||
 			   ((stmt->d.s_prifilt.pmask[pMsg->iFacility]
 			            & (1<<pMsg->iSeverity)) == 0) )
@@ -348,37 +478,25 @@ execPRIFILT(struct cnfstmt *stmt, batch_t *pBatch, sbool *active)
 		} else 
 			bRet = 0;
 		newAct[i] = bRet;
+		nThen += bRet;
 		DBGPRINTF("batch: item %d PRIFILT %d\n", i, newAct[i]);
 	}
 
-	if(stmt->d.s_prifilt.t_then != NULL) {
-		scriptExec(stmt->d.s_prifilt.t_then, pBatch, newAct);
-	}
-	if(stmt->d.s_prifilt.t_else != NULL) {
-		for(i = 0 ; i < batchNumMsgs(pBatch) && !*(pBatch->pbShutdownImmediate)
-		    ; ++i)
-			if(pBatch->pElem[i].state != BATCH_STATE_DISC)
-				newAct[i] = !newAct[i];
-		scriptExec(stmt->d.s_prifilt.t_else, pBatch, newAct);
-	}
-	freeActive(newAct);
+	iRet = execThenElse(ctx, stmt->d.s_prifilt.t_then, stmt->d.s_prifilt.t_else,
+			    active, newAct, nThen);
+	freeActive(ctx, newAct);
+finalize_it:
+	RETiRet;
 }
 
 
-/* helper to execPROPFILT(), as the evaluation itself is quite lengthy */
+/* helper to execPROPFILT(), as the evaluation itself is quite lengthy.
+ * The property value has already been obtained by the caller.
+ */
 static int
-evalPROPFILT(struct cnfstmt *stmt, msg_t *pMsg)
+evalPROPFILT(struct cnfstmt *stmt, uchar *pszPropVal, rs_size_t propLen)
 {
-	unsigned short pbMustBeFreed;
-	uchar *pszPropVal;
 	int bRet = 0;
-	rs_size_t propLen;
-
-	if(stmt->d.s_propfilt.propID == PROP_INVALID)
-		goto done;
-
-	pszPropVal = MsgGetProp(pMsg, NULL, stmt->d.s_propfilt.propID,
-				stmt->d.s_propfilt.propName, &propLen, &pbMustBeFreed);
 
 	/* Now do the compares (short list currently ;)) */
 	switch(stmt->d.s_propfilt.operation ) {
@@ -446,34 +564,218 @@ evalPROPFILT(struct cnfstmt *stmt, msg_t *pMsg)
 		}
 	}
 
-	/* cleanup */
-	if(pbMustBeFreed)
-		free(pszPropVal);
-done:
 	return bRet;
 }
 
-/* for details, see scriptExec() header comment! */
-static void
-execPROPFILT(struct cnfstmt *stmt, batch_t *pBatch, sbool *active)
+/* Fetch the property a PROPFILT refers to for all active messages of
+ * the batch into the context's property column. Only the fetch is done
+ * here, so that the actual compare can run in a tight loop over the
+ * column. The column must be released via releasePropCol().
+ */
+static rsRetVal
+fetchPropCol(struct cnfstmt *stmt, scriptExecCtx_t *ctx, sbool *active)
+{
+	batch_t *pBatch = ctx->pBatch;
+	propColElem_t *col;
+	int i;
+	DEFiRet;
+
+	if(ctx->propCol == NULL) {
+		CHKmalloc(ctx->propCol = malloc(sizeof(propColElem_t) * ctx->nElem));
+	}
+	col = ctx->propCol;
+	for(i = 0 ; i < batchNumMsgs(pBatch) ; ++i) {
+		if(   pBatch->pElem[i].state != BATCH_STATE_DISC
+		   && (active == NULL || active[i])) {
+			col[i].pVal = MsgGetProp((msg_t*)(pBatch->pElem[i].pUsrp), NULL,
+						 stmt->d.s_propfilt.propID,
+						 stmt->d.s_propfilt.propName,
+						 &col[i].lenVal, &col[i].bMustBeFreed);
+		} else {
+			col[i].pVal = NULL;
+			col[i].bMustBeFreed = 0;
+		}
+	}
+finalize_it:
+	RETiRet;
+}
+
+static inline void
+releasePropCol(scriptExecCtx_t *ctx)
 {
+	int i;
+	for(i = 0 ; i < batchNumMsgs(ctx->pBatch) ; ++i) {
+		if(ctx->propCol[i].bMustBeFreed) {
+			free(ctx->propCol[i].pVal);
+			ctx->propCol[i].bMustBeFreed = 0;
+		}
+	}
+}
+
+/* for details, see scriptExec() header comment!
+ * Property-based filters are evaluated column-wise: the property is first
+ * fetched for the whole batch, then the compare runs over the column.
+ */
+static rsRetVal
+execPROPFILT(struct cnfstmt *stmt, scriptExecCtx_t *ctx, sbool *active)
+{
+	batch_t *pBatch = ctx->pBatch;
+	propColElem_t *col;
 	sbool *thenAct;
 	sbool bRet;
 	int i;
-	thenAct = newActive(pBatch);
+	int nThen = 0;
+	DEFiRet;
+
+	CHKmalloc(thenAct = newActive(ctx));
+	memset(thenAct, 0, batchNumMsgs(pBatch));
+	if(stmt->d.s_propfilt.propID != PROP_INVALID) {
+		CHKiRet(fetchPropCol(stmt, ctx, active));
+		col = ctx->propCol;
+		for(i = 0 ; i < batchNumMsgs(pBatch) && !*(pBatch->pbShutdownImmediate) ; ++i) {
+			if(col[i].pVal != NULL) {
+				bRet = evalPROPFILT(stmt, col[i].pVal, col[i].lenVal);
+			} else 
+				bRet = 0;
+			thenAct[i] = bRet;
+			nThen += bRet;
+			DBGPRINTF("batch: item %d PROPFILT %d\n", i, thenAct[i]);
+		}
+		releasePropCol(ctx);
+	}
+
+	iRet = execThenElse(ctx, stmt->d.s_propfilt.t_then, stmt->d.s_propfilt.t_else,
+			    active, thenAct, nThen);
+
+finalize_it:
+	if(thenAct != NULL)
+		freeActive(ctx, thenAct);
+	RETiRet;
+}
+
+/* for details, see scriptExec() header comment!
+ * A PROPFILT group is evaluated by scanning the property once per message
+ * with the group's matcher, which records the result for all members.
+ * Then the members are executed in order, just like individual PROPFILTs.
+ * Messages discarded by an earlier member are not active for the later
+ * ones, exactly as without grouping.
+ */
+static rsRetVal
+execPROPGRP(struct cnfstmt *stmt, scriptExecCtx_t *ctx, sbool *active)
+{
+	batch_t *pBatch = ctx->pBatch;
+	struct cnfstmt *memb;
+	propColElem_t *col;
+	sbool *matches = NULL;
+	sbool *thenAct = NULL;
+	sbool bRet;
+	const int nMembers = stmt->d.s_propgrp.nMembers;
+	int i, k;
+	int nThen;
+	DEFiRet;
+
+	CHKmalloc(matches = calloc(batchNumMsgs(pBatch) * nMembers, sizeof(sbool)));
+	CHKiRet(fetchPropCol(stmt->d.s_propgrp.members, ctx, active));
+	col = ctx->propCol;
 	for(i = 0 ; i < batchNumMsgs(pBatch) && !*(pBatch->pbShutdownImmediate) ; ++i) {
-		if(pBatch->pElem[i].state == BATCH_STATE_DISC)
-			continue; /* will be ignored in any case */
-		if(active == NULL || active[i]) {
-			bRet = evalPROPFILT(stmt, (msg_t*)(pBatch->pElem[i].pUsrp));
-		} else 
-			bRet = 0;
-		thenAct[i] = bRet;
-		DBGPRINTF("batch: item %d PROPFILT %d\n", i, thenAct[i]);
+		if(col[i].pVal != NULL)
+			acmatchScan(stmt->d.s_propgrp.matcher, col[i].pVal, matches + i * nMembers);
+	}
+	releasePropCol(ctx);
+
+	CHKmalloc(thenAct = newActive(ctx));
+	for(memb = stmt->d.s_propgrp.members, k = 0 ; memb != NULL ; memb = memb->next, ++k) {
+		nThen = 0;
+		for(i = 0 ; i < batchNumMsgs(pBatch) ; ++i) {
+			if(   pBatch->pElem[i].state != BATCH_STATE_DISC
+			   && (active == NULL || active[i])) {
+				bRet = matches[i * nMembers + k];
+				if(memb->d.s_propfilt.isNegated)
+					bRet = !bRet;
+			} else
+				bRet = 0;
+			thenAct[i] = bRet;
+			nThen += bRet;
+		}
+		DBGPRINTF("batch: PROPGRP member %d matched %d messages\n", k, nThen);
+		CHKiRet(execThenElse(ctx, memb->d.s_propfilt.t_then, memb->d.s_propfilt.t_else,
+				     active, thenAct, nThen));
+	}
+
+finalize_it:
+	if(thenAct != NULL)
+		freeActive(ctx, thenAct);
+	free(matches);
+	RETiRet;
+}
+
+/* set the mask for all active messages that belong to case caseNum of
+ * a SWITCH. Returns the number of such messages.
+ */
+static inline int
+maskSwitchCase(sbool *newAct, batch_t *pBatch, sbool *active, int *caseOf, int caseNum)
+{
+	int i;
+	int nActive = 0;
+	for(i = 0 ; i < batchNumMsgs(pBatch) ; ++i) {
+		newAct[i] =    pBatch->pElem[i].state != BATCH_STATE_DISC
+			    && (active == NULL || active[i])
+			    && caseOf[i] == caseNum;
+		nActive += newAct[i];
+	}
+	return nActive;
+}
+
+/* for details, see scriptExec() header comment!
+ * The case of each message is found by a single hash lookup, then the
+ * cases are executed in order. For an else-chain, the messages that
+ * match no case run the else-part of the last IF; for siblings, each
+ * IF's own else-part is run, just like with individual IFs.
+ */
+static rsRetVal
+execSWITCH(struct cnfstmt *stmt, scriptExecCtx_t *ctx, sbool *active)
+{
+	batch_t *pBatch = ctx->pBatch;
+	struct cnfstmt *memb;
+	struct cnfstmt *t_else;
+	int *caseOf = NULL;
+	sbool *thenAct = NULL;
+	int i, k;
+	int nThen;
+	DEFiRet;
+
+	CHKmalloc(caseOf = calloc(batchNumMsgs(pBatch), sizeof(int)));
+	for(i = 0 ; i < batchNumMsgs(pBatch) && !*(pBatch->pbShutdownImmediate) ; ++i) {
+		if(   pBatch->pElem[i].state != BATCH_STATE_DISC
+		   && (active == NULL || active[i])) {
+			caseOf[i] = cnfstmtSwitchLookup(stmt, pBatch->pElem[i].pUsrp);
+			DBGPRINTF("batch: item %d SWITCH case %d\n", i, caseOf[i]);
+		}
 	}
 
-	scriptExec(stmt->d.s_propfilt.t_then, pBatch, thenAct);
-	freeActive(thenAct);
+	CHKmalloc(thenAct = newActive(ctx));
+	for(k = 0 ; k < stmt->d.s_switch.nCases ; ++k) {
+		memb = stmt->d.s_switch.cases[k];
+		nThen = maskSwitchCase(thenAct, pBatch, active, caseOf, k + 1);
+		if(stmt->d.s_switch.bElseChain) {
+			if(nThen > 0 && memb->d.s_if.t_then != NULL)
+				CHKiRet(scriptExec(memb->d.s_if.t_then, ctx, thenAct));
+		} else {
+			CHKiRet(execThenElse(ctx, memb->d.s_if.t_then, memb->d.s_if.t_else,
+					     active, thenAct, nThen));
+		}
+	}
+	if(stmt->d.s_switch.bElseChain) {
+		t_else = stmt->d.s_switch.cases[stmt->d.s_switch.nCases - 1]->d.s_if.t_else;
+		if(t_else != NULL && maskSwitchCase(thenAct, pBatch, active, caseOf, 0) > 0)
+			CHKiRet(scriptExec(t_else, ctx, thenAct));
+	}
+
+finalize_it:
+	if(thenAct != NULL)
+		freeActive(ctx, thenAct);
+	free(caseOf);
+	RETiRet;
 }
 
 /* The rainerscript execution engine. It is debatable if that would be better
@@ -487,10 +789,11 @@ execPROPFILT(struct cnfstmt *stmt, batch_t *pBatch, sbool *active)
  * rgerhards, 2012-09-04
  */
 static rsRetVal
-scriptExec(struct cnfstmt *root, batch_t *pBatch, sbool *active)
+scriptExec(struct cnfstmt *root, scriptExecCtx_t *ctx, sbool *active)
 {
 	DEFiRet;
 	struct cnfstmt *stmt;
+	batch_t *pBatch = ctx->pBatch;
 
 	for(stmt = root ; stmt != NULL ; stmt = stmt->next) {
 dbgprintf("RRRR: scriptExec: batch of %d elements, active %p, stmt %p, nodetype %u\n", batchNumMsgs(pBatch), active, stmt, stmt->nodetype);
@@ -511,16 +814,22 @@ dbgprintf("RRRR: scriptExec: batch of %d elements, active %p, stmt %p, nodetype
 			break;
 		case S_CALL:
 			DBGPRINTF("calling ruleset\n"); // TODO: add Name
-			scriptExec(stmt->d.s_call.stmt, pBatch, active);
+			scriptExec(stmt->d.s_call.stmt, ctx, active);
 			break;
 		case S_IF:
-			execIf(stmt, pBatch, active);
+			execIf(stmt, ctx, active);
 			break;
 		case S_PRIFILT:
-			execPRIFILT(stmt, pBatch, active);
+			execPRIFILT(stmt, ctx, active);
 			break;
 		case S_PROPFILT:
-			execPROPFILT(stmt, pBatch, active);
+			execPROPFILT(stmt, ctx, active);
+			break;
+		case S_PROPGRP:
+			execPROPGRP(stmt, ctx, active);
+			break;
+		case S_SWITCH:
+			execSWITCH(stmt, ctx, active);
 			break;
 		default:
 			dbgprintf("error: unknown stmt type %u during exec\n",
@@ -542,6 +851,7 @@ static rsRetVal
 processBatch(batch_t *pBatch)
 {
 	ruleset_t *pThis;
+	scriptExecCtx_t ctx;
 	DEFiRet;
 	assert(pBatch != NULL);
 
@@ -551,7 +861,10 @@ processBatch(batch_t *pBatch)
 		if(pThis == NULL)
 			pThis = ourConf->rulesets.pDflt;
 		ISOBJ_TYPE_assert(pThis, ruleset);
-		CHKiRet(scriptExec(pThis->root, pBatch, NULL));
+		scriptExecCtxInit(&ctx, pBatch);
+		iRet = scriptExec(pThis->root, &ctx, NULL);
+		scriptExecCtxExit(&ctx);
+		CHKiRet(iRet);
 	} else {
 		CHKiRet(processBatchMultiRuleset(pBatch));
 	}
@@ -788,6 +1101,7 @@ rulesetOptimize(ruleset_t *pRuleset)
 		rulesetDebugPrint((ruleset_t*) pRuleset);
 	}
 	cnfstmtOptimize(pRuleset->root);
+	cnfstmtCountMemoProps(pRuleset->root);
 	if(Debug) {
 		dbgprintf("ruleset '%s' after optimization:\n",
 			  pRuleset->pszName);
@@ -46,6 +46,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>	 /* required for HP UX */
+#include <sys/uio.h>
 #include <errno.h>
 #include <pthread.h>
 
@@ -72,13 +73,121 @@
 /* static data */
 DEFobjStaticHelpers
 DEFobjCurrIf(zlibw)
+DEFobjCurrIf(statsobj)
+
+/* The writer pool. All streams in async mode share a bounded number of
+ * writer threads. A stream with filled buffers is put into the work queue,
+ * a stream with a partial buffer and a flush interval is put into the timer
+ * heap, ordered by its flush deadline. The pool threads service the queue
+ * and move streams whose deadline has expired to it. Lock order is stream
+ * mutex first, then pool mutex. The pool threads never hold the pool mutex
+ * while they lock a stream.
+ */
+static pthread_mutex_t mutPool = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condPoolWork = PTHREAD_COND_INITIALIZER;	/* work or new deadline available */
+static pthread_cond_t condPoolIdle = PTHREAD_COND_INITIALIZER;	/* a stream is no longer in service */
+static strm_t *pPoolWorkRoot = NULL;	/* work queue */
+static strm_t *pPoolWorkLast = NULL;
+static strm_t **ppPoolHeap = NULL;	/* timer heap */
+static int iPoolHeapSize = 0;
+static int iPoolHeapMax = 0;
+static sbool bPoolTerminate = 0;
+/* thread management, protected by mutPoolThrds */
+static pthread_mutex_t mutPoolThrds = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t poolThrdIDs[STREAM_WRITER_POOL_MAX];
+static int nPoolThrds = 0;
+static int nPoolStreams = 0;	/* number of async streams */
+
+/* The compressor pool for parallel zip mode. Each output buffer is
+ * compressed as an independent gzip member (exactly like in inline mode),
+ * but by one of a small number of threads shared by all streams. A stream
+ * keeps a ring of the blocks it has in flight and writes them in order as
+ * they complete.
+ */
+typedef struct strmZipJob_s {
+	strm_t	*pStrm;
+	uchar	*pIn;		/* copy of the uncompressed buffer */
+	size_t	lenIn;
+	size_t	sizeIn;
+	uchar	*pOut;		/* the compressed gzip member */
+	size_t	lenOut;
+	size_t	sizeOut;
+	rsRetVal iRet;		/* result of compression */
+	sbool	bDone;		/* compression finished (protected by mutZipPool) */
+	struct strmZipJob_s *pNext;	/* next job in compressor queue */
+} strmZipJob_t;
+static pthread_mutex_t mutZipPool = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condZipWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t condZipDone = PTHREAD_COND_INITIALIZER;
+static strmZipJob_t *pZipWorkRoot = NULL;
+static strmZipJob_t *pZipWorkLast = NULL;
+static sbool bZipPoolTerminate = 0;
+static pthread_mutex_t mutZipThrds = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t zipThrdIDs[STREAM_ZIP_POOL_MAX];
+static int nZipThrds = 0;
+static int nZipStreams = 0;	/* number of streams in parallel zip mode */
+
+/* Native rotation. The active file is renamed to "<name>.1", older
+ * generations are shifted up to "<name>.<keep>" and the oldest one is
+ * removed. This is just a handful of rename() calls on the writer's path.
+ * If requested, rotated files are gzipped to "<name>.<n>.gz" by a
+ * background thread. As the file may be shifted to another generation
+ * while it is compressed, the thread identifies it by its inode.
+ * mutRotate serializes renames done by the writers and the thread.
+ */
+typedef struct strmRotJob_s {
+	uchar	*pszBase;	/* name of the active file */
+	dev_t	dev;		/* identifies the rotated file */
+	ino_t	ino;
+	int	iKeep;
+	int	iZipLevel;
+	mode_t	tOpenMode;
+	struct strmRotJob_s *pNext;
+} strmRotJob_t;
+/* The sync coordinator for group commit mode. Streams in this mode do not
+ * sync after each write. Instead, the owner requests a sync for all streams
+ * it has written (e.g. at the end of a batch) and waits until they are done.
+ * A single thread carries out the syncs: all requests that arrive while it
+ * is busy are collected and served together in the next round, so many
+ * flushes (of many actions) share the cost of a sync. The requests carry
+ * their own duplicates of the file descriptors, so the files can safely be
+ * closed or rotated in the meantime.
+ */
+typedef struct strmSyncReq_s {
+	int	fd;		/* dup of the file's descriptor */
+	int	fdDir;		/* dup of the directory's descriptor, -1 if none */
+	strmSyncCtx_t *pCtx;	/* the requestor, who waits for us */
+	struct strmSyncReq_s *pNext;
+} strmSyncReq_t;
+static pthread_mutex_t mutSync = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condSyncWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t condSyncDone = PTHREAD_COND_INITIALIZER;
+static strmSyncReq_t *pSyncRoot = NULL;
+static sbool bSyncTerminate = 0;
+static pthread_mutex_t mutSyncThrd = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t syncThrdID;
+static int nSyncStreams = 0;	/* number of streams in group commit mode */
+
+static pthread_mutex_t mutRotate = PTHREAD_MUTEX_INITIALIZER;
+static strmRotJob_t *pRotRoot = NULL;
+static strmRotJob_t *pRotLast = NULL;
+static sbool bRotThrdRunning = 0;
 
 /* forward definitions */
 static rsRetVal strmFlushInternal(strm_t *pThis);
 static rsRetVal strmWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf);
 static rsRetVal strmCloseFile(strm_t *pThis);
 static void *asyncWriterThread(void *pPtr);
+static rsRetVal doWriteInternal(strm_t *pThis, uchar *pBuf, size_t lenBuf);
 static rsRetVal doZipWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf);
+static rsRetVal zipWriteDoneJobs(strm_t *pThis, int nWait);
+static void zipPoolRegisterStrm(strm_t *pThis);
+static void zipPoolUnregisterStrm(void);
+static void strmPageCacheClose(strm_t *pThis);
+static void syncCoordRegisterStrm(strm_t *pThis);
+static void syncCoordUnregisterStrm(void);
+static rsRetVal strmSyncRequestInternal(strm_t *pThis, strmSyncCtx_t *pCtx);
+static rsRetVal strmSyncWait(strmSyncCtx_t *pCtx);
 static rsRetVal strmPhysWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf);
 
 
@@ -184,6 +293,331 @@ finalize_it:
 }
 
 
+/* build the name of a rotated generation. The caller must free it. */
+static char *
+rotGenName(uchar *pszBase, int iGen, const char *pszSfx)
+{
+	char *pszName;
+	size_t len;
+
+	len = ustrlen(pszBase) + strlen(pszSfx) + 16;
+	if((pszName = malloc(len)) != NULL)
+		snprintf(pszName, len, "%s.%d%s", (char*) pszBase, iGen, pszSfx);
+	return pszName;
+}
+
+
+/* shift the rotated generations of a file up by one, removing the oldest.
+ * Generations may be plain, compressed or have a zip index. Must be called
+ * with mutRotate locked.
+ */
+static void
+rotShift(uchar *pszBase, int iKeep)
+{
+	static const char *sfx[] = { "", ".gz", ".idx" };
+	char *pszFrom;
+	char *pszTo;
+	int i;
+	int n;
+
+	for(i = 0 ; i < (int) (sizeof(sfx) / sizeof(char*)) ; ++i) {
+		if((pszTo = rotGenName(pszBase, iKeep, sfx[i])) != NULL) {
+			unlink(pszTo);
+			free(pszTo);
+		}
+		for(n = iKeep - 1 ; n >= 1 ; --n) {
+			pszFrom = rotGenName(pszBase, n, sfx[i]);
+			pszTo = rotGenName(pszBase, n + 1, sfx[i]);
+			if(pszFrom != NULL && pszTo != NULL)
+				rename(pszFrom, pszTo); /* ENOENT is expected for missing generations */
+			free(pszFrom);
+			free(pszTo);
+		}
+	}
+}
+
+
+/* find the generation a rotated file currently has. Returns its name (to be
+ * freed by the caller) or NULL if it no longer exists. Must be called with
+ * mutRotate locked.
+ */
+static char *
+rotFindGen(strmRotJob_t *pJob)
+{
+	struct stat st;
+	char *pszName;
+	int n;
+
+	for(n = 1 ; n <= pJob->iKeep ; ++n) {
+		if((pszName = rotGenName(pJob->pszBase, n, "")) == NULL)
+			return NULL;
+		if(stat(pszName, &st) == 0 && st.st_ino == pJob->ino && st.st_dev == pJob->dev)
+			return pszName;
+		free(pszName);
+	}
+	return NULL;
+}
+
+
+/* gzip a rotated file. We compress into a temporary file and, once done,
+ * replace the plain generation with it - under whatever generation number
+ * the file has by then.
+ */
+static void
+rotCompressFile(strmRotJob_t *pJob)
+{
+	z_stream zstrm;
+	sbool bzInitDone = RSFALSE;
+	uchar inBuf[16384];
+	uchar outBuf[16384];
+	ssize_t lenRead;
+	int fdIn = -1;
+	int fdOut = -1;
+	int zRet;
+	int flush;
+	sbool bOK = RSFALSE;
+	char *pszName = NULL;
+	char *pszTmp = NULL;
+	char *pszGz = NULL;
+	size_t len;
+	size_t lenOut;
+
+	len = ustrlen(pJob->pszBase) + sizeof(".rotate.tmp");
+	if((pszTmp = malloc(len)) == NULL)
+		goto done;
+	snprintf(pszTmp, len, "%s.rotate.tmp", (char*) pJob->pszBase);
+
+	pthread_mutex_lock(&mutRotate);
+	if((pszName = rotFindGen(pJob)) != NULL)
+		fdIn = open(pszName, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+	pthread_mutex_unlock(&mutRotate);
+	if(fdIn == -1)
+		goto done; /* already gone (or never made it), nothing to do */
+	fdOut = open(pszTmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOCTTY, pJob->tOpenMode);
+	if(fdOut == -1)
+		goto done;
+
+	zstrm.zalloc = Z_NULL;
+	zstrm.zfree = Z_NULL;
+	zstrm.opaque = Z_NULL;
+	zstrm.next_in = inBuf;
+	if(zlibw.DeflateInit2(&zstrm, pJob->iZipLevel, Z_DEFLATED, 31, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+		goto done;
+	bzInitDone = RSTRUE;
+	do {
+		lenRead = read(fdIn, inBuf, sizeof(inBuf));
+		if(lenRead < 0)
+			goto done;
+		flush = (lenRead == 0) ? Z_FINISH : Z_NO_FLUSH;
+		zstrm.next_in = inBuf;
+		zstrm.avail_in = lenRead;
+		do {
+			zstrm.next_out = outBuf;
+			zstrm.avail_out = sizeof(outBuf);
+			zRet = zlibw.Deflate(&zstrm, flush);
+			if(zRet == Z_STREAM_ERROR)
+				goto done;
+			lenOut = sizeof(outBuf) - zstrm.avail_out;
+			if(lenOut > 0 && write(fdOut, outBuf, lenOut) != (ssize_t) lenOut)
+				goto done;
+		} while(zstrm.avail_out == 0);
+	} while(flush != Z_FINISH);
+	if(close(fdOut) != 0) {
+		fdOut = -1;
+		goto done;
+	}
+	fdOut = -1;
+	bOK = RSTRUE;
+
+done:
+	if(bzInitDone)
+		zlibw.DeflateEnd(&zstrm);
+	if(fdIn != -1)
+		close(fdIn);
+	if(fdOut != -1)
+		close(fdOut);
+	if(pszTmp != NULL) {
+		pthread_mutex_lock(&mutRotate);
+		free(pszName);
+		pszName = NULL;
+		if(bOK && (pszName = rotFindGen(pJob)) != NULL) {
+			len = strlen(pszName) + sizeof(".gz");
+			if((pszGz = malloc(len)) != NULL) {
+				snprintf(pszGz, len, "%s.gz", pszName);
+				if(rename(pszTmp, pszGz) == 0)
+					unlink(pszName);
+			}
+		}
+		unlink(pszTmp); /* if still present, the result is not needed */
+		pthread_mutex_unlock(&mutRotate);
+		DBGPRINTF("stream rotation: compressing rotated '%s' %s\n", pJob->pszBase,
+			  (pszGz == NULL) ? "failed or obsolete" : "done");
+	}
+	free(pszName);
+	free(pszTmp);
+	free(pszGz);
+}
+
+
+/* the background thread that compresses rotated files. It runs only while
+ * there is work to do.
+ */
+static void*
+rotCompressThread(void __attribute__((unused)) *pPtr)
+{
+	strmRotJob_t *pJob;
+
+	BEGINfunc
+	pthread_detach(pthread_self());
+#	if HAVE_PRCTL && defined PR_SET_NAME
+	if(prctl(PR_SET_NAME, "rs:strm rotate", 0, 0, 0) != 0) {
+		DBGPRINTF("prctl failed, not setting thread name for '%s'\n", "stream rotation");
+	}
+#	endif
+
+	pthread_mutex_lock(&mutRotate);
+	while((pJob = pRotRoot) != NULL) {
+		pRotRoot = pJob->pNext;
+		if(pRotRoot == NULL)
+			pRotLast = NULL;
+		pthread_mutex_unlock(&mutRotate);
+		rotCompressFile(pJob);
+		free(pJob->pszBase);
+		free(pJob);
+		pthread_mutex_lock(&mutRotate);
+	}
+	bRotThrdRunning = 0;
+	pthread_mutex_unlock(&mutRotate);
+
+	ENDfunc
+	return NULL; /* to keep pthreads happy */
+}
+
+
+/* compute when the next interval-based rotation is due. Intervals are
+ * aligned to multiples of the interval since the epoch (e.g. full hours).
+ * If an existing file was last written in an earlier interval, it is
+ * rotated before the first write.
+ */
+static void
+strmRotateSchedule(strm_t *pThis)
+{
+	struct stat st;
+	time_t tNow;
+	time_t tStart;
+
+	tNow = time(NULL);
+	tStart = tNow - tNow % pThis->iRotateInterval;
+	pThis->tNextRotate = tStart + pThis->iRotateInterval;
+	if(pThis->iCurrOffs > 0 && fstat(pThis->fd, &st) == 0 && st.st_mtime < tStart)
+		pThis->tNextRotate = 0;
+}
+
+
+/* carry out a group sync that is still pending for the current file and
+ * wait for it. Must be called before the file is closed, as the sync
+ * coordinator would otherwise never see the data written since the last
+ * request.
+ */
+static void
+strmSyncPendingNow(strm_t *pThis)
+{
+	strmSyncCtx_t syncCtx = { 0 };
+
+	if(!pThis->bGroupSync || !pThis->bSyncPending)
+		return;
+	strmSyncRequestInternal(pThis, &syncCtx);
+	strmSyncWait(&syncCtx);
+}
+
+
+/* rotate the current file. The file is closed, the generations are shifted
+ * and the next write will create a new file.
+ */
+static rsRetVal
+strmRotate(strm_t *pThis)
+{
+	struct stat st;
+	strmRotJob_t *pJob = NULL;
+	char *pszGen1 = NULL;
+	char *pszIdx = NULL;
+	char *pszIdxGen1 = NULL;
+	pthread_t thrdID;
+	DEFiRet;
+
+	ASSERT(pThis->fd != -1);
+	DBGOPRINT((obj_t*) pThis, "rotating file '%s' at size %lld\n", pThis->pszCurrFName,
+		  (long long) pThis->iCurrOffs);
+
+	CHKmalloc(pszGen1 = rotGenName(pThis->pszCurrFName, 1, ""));
+	if(pThis->bRotateCompress && fstat(pThis->fd, &st) == 0) {
+		CHKmalloc(pJob = calloc(1, sizeof(strmRotJob_t)));
+		CHKmalloc(pJob->pszBase = ustrdup(pThis->pszCurrFName));
+		pJob->dev = st.st_dev;
+		pJob->ino = st.st_ino;
+		pJob->iKeep = pThis->iRotateKeep;
+		pJob->iZipLevel = (pThis->iZipLevel == 0) ? 6 : pThis->iZipLevel;
+		pJob->tOpenMode = pThis->tOpenMode;
+	}
+
+	strmSyncPendingNow(pThis);
+	strmPageCacheClose(pThis);
+	close(pThis->fd);
+	pThis->fd = -1;
+	if(pThis->fdZipIdx != -1) {
+		close(pThis->fdZipIdx);
+		pThis->fdZipIdx = -1;
+		CHKmalloc(pszIdx = malloc(ustrlen(pThis->pszCurrFName) + sizeof(".idx")));
+		sprintf(pszIdx, "%s.idx", (char*) pThis->pszCurrFName);
+		CHKmalloc(pszIdxGen1 = rotGenName(pThis->pszCurrFName, 1, ".idx"));
+	}
+
+	pthread_mutex_lock(&mutRotate);
+	rotShift(pThis->pszCurrFName, pThis->iRotateKeep);
+	if(rename((char*) pThis->pszCurrFName, pszGen1) != 0) {
+		char errStr[1024];
+		rs_strerror_r(errno, errStr, sizeof(errStr));
+		DBGPRINTF("error rotating '%s': %s\n", pThis->pszCurrFName, errStr);
+	}
+	if(pszIdx != NULL)
+		rename(pszIdx, pszIdxGen1);
+	if(pJob != NULL) {
+		if(pRotLast == NULL)
+			pRotRoot = pJob;
+		else
+			pRotLast->pNext = pJob;
+		pRotLast = pJob;
+		pJob = NULL;
+		if(!bRotThrdRunning) {
+			if(pthread_create(&thrdID, NULL, rotCompressThread, NULL) == 0)
+				bRotThrdRunning = 1;
+			else
+				DBGPRINTF("stream %p: could not create rotation thread, "
+					  "compression delayed\n", pThis);
+		}
+	}
+	pthread_mutex_unlock(&mutRotate);
+
+	free(pThis->pszCurrFName);
+	pThis->pszCurrFName = NULL;
+	pThis->iCurrOffs = 0;
+	if(pThis->iRotateInterval != 0) {
+		pThis->tNextRotate = time(NULL);
+		pThis->tNextRotate += pThis->iRotateInterval - pThis->tNextRotate % pThis->iRotateInterval;
+	}
+
+finalize_it:
+	if(pJob != NULL) {
+		free(pJob->pszBase);
+		free(pJob);
+	}
+	free(pszGen1);
+	free(pszIdx);
+	free(pszIdxGen1);
+	RETiRet;
+}
+
+
 /* now, we define type-specific handlers. The provide a generic functionality,
  * but for this specific type of strm. The mapping to these handlers happens during
  * strm construction. Later on, handlers are called by pointers present in the
@@ -287,6 +721,17 @@ static rsRetVal strmOpenFile(strm_t *pThis)
 		pThis->iCurrOffs = offset;
 	}
 
+	pThis->iPreallocEnd = 0;
+	pThis->iSyncRangeStart = pThis->iSyncRangePrev = pThis->iCurrOffs;
+	if(pThis->bIsTTY || pThis->sType == STREAMTYPE_NAMED_PIPE) {
+		pThis->iRotateSize = 0; /* we can not rotate such files */
+		pThis->iRotateInterval = 0;
+		pThis->iPreallocSize = 0; /* nor manage their space or cache */
+		pThis->iSyncRangeSize = 0;
+	} else if(pThis->iRotateInterval != 0) {
+		strmRotateSchedule(pThis);
+	}
+
 	DBGOPRINT((obj_t*) pThis, "opened file '%s' for %s as %d\n", pThis->pszCurrFName,
 		  (pThis->tOperationsMode == STREAMMODE_READ) ? "READ" : "WRITE", pThis->fd);
 
@@ -305,6 +750,297 @@ finalize_it:
 }
 
 
+/* CODE FOR THE WRITER POOL */
+
+/* compare two flush deadlines, returns 1 if a is earlier than b */
+static inline int
+poolDeadlineBefore(struct timespec *a, struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static inline void
+poolHeapSet(int i, strm_t *pStrm)
+{
+	ppPoolHeap[i] = pStrm;
+	pStrm->iHeapIdx = i;
+}
+
+/* restore the heap property for the element at index i */
+static void
+poolHeapFix(int i)
+{
+	strm_t *pStrm = ppPoolHeap[i];
+	int iChild;
+
+	while(i > 0 && poolDeadlineBefore(&pStrm->tFlushDeadline, &ppPoolHeap[(i-1)/2]->tFlushDeadline)) {
+		poolHeapSet(i, ppPoolHeap[(i-1)/2]);
+		i = (i-1)/2;
+	}
+	while((iChild = 2*i + 1) < iPoolHeapSize) {
+		if(   iChild + 1 < iPoolHeapSize
+		   && poolDeadlineBefore(&ppPoolHeap[iChild+1]->tFlushDeadline, &ppPoolHeap[iChild]->tFlushDeadline))
+			++iChild;
+		if(!poolDeadlineBefore(&ppPoolHeap[iChild]->tFlushDeadline, &pStrm->tFlushDeadline))
+			break;
+		poolHeapSet(i, ppPoolHeap[iChild]);
+		i = iChild;
+	}
+	poolHeapSet(i, pStrm);
+}
+
+/* remove a stream from the timer heap (if it is in it) */
+static void
+poolHeapRemove(strm_t *pStrm)
+{
+	int i = pStrm->iHeapIdx;
+
+	if(i == -1)
+		return;
+	pStrm->iHeapIdx = -1;
+	if(--iPoolHeapSize > i) {
+		poolHeapSet(i, ppPoolHeap[iPoolHeapSize]);
+		poolHeapFix(i);
+	}
+}
+
+/* append a stream to the work queue. Must be called with mutPool locked. */
+static void
+poolEnqueue(strm_t *pStrm)
+{
+	if(pStrm->bQueued)
+		return;
+	pStrm->bQueued = 1;
+	pStrm->pNextWork = NULL;
+	if(pPoolWorkLast == NULL)
+		pPoolWorkRoot = pStrm;
+	else
+		pPoolWorkLast->pNextWork = pStrm;
+	pPoolWorkLast = pStrm;
+	pthread_cond_signal(&condPoolWork);
+}
+
+/* remove a stream from the work queue. Must be called with mutPool locked. */
+static void
+poolDequeue(strm_t *pStrm)
+{
+	strm_t *pPrev = NULL;
+	strm_t *pCurr;
+
+	if(!pStrm->bQueued)
+		return;
+	for(pCurr = pPoolWorkRoot ; pCurr != pStrm ; pCurr = pCurr->pNextWork)
+		pPrev = pCurr;
+	if(pPrev == NULL)
+		pPoolWorkRoot = pStrm->pNextWork;
+	else
+		pPrev->pNextWork = pStrm->pNextWork;
+	if(pPoolWorkLast == pStrm)
+		pPoolWorkLast = pPrev;
+	pStrm->bQueued = 0;
+}
+
+/* hand a stream with filled buffers over to the pool. The stream
+ * mutex must be locked.
+ */
+static void
+poolSubmit(strm_t *pStrm)
+{
+	pthread_mutex_lock(&mutPool);
+	poolEnqueue(pStrm);
+	pthread_mutex_unlock(&mutPool);
+}
+
+/* schedule (or cancel, if bSchedule is 0) the timed flush of a partial
+ * buffer. The stream mutex must be locked.
+ */
+static rsRetVal
+poolSchedFlush(strm_t *pStrm, sbool bSchedule)
+{
+	strm_t **ppNew;
+	DEFiRet;
+
+	pthread_mutex_lock(&mutPool);
+	poolHeapRemove(pStrm);
+	if(bSchedule) {
+		if(iPoolHeapSize == iPoolHeapMax) {
+			CHKmalloc(ppNew = realloc(ppPoolHeap, sizeof(strm_t*) * (iPoolHeapMax + 64)));
+			ppPoolHeap = ppNew;
+			iPoolHeapMax += 64;
+		}
+		timeoutComp(&pStrm->tFlushDeadline, pStrm->iFlushInterval * 1000); /* *1000 millisconds */
+		poolHeapSet(iPoolHeapSize++, pStrm);
+		poolHeapFix(pStrm->iHeapIdx);
+		if(pStrm->iHeapIdx == 0) /* new earliest deadline, waiting threads must recompute */
+			pthread_cond_broadcast(&condPoolWork);
+	}
+
+finalize_it:
+	pthread_mutex_unlock(&mutPool);
+	RETiRet;
+}
+
+/* let the writer pool write a partial buffer once the flush interval has
+ * expired, unless that is already scheduled. If scheduling fails (out of
+ * memory), the data stays in the buffer and the next write tries again.
+ * We do not report the error, as the data itself was written successfully.
+ * The stream mutex must be locked.
+ */
+static void
+poolSchedTimedFlush(strm_t *pThis)
+{
+	rsRetVal localRet;
+
+	if(pThis->bDoTimedWait || pThis->iBufPtr == 0)
+		return;
+	pThis->bDoTimedWait = 1;
+	localRet = poolSchedFlush(pThis, 1);
+	if(localRet != RS_RET_OK) {
+		DBGPRINTF("stream %p: could not schedule timed flush, error %d\n", pThis, localRet);
+		pThis->bDoTimedWait = 0;
+	}
+}
+
+/* do all pending work for a stream. Called by the pool threads. */
+static void
+poolServiceStrm(strm_t *pThis, sbool bFlushDue)
+{
+	int iDeq;
+	int iPass;
+
+	d_pthread_mutex_lock(&pThis->mut);
+	/* the flush must be done when no buffer is outstanding, else we would need
+	 * to wait for ourselves. So we write the filled buffers first.
+	 */
+	for(iPass = 0 ; iPass < 2 ; ++iPass) {
+		while(pThis->iCnt > 0) {
+			iDeq = pThis->iDeq++ % STREAM_ASYNC_NUMBUFS;
+			doWriteInternal(pThis, pThis->asyncBuf[iDeq].pBuf, pThis->asyncBuf[iDeq].lenBuf);
+			// TODO: error check????? 2009-07-06
+			--pThis->iCnt;
+			pthread_cond_signal(&pThis->notFull);
+		}
+		if(pThis->pZipJobs != NULL)
+			zipWriteDoneJobs(pThis, -1);
+		pthread_cond_broadcast(&pThis->isEmpty);
+		if(iPass == 0 && bFlushDue && pThis->bDoTimedWait && !pThis->bStopWriter) {
+			pThis->bDoTimedWait = 0;
+			if(pThis->iBufPtr > 0)
+				strmFlushInternal(pThis);
+		} else {
+			break;
+		}
+	}
+	d_pthread_mutex_unlock(&pThis->mut);
+}
+
+
+/* This is the writer thread for asynchronous mode. Any number of streams
+ * is serviced by the (few) threads of the pool.
+ * -- rgerhards, 2009-07-06
+ */
+static void*
+asyncWriterThread(void __attribute__((unused)) *pPtr)
+{
+	strm_t *pStrm;
+	sbool bFlushDue;
+
+	BEGINfunc
+#	if HAVE_PRCTL && defined PR_SET_NAME
+	if(prctl(PR_SET_NAME, "rs:asyn strmwr", 0, 0, 0) != 0) {
+		DBGPRINTF("prctl failed, not setting thread name for '%s'\n", "stream writer");
+	}
+#	endif
+
+	pthread_mutex_lock(&mutPool);
+	while(!bPoolTerminate) {
+		if(pPoolWorkRoot != NULL) {
+			pStrm = pPoolWorkRoot;
+			poolDequeue(pStrm);
+			bFlushDue = pStrm->bFlushDue;
+			pStrm->bFlushDue = 0;
+			++pStrm->iInService;
+			pthread_mutex_unlock(&mutPool);
+			poolServiceStrm(pStrm, bFlushDue);
+			pthread_mutex_lock(&mutPool);
+			if(--pStrm->iInService == 0)
+				pthread_cond_broadcast(&condPoolIdle);
+		} else if(iPoolHeapSize > 0) {
+			if(timeoutVal(&ppPoolHeap[0]->tFlushDeadline) == 0) {
+				pStrm = ppPoolHeap[0];
+				poolHeapRemove(pStrm);
+				pStrm->bFlushDue = 1;
+				poolEnqueue(pStrm);
+			} else {
+				pthread_cond_timedwait(&condPoolWork, &mutPool, &ppPoolHeap[0]->tFlushDeadline);
+			}
+		} else {
+			pthread_cond_wait(&condPoolWork, &mutPool);
+		}
+	}
+	pthread_mutex_unlock(&mutPool);
+
+	ENDfunc
+	return NULL; /* to keep pthreads happy */
+}
+
+
+/* register a new async stream with the pool. Threads are created on
+ * demand, but never more than STREAM_WRITER_POOL_MAX.
+ */
+static void
+poolRegisterStrm(strm_t *pThis)
+{
+	pThis->iHeapIdx = -1;
+	pthread_mutex_lock(&mutPoolThrds);
+	++nPoolStreams;
+	if(nPoolThrds < nPoolStreams && nPoolThrds < STREAM_WRITER_POOL_MAX) {
+		if(pthread_create(&poolThrdIDs[nPoolThrds],
+#ifdef HAVE_PTHREAD_SETSCHEDPARAM
+			    	  &default_thread_attr,
+#else
+				  NULL,
+#endif
+				  asyncWriterThread, NULL) == 0)
+			++nPoolThrds;
+		else
+			DBGPRINTF("ERROR: stream %p could not create writer pool thread\n", pThis);
+	}
+	pthread_mutex_unlock(&mutPoolThrds);
+}
+
+
+/* unregister an async stream from the pool. When we return, no pool thread
+ * accesses the stream any longer. If it was the last stream, the pool
+ * threads are terminated. The stream mutex must NOT be locked.
+ */
+static void
+poolUnregisterStrm(strm_t *pThis)
+{
+	int i;
+
+	pthread_mutex_lock(&mutPool);
+	while(pThis->iInService > 0)
+		pthread_cond_wait(&condPoolIdle, &mutPool);
+	poolDequeue(pThis);
+	poolHeapRemove(pThis);
+	pthread_mutex_unlock(&mutPool);
+
+	pthread_mutex_lock(&mutPoolThrds);
+	if(--nPoolStreams == 0) {
+		pthread_mutex_lock(&mutPool);
+		bPoolTerminate = 1;
+		pthread_cond_broadcast(&condPoolWork);
+		pthread_mutex_unlock(&mutPool);
+		for(i = 0 ; i < nPoolThrds ; ++i)
+			pthread_join(poolThrdIDs[i], NULL);
+		nPoolThrds = 0;
+		bPoolTerminate = 0;
+	}
+	pthread_mutex_unlock(&mutPoolThrds);
+}
+
+
 /* wait for the output writer thread to be done. This must be called before actions
  * that require data to be persisted. May be called in non-async mode and is a null
  * operation than. Must be called with the mutex locked.
@@ -314,9 +1050,8 @@ strmWaitAsyncWriterDone(strm_t *pThis)
 {
 	BEGINfunc
 	if(pThis->bAsyncWrite) {
-		/* awake writer thread and make it write out everything */
+		/* filled buffers are always queued at the pool, so we just need to wait */
 		while(pThis->iCnt > 0) {
-			pthread_cond_signal(&pThis->notEmpty);
 			d_pthread_cond_wait(&pThis->isEmpty, &pThis->mut);
 		}
 	}
@@ -345,12 +1080,22 @@ static rsRetVal strmCloseFile(strm_t *pThis)
 		if(pThis->bAsyncWrite) {
 			strmWaitAsyncWriterDone(pThis);
 		}
+		if(pThis->pZipJobs != NULL)
+			zipWriteDoneJobs(pThis, -1);
+		strmSyncPendingNow(pThis);
+	}
+
+	if(pThis->fdZipIdx != -1) {
+		close(pThis->fdZipIdx);
+		pThis->fdZipIdx = -1;
 	}
 
 	/* the file may already be closed (or never have opened), so guard
 	 * against this. -- rgerhards, 2010-03-19
 	 */
 	if(pThis->fd != -1) {
+		if(pThis->tOperationsMode != STREAMMODE_READ)
+			strmPageCacheClose(pThis);
 		close(pThis->fd);
 		pThis->fd = -1;
 	}
@@ -678,9 +1423,41 @@ BEGINobjConstruct(strm) /* be sure to specify the object type also in END macro!
 	pThis->sType = STREAMTYPE_FILE_SINGLE;
 	pThis->sIOBufSize = glblGetIOBufSize();
 	pThis->tOpenMode = 0600;
+	pThis->fdZipIdx = -1;
+	pThis->iRotateKeep = STREAM_ROTATE_KEEP_DFLT;
 ENDobjConstruct(strm)
 
 
+/* create the statistics counters of a stream. We do this only if page cache
+ * control is enabled, as there may be a lot of (short-lived) streams.
+ * statsobj is obtained here and not in class init, because strm is
+ * initialized before statsobj. Like zlibw, it is never released.
+ */
+static rsRetVal
+strmInitStats(strm_t *pThis)
+{
+	uchar ctrName[512];
+	DEFiRet;
+
+	snprintf((char*) ctrName, sizeof(ctrName), "stream %s%s%s",
+		 (pThis->pszDir == NULL) ? "" : (char*) pThis->pszDir,
+		 (pThis->pszDir == NULL) ? "" : "/",
+		 (pThis->pszFName == NULL) ? "N/A" : (char*) pThis->pszFName);
+	ctrName[sizeof(ctrName)-1] = '\0';
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+	CHKiRet(statsobj.Construct(&pThis->stats));
+	CHKiRet(statsobj.SetName(pThis->stats, ctrName));
+	CHKiRet(statsobj.AddCounter(pThis->stats, UCHAR_CONSTANT("bytes.written"),
+		ctrType_IntCtr, &pThis->ctrWritten));
+	CHKiRet(statsobj.AddCounter(pThis->stats, UCHAR_CONSTANT("bytes.synced"),
+		ctrType_IntCtr, &pThis->ctrSynced));
+	CHKiRet(statsobj.ConstructFinalize(pThis->stats));
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* ConstructionFinalizer
  * rgerhards, 2008-01-09
  */
@@ -693,6 +1470,29 @@ static rsRetVal strmConstructFinalize(strm_t *pThis)
 	ASSERT(pThis != NULL);
 
 	pThis->iBufPtrMax = 0; /* results in immediate read request */
+	if(   pThis->sType != STREAMTYPE_FILE_SINGLE
+	   || pThis->tOperationsMode == STREAMMODE_READ
+	   || pThis->iRotateKeep < 1) {
+		/* native rotation is only supported for single files we write */
+		pThis->iRotateSize = 0;
+		pThis->iRotateInterval = 0;
+	}
+	if(!pThis->bSync || pThis->tOperationsMode == STREAMMODE_READ)
+		pThis->bGroupSync = 0;
+	if(pThis->bGroupSync)
+		syncCoordRegisterStrm(pThis);
+	if(pThis->bDropCache && pThis->iSyncRangeSize == 0)
+		pThis->iSyncRangeSize = STREAM_SYNCRANGE_DFLT; /* pages must be clean to be dropped */
+	if(pThis->iPreallocSize != 0 || pThis->iSyncRangeSize != 0)
+		CHKiRet(strmInitStats(pThis));
+	if(pThis->bRotateCompress && (pThis->iRotateSize != 0 || pThis->iRotateInterval != 0)) {
+		localRet = objUse(zlibw, LM_ZLIBW_FILENAME);
+		if(localRet != RS_RET_OK) {
+			pThis->bRotateCompress = 0;
+			DBGPRINTF("rotated files were requested to be compressed, but zlibw module "
+				  "unavailable (%d) - not compressing\n", localRet);
+		}
+	}
 	if(pThis->iZipLevel) { /* do we need a zip buf? */
 		localRet = objUse(zlibw, LM_ZLIBW_FILENAME);
 		if(localRet != RS_RET_OK) {
@@ -705,6 +1505,13 @@ static rsRetVal strmConstructFinalize(strm_t *pThis)
 			 * We add another 128 bytes to take care of the gzip header and "all eventualities".
 			 */
 			CHKmalloc(pThis->pZipBuf = (Bytef*) MALLOC(sizeof(uchar) * (pThis->sIOBufSize + 128)));
+			if(pThis->iZipThreads > 1) {
+				CHKmalloc(pThis->pZipJobs = (strmZipJob_t*) calloc(pThis->iZipThreads,
+										   sizeof(strmZipJob_t)));
+				for(i = 0 ; i < pThis->iZipThreads ; ++i)
+					pThis->pZipJobs[i].pStrm = pThis;
+				zipPoolRegisterStrm(pThis);
+			}
 		}
 	}
 
@@ -732,7 +1539,6 @@ static rsRetVal strmConstructFinalize(strm_t *pThis)
 	if(pThis->bAsyncWrite) {
 		pthread_mutex_init(&pThis->mut, 0);
 		pthread_cond_init(&pThis->notFull, 0);
-		pthread_cond_init(&pThis->notEmpty, 0);
 		pthread_cond_init(&pThis->isEmpty, 0);
 		pThis->iCnt = pThis->iEnq = pThis->iDeq = 0;
 		for(i = 0 ; i < STREAM_ASYNC_NUMBUFS ; ++i) {
@@ -740,14 +1546,7 @@ static rsRetVal strmConstructFinalize(strm_t *pThis)
 		}
 		pThis->pIOBuf = pThis->asyncBuf[0].pBuf;
 		pThis->bStopWriter = 0;
-		if(pthread_create(&pThis->writerThreadID,
-#ifdef HAVE_PTHREAD_SETSCHEDPARAM
-			    	  &default_thread_attr,
-#else
-				  NULL,
-#endif
-				  asyncWriterThread, pThis) != 0)
-			DBGPRINTF("ERROR: stream %p cold not create writer thread\n", pThis);
+		poolRegisterStrm(pThis);
 	} else {
 		/* we work synchronously, so we need to alloc a fixed pIOBuf */
 		CHKmalloc(pThis->pIOBuf = (uchar*) MALLOC(sizeof(uchar) * pThis->sIOBufSize));
@@ -758,17 +1557,16 @@ finalize_it:
 }
 
 
-/* stop the writer thread (we MUST be runnnig asynchronously when this method
- * is called!). Note that the mutex must be locked! -- rgerhards, 2009-07-06
+/* detach the stream from the writer pool (we MUST be runnnig asynchronously
+ * when this method is called!). Note that the mutex must be locked! -- rgerhards, 2009-07-06
  */
 static inline void
 stopWriter(strm_t *pThis)
 {
 	BEGINfunc
 	pThis->bStopWriter = 1;
-	pthread_cond_signal(&pThis->notEmpty);
 	d_pthread_mutex_unlock(&pThis->mut);
-	pthread_join(pThis->writerThreadID, NULL);
+	poolUnregisterStrm(pThis);
 	ENDfunc
 }
 
@@ -790,7 +1588,6 @@ CODESTARTobjDestruct(strm)
 		stopWriter(pThis);
 		pthread_mutex_destroy(&pThis->mut);
 		pthread_cond_destroy(&pThis->notFull);
-		pthread_cond_destroy(&pThis->notEmpty);
 		pthread_cond_destroy(&pThis->isEmpty);
 		for(i = 0 ; i < STREAM_ASYNC_NUMBUFS ; ++i) {
 			free(pThis->asyncBuf[i].pBuf);
@@ -803,6 +1600,18 @@ CODESTARTobjDestruct(strm)
 	 * IMPORTANT: we MUST free this only AFTER the ansyncWriter has been stopped, else
 	 * we get random errors...
 	 */
+	if(pThis->pZipJobs != NULL) {
+		zipPoolUnregisterStrm();
+		for(i = 0 ; i < pThis->iZipThreads ; ++i) {
+			free(pThis->pZipJobs[i].pIn);
+			free(pThis->pZipJobs[i].pOut);
+		}
+		free(pThis->pZipJobs);
+	}
+	if(pThis->bSyncRegistered)
+		syncCoordUnregisterStrm();
+	if(pThis->stats != NULL)
+		statsobj.Destruct(&pThis->stats);
 	free(pThis->pszDir);
 	free(pThis->pZipBuf);
 	free(pThis->pszCurrFName);
@@ -861,27 +1670,27 @@ finalize_it:
 #undef ER_TTYHUP
 
 
-/* issue write() api calls until either the buffer is completely
+/* issue writev() api calls until either the buffers are completely
  * written or an error occured (it may happen that multiple writes
  * are required, what is perfectly legal. On exit, *pLenBuf contains
- * the number of bytes actually written.
+ * the number of bytes actually written. Note that the iovec array is
+ * modified in the case of partial writes.
  * rgerhards, 2009-06-08
  */
 static rsRetVal
-doWriteCall(strm_t *pThis, uchar *pBuf, size_t *pLenBuf)
+doWriteCall(strm_t *pThis, struct iovec *iov, int iovcnt, size_t *pLenBuf)
 {
 	ssize_t lenBuf;
 	ssize_t iTotalWritten;
 	ssize_t iWritten;
-	char *pWriteBuf;
+	ssize_t iAdvance;
 	DEFiRet;
 	ISOBJ_TYPE_assert(pThis, strm);
 
 	lenBuf = *pLenBuf;
-	pWriteBuf = (char*) pBuf;
 	iTotalWritten = 0;
 	do {
-		iWritten = write(pThis->fd, pWriteBuf, lenBuf);
+		iWritten = writev(pThis->fd, iov, iovcnt);
 		if(iWritten < 0) {
 			char errStr[1024];
 			int err = errno;
@@ -901,10 +1710,17 @@ doWriteCall(strm_t *pThis, uchar *pBuf, size_t *pLenBuf)
 				}
 			}
 	 	} 
-		/* advance buffer to next write position */
+		/* advance buffers to next write position */
 		iTotalWritten += iWritten;
 		lenBuf -= iWritten;
-		pWriteBuf += iWritten;
+		for(iAdvance = iWritten ; iovcnt > 0 && iAdvance >= (ssize_t) iov->iov_len ; --iovcnt) {
+			iAdvance -= iov->iov_len;
+			++iov;
+		}
+		if(iovcnt > 0) {
+			iov->iov_base = (char*) iov->iov_base + iAdvance;
+			iov->iov_len -= iAdvance;
+		}
 	} while(lenBuf > 0);	/* Warning: do..while()! */
 
 	DBGOPRINT((obj_t*) pThis, "file %d write wrote %d bytes\n", pThis->fd, (int) iWritten);
@@ -918,7 +1734,7 @@ finalize_it:
 
 /* write memory buffer to a stream object.
  */
-static inline rsRetVal
+static rsRetVal
 doWriteInternal(strm_t *pThis, uchar *pBuf, size_t lenBuf)
 {
 	DEFiRet;
@@ -938,7 +1754,7 @@ finalize_it:
 
 
 /* This function is called to "do" an async write call, what primarily means that 
- * the data is handed over to the writer thread (which will then do the actual write
+ * the data is handed over to the writer pool (which will then do the actual write
  * in parallel). Note that the stream mutex has already been locked by the
  * strmWrite...() calls. Also note that we always have only a single producer,
  * so we can simply serially assign the next free buffer to it and be sure that
@@ -958,10 +1774,15 @@ doAsyncWriteInternal(strm_t *pThis, size_t lenBuf)
 	pThis->asyncBuf[pThis->iEnq % STREAM_ASYNC_NUMBUFS].lenBuf = lenBuf;
 	pThis->pIOBuf = pThis->asyncBuf[++pThis->iEnq % STREAM_ASYNC_NUMBUFS].pBuf;
 
-	pThis->bDoTimedWait = 0; /* everything written, no need to timeout partial buffer writes */
-	if(++pThis->iCnt == 1)
-		pthread_cond_signal(&pThis->notEmpty);
+	++pThis->iCnt;
+	poolSubmit(pThis);
+	if(pThis->bDoTimedWait) {
+		/* everything written, no need to timeout partial buffer writes */
+		pThis->bDoTimedWait = 0;
+		CHKiRet(poolSchedFlush(pThis, 0));
+	}
 
+finalize_it:
 	RETiRet;
 }
 
@@ -1000,148 +1821,389 @@ finalize_it:
 
 
 
-/* This is the writer thread for asynchronous mode.
- * -- rgerhards, 2009-07-06
+/* sync the file to disk, so that any unwritten data is persisted. This
+ * also syncs the directory and thus makes sure that the file survives
+ * fatal failure. Note that we do NOT return an error status if the
+ * sync fails. Doing so would probably cause more trouble than it
+ * is worth (read: data loss may occur where we otherwise might not
+ * have it). -- rgerhards, 2009-06-08
  */
-static void*
-asyncWriterThread(void *pPtr)
+#undef SYNCCALL
+#if HAVE_FDATASYNC
+#	define SYNCCALL(x) fdatasync(x)
+#else
+#	define SYNCCALL(x) fsync(x)
+#endif
+static rsRetVal
+syncFile(strm_t *pThis)
 {
-	int iDeq;
-	struct timespec t;
-	sbool bTimedOut = 0;
-	strm_t *pThis = (strm_t*) pPtr;
-	int err;
-	ISOBJ_TYPE_assert(pThis, strm);
-
+	int ret;
+	DEFiRet;
+
+	if(pThis->bIsTTY)
+		FINALIZE; /* TTYs can not be synced */
+
+	DBGPRINTF("syncing file %d\n", pThis->fd);
+	ret = SYNCCALL(pThis->fd);
+	if(ret != 0) {
+		char errStr[1024];
+		int err = errno;
+		rs_strerror_r(err, errStr, sizeof(errStr));
+		DBGPRINTF("sync failed for file %d with error (%d): %s - ignoring\n",
+			   pThis->fd, err, errStr);
+	}
+	
+	if(pThis->fdDir != -1) {
+		ret = fsync(pThis->fdDir);
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* the sync coordinator thread */
+static void*
+syncCoordThread(void __attribute__((unused)) *pPtr)
+{
+	strmSyncReq_t *pRound;
+	strmSyncReq_t *pReq;
+	int nReqs;
+
 	BEGINfunc
 #	if HAVE_PRCTL && defined PR_SET_NAME
-	if(prctl(PR_SET_NAME, "rs:asyn strmwr", 0, 0, 0) != 0) {
-		DBGPRINTF("prctl failed, not setting thread name for '%s'\n", "stream writer");
+	if(prctl(PR_SET_NAME, "rs:strm sync", 0, 0, 0) != 0) {
+		DBGPRINTF("prctl failed, not setting thread name for '%s'\n", "sync coordinator");
 	}
 #	endif
 
-	while(1) { /* loop broken inside */
-		d_pthread_mutex_lock(&pThis->mut);
-		while(pThis->iCnt == 0) {
-			if(pThis->bStopWriter) {
-				pthread_cond_broadcast(&pThis->isEmpty);
-				d_pthread_mutex_unlock(&pThis->mut);
-				goto finalize_it; /* break main loop */
+	pthread_mutex_lock(&mutSync);
+	while(1) {
+		while(pSyncRoot == NULL && !bSyncTerminate)
+			pthread_cond_wait(&condSyncWork, &mutSync);
+		if(pSyncRoot == NULL)
+			break; /* terminate, but only after all requests have been served */
+		pRound = pSyncRoot;	/* everything requested so far forms this round */
+		pSyncRoot = NULL;
+		pthread_mutex_unlock(&mutSync);
+
+		nReqs = 0;
+		for(pReq = pRound ; pReq != NULL ; pReq = pReq->pNext) {
+			if(SYNCCALL(pReq->fd) != 0) {
+				char errStr[1024];
+				int err = errno;
+				rs_strerror_r(err, errStr, sizeof(errStr));
+				DBGPRINTF("group sync failed for file %d with error (%d): %s - ignoring\n",
+					   pReq->fd, err, errStr);
 			}
-			if(bTimedOut && pThis->iBufPtr > 0) {
-				/* if we timed out, we need to flush pending data */
-				strmFlushInternal(pThis);
-				bTimedOut = 0;
-				continue; /* now we should have data */
-			}
-			bTimedOut = 0;
-			timeoutComp(&t, pThis->iFlushInterval * 1000); /* *1000 millisconds */
-			if(pThis->bDoTimedWait) {
-				if((err = pthread_cond_timedwait(&pThis->notEmpty, &pThis->mut, &t)) != 0) {
-					if(err == ETIMEDOUT) {
-						bTimedOut = 1;
-					} else {
-						bTimedOut = 1;
-						char errStr[1024];
-						rs_strerror_r(err, errStr, sizeof(errStr));
-						DBGPRINTF("stream async writer timeout with error (%d): %s - ignoring\n",
-							   err, errStr);
-					}
-				}
-			} else {
-				d_pthread_cond_wait(&pThis->notEmpty, &pThis->mut);
+			close(pReq->fd);
+			if(pReq->fdDir != -1) {
+				fsync(pReq->fdDir);
+				close(pReq->fdDir);
 			}
+			++nReqs;
 		}
-
-		bTimedOut = 0; /* we may have timed out, but there *is* work to do... */
-
-		iDeq = pThis->iDeq++ % STREAM_ASYNC_NUMBUFS;
-		doWriteInternal(pThis, pThis->asyncBuf[iDeq].pBuf, pThis->asyncBuf[iDeq].lenBuf);
-		// TODO: error check????? 2009-07-06
-
-		--pThis->iCnt;
-		if(pThis->iCnt < STREAM_ASYNC_NUMBUFS) {
-			pthread_cond_signal(&pThis->notFull);
-			if(pThis->iCnt == 0)
-				pthread_cond_broadcast(&pThis->isEmpty);
+		DBGPRINTF("sync coordinator: round with %d files done\n", nReqs);
+
+		pthread_mutex_lock(&mutSync);
+		while(pRound != NULL) {
+			pReq = pRound;
+			pRound = pReq->pNext;
+			--pReq->pCtx->nPending;
+			free(pReq);
 		}
-		d_pthread_mutex_unlock(&pThis->mut);
+		pthread_cond_broadcast(&condSyncDone);
 	}
+	pthread_mutex_unlock(&mutSync);
 
-finalize_it:
 	ENDfunc
 	return NULL; /* to keep pthreads happy */
 }
 
 
-/* sync the file to disk, so that any unwritten data is persisted. This
- * also syncs the directory and thus makes sure that the file survives
- * fatal failure. Note that we do NOT return an error status if the
- * sync fails. Doing so would probably cause more trouble than it
- * is worth (read: data loss may occur where we otherwise might not
- * have it). -- rgerhards, 2009-06-08
+/* register a stream in group commit mode. The coordinator thread is
+ * started with the first such stream and stopped with the last one.
+ * Only registered streams are unregistered on destruction, as a stream
+ * may be destroyed before it has been finalized.
  */
-#undef SYNCCALL
-#if HAVE_FDATASYNC
-#	define SYNCCALL(x) fdatasync(x)
+static void
+syncCoordRegisterStrm(strm_t *pThis)
+{
+	pthread_mutex_lock(&mutSyncThrd);
+	if(nSyncStreams == 0) {
+		if(pthread_create(&syncThrdID,
+#ifdef HAVE_PTHREAD_SETSCHEDPARAM
+			    	  &default_thread_attr,
 #else
-#	define SYNCCALL(x) fsync(x)
+				  NULL,
 #endif
+				  syncCoordThread, NULL) != 0) {
+			DBGPRINTF("ERROR: stream %p could not create sync coordinator, "
+				  "syncing after each write\n", pThis);
+			pThis->bGroupSync = 0;
+			goto done;
+		}
+	}
+	++nSyncStreams;
+	pThis->bSyncRegistered = 1;
+done:
+	pthread_mutex_unlock(&mutSyncThrd);
+}
+
+
+static void
+syncCoordUnregisterStrm(void)
+{
+	pthread_mutex_lock(&mutSyncThrd);
+	if(--nSyncStreams == 0) {
+		pthread_mutex_lock(&mutSync);
+		bSyncTerminate = 1;
+		pthread_cond_signal(&condSyncWork);
+		pthread_mutex_unlock(&mutSync);
+		pthread_join(syncThrdID, NULL);
+		bSyncTerminate = 0;
+	}
+	pthread_mutex_unlock(&mutSyncThrd);
+}
+
+
+/* request a sync for a stream in group commit mode, if anything was
+ * written since the last request. The stream must already be flushed.
+ * The request is added to pCtx, use strmSyncWait() to wait for it.
+ */
 static rsRetVal
-syncFile(strm_t *pThis)
+strmSyncRequestInternal(strm_t *pThis, strmSyncCtx_t *pCtx)
 {
-	int ret;
+	strmSyncReq_t *pReq;
 	DEFiRet;
 
-	if(pThis->bIsTTY)
-		FINALIZE; /* TTYs can not be synced */
+	if(!pThis->bSyncPending || pThis->fd == -1 || pThis->bIsTTY)
+		FINALIZE;
 
-	DBGPRINTF("syncing file %d\n", pThis->fd);
-	ret = SYNCCALL(pThis->fd);
-	if(ret != 0) {
-		char errStr[1024];
-		int err = errno;
-		rs_strerror_r(err, errStr, sizeof(errStr));
-		DBGPRINTF("sync failed for file %d with error (%d): %s - ignoring\n",
-			   pThis->fd, err, errStr);
-	}
-	
-	if(pThis->fdDir != -1) {
-		ret = fsync(pThis->fdDir);
+	CHKmalloc(pReq = malloc(sizeof(strmSyncReq_t)));
+	if((pReq->fd = dup(pThis->fd)) == -1) {
+		free(pReq);
+		DBGPRINTF("stream %p: dup() failed, syncing directly\n", pThis);
+		CHKiRet(syncFile(pThis));
+		pThis->bSyncPending = 0;
+		FINALIZE;
 	}
+	pReq->fdDir = (pThis->fdDir == -1) ? -1 : dup(pThis->fdDir);
+	pReq->pCtx = pCtx;
+	pThis->bSyncPending = 0;
+	pThis->ctrSynced = pThis->ctrWritten; /* will be true once the caller's wait returns */
+
+	pthread_mutex_lock(&mutSync);
+	pReq->pNext = pSyncRoot;
+	pSyncRoot = pReq;
+	++pCtx->nPending;
+	pthread_cond_signal(&condSyncWork);
+	pthread_mutex_unlock(&mutSync);
 
 finalize_it:
 	RETiRet;
 }
 #undef SYNCCALL
 
+
+/* wait until all syncs requested via pCtx have been carried out */
+static rsRetVal
+strmSyncWait(strmSyncCtx_t *pCtx)
+{
+	DEFiRet;
+
+	pthread_mutex_lock(&mutSync);
+	pthread_cleanup_push(mutexCancelCleanup, &mutSync);
+	while(pCtx->nPending > 0)
+		pthread_cond_wait(&condSyncDone, &mutSync);
+	pthread_cleanup_pop(1);
+
+	RETiRet;
+}
+
+
+/* flush a stream in group commit mode and request a sync for it. This is
+ * the entry point for external callers.
+ */
+static rsRetVal
+strmSyncRequest(strm_t *pThis, strmSyncCtx_t *pCtx)
+{
+	DEFiRet;
+
+	ISOBJ_TYPE_assert(pThis, strm);
+	if(!pThis->bGroupSync)
+		FINALIZE;
+
+	if(pThis->bAsyncWrite)
+		d_pthread_mutex_lock(&pThis->mut);
+	iRet = strmFlushInternal(pThis);
+	if(pThis->bAsyncWrite)
+		strmWaitAsyncWriterDone(pThis);
+	else if(iRet == RS_RET_OK && pThis->pZipJobs != NULL)
+		iRet = zipWriteDoneJobs(pThis, -1);
+	if(iRet == RS_RET_OK)
+		iRet = strmSyncRequestInternal(pThis, pCtx);
+	if(pThis->bAsyncWrite)
+		d_pthread_mutex_unlock(&pThis->mut);
+
+finalize_it:
+	RETiRet;
+}
+
+/* preallocate file space so that the filesystem can allocate large extents
+ * instead of growing the file block by block with each write. We keep the
+ * file size unchanged, so appending still works as usual.
+ */
+static inline void
+strmPrealloc(strm_t *pThis, size_t lenBuf)
+{
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+	int64 iEnd;
+
+	if(pThis->iCurrOffs + (int64) lenBuf <= pThis->iPreallocEnd)
+		return;
+	if(pThis->iPreallocEnd < pThis->iCurrOffs)
+		pThis->iPreallocEnd = pThis->iCurrOffs;
+	iEnd = pThis->iCurrOffs + lenBuf + pThis->iPreallocSize;
+	iEnd -= iEnd % pThis->iPreallocSize;
+	if(fallocate(pThis->fd, FALLOC_FL_KEEP_SIZE, pThis->iPreallocEnd, iEnd - pThis->iPreallocEnd) == 0) {
+		pThis->iPreallocEnd = iEnd;
+	} else {
+		DBGPRINTF("stream %p: fallocate failed with errno %d, preallocation disabled\n", pThis, errno);
+		pThis->iPreallocSize = 0;
+	}
+#else
+	(void) pThis; (void) lenBuf;
+#endif
+}
+
+
+/* steady writeback: each time iSyncRangeSize bytes have been written, we
+ * start writeback for them, but do not wait. Then we wait for the range
+ * started the previous time, which usually is done already, so that the
+ * amount of dirty data per file stays bounded. Once written back, that
+ * range can be dropped from the page cache if so requested.
+ */
+static inline void
+strmSyncRange(strm_t *pThis)
+{
+#ifdef HAVE_SYNC_FILE_RANGE
+	int64 iStart = pThis->iSyncRangeStart;
+
+	if(pThis->iCurrOffs - iStart < pThis->iSyncRangeSize)
+		return;
+	sync_file_range(pThis->fd, iStart, pThis->iCurrOffs - iStart, SYNC_FILE_RANGE_WRITE);
+	if(pThis->iSyncRangePrev < iStart) {
+		if(sync_file_range(pThis->fd, pThis->iSyncRangePrev, iStart - pThis->iSyncRangePrev,
+				   SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+				   | SYNC_FILE_RANGE_WAIT_AFTER) == 0) {
+			pThis->ctrSynced += iStart - pThis->iSyncRangePrev;
+#			ifdef HAVE_POSIX_FADVISE
+			if(pThis->bDropCache)
+				posix_fadvise(pThis->fd, pThis->iSyncRangePrev, iStart - pThis->iSyncRangePrev,
+					      POSIX_FADV_DONTNEED);
+#			endif
+		}
+	}
+	pThis->iSyncRangePrev = iStart;
+	pThis->iSyncRangeStart = pThis->iCurrOffs;
+#else
+	(void) pThis;
+#endif
+}
+
+
+/* page cache related processing when a file is closed: we give back
+ * preallocated space we did not use and drop what is already clean from
+ * the cache. Must be called while the file is still open.
+ */
+static void
+strmPageCacheClose(strm_t *pThis)
+{
+	struct stat st;
+
+	if(pThis->iPreallocEnd > 0 && fstat(pThis->fd, &st) == 0 && pThis->iPreallocEnd > st.st_size) {
+		/* truncating to the current size releases blocks beyond EOF */
+		if(ftruncate(pThis->fd, st.st_size) != 0)
+			DBGPRINTF("stream %p: could not release preallocated space, errno %d\n", pThis, errno);
+	}
+	pThis->iPreallocEnd = 0;
+#ifdef HAVE_POSIX_FADVISE
+	if(pThis->bDropCache)
+		posix_fadvise(pThis->fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
+
+/* open the output file if needed and rotate it if that is due. Rotation
+ * is done before writing, so that a block (and its index entry) always goes
+ * to a single file.
+ */
+static rsRetVal
+strmCheckRotate(strm_t *pThis)
+{
+	DEFiRet;
+
+	if(pThis->fd == -1)
+		CHKiRet(strmOpenFile(pThis));
+	if(   (pThis->iRotateSize != 0 && pThis->iCurrOffs >= pThis->iRotateSize)
+	   || (pThis->iRotateInterval != 0 && time(NULL) >= pThis->tNextRotate)) {
+		CHKiRet(strmRotate(pThis));
+		CHKiRet(strmOpenFile(pThis));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* physically write to the output file. the provided data is ready for
  * writing (e.g. zipped if we are requested to do that).
  * Note that if the write() API fails, we do not reset any pointers, but return
  * an error code. That means we may redo work in the next iteration.
+ * The data is given as an iovec array of total length lenBuf, which
+ * may be modified by this function.
  * rgerhards, 2009-06-04
  */
 static rsRetVal
-strmPhysWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
+strmPhysWriteV(strm_t *pThis, struct iovec *iov, int iovcnt, size_t lenBuf)
 {
 	size_t iWritten;
 	DEFiRet;
 	ISOBJ_TYPE_assert(pThis, strm);
 
-	DBGPRINTF("strmPhysWrite, stream %p, len %d\n", pThis, (int) lenBuf);
-	if(pThis->fd == -1)
-		CHKiRet(strmOpenFile(pThis));
+	DBGPRINTF("strmPhysWrite, stream %p, len %d, %d buffers\n", pThis, (int) lenBuf, iovcnt);
+	/* inline zip writes a gzip member in several physical writes, it has
+	 * already checked rotation before it started the member.
+	 */
+	if(pThis->bNoRotate) {
+		if(pThis->fd == -1)
+			CHKiRet(strmOpenFile(pThis));
+	} else {
+		CHKiRet(strmCheckRotate(pThis));
+	}
+
+	if(pThis->iPreallocSize != 0)
+		strmPrealloc(pThis, lenBuf);
 
 	iWritten = lenBuf;
-	CHKiRet(doWriteCall(pThis, pBuf, &iWritten));
+	CHKiRet(doWriteCall(pThis, iov, iovcnt, &iWritten));
 
 	pThis->iCurrOffs += iWritten;
+	pThis->ctrWritten += iWritten;
+	if(pThis->iSyncRangeSize != 0)
+		strmSyncRange(pThis);
 	/* update user counter, if provided */
 	if(pThis->pUsrWCntr != NULL)
 		*pThis->pUsrWCntr += iWritten;
 
 	if(pThis->bSync) {
-		CHKiRet(syncFile(pThis));
+		if(pThis->bGroupSync) {
+			pThis->bSyncPending = 1; /* synced when the owner requests it */
+		} else {
+			CHKiRet(syncFile(pThis));
+			pThis->ctrSynced += iWritten;
+		}
 	}
 
 	if(pThis->sType == STREAMTYPE_FILE_CIRCULAR) {
@@ -1154,6 +2216,302 @@ finalize_it:
 	RETiRet;
 }
 
+/* the same for a single buffer */
+static rsRetVal
+strmPhysWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
+{
+	struct iovec iov;
+	DEFiRet;
+
+	iov.iov_base = pBuf;
+	iov.iov_len = lenBuf;
+	iRet = strmPhysWriteV(pThis, &iov, 1, lenBuf);
+	RETiRet;
+}
+
+
+/* add an entry for a gzip member to the block index sidecar file (if enabled).
+ * Each line holds the compressed offset and length of the member and its
+ * uncompressed length, so readers can seek to any member and start
+ * decompressing there.
+ */
+static rsRetVal
+zipIdxAdd(strm_t *pThis, int64 iOffs, size_t lenComp, size_t lenUncomp)
+{
+	char *pszIdxName = NULL;
+	size_t lenIdxName;
+	char szLine[64];
+	int lenLine;
+	DEFiRet;
+
+	if(!pThis->bZipIndex || pThis->pszCurrFName == NULL || pThis->fd == -1)
+		FINALIZE; /* no index or file already closed again (e.g. size limit) */
+
+	if(pThis->fdZipIdx == -1) {
+		lenIdxName = ustrlen(pThis->pszCurrFName) + sizeof(".idx");
+		CHKmalloc(pszIdxName = malloc(lenIdxName));
+		snprintf(pszIdxName, lenIdxName, "%s.idx", (char*) pThis->pszCurrFName);
+		pThis->fdZipIdx = open(pszIdxName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | O_NOCTTY,
+				       pThis->tOpenMode);
+		if(pThis->fdZipIdx == -1) {
+			char errStr[1024];
+			rs_strerror_r(errno, errStr, sizeof(errStr));
+			DBGPRINTF("error opening zip index file '%s': %s\n", pszIdxName, errStr);
+			ABORT_FINALIZE(RS_RET_IO_ERROR);
+		}
+	}
+
+	lenLine = snprintf(szLine, sizeof(szLine), "%lld %lld %lld\n", (long long) iOffs,
+			   (long long) lenComp, (long long) lenUncomp);
+	if(write(pThis->fdZipIdx, szLine, lenLine) != lenLine) {
+		DBGPRINTF("error writing zip index for '%s'\n", pThis->pszCurrFName);
+		ABORT_FINALIZE(RS_RET_IO_ERROR);
+	}
+
+finalize_it:
+	free(pszIdxName);
+	RETiRet;
+}
+
+
+/* compress a job's input into a complete gzip member. Called by the
+ * compressor threads, without any lock held.
+ */
+static rsRetVal
+zipCompressJob(strmZipJob_t *pJob)
+{
+	z_stream zstrm;
+	int zRet;
+	sbool bzInitDone = RSFALSE;
+	uchar *pNewOut;
+	DEFiRet;
+
+	if(pJob->sizeOut < pJob->lenIn + pJob->lenIn / 8 + 128) {
+		pJob->sizeOut = pJob->lenIn + pJob->lenIn / 8 + 128;
+		CHKmalloc(pNewOut = realloc(pJob->pOut, pJob->sizeOut));
+		pJob->pOut = pNewOut;
+	}
+
+	zstrm.zalloc = Z_NULL;
+	zstrm.zfree = Z_NULL;
+	zstrm.opaque = Z_NULL;
+	zstrm.next_in = (Bytef*) pJob->pIn;
+	zRet = zlibw.DeflateInit2(&zstrm, pJob->pStrm->iZipLevel, Z_DEFLATED, 31, 9, Z_DEFAULT_STRATEGY);
+	if(zRet != Z_OK) {
+		DBGPRINTF("error %d returned from zlib/deflateInit2()\n", zRet);
+		ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+	}
+	bzInitDone = RSTRUE;
+
+	zstrm.next_in = (Bytef*) pJob->pIn;
+	zstrm.avail_in = pJob->lenIn;
+	zstrm.next_out = pJob->pOut;
+	zstrm.avail_out = pJob->sizeOut;
+	while((zRet = zlibw.Deflate(&zstrm, Z_FINISH)) != Z_STREAM_END) {
+		if(zRet != Z_OK && zRet != Z_BUF_ERROR) {
+			DBGPRINTF("error %d returned from zlib/deflate()\n", zRet);
+			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+		}
+		/* output buffer too small (should not happen) - extend it */
+		CHKmalloc(pNewOut = realloc(pJob->pOut, pJob->sizeOut * 2));
+		pJob->pOut = pNewOut;
+		zstrm.next_out = pJob->pOut + zstrm.total_out;
+		zstrm.avail_out = pJob->sizeOut * 2 - zstrm.total_out;
+		pJob->sizeOut *= 2;
+	}
+	pJob->lenOut = zstrm.total_out;
+
+finalize_it:
+	if(bzInitDone)
+		zlibw.DeflateEnd(&zstrm);
+	RETiRet;
+}
+
+
+/* the compressor thread, shared by all streams in parallel zip mode */
+static void*
+zipPoolThread(void __attribute__((unused)) *pPtr)
+{
+	strmZipJob_t *pJob;
+	rsRetVal localRet;
+
+	BEGINfunc
+#	if HAVE_PRCTL && defined PR_SET_NAME
+	if(prctl(PR_SET_NAME, "rs:strm zip", 0, 0, 0) != 0) {
+		DBGPRINTF("prctl failed, not setting thread name for '%s'\n", "stream compressor");
+	}
+#	endif
+
+	pthread_mutex_lock(&mutZipPool);
+	while(!bZipPoolTerminate) {
+		if(pZipWorkRoot == NULL) {
+			pthread_cond_wait(&condZipWork, &mutZipPool);
+			continue;
+		}
+		pJob = pZipWorkRoot;
+		pZipWorkRoot = pJob->pNext;
+		if(pZipWorkRoot == NULL)
+			pZipWorkLast = NULL;
+		pthread_mutex_unlock(&mutZipPool);
+		localRet = zipCompressJob(pJob);
+		pthread_mutex_lock(&mutZipPool);
+		pJob->iRet = localRet;
+		pJob->bDone = 1;
+		pthread_cond_broadcast(&condZipDone);
+	}
+	pthread_mutex_unlock(&mutZipPool);
+
+	ENDfunc
+	return NULL; /* to keep pthreads happy */
+}
+
+
+/* register a stream in parallel zip mode. The compressor pool grows up to
+ * the largest number of threads any stream requested, but never beyond
+ * STREAM_ZIP_POOL_MAX. If the pool has no thread at all, nobody would ever
+ * compress the stream's blocks, so it falls back to inline compression.
+ */
+static void
+zipPoolRegisterStrm(strm_t *pThis)
+{
+	pthread_mutex_lock(&mutZipThrds);
+	++nZipStreams;
+	while(nZipThrds < pThis->iZipThreads && nZipThrds < STREAM_ZIP_POOL_MAX) {
+		if(pthread_create(&zipThrdIDs[nZipThrds],
+#ifdef HAVE_PTHREAD_SETSCHEDPARAM
+			    	  &default_thread_attr,
+#else
+				  NULL,
+#endif
+				  zipPoolThread, NULL) != 0) {
+			DBGPRINTF("ERROR: stream %p could not create compressor thread\n", pThis);
+			break;
+		}
+		++nZipThrds;
+	}
+	if(nZipThrds == 0) {
+		DBGPRINTF("ERROR: stream %p has no compressor thread, compressing inline\n", pThis);
+		--nZipStreams;
+		free(pThis->pZipJobs);
+		pThis->pZipJobs = NULL;
+	}
+	pthread_mutex_unlock(&mutZipThrds);
+}
+
+
+/* unregister a stream from parallel zip mode. It must not have any blocks
+ * in flight. The pool is shut down with the last stream.
+ */
+static void
+zipPoolUnregisterStrm(void)
+{
+	int i;
+
+	pthread_mutex_lock(&mutZipThrds);
+	if(--nZipStreams == 0) {
+		pthread_mutex_lock(&mutZipPool);
+		bZipPoolTerminate = 1;
+		pthread_cond_broadcast(&condZipWork);
+		pthread_mutex_unlock(&mutZipPool);
+		for(i = 0 ; i < nZipThrds ; ++i)
+			pthread_join(zipThrdIDs[i], NULL);
+		nZipThrds = 0;
+		bZipPoolTerminate = 0;
+	}
+	pthread_mutex_unlock(&mutZipThrds);
+}
+
+
+/* write out the compressed blocks at the head of the ring, in order. We
+ * wait until at least nWait blocks have been written (-1 means all). Blocks
+ * that are not yet done are left for later if we need not wait for them.
+ * A block that failed to compress or write is dropped, as the inline mode
+ * would also lose it.
+ */
+static rsRetVal
+zipWriteDoneJobs(strm_t *pThis, int nWait)
+{
+	strmZipJob_t *pJob;
+	int nWritten = 0;
+	sbool bDone;
+	rsRetVal localRet;
+	DEFiRet;
+
+	if(pThis->bInZipDrain)
+		FINALIZE; /* called recursively via a file switch, the outer call writes */
+	pThis->bInZipDrain = 1;
+	while(pThis->iZipJobCnt > 0) {
+		pJob = &pThis->pZipJobs[pThis->iZipJobHead];
+		pthread_mutex_lock(&mutZipPool);
+		while(!pJob->bDone && (nWait == -1 || nWritten < nWait))
+			pthread_cond_wait(&condZipDone, &mutZipPool);
+		bDone = pJob->bDone;
+		pthread_mutex_unlock(&mutZipPool);
+		if(!bDone)
+			break;
+
+		localRet = pJob->iRet;
+		if(localRet == RS_RET_OK) {
+			localRet = strmPhysWrite(pThis, pJob->pOut, pJob->lenOut);
+			if(localRet == RS_RET_OK)
+				zipIdxAdd(pThis, pThis->iCurrOffs - pJob->lenOut, pJob->lenOut, pJob->lenIn);
+		}
+		if(localRet != RS_RET_OK) {
+			DBGPRINTF("stream %p: error %d writing compressed block, block lost\n", pThis, localRet);
+			iRet = localRet;
+		}
+		pThis->iZipJobHead = (pThis->iZipJobHead + 1) % pThis->iZipThreads;
+		--pThis->iZipJobCnt;
+		++nWritten;
+	}
+	pThis->bInZipDrain = 0;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* hand a buffer over to the compressor pool. If all slots are in use, we
+ * first wait for the oldest block and write it.
+ */
+static rsRetVal
+doZipWriteParallel(strm_t *pThis, uchar *pBuf, size_t lenBuf)
+{
+	strmZipJob_t *pJob;
+	uchar *pNewIn;
+	DEFiRet;
+
+	if(pThis->iZipJobCnt == pThis->iZipThreads)
+		CHKiRet(zipWriteDoneJobs(pThis, 1));
+
+	pJob = &pThis->pZipJobs[(pThis->iZipJobHead + pThis->iZipJobCnt) % pThis->iZipThreads];
+	if(pJob->sizeIn < lenBuf) {
+		CHKmalloc(pNewIn = realloc(pJob->pIn, lenBuf));
+		pJob->pIn = pNewIn;
+		pJob->sizeIn = lenBuf;
+	}
+	memcpy(pJob->pIn, pBuf, lenBuf);
+	pJob->lenIn = lenBuf;
+	pJob->bDone = 0;
+	pJob->pNext = NULL;
+	++pThis->iZipJobCnt;
+
+	pthread_mutex_lock(&mutZipPool);
+	if(pZipWorkLast == NULL)
+		pZipWorkRoot = pJob;
+	else
+		pZipWorkLast->pNext = pJob;
+	pZipWorkLast = pJob;
+	pthread_cond_signal(&condZipWork);
+	pthread_mutex_unlock(&mutZipPool);
+
+	/* write whatever is already done, but do not wait */
+	CHKiRet(zipWriteDoneJobs(pThis, 0));
+
+finalize_it:
+	RETiRet;
+}
+
 
 /* write the output buffer in zip mode
  * This means we compress it first and then do a physical write.
@@ -1172,10 +2530,30 @@ doZipWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
 	z_stream zstrm;
 	int zRet;	/* zlib return state */
 	sbool bzInitDone = RSFALSE;
+	sbool bNoRotateSave;
 	DEFiRet;
 	assert(pThis != NULL);
 	assert(pBuf != NULL);
 
+	bNoRotateSave = pThis->bNoRotate; /* we may be called while a member is written */
+
+	/* in parallel mode, we just hand over the block. We compress inline only if
+	 * we are called while writing out blocks and there is no free slot.
+	 */
+	if(   pThis->pZipJobs != NULL
+	   && !(pThis->bInZipDrain && pThis->iZipJobCnt == pThis->iZipThreads)) {
+		CHKiRet(doZipWriteParallel(pThis, pBuf, lenBuf));
+		FINALIZE;
+	}
+
+
+	/* the member may need several physical writes. We rotate only before
+	 * it starts, so that it (and its index entry) goes to a single file.
+	 */
+	if(!pThis->bNoRotate)
+		CHKiRet(strmCheckRotate(pThis));
+	pThis->bNoRotate = 1;
+
 	/* allocate deflate state */
 	zstrm.zalloc = Z_NULL;
 	zstrm.zfree = Z_NULL;
@@ -1205,8 +2583,11 @@ doZipWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
 		CHKiRet(strmPhysWrite(pThis, (uchar*)pThis->pZipBuf, pThis->sIOBufSize - zstrm.avail_out));
 	} while (zstrm.avail_out == 0);
 	assert(zstrm.avail_in == 0);     /* all input will be used */
+	/* index errors do not affect the data */
+	zipIdxAdd(pThis, pThis->iCurrOffs - zstrm.total_out, zstrm.total_out, lenBuf);
 
 finalize_it:
+	pThis->bNoRotate = bNoRotateSave;
 	if(bzInitDone) {
 		zRet = zlibw.DeflateEnd(&zstrm);
 		if(zRet != Z_OK) {
@@ -1256,6 +2637,9 @@ strmFlush(strm_t *pThis)
 	if(pThis->bAsyncWrite)
 		d_pthread_mutex_lock(&pThis->mut);
 	CHKiRet(strmFlushInternal(pThis));
+	/* in async mode, the writer pool writes the compressed blocks */
+	if(pThis->pZipJobs != NULL && !pThis->bAsyncWrite)
+		CHKiRet(zipWriteDoneJobs(pThis, -1));
 
 finalize_it:
 	if(pThis->bAsyncWrite)
@@ -1371,23 +2755,13 @@ finalize_it:
  * free byte left. This came up during a code walkthrough and was considered
  * worth nothing. -- rgerhards, 2010-03-10
  */
-static rsRetVal
-strmWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
+static inline rsRetVal
+strmBufWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
 {
 	DEFiRet;
 	size_t iWrite;
 	size_t iOffset;
 
-	ASSERT(pThis != NULL);
-	ASSERT(pBuf != NULL);
-
-//DBGPRINTF("strmWrite(%p, '%65.65s', %ld);, disabled %d, sizelim %ld, size %lld\n", pThis, pBuf,lenBuf, pThis->bDisabled, pThis->iSizeLimit, pThis->iCurrOffs);
-	if(pThis->bAsyncWrite)
-		d_pthread_mutex_lock(&pThis->mut);
-
-	if(pThis->bDisabled)
-		ABORT_FINALIZE(RS_RET_STREAM_DISABLED);
-
 	iOffset = 0;
 	do {
 		if(pThis->iBufPtr == pThis->sIOBufSize) {
@@ -1402,6 +2776,29 @@ strmWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
 		lenBuf -= iWrite;
 	} while(lenBuf > 0);
 
+finalize_it:
+	RETiRet;
+}
+
+/* the locked entry point for strmBufWrite() */
+static rsRetVal
+strmWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
+{
+	DEFiRet;
+
+	ASSERT(pThis != NULL);
+	ASSERT(pBuf != NULL);
+
+//DBGPRINTF("strmWrite(%p, '%65.65s', %ld);, disabled %d, sizelim %ld, size %lld\n", pThis, pBuf,lenBuf, pThis->bDisabled, pThis->iSizeLimit, pThis->iCurrOffs);
+	if(pThis->bAsyncWrite)
+		d_pthread_mutex_lock(&pThis->mut);
+
+	if(pThis->bDisabled)
+		ABORT_FINALIZE(RS_RET_STREAM_DISABLED);
+
+	if(lenBuf > 0)
+		CHKiRet(strmBufWrite(pThis, pBuf, lenBuf));
+
 	/* now check if the buffer right at the end of the write is full and, if so,
 	 * write it. This seems more natural than waiting (hours?) for the next message...
 	 */
@@ -1411,13 +2808,69 @@ strmWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
 
 finalize_it:
 	if(pThis->bAsyncWrite) {
-		if(pThis->bDoTimedWait == 0) {
-			/* we potentially have a partial buffer, so re-activate the
-			 * writer thread that it can set and pick up timeouts.
-			 */
-			pThis->bDoTimedWait = 1;
-			pthread_cond_signal(&pThis->notEmpty);
-		}
+		/* if we have a partial buffer, let the writer pool
+		 * write it when the flush interval has expired.
+		 */
+		poolSchedTimedFlush(pThis);
+		d_pthread_mutex_unlock(&pThis->mut);
+	}
+
+	RETiRet;
+}
+
+
+/* write a scatter list (e.g. a template rendered via tplToIovec()) to a
+ * stream. Usually, the data is gathered into the stream buffer just like
+ * strmWrite() does, but without the need for the caller to build a
+ * contiguous string first. If the data does not fit into the buffer and
+ * we write synchronously and uncompressed, the buffer content and the
+ * list are written with a single writev() call, so the data is not
+ * copied at all.
+ */
+#define STRM_MAX_IOV 65
+static rsRetVal
+strmWriteV(strm_t *pThis, struct iovec *iov, int iovcnt)
+{
+	struct iovec iovWrite[STRM_MAX_IOV];
+	size_t lenTotal;
+	int i;
+	DEFiRet;
+
+	ASSERT(pThis != NULL);
+	ASSERT(iov != NULL);
+
+	if(pThis->bAsyncWrite)
+		d_pthread_mutex_lock(&pThis->mut);
+
+	if(pThis->bDisabled)
+		ABORT_FINALIZE(RS_RET_STREAM_DISABLED);
+
+	lenTotal = 0;
+	for(i = 0 ; i < iovcnt ; ++i)
+		lenTotal += iov[i].iov_len;
+
+	if(   !pThis->bAsyncWrite && pThis->iZipLevel == 0 && iovcnt < STRM_MAX_IOV
+	   && pThis->iBufPtr + lenTotal > pThis->sIOBufSize) {
+		iovWrite[0].iov_base = pThis->pIOBuf;
+		iovWrite[0].iov_len = pThis->iBufPtr;
+		memcpy(iovWrite + 1, iov, iovcnt * sizeof(struct iovec));
+		lenTotal += pThis->iBufPtr;
+		pThis->iBufPtr = 0; /* see strmSchedWrite() for why this is done first */
+		CHKiRet(strmPhysWriteV(pThis, iovWrite, iovcnt + 1, lenTotal));
+		FINALIZE;
+	}
+
+	for(i = 0 ; i < iovcnt ; ++i) {
+		if(iov[i].iov_len > 0)
+			CHKiRet(strmBufWrite(pThis, iov[i].iov_base, iov[i].iov_len));
+	}
+	if(pThis->iBufPtr == pThis->sIOBufSize) {
+		CHKiRet(strmFlushInternal(pThis));
+	}
+
+finalize_it:
+	if(pThis->bAsyncWrite) {
+		poolSchedTimedFlush(pThis);
 		d_pthread_mutex_unlock(&pThis->mut);
 	}
 
@@ -1439,6 +2892,16 @@ DEFpropSetMeth(strm, sIOBufSize, size_t)
 DEFpropSetMeth(strm, iSizeLimit, off_t)
 DEFpropSetMeth(strm, iFlushInterval, int)
 DEFpropSetMeth(strm, pszSizeLimitCmd, uchar*)
+DEFpropSetMeth(strm, iZipThreads, int)
+DEFpropSetMeth(strm, bZipIndex, int)
+DEFpropSetMeth(strm, iRotateSize, int64)
+DEFpropSetMeth(strm, iRotateInterval, int)
+DEFpropSetMeth(strm, iRotateKeep, int)
+DEFpropSetMeth(strm, bRotateCompress, int)
+DEFpropSetMeth(strm, iPreallocSize, int64)
+DEFpropSetMeth(strm, iSyncRangeSize, int64)
+DEFpropSetMeth(strm, bDropCache, int)
+DEFpropSetMeth(strm, bGroupSync, int)
 
 static rsRetVal strmSetiMaxFiles(strm_t *pThis, int iNewVal)
 {
@@ -1738,6 +3201,7 @@ CODESTARTobjQueryInterface(strm)
 	pIf->ReadLine = strmReadLine;
 	pIf->SeekCurrOffs = strmSeekCurrOffs;
 	pIf->Write = strmWrite;
+	pIf->WriteV = strmWriteV;
 	pIf->WriteChar = strmWriteChar;
 	pIf->WriteLong = strmWriteLong;
 	pIf->SetFName = strmSetFName;
@@ -1763,6 +3227,18 @@ CODESTARTobjQueryInterface(strm)
 	pIf->SetiSizeLimit = strmSetiSizeLimit;
 	pIf->SetiFlushInterval = strmSetiFlushInterval;
 	pIf->SetpszSizeLimitCmd = strmSetpszSizeLimitCmd;
+	pIf->SetiZipThreads = strmSetiZipThreads;
+	pIf->SetbZipIndex = strmSetbZipIndex;
+	pIf->SetiRotateSize = strmSetiRotateSize;
+	pIf->SetiRotateInterval = strmSetiRotateInterval;
+	pIf->SetiRotateKeep = strmSetiRotateKeep;
+	pIf->SetbRotateCompress = strmSetbRotateCompress;
+	pIf->SetiPreallocSize = strmSetiPreallocSize;
+	pIf->SetiSyncRangeSize = strmSetiSyncRangeSize;
+	pIf->SetbDropCache = strmSetbDropCache;
+	pIf->SetbGroupSync = strmSetbGroupSync;
+	pIf->SyncRequest = strmSyncRequest;
+	pIf->SyncWait = strmSyncWait;
 finalize_it:
 ENDobjQueryInterface(strm)
 
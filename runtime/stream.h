@@ -66,10 +66,12 @@
 #define STREAM_H_INCLUDED
 
 #include <pthread.h>
+#include <sys/uio.h>
 #include "obj-types.h"
 #include "glbl.h"
 #include "stream.h"
 #include "zlibw.h"
+#include "statsobj.h"
 
 /* stream types */
 typedef enum {
@@ -88,6 +90,17 @@ typedef enum {				/* when extending, do NOT change existing modes! */
 } strmMode_t;
 
 #define STREAM_ASYNC_NUMBUFS 2 /* must be a power of 2 -- TODO: make configurable */
+#define STREAM_WRITER_POOL_MAX 4 /* max number of threads servicing all async streams */
+#define STREAM_ZIP_POOL_MAX 16 /* max number of threads compressing for all streams */
+#define STREAM_ROTATE_KEEP_DFLT 5 /* default number of rotated generations to keep */
+#define STREAM_SYNCRANGE_DFLT (8 * 1024 * 1024) /* writeback chunk if only cache dropping is requested */
+
+struct strmZipJob_s;	/* a block being compressed in parallel, opaque outside of stream.c */
+
+/* a caller's set of sync requests for group commit mode, see strmSyncRequest() */
+typedef struct strmSyncCtx_s {
+	int nPending;	/* number of syncs not yet done */
+} strmSyncCtx_t;
 /* The strm_t data structure */
 typedef struct strm_s {
 	BEGINobjInstance;	/* Data to implement generic object - MUST be the first data element! */
@@ -107,6 +120,9 @@ typedef struct strm_s {
 	/* dynamic properties, valid only during file open, not to be persistet */
 	sbool bDisabled; /* should file no longer be written to? (currently set only if omfile file size limit fails) */
 	sbool bSync;	/* sync this file after every write? */
+	sbool bGroupSync;	/* group commit: sync on request via the sync coordinator instead */
+	sbool bSyncPending;	/* group commit: data written since the last sync request */
+	sbool bSyncRegistered;	/* group commit: stream is registered with the sync coordinator */
 	size_t sIOBufSize;/* size of IO buffer */
 	uchar *pszDir; /* Directory */
 	int lenDir;
@@ -120,14 +136,21 @@ typedef struct strm_s {
 	sbool bInRecord;	/* if 1, indicates that we are currently writing a not-yet complete record */
 	int iZipLevel;	/* zip level (0..9). If 0, zip is completely disabled */
 	Bytef *pZipBuf;
+	/* support for parallel zip processing */
+	int iZipThreads;	/* max nbr of blocks compressed in parallel, 0 or 1 - compress inline */
+	sbool bZipIndex;	/* write a block index sidecar file (<name>.idx)? */
+	sbool bInZipDrain;	/* currently writing out compressed blocks (guards against recursion) */
+	int fdZipIdx;		/* the index file's descriptor, -1 if closed */
+	struct strmZipJob_s *pZipJobs;	/* ring of blocks in flight, NULL if compressing inline */
+	int iZipJobHead;	/* oldest block not yet written */
+	int iZipJobCnt;		/* number of blocks in flight */
 	/* support for async flush procesing */
 	sbool bAsyncWrite;	/* do asynchronous writes (always if a flush interval is given) */
-	sbool bStopWriter;	/* shall writer thread terminate? */
-	sbool bDoTimedWait;	/* instruct writer thread to do a times wait to support flush timeouts */
+	sbool bStopWriter;	/* stream is being destructed, no more writes */
+	sbool bDoTimedWait;	/* a flush deadline is scheduled for a partial buffer */
 	int iFlushInterval; /* flush in which interval - 0, no flushing */
 	pthread_mutex_t mut;/* mutex for flush in async mode */
 	pthread_cond_t notFull;
-	pthread_cond_t notEmpty;
 	pthread_cond_t isEmpty;
 	unsigned short iEnq;	/* this MUST be unsigned as we use module arithmetic (else invalid indexing happens!) */
 	unsigned short iDeq;	/* this MUST be unsigned as we use module arithmetic (else invalid indexing happens!) */
@@ -136,7 +159,30 @@ typedef struct strm_s {
 		uchar *pBuf;
 		size_t lenBuf;
 	} asyncBuf[STREAM_ASYNC_NUMBUFS];
-	pthread_t writerThreadID;
+	/* the following fields are protected by the writer pool mutex */
+	struct strm_s *pNextWork;	/* next stream in the pool's work queue */
+	sbool bQueued;		/* stream is in the work queue */
+	sbool bFlushDue;	/* flush deadline has expired, partial buffer must be written */
+	int iInService;		/* number of pool threads currently working on this stream */
+	int iHeapIdx;		/* index into the pool's timer heap, -1 if not in heap */
+	struct timespec tFlushDeadline;	/* when the partial buffer must be written */
+	/* support for native rotation (single files in write mode only) */
+	int64	iRotateSize;	/* rotate when the file has reached this size, 0 - never */
+	int	iRotateInterval;/* rotate at multiples of this many seconds, 0 - never */
+	int	iRotateKeep;	/* number of rotated generations to keep */
+	sbool	bRotateCompress;/* gzip rotated files in the background? */
+	time_t	tNextRotate;	/* time of next interval-based rotation */
+	sbool	bNoRotate;	/* inside a gzip member, rotation must wait until it is complete */
+	/* support for page cache friendly writing */
+	int64	iPreallocSize;	/* preallocate file space in chunks of this size, 0 - off */
+	int64	iPreallocEnd;	/* end of space preallocated so far */
+	int64	iSyncRangeSize;	/* start writeback each time this many bytes were written, 0 - off */
+	int64	iSyncRangeStart;/* begin of data not yet handed to writeback */
+	int64	iSyncRangePrev;	/* begin of range handed to writeback last time */
+	sbool	bDropCache;	/* advise the kernel to drop written data from the page cache */
+	statsobj_t *stats;	/* counters, only if one of the above is enabled */
+	intctr_t ctrWritten;	/* bytes written */
+	intctr_t ctrSynced;	/* bytes known to be written back to disk */
 	/* support for omfile size-limiting commands, special counters, NOT persisted! */
 	off_t	iSizeLimit;	/* file size limit, 0 = no limit */
 	uchar	*pszSizeLimitCmd;	/* command to carry out when size limit is reached */
@@ -181,8 +227,26 @@ BEGINinterface(strm) /* name must also be changed in ENDinterface macro! */
 	INTERFACEpropSetMeth(strm, pszSizeLimitCmd, uchar*);
 	/* v6 added */
 	rsRetVal (*ReadLine)(strm_t *pThis, cstr_t **ppCStr, int mode);
+	/* v7 added */
+	rsRetVal (*WriteV)(strm_t *pThis, struct iovec *iov, int iovcnt);
+	/* v8 added */
+	INTERFACEpropSetMeth(strm, iZipThreads, int);
+	INTERFACEpropSetMeth(strm, bZipIndex, int);
+	/* v9 added */
+	INTERFACEpropSetMeth(strm, iRotateSize, int64);
+	INTERFACEpropSetMeth(strm, iRotateInterval, int);
+	INTERFACEpropSetMeth(strm, iRotateKeep, int);
+	INTERFACEpropSetMeth(strm, bRotateCompress, int);
+	/* v10 added */
+	INTERFACEpropSetMeth(strm, iPreallocSize, int64);
+	INTERFACEpropSetMeth(strm, iSyncRangeSize, int64);
+	INTERFACEpropSetMeth(strm, bDropCache, int);
+	/* v11 added */
+	INTERFACEpropSetMeth(strm, bGroupSync, int);
+	rsRetVal (*SyncRequest)(strm_t *pThis, strmSyncCtx_t *pCtx);
+	rsRetVal (*SyncWait)(strmSyncCtx_t *pCtx);
 ENDinterface(strm)
-#define strmCURR_IF_VERSION 6 /* increment whenever you change the interface structure! */
+#define strmCURR_IF_VERSION 11 /* increment whenever you change the interface structure! */
 
 
 /* prototypes */
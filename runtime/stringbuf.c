@@ -50,6 +50,11 @@ uchar*  rsCStrGetSzStr(cstr_t *pThis);
 DEFobjCurrIf(obj)
 DEFobjCurrIf(regexp)
 
+/* stored in a regex cache if the regex could not be compiled, so that we
+ * do not try to compile it again for each message.
+ */
+static rsregex_t regexFailed;
+
 /* ################################################################# *
  * public members                                                    *
  * ################################################################# */
@@ -640,10 +645,11 @@ int rsCStrCaseInsensitveStartsWithSzStr(cstr_t *pCS1, uchar *psz, size_t iLenSz)
  * Arnaud Cornet/rgerhards: 2009-04-02: performance improvement by caching compiled regex
  * If a caller does not need the cached version, it must still provide memory for it
  * and must call rsCStrRegexDestruct() afterwards.
+ * A regex that does not compile never matches. The failure is cached as well.
  */
 rsRetVal rsCStrSzStrMatchRegex(cstr_t *pCS1, uchar *psz, int iType, void *rc)
 {
-	regex_t **cache = (regex_t**) rc;
+	rsregex_t **cache = (rsregex_t**) rc;
 	int ret;
 	DEFiRet;
 
@@ -653,10 +659,16 @@ rsRetVal rsCStrSzStrMatchRegex(cstr_t *pCS1, uchar *psz, int iType, void *rc)
 
 	if(objUse(regexp, LM_REGEXP_FILENAME) == RS_RET_OK) {
 		if (*cache == NULL) {
-			*cache = calloc(sizeof(regex_t), 1);
-			regexp.regcomp(*cache, (char*) rsCStrGetSzStr(pCS1), (iType == 1 ? REG_EXTENDED : 0) | REG_NOSUB);
+			if(regexp.compile(cache, (char*) rsCStrGetSzStr(pCS1),
+				       (iType == 1 ? REG_EXTENDED : 0) | REG_NOSUB, RS_REGEX_ENGINE_DFLT) != 0) {
+				DBGPRINTF("regex '%s' could not be compiled, it never matches\n",
+					  rsCStrGetSzStr(pCS1));
+				*cache = &regexFailed;
+			}
 		}
-		ret = regexp.regexec(*cache, (char*) psz, 0, NULL, 0);
+		if(*cache == &regexFailed)
+			ABORT_FINALIZE(RS_RET_NOT_FOUND);
+		ret = regexp.exec(*cache, (char*) psz, 0, NULL, 0);
 		if(ret != 0)
 			ABORT_FINALIZE(RS_RET_NOT_FOUND);
 	} else {
@@ -674,15 +686,17 @@ finalize_it:
  */
 void rsCStrRegexDestruct(void *rc)
 {
-	regex_t **cache = rc;
+	rsregex_t **cache = rc;
 	
 	assert(cache != NULL);
 	assert(*cache != NULL);
 
-	if(objUse(regexp, LM_REGEXP_FILENAME) == RS_RET_OK) {
-		regexp.regfree(*cache);
-		free(*cache);
+	if(*cache == &regexFailed) {
 		*cache = NULL;
+		return;
+	}
+	if(objUse(regexp, LM_REGEXP_FILENAME) == RS_RET_OK) {
+		regexp.destruct(cache);
 	}
 }
 
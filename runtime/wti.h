@@ -36,6 +36,8 @@ struct wti_s {
 	sbool bAlwaysRunning;	/* should this thread always run? */
 	wtp_t *pWtp; /* my worker thread pool (important if only the work thread instance is passed! */
 	batch_t batch; /* pointer to an object array meaningful for current user pointer (e.g. queue pUsr data elemt) */
+	batch_t batchPending; /* previous batch, if its commit is still pending (nElem == 0 if none) */
+	sbool bBatchDeleted; /* batch is already deleted from the queue (swapped with batchPending) */
 	uchar *pszDbgHdr;	/* header string for debug messages */
 	DEF_ATOMIC_HELPER_MUT(mutIsRunning);
 };
@@ -65,6 +65,26 @@ static int myDeflate(z_streamp strm, int flush)
 	return deflate(strm, flush);
 }
 
+static int myInflateInit2(z_streamp strm, int windowBits)
+{
+	return inflateInit2(strm, windowBits);
+}
+
+static int myInflate(z_streamp strm, int flush)
+{
+	return inflate(strm, flush);
+}
+
+static int myInflateReset(z_streamp strm)
+{
+	return inflateReset(strm);
+}
+
+static int myInflateEnd(z_streamp strm)
+{
+	return inflateEnd(strm);
+}
+
 
 /* queryInterface function
  * rgerhards, 2008-03-05
@@ -84,6 +104,10 @@ CODESTARTobjQueryInterface(zlibw)
 	pIf->DeflateInit2 = myDeflateInit2;
 	pIf->Deflate     = myDeflate;
 	pIf->DeflateEnd  = myDeflateEnd;
+	pIf->InflateInit2 = myInflateInit2;
+	pIf->Inflate     = myInflate;
+	pIf->InflateReset = myInflateReset;
+	pIf->InflateEnd  = myInflateEnd;
 finalize_it:
 ENDobjQueryInterface(zlibw)
 
@@ -31,8 +31,13 @@ BEGINinterface(zlibw) /* name must also be changed in ENDinterface macro! */
 	int (*DeflateInit2)(z_streamp strm, int level, int method, int windowBits, int memLevel, int strategy);
 	int (*Deflate)(z_streamp strm, int);
 	int (*DeflateEnd)(z_streamp strm);
+	/* v2 added */
+	int (*InflateInit2)(z_streamp strm, int windowBits);
+	int (*Inflate)(z_streamp strm, int);
+	int (*InflateReset)(z_streamp strm);
+	int (*InflateEnd)(z_streamp strm);
 ENDinterface(zlibw)
-#define zlibwCURR_IF_VERSION 1 /* increment whenever you change the interface structure! */
+#define zlibwCURR_IF_VERSION 2 /* increment whenever you change the interface structure! */
 
 
 /* prototypes */
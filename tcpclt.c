@@ -34,6 +34,7 @@
 #include <netdb.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #if HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
@@ -256,46 +257,27 @@ finalize_it:
 }
 
 
-/* Sends a TCP message. It is first checked if the
- * session is open and, if not, it is opened. Then the send
- * is tried. If it fails, one silent re-try is made. If the send
- * fails again, an error status (-1) is returned. If all goes well,
- * 0 is returned. The TCP session is NOT torn down.
- * For now, EAGAIN is ignored (causing message loss) - but it is
- * hard to do something intelligent in this case. With this
- * implementation here, we can not block and/or defer. Things are
- * probably a bit better when we move to liblogging. The alternative
- * would be to enhance the current select server with buffering and
- * write descriptors. This seems not justified, given the expected
- * short life span of this code (and the unlikeliness of this event).
- * rgerhards 2005-07-06
- * This function is now expected to stay. Libloging won't be used for
- * that purpose. I have added the param "len", because it is known by the
- * caller and so saves us some time. Also, it MUST be given because there
- * may be NULs inside msg so that we can not rely on strlen(). Please note
- * that the restrictions outlined above do not existin in multi-threaded
- * mode, which we assume will now be most often used. So there is no
- * real issue with the potential message loss in single-threaded builds.
- * rgerhards, 2006-11-30
- * I greatly restructured the function to be more generic and work
- * with function pointers. So it now can be used with any type of transport,
- * as long as it follows stream semantics. This was initially done to 
- * support plain TCP and GSS via common code.
+/* copy a scatter list into a (large enough) buffer */
+static inline void
+iovCopy(char *pDst, struct iovec *iov, int iovcnt)
+{
+	int i;
+	for(i = 0 ; i < iovcnt ; ++i) {
+		memcpy(pDst, iov[i].iov_base, iov[i].iov_len);
+		pDst += iov[i].iov_len;
+	}
+}
+
+
+/* the actual sending, including the retry handling. The (already framed)
+ * message is either given as string (msg) or as scatter list (iov).
  */
-static int
-Send(tcpclt_t *pThis, void *pData, char *msg, size_t len)
+static rsRetVal
+doSend(tcpclt_t *pThis, void *pData, char *msg, struct iovec *iov, int iovcnt, size_t len)
 {
 	DEFiRet;
 	int bDone = 0;
 	int retry = 0;
-	int bMsgMustBeFreed = 0;/* must msg be freed at end of function? 0 - no, 1 - yes */
-
-	ISOBJ_TYPE_assert(pThis, tcpclt);
-	assert(pData != NULL);
-	assert(msg != NULL);
-	assert(len > 0);
-
-	CHKiRet(TCPSendBldFrame(pThis, &msg, &len, &bMsgMustBeFreed));
 
 	if(pThis->iRebindInterval > 0  && ++pThis->iNumMsgs == pThis->iRebindInterval) {
 		/* we need to rebind, and use the retry logic for this*/
@@ -305,7 +287,10 @@ Send(tcpclt_t *pThis, void *pData, char *msg, size_t len)
 
 	while(!bDone) { /* loop is broken when send succeeds or error occurs */
 		CHKiRet(pThis->initFunc(pData));
-		iRet = pThis->sendFunc(pData, msg, len);
+		if(iov == NULL)
+			iRet = pThis->sendFunc(pData, msg, len);
+		else
+			iRet = pThis->sendFrameVFunc(pData, iov, iovcnt, len);
 
 		if(iRet == RS_RET_OK || iRet == RS_RET_DEFER_COMMIT || iRet == RS_RET_PREVIOUS_COMMITTED) {
 			/* we are done, we also use this as indication that the previous
@@ -325,7 +310,10 @@ Send(tcpclt_t *pThis, void *pData, char *msg, size_t len)
 				 * be worse, so don't try anything ;) -- rgerhards, 2008-03-12
 				 */
 				if((pThis->prevMsg = MALLOC(len)) != NULL) {
-					memcpy(pThis->prevMsg, msg, len);
+					if(iov == NULL)
+						memcpy(pThis->prevMsg, msg, len);
+					else
+						iovCopy(pThis->prevMsg, iov, iovcnt);
 					pThis->lenPrevMsg = len;
 				}
 			}
@@ -351,6 +339,51 @@ Send(tcpclt_t *pThis, void *pData, char *msg, size_t len)
 		}
 	}
 
+finalize_it:
+	RETiRet;
+}
+
+
+/* Sends a TCP message. It is first checked if the
+ * session is open and, if not, it is opened. Then the send
+ * is tried. If it fails, one silent re-try is made. If the send
+ * fails again, an error status (-1) is returned. If all goes well,
+ * 0 is returned. The TCP session is NOT torn down.
+ * For now, EAGAIN is ignored (causing message loss) - but it is
+ * hard to do something intelligent in this case. With this
+ * implementation here, we can not block and/or defer. Things are
+ * probably a bit better when we move to liblogging. The alternative
+ * would be to enhance the current select server with buffering and
+ * write descriptors. This seems not justified, given the expected
+ * short life span of this code (and the unlikeliness of this event).
+ * rgerhards 2005-07-06
+ * This function is now expected to stay. Libloging won't be used for
+ * that purpose. I have added the param "len", because it is known by the
+ * caller and so saves us some time. Also, it MUST be given because there
+ * may be NULs inside msg so that we can not rely on strlen(). Please note
+ * that the restrictions outlined above do not existin in multi-threaded
+ * mode, which we assume will now be most often used. So there is no
+ * real issue with the potential message loss in single-threaded builds.
+ * rgerhards, 2006-11-30
+ * I greatly restructured the function to be more generic and work
+ * with function pointers. So it now can be used with any type of transport,
+ * as long as it follows stream semantics. This was initially done to 
+ * support plain TCP and GSS via common code.
+ */
+static int
+Send(tcpclt_t *pThis, void *pData, char *msg, size_t len)
+{
+	DEFiRet;
+	int bMsgMustBeFreed = 0;/* must msg be freed at end of function? 0 - no, 1 - yes */
+
+	ISOBJ_TYPE_assert(pThis, tcpclt);
+	assert(pData != NULL);
+	assert(msg != NULL);
+	assert(len > 0);
+
+	CHKiRet(TCPSendBldFrame(pThis, &msg, &len, &bMsgMustBeFreed));
+	CHKiRet(doSend(pThis, pData, msg, NULL, 0, len));
+
 finalize_it:
 	if(bMsgMustBeFreed)
 		free(msg);
@@ -358,6 +391,66 @@ finalize_it:
 }
 
 
+/* Send a message that is given as scatter list (e.g. a template rendered via
+ * tplToIovec()). Framing is done by adding entries in front of or behind the
+ * message, so the message itself is not copied. Note that compressed
+ * messages are never passed to this function, so the framing is always the
+ * configured one. If the list is too large or the caller did not set a
+ * SendFrameV callback, the message is copied and sent via Send().
+ */
+#define TCPCLT_MAX_IOV 66
+static int
+SendV(tcpclt_t *pThis, void *pData, struct iovec *iov, int iovcnt, size_t len)
+{
+	struct iovec iovFrame[TCPCLT_MAX_IOV];
+	char szLenBuf[16];
+	char *pFlat = NULL;
+	int nFrame;
+	int i;
+	DEFiRet;
+
+	ISOBJ_TYPE_assert(pThis, tcpclt);
+	assert(pData != NULL);
+	assert(iov != NULL);
+	assert(len > 0);
+
+	if(iovcnt + 2 > TCPCLT_MAX_IOV || pThis->sendFrameVFunc == NULL) {
+		CHKmalloc(pFlat = MALLOC(len + 1));
+		iovCopy(pFlat, iov, iovcnt);
+		pFlat[len] = '\0';
+		CHKiRet(Send(pThis, pData, pFlat, len));
+		FINALIZE;
+	}
+
+	nFrame = 0;
+	if(pThis->tcp_framing == TCP_FRAMING_OCTET_COUNTING) {
+		iovFrame[0].iov_base = szLenBuf;
+		iovFrame[0].iov_len = snprintf(szLenBuf, sizeof(szLenBuf), "%d ", (int) len);
+		len += iovFrame[0].iov_len;
+		nFrame = 1;
+	}
+	memcpy(iovFrame + nFrame, iov, iovcnt * sizeof(struct iovec));
+	nFrame += iovcnt;
+	if(pThis->tcp_framing == TCP_FRAMING_OCTET_STUFFING) {
+		/* as in TCPSendBldFrame(), we add a LF only if there is none */
+		for(i = iovcnt - 1 ; i >= 0 && iov[i].iov_len == 0 ; --i)
+			/* just skip empty entries */;
+		if(i < 0 || ((char*)iov[i].iov_base)[iov[i].iov_len - 1] != '\n') {
+			iovFrame[nFrame].iov_base = "\n";
+			iovFrame[nFrame].iov_len = 1;
+			++nFrame;
+			++len;
+		}
+	}
+
+	CHKiRet(doSend(pThis, pData, NULL, iovFrame, nFrame, len));
+
+finalize_it:
+	free(pFlat);
+	RETiRet;
+}
+
+
 /* set functions */
 static rsRetVal
 SetResendLastOnRecon(tcpclt_t *pThis, int bResendLastOnRecon)
@@ -388,6 +481,13 @@ SetSendFrame(tcpclt_t *pThis, rsRetVal (*pCB)(void*, char*, size_t))
 	RETiRet;
 }
 static rsRetVal
+SetSendFrameV(tcpclt_t *pThis, rsRetVal (*pCB)(void*, struct iovec*, int, size_t))
+{
+	DEFiRet;
+	pThis->sendFrameVFunc = pCB;
+	RETiRet;
+}
+static rsRetVal
 SetFraming(tcpclt_t *pThis, TCPFRAMINGMODE framing)
 {
 	DEFiRet;
@@ -459,6 +559,8 @@ CODESTARTobjQueryInterface(tcpclt)
 	pIf->SetSendPrepRetry = SetSendPrepRetry;
 	pIf->SetFraming = SetFraming;
 	pIf->SetRebindInterval = SetRebindInterval;
+	pIf->SendV = SendV;
+	pIf->SetSendFrameV = SetSendFrameV;
 
 finalize_it:
 ENDobjQueryInterface(tcpclt)
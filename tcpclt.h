@@ -25,6 +25,7 @@
 #ifndef	TCPCLT_H_INCLUDED
 #define	TCPCLT_H_INCLUDED 1
 
+#include <sys/uio.h>
 #include "obj.h"
 
 /* the tcpclt object */
@@ -39,6 +40,7 @@ typedef struct tcpclt_s {
 	int iNumMsgs;		/* number of messages during current "rebind session" */
 	rsRetVal (*initFunc)(void*);
 	rsRetVal (*sendFunc)(void*, char*, size_t);
+	rsRetVal (*sendFrameVFunc)(void*, struct iovec*, int, size_t);
 	rsRetVal (*prepRetryFunc)(void*);
 } tcpclt_t;
 
@@ -58,8 +60,11 @@ BEGINinterface(tcpclt) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*SetFraming)(tcpclt_t*, TCPFRAMINGMODE framing);
 	/* v3, 2009-07-14*/
 	rsRetVal (*SetRebindInterval)(tcpclt_t*, int iRebindInterval);
+	/* v4, added in 7.2.2 */
+	int (*SendV)(tcpclt_t *pThis, void *pData, struct iovec *iov, int iovcnt, size_t len);
+	rsRetVal (*SetSendFrameV)(tcpclt_t*, rsRetVal (*)(void*, struct iovec*, int, size_t));
 ENDinterface(tcpclt)
-#define tcpcltCURR_IF_VERSION 3 /* increment whenever you change the interface structure! */
+#define tcpcltCURR_IF_VERSION 4 /* increment whenever you change the interface structure! */
 
 
 /* prototypes */
@@ -48,6 +48,10 @@
 #include "datetime.h"
 #include "prop.h"
 #include "debug.h"
+#ifdef USE_NETZIP
+#include <zlib.h>
+#include "zlibw.h"
+#endif
 
 
 /* static data */
@@ -57,6 +61,10 @@ DEFobjCurrIf(errmsg)
 DEFobjCurrIf(netstrm)
 DEFobjCurrIf(prop)
 DEFobjCurrIf(datetime)
+#ifdef USE_NETZIP
+DEFobjCurrIf(zlibw)
+static sbool bHaveZlibw = 0; /* zlibw could be loaded, so we can decompress */
+#endif
 
 static int iMaxLine; /* maximum size of a single message */
 
@@ -107,6 +115,12 @@ CODESTARTobjDestruct(tcps_sess)
 		CHKiRet(prop.Destruct(&pThis->fromHost));
 	if(pThis->fromHostIP != NULL)
 		CHKiRet(prop.Destruct(&pThis->fromHostIP));
+#	ifdef USE_NETZIP
+	if(pThis->pZStrm != NULL) {
+		zlibw.InflateEnd(pThis->pZStrm);
+		free(pThis->pZStrm);
+	}
+#	endif
 	free(pThis->pMsg);
 ENDobjDestruct(tcps_sess)
 
@@ -462,6 +476,73 @@ processDataRcvd(tcps_sess_t *pThis, char c, struct syslogTime *stTime, time_t tt
  * we have just received a bunch of data! -- rgerhards, 2009-06-16
  */
 #define NUM_MULTISUB 1024
+
+/* process data received on a session with stream compression: the whole
+ * session is a single zlib stream, which the sender flushes at the end of
+ * each batch. So we decompress whatever we received and process the output
+ * just like uncompressed data. If the data is not a valid zlib stream, the
+ * session is closed.
+ */
+static rsRetVal
+DataRcvdCompressed(tcps_sess_t *pThis, char *pData, size_t iLen,
+		   struct syslogTime *stTime, time_t ttGenTime, multi_submit_t *pMultiSub)
+{
+#	ifdef USE_NETZIP
+	char zipBuf[32*1024];
+	char *pBuf;
+	char *pEnd;
+	int zRet;
+	uchar *pszPeer;
+	int lenPeer;
+#	endif
+	DEFiRet;
+
+#	ifdef USE_NETZIP
+	if(!bHaveZlibw) {
+		errmsg.LogError(0, RS_RET_ZLIB_ERR, "imtcp: compressed data received, but zlibw "
+				"module could not be loaded - closing session");
+		ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+	}
+	if(pThis->pZStrm == NULL) {
+		CHKmalloc(pThis->pZStrm = calloc(1, sizeof(z_stream)));
+		if(zlibw.InflateInit2(pThis->pZStrm, MAX_WBITS) != Z_OK) {
+			free(pThis->pZStrm);
+			pThis->pZStrm = NULL;
+			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+		}
+	}
+
+	pThis->pZStrm->next_in = (Bytef*) pData;
+	pThis->pZStrm->avail_in = iLen;
+	do {
+		pThis->pZStrm->next_out = (Bytef*) zipBuf;
+		pThis->pZStrm->avail_out = sizeof(zipBuf);
+		zRet = zlibw.Inflate(pThis->pZStrm, Z_SYNC_FLUSH);
+		if(zRet != Z_OK && zRet != Z_STREAM_END && zRet != Z_BUF_ERROR) {
+			prop.GetString(pThis->fromHostIP, &pszPeer, &lenPeer);
+			errmsg.LogError(0, RS_RET_ZLIB_ERR, "imtcp: invalid compressed data received "
+					"from %s (zlib error %d) - is the sender using stream compression?",
+					pszPeer, zRet);
+			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+		}
+		pEnd = zipBuf + sizeof(zipBuf) - pThis->pZStrm->avail_out;
+		for(pBuf = zipBuf ; pBuf < pEnd ; ++pBuf) {
+			CHKiRet(processDataRcvd(pThis, *pBuf, stTime, ttGenTime, pMultiSub));
+		}
+		if(zRet == Z_STREAM_END) /* the sender started a new stream */
+			zlibw.InflateReset(pThis->pZStrm);
+	} while(pThis->pZStrm->avail_in > 0 || pThis->pZStrm->avail_out == 0);
+#	else
+	errmsg.LogError(0, RS_RET_ZLIB_ERR, "imtcp: compressed data received, but rsyslog is not "
+			"compiled with zlib support - closing session");
+	ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+#	endif
+
+finalize_it:
+	RETiRet;
+}
+
+
 static rsRetVal
 DataRcvd(tcps_sess_t *pThis, char *pData, size_t iLen)
 {
@@ -481,11 +562,15 @@ DataRcvd(tcps_sess_t *pThis, char *pData, size_t iLen)
 	multiSub.maxElem = NUM_MULTISUB;
 	multiSub.nElem = 0;
 
-	 /* We now copy the message to the session buffer. */
-	pEnd = pData + iLen; /* this is one off, which is intensional */
+	if(pThis->pLstnInfo->bStreamDecompress) {
+		CHKiRet(DataRcvdCompressed(pThis, pData, iLen, &stTime, ttGenTime, &multiSub));
+	} else {
+		 /* We now copy the message to the session buffer. */
+		pEnd = pData + iLen; /* this is one off, which is intensional */
 
-	while(pData < pEnd) {
-		CHKiRet(processDataRcvd(pThis, *pData++, &stTime, ttGenTime, &multiSub));
+		while(pData < pEnd) {
+			CHKiRet(processDataRcvd(pThis, *pData++, &stTime, ttGenTime, &multiSub));
+		}
 	}
 
 	if(multiSub.nElem > 0) {
@@ -544,6 +629,10 @@ CODESTARTObjClassExit(tcps_sess)
 	objRelease(netstrm, LM_NETSTRMS_FILENAME);
 	objRelease(datetime, CORE_COMPONENT);
 	objRelease(prop, CORE_COMPONENT);
+#	ifdef USE_NETZIP
+	if(bHaveZlibw)
+		objRelease(zlibw, LM_ZLIBW_FILENAME);
+#	endif
 ENDObjClassExit(tcps_sess)
 
 
@@ -557,6 +646,13 @@ BEGINObjClassInit(tcps_sess, 1, OBJ_IS_CORE_MODULE) /* class, version - CHANGE c
 	CHKiRet(objUse(netstrm, LM_NETSTRMS_FILENAME));
 	CHKiRet(objUse(datetime, CORE_COMPONENT));
 	CHKiRet(objUse(prop, CORE_COMPONENT));
+#	ifdef USE_NETZIP
+	/* zlibw is only needed for stream decompression, so we can live without it */
+	if(objUse(zlibw, LM_ZLIBW_FILENAME) == RS_RET_OK)
+		bHaveZlibw = 1;
+	else
+		DBGPRINTF("tcps_sess: zlibw unavailable, stream decompression not supported\n");
+#	endif
 
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	iMaxLine = glbl.GetMaxLine(); /* get maximum size we currently support */
@@ -27,6 +27,7 @@
 
 /* a forward-definition, we are somewhat cyclic */
 struct tcpsrv_s;
+struct z_stream_s;	/* zlib's z_stream, only needed by tcps_sess.c */
 
 /* the tcps_sess object */
 struct tcps_sess_s {
@@ -45,6 +46,7 @@ struct tcps_sess_s {
 	int iOctetsRemain;	/* Number of Octets remaining in message */
 	TCPFRAMINGMODE eFraming;
 	uchar *pMsg;		/* message (fragment) received */
+	struct z_stream_s *pZStrm;	/* decompression state for stream compression, NULL if not used */
 	prop_t *fromHost;	/* host name we received messages from */
 	prop_t *fromHostIP;
 	void *pUsr;		/* a user-pointer */
@@ -71,11 +73,13 @@ BEGINinterface(tcps_sess) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*SetMsgIdx)(tcps_sess_t *pThis, int);
 	rsRetVal (*SetOnMsgReceive)(tcps_sess_t *pThis, rsRetVal (*OnMsgReceive)(tcps_sess_t*, uchar*, int));
 ENDinterface(tcps_sess)
-#define tcps_sessCURR_IF_VERSION 2 /* increment whenever you change the interface structure! */
+#define tcps_sessCURR_IF_VERSION 3 /* increment whenever you change the interface structure! */
 /* interface changes
  * to version v2, rgerhards, 2009-05-22
  * - Data structures changed
  * - SetLstnInfo entry point added
+ * to version v3
+ * - Data structures changed (stream decompression)
  */
 
 
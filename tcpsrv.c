@@ -136,6 +136,7 @@ addNewLstnPort(tcpsrv_t *pThis, uchar *pszPort, int bSuppOctetFram)
 	pEntry->pSrv = pThis;
 	pEntry->pRuleset = pThis->pRuleset;
 	pEntry->bSuppOctetFram = bSuppOctetFram;
+	pEntry->bStreamDecompress = pThis->bStreamDecompress;
 
 	/* we need to create a property */ 
 	CHKiRet(prop.Construct(&pEntry->pInputName));
@@ -1068,6 +1069,18 @@ SetKeepAlive(tcpsrv_t *pThis, int iVal)
 	RETiRet;
 }
 
+/* set if the listeners configured from now on receive compressed data,
+ * that is each session is one zlib stream (compression.mode "stream:always").
+ */
+static rsRetVal
+SetStreamDecompress(tcpsrv_t *pThis, int bVal)
+{
+	DEFiRet;
+	DBGPRINTF("tcpsrv: stream decompression set to %d\n", bVal);
+	pThis->bStreamDecompress = bVal;
+	RETiRet;
+}
+
 static rsRetVal
 SetOnMsgReceive(tcpsrv_t *pThis, rsRetVal (*OnMsgReceive)(tcps_sess_t*, uchar*, int))
 {
@@ -1248,6 +1261,7 @@ CODESTARTobjQueryInterface(tcpsrv)
 	pIf->Run = Run;
 
 	pIf->SetKeepAlive = SetKeepAlive;
+	pIf->SetStreamDecompress = SetStreamDecompress;
 	pIf->SetUsrP = SetUsrP;
 	pIf->SetInputName = SetInputName;
 	pIf->SetAddtlFrameDelim = SetAddtlFrameDelim;
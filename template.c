@@ -46,6 +46,7 @@
 #include "rsconf.h"
 #include "msg.h"
 #include "unicode-helper.h"
+#include "escape.h"
 
 /* static data */
 DEFobjCurrIf(obj)
@@ -131,6 +132,255 @@ finalize_it:
 }
 
 
+/* Streaming JSON writer. It serializes template fields and json-c (sub)trees
+ * directly into a (reusable) output buffer, without building an intermediate
+ * json-c tree for the template and without json-c's own string generation.
+ * The output is the same as that of json_object_to_json_string(): the
+ * layout follows it and strings are escaped the json-c way, which includes
+ * '/' (as "\/") and uses lower case hex digits for "\u00xx" sequences.
+ */
+typedef struct jsonWriter_s {
+	uchar **ppBuf;
+	size_t *pLenBuf;
+	size_t iBuf;
+} jsonWriter_t;
+
+static inline rsRetVal
+jsonwAdd(jsonWriter_t *pW, const char *p, size_t len)
+{
+	DEFiRet;
+	if(pW->iBuf + len >= *pW->pLenBuf) /* we reserve one char for the final \0! */
+		CHKiRet(ExtendBuf(pW->ppBuf, pW->pLenBuf, pW->iBuf + len + 1));
+	memcpy(*pW->ppBuf + pW->iBuf, p, len);
+	pW->iBuf += len;
+finalize_it:
+	RETiRet;
+}
+
+static rsRetVal
+jsonwAddStr(jsonWriter_t *pW, uchar *p, size_t len)
+{
+	static const char hexdigit[16] =
+		{'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+	char esc[6];
+	size_t lenRun;
+	size_t lenEsc;
+	uchar c;
+	DEFiRet;
+
+	CHKiRet(jsonwAdd(pW, "\"", 1));
+	while(len > 0) {
+		lenRun = escScanJSONSlash(p, len);
+		CHKiRet(jsonwAdd(pW, (char*) p, lenRun));
+		p += lenRun;
+		len -= lenRun;
+		if(len == 0)
+			break;
+		c = *p++;
+		--len;
+		esc[0] = '\\';
+		lenEsc = 2;
+		switch(c) {
+		case '"':  esc[1] = '"'; break;
+		case '\\': esc[1] = '\\'; break;
+		case '/':  esc[1] = '/'; break;
+		case '\010': esc[1] = 'b'; break;
+		case '\014': esc[1] = 'f'; break;
+		case '\n': esc[1] = 'n'; break;
+		case '\r': esc[1] = 'r'; break;
+		case '\t': esc[1] = 't'; break;
+		default:
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = hexdigit[c / 16];
+			esc[5] = hexdigit[c % 16];
+			lenEsc = 6;
+			break;
+		}
+		CHKiRet(jsonwAdd(pW, esc, lenEsc));
+	}
+	CHKiRet(jsonwAdd(pW, "\"", 1));
+finalize_it:
+	RETiRet;
+}
+
+static rsRetVal
+jsonwAddObj(jsonWriter_t *pW, struct json_object *json)
+{
+	struct json_object_iter it;
+	const char *psz;
+	char numbuf[32];
+	int i, n;
+	DEFiRet;
+
+	if(json == NULL) {
+		CHKiRet(jsonwAdd(pW, "null", 4));
+		FINALIZE;
+	}
+	switch(json_object_get_type(json)) {
+	case json_type_null:
+		CHKiRet(jsonwAdd(pW, "null", 4));
+		break;
+	case json_type_boolean:
+		if(json_object_get_boolean(json)) {
+			CHKiRet(jsonwAdd(pW, "true", 4));
+		} else {
+			CHKiRet(jsonwAdd(pW, "false", 5));
+		}
+		break;
+	case json_type_int:
+		n = snprintf(numbuf, sizeof(numbuf), "%lld", (long long) json_object_get_int64(json));
+		CHKiRet(jsonwAdd(pW, numbuf, n));
+		break;
+	case json_type_string:
+		CHKiRet(jsonwAddStr(pW, (uchar*) json_object_get_string(json),
+				    strlen(json_object_get_string(json))));
+		break;
+	case json_type_object:
+		i = 0;
+		CHKiRet(jsonwAdd(pW, "{", 1));
+		json_object_object_foreachC(json, it) {
+			CHKiRet(jsonwAdd(pW, (i == 0) ? " " : ", ", (i == 0) ? 1 : 2));
+			++i;
+			CHKiRet(jsonwAddStr(pW, (uchar*) it.key, strlen(it.key)));
+			CHKiRet(jsonwAdd(pW, ": ", 2));
+			CHKiRet(jsonwAddObj(pW, it.val));
+		}
+		CHKiRet(jsonwAdd(pW, " }", 2));
+		break;
+	case json_type_array:
+		n = json_object_array_length(json);
+		CHKiRet(jsonwAdd(pW, "[", 1));
+		for(i = 0 ; i < n ; ++i) {
+			CHKiRet(jsonwAdd(pW, (i == 0) ? " " : ", ", (i == 0) ? 1 : 2));
+			CHKiRet(jsonwAddObj(pW, json_object_array_get_idx(json, i)));
+		}
+		CHKiRet(jsonwAdd(pW, " ]", 2));
+		break;
+	default: /* doubles are rare, so we let json-c format them */
+		psz = json_object_to_json_string(json);
+		CHKiRet(jsonwAdd(pW, psz, strlen(psz)));
+		break;
+	}
+finalize_it:
+	RETiRet;
+}
+
+/* add a "name": prefix for an object member */
+static inline rsRetVal
+jsonwAddName(jsonWriter_t *pW, struct templateEntry *pTpe, int *pbFirst)
+{
+	DEFiRet;
+	CHKiRet(jsonwAdd(pW, *pbFirst ? " " : ", ", *pbFirst ? 1 : 2));
+	*pbFirst = 0;
+	CHKiRet(jsonwAddStr(pW, pTpe->fieldName, pTpe->lenFieldName));
+	CHKiRet(jsonwAdd(pW, ": ", 2));
+finalize_it:
+	RETiRet;
+}
+
+
+/* obtain the value of a (non-constant) compiled template op. On return,
+ * *pbMustBeFreed tells if the caller must free the value.
+ */
+static inline void
+tplOpGetVal(struct template *pTpl, struct tplOp *pOp, msg_t *pMsg,
+	    uchar **ppVal, rs_size_t *piLenVal, unsigned short *pbMustBeFreed)
+{
+	struct templateEntry *pTpe = pOp->pTpe;
+
+	*pbMustBeFreed = 0;
+	switch(pOp->opType) {
+	case TPLOP_MSG:
+		*ppVal = getMSG(pMsg);
+		*piLenVal = getMSGLen(pMsg);
+		break;
+	case TPLOP_HOSTNAME:
+		*ppVal = (uchar*) getHOSTNAME(pMsg);
+		*piLenVal = getHOSTNAMELen(pMsg);
+		break;
+	case TPLOP_SYSLOGTAG:
+		getTAG(pMsg, ppVal, piLenVal);
+		break;
+	case TPLOP_RAWMSG:
+		getRawMsg(pMsg, ppVal, piLenVal);
+		break;
+	case TPLOP_TIMESTAMP:
+		*ppVal = (uchar*) getTimeReported(pMsg, pTpe->data.field.eDateFormat);
+		*piLenVal = ustrlen(*ppVal);
+		break;
+	case TPLOP_PROP:
+		/* without template entry, MsgGetProp() skips all option processing */
+		*ppVal = MsgGetProp(pMsg, NULL, pTpe->data.field.propid,
+				    pTpe->data.field.propName, piLenVal, pbMustBeFreed);
+		break;
+	default: /* TPLOP_ENTRY */
+		*ppVal = MsgGetProp(pMsg, pTpe, pTpe->data.field.propid,
+				    pTpe->data.field.propName, piLenVal, pbMustBeFreed);
+		break;
+	}
+	if(pTpl->optFormatEscape != NO_ESCAPE)
+		doEscape(ppVal, piLenVal, pbMustBeFreed, pTpl->optFormatEscape);
+}
+
+
+/* render a compiled template (see tplCompile()). Most importantly, the
+ * output buffer is sized in advance based on the constant parts and the
+ * length of the previously rendered message, so that for typical log
+ * traffic it needs not to be grown while rendering.
+ */
+static rsRetVal
+tplRenderCompiled(struct template *pTpl, msg_t *pMsg, uchar **ppBuf, size_t *pLenBuf)
+{
+	struct tplOp *pOp;
+	struct tplOp *pOpEnd;
+	size_t iBuf;
+	size_t lenEst;
+	unsigned short bMustBeFreed;
+	uchar *pVal;
+	rs_size_t iLenVal;
+	DEFiRet;
+
+	/* note: lenHint is updated without sync. It is just a size estimate,
+	 * so a value from a concurrently running worker is as good as ours.
+	 */
+	lenEst = (pTpl->lenHint > pTpl->lenFixed) ? pTpl->lenHint : pTpl->lenFixed;
+	if(lenEst >= *pLenBuf)
+		CHKiRet(ExtendBuf(ppBuf, pLenBuf, lenEst + 1));
+
+	iBuf = 0;
+	pOpEnd = pTpl->pOps + pTpl->nOps;
+	for(pOp = pTpl->pOps ; pOp < pOpEnd ; ++pOp) {
+		if(pOp->opType == TPLOP_CONST) {
+			if(iBuf + pOp->lenConst >= *pLenBuf)
+				CHKiRet(ExtendBuf(ppBuf, pLenBuf, iBuf + pOp->lenConst + 1));
+			memcpy(*ppBuf + iBuf, pOp->pConst, pOp->lenConst);
+			iBuf += pOp->lenConst;
+			continue;
+		}
+
+		tplOpGetVal(pTpl, pOp, pMsg, &pVal, &iLenVal, &bMustBeFreed);
+		if(iLenVal > 0) {
+			if(iBuf + iLenVal >= *pLenBuf) /* we reserve one char for the final \0! */
+				CHKiRet(ExtendBuf(ppBuf, pLenBuf, iBuf + iLenVal + 1));
+			memcpy(*ppBuf + iBuf, pVal, iLenVal);
+			iBuf += iLenVal;
+		}
+		if(bMustBeFreed)
+			free(pVal);
+	}
+
+	if(iBuf == *pLenBuf) /* empty template, see tplToString() */
+		CHKiRet(ExtendBuf(ppBuf, pLenBuf, iBuf + 1));
+	(*ppBuf)[iBuf] = '\0';
+	pTpl->lenHint = iBuf;
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* This functions converts a template into a string.
  *
  * The function takes a pointer to a template and a pointer to a msg object
@@ -144,6 +394,8 @@ finalize_it:
 rsRetVal tplToString(struct template *pTpl, msg_t *pMsg, uchar **ppBuf, size_t *pLenBuf)
 {
 	DEFiRet;
+	struct json_object *json = NULL;
+	jsonWriter_t w;
 	struct templateEntry *pTpe;
 	size_t iBuf;
 	unsigned short bMustBeFreed = 0;
@@ -161,11 +413,19 @@ rsRetVal tplToString(struct template *pTpl, msg_t *pMsg, uchar **ppBuf, size_t *
 	}
 
 	if(pTpl->subtree != NULL) {
-		/* only a single CEE subtree must be provided */
-		/* note: we could optimize the code below, however, this is
-		 * not worth the effort, as this passing mode is not expected
-		 * in subtree mode and so most probably only used for debug & test.
+		/* only a single CEE subtree must be provided. Objects and
+		 * arrays are serialized directly into our buffer, without
+		 * json-c's own (allocation-heavy) string generation.
 		 */
+		jsonFind(pMsg, pTpl->subtree, &json);
+		if(json != NULL && json_object_get_type(json) != json_type_string) {
+			w.ppBuf = ppBuf;
+			w.pLenBuf = pLenBuf;
+			w.iBuf = 0;
+			CHKiRet(jsonwAddObj(&w, json));
+			(*ppBuf)[w.iBuf] = '\0';
+			FINALIZE;
+		}
 		getCEEPropVal(pMsg, pTpl->subtree, &pVal, &iLenVal, &bMustBeFreed);
 		if(iLenVal >= (rs_size_t)*pLenBuf) /* we reserve one char for the final \0! */
 			CHKiRet(ExtendBuf(ppBuf, pLenBuf, iLenVal + 1));
@@ -174,6 +434,11 @@ rsRetVal tplToString(struct template *pTpl, msg_t *pMsg, uchar **ppBuf, size_t *
 			free(pVal);
 		FINALIZE;
 	}
+
+	if(pTpl->pOps != NULL) {
+		CHKiRet(tplRenderCompiled(pTpl, pMsg, ppBuf, pLenBuf));
+		FINALIZE;
+	}
 	
 	/* we have a "regular" template with template entries */
 
@@ -371,6 +636,257 @@ finalize_it:
 }
 
 
+/* This functions converts a template into a serialized JSON object. The
+ * result is the same that json_object_to_json_string() would generate for
+ * the tree created by tplToJSON(), but is written directly into the
+ * provided buffer. Buffer handling is the same as for tplToString().
+ * This is used for output modules that request OMSR_TPL_AS_JSONSTR.
+ */
+rsRetVal
+tplToJSONString(struct template *pTpl, msg_t *pMsg, uchar **ppBuf, size_t *pLenBuf)
+{
+	struct templateEntry *pTpe;
+	struct json_object *json = NULL;
+	jsonWriter_t w;
+	rs_size_t propLen;
+	unsigned short bMustBeFreed;
+	uchar *pVal;
+	int bFirst;
+	rsRetVal localRet;
+	DEFiRet;
+
+	w.ppBuf = ppBuf;
+	w.pLenBuf = pLenBuf;
+	w.iBuf = 0;
+
+	if(pTpl->subtree != NULL) {
+		jsonFind(pMsg, pTpl->subtree, &json);
+		if(json == NULL) { /* we need to have a root object! */
+			CHKiRet(jsonwAdd(&w, "{ }", 3));
+		} else {
+			CHKiRet(jsonwAddObj(&w, json));
+		}
+		FINALIZE;
+	}
+
+	bFirst = 1;
+	CHKiRet(jsonwAdd(&w, "{", 1));
+	for(pTpe = pTpl->pEntryRoot ; pTpe != NULL ; pTpe = pTpe->pNext) {
+		if(pTpe->eEntryType == CONSTANT) {
+			if(pTpe->fieldName == NULL)
+				continue;
+			CHKiRet(jsonwAddName(&w, pTpe, &bFirst));
+			CHKiRet(jsonwAddStr(&w, pTpe->data.constant.pConstant,
+					    pTpe->data.constant.iLenConstant));
+		} else if(pTpe->eEntryType == FIELD) {
+			if(pTpe->data.field.propid == PROP_CEE) {
+				if(msgGetCEEPropJSON(pMsg, pTpe->data.field.propName, &json) == RS_RET_OK) {
+					CHKiRet(jsonwAddName(&w, pTpe, &bFirst));
+					CHKiRet(jsonwAddObj(&w, json));
+				} else if(pTpe->data.field.options.bMandatory) {
+					CHKiRet(jsonwAddName(&w, pTpe, &bFirst));
+					CHKiRet(jsonwAdd(&w, "null", 4));
+				}
+			} else {
+				pVal = (uchar*) MsgGetProp(pMsg, pTpe, pTpe->data.field.propid,
+							   pTpe->data.field.propName,  &propLen,
+							   &bMustBeFreed);
+				if(pTpe->data.field.options.bMandatory || propLen > 0) {
+					localRet = jsonwAddName(&w, pTpe, &bFirst);
+					if(localRet == RS_RET_OK)
+						localRet = jsonwAddStr(&w, pVal, propLen);
+				} else {
+					localRet = RS_RET_OK;
+				}
+				if(bMustBeFreed)
+					free(pVal);
+				CHKiRet(localRet);
+			}
+		}
+	}
+	CHKiRet(jsonwAdd(&w, " }", 2));
+
+finalize_it:
+	if(iRet == RS_RET_OK)
+		(*ppBuf)[w.iBuf] = '\0';
+	RETiRet;
+}
+
+
+/* add an entry to a template scatter list */
+static inline rsRetVal
+tplIovAdd(tplIov_t *pIov, uchar *p, size_t len)
+{
+	struct iovec *iovNew;
+	DEFiRet;
+
+	if(pIov->nIov == pIov->maxIov) {
+		CHKmalloc(iovNew = realloc(pIov->iov, (pIov->maxIov + 16) * sizeof(struct iovec)));
+		pIov->iov = iovNew;
+		pIov->maxIov += 16;
+	}
+	pIov->iov[pIov->nIov].iov_base = p;
+	pIov->iov[pIov->nIov].iov_len = len;
+	++pIov->nIov;
+	pIov->lenTotal += len;
+finalize_it:
+	RETiRet;
+}
+
+
+/* remember a value we need to free once the scatter list is no longer used */
+static inline rsRetVal
+tplIovAddOwned(tplIov_t *pIov, uchar *p)
+{
+	uchar **ppNew;
+	DEFiRet;
+
+	if(pIov->nOwned == pIov->maxOwned) {
+		CHKmalloc(ppNew = realloc(pIov->ppOwned, (pIov->maxOwned + 8) * sizeof(uchar*)));
+		pIov->ppOwned = ppNew;
+		pIov->maxOwned += 8;
+	}
+	pIov->ppOwned[pIov->nOwned++] = p;
+finalize_it:
+	RETiRet;
+}
+
+
+/* reset a scatter list, freeing all values it owns. The list itself is
+ * kept for reuse.
+ */
+void
+tplIovReset(tplIov_t *pIov)
+{
+	int i;
+
+	if(pIov == NULL)
+		return;
+	for(i = 0 ; i < pIov->nOwned ; ++i)
+		free(pIov->ppOwned[i]);
+	pIov->nOwned = 0;
+	pIov->nIov = 0;
+	pIov->lenTotal = 0;
+}
+
+
+void
+tplIovDestruct(tplIov_t *pIov)
+{
+	if(pIov == NULL)
+		return;
+	tplIovReset(pIov);
+	free(pIov->iov);
+	free(pIov->ppOwned);
+	free(pIov->pBuf);
+	free(pIov);
+}
+
+
+/* This function renders a template into a scatter list (iovec) instead of
+ * a string. The entries point directly to the message properties and
+ * template constants, so the message content is not copied at all. Only
+ * values generated on the fly (e.g. because of property options) are
+ * allocated; they are kept with the list and freed by tplIovReset().
+ * The list is valid as long as the message is unmodified and must not
+ * be used after the next tplToIovec() call on it.
+ * Templates which are not compiled and templates with so many entries
+ * that they may exceed the iovec limits of the OS are rendered into a
+ * buffer that is then referenced by a single entry.
+ * *ppIov is allocated on the first call.
+ */
+rsRetVal
+tplToIovec(struct template *pTpl, msg_t *pMsg, tplIov_t **ppIov)
+{
+	tplIov_t *pIov;
+	struct tplOp *pOp;
+	struct tplOp *pOpEnd;
+	unsigned short bMustBeFreed;
+	uchar *pVal;
+	rs_size_t iLenVal;
+	DEFiRet;
+
+	assert(pTpl != NULL);
+	assert(ppIov != NULL);
+
+	if(*ppIov == NULL)
+		CHKmalloc(*ppIov = calloc(1, sizeof(tplIov_t)));
+	pIov = *ppIov;
+	tplIovReset(pIov);
+
+	if(pTpl->pOps == NULL || pTpl->nOps > TPL_MAX_IOV) {
+		CHKiRet(tplToString(pTpl, pMsg, &pIov->pBuf, &pIov->lenBuf));
+		CHKiRet(tplIovAdd(pIov, pIov->pBuf, ustrlen(pIov->pBuf)));
+		FINALIZE;
+	}
+
+	pOpEnd = pTpl->pOps + pTpl->nOps;
+	for(pOp = pTpl->pOps ; pOp < pOpEnd ; ++pOp) {
+		if(pOp->opType == TPLOP_CONST) {
+			CHKiRet(tplIovAdd(pIov, pOp->pConst, pOp->lenConst));
+			continue;
+		}
+		tplOpGetVal(pTpl, pOp, pMsg, &pVal, &iLenVal, &bMustBeFreed);
+		if(bMustBeFreed) {
+			if(tplIovAddOwned(pIov, pVal) != RS_RET_OK) {
+				free(pVal);
+				ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+			}
+		}
+		if(iLenVal > 0)
+			CHKiRet(tplIovAdd(pIov, pVal, iLenVal));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* limit a scatter list to lenMax bytes (e.g. for the max message size) */
+void
+tplIovTruncate(tplIov_t *pIov, size_t lenMax)
+{
+	int i;
+	size_t len = 0;
+
+	if(pIov->lenTotal <= lenMax)
+		return;
+	for(i = 0 ; i < pIov->nIov ; ++i) {
+		if(len + pIov->iov[i].iov_len >= lenMax) {
+			pIov->iov[i].iov_len = lenMax - len;
+			pIov->nIov = i + 1;
+			break;
+		}
+		len += pIov->iov[i].iov_len;
+	}
+	pIov->lenTotal = lenMax;
+}
+
+
+/* copy a scatter list into a string. Buffer handling is the same as for
+ * tplToString(). This is for the (rare) cases where a module needs the
+ * content of an iovec-rendered template contiguously.
+ */
+rsRetVal
+tplIovToString(tplIov_t *pIov, uchar **ppBuf, size_t *pLenBuf)
+{
+	int i;
+	size_t iBuf;
+	DEFiRet;
+
+	if(pIov->lenTotal >= *pLenBuf)
+		CHKiRet(ExtendBuf(ppBuf, pLenBuf, pIov->lenTotal + 1));
+	iBuf = 0;
+	for(i = 0 ; i < pIov->nIov ; ++i) {
+		memcpy(*ppBuf + iBuf, pIov->iov[i].iov_base, pIov->iov[i].iov_len);
+		iBuf += pIov->iov[i].iov_len;
+	}
+	(*ppBuf)[iBuf] = '\0';
+finalize_it:
+	RETiRet;
+}
+
+
 /* Helper to doEscape. This is called if doEscape
  * runs out of memory allocating the escaped string.
  * Then we are in trouble. We can
@@ -422,14 +938,17 @@ static void doEmergencyEscape(register uchar *p, int mode)
  * Parameter "mode" is STDSQL_ESCAPE, SQL_ESCAPE "smart" SQL engines, or
  * JSON_ESCAPE for everyone requiring escaped JSON (e.g. ElasticSearch).
  * 2005-09-22 rgerhards
+ * All modes put an escape char in front of one or two special chars. This
+ * is done via the escape kernels (runtime/escape.c), which check whole
+ * blocks of chars at once and copy unescaped runs in bulk. The (common)
+ * case of a string without any special chars does not copy at all.
  */
 rsRetVal
 doEscape(uchar **pp, rs_size_t *pLen, unsigned short *pbMustBeFreed, int mode)
 {
 	DEFiRet;
-	uchar *p = NULL;
-	int iLen;
-	cstr_t *pStrB = NULL;
+	uchar cEsc, c1, c2;
+	size_t iLen;
 	uchar *pszGenerated;
 
 	assert(pp != NULL);
@@ -437,41 +956,28 @@ doEscape(uchar **pp, rs_size_t *pLen, unsigned short *pbMustBeFreed, int mode)
 	assert(pLen != NULL);
 	assert(pbMustBeFreed != NULL);
 
-	/* first check if we need to do anything at all... */
-	if(mode == STDSQL_ESCAPE)
-		for(p = *pp ; *p && *p != '\'' ; ++p)
-			;
-	else if(mode == SQL_ESCAPE)
-		for(p = *pp ; *p && *p != '\'' && *p != '\\' ; ++p)
-			;
-	else if(mode == JSON_ESCAPE)
-		for(p = *pp ; *p && *p != '"' ; ++p)
-			;
-	/* when we get out of the loop, we are either at the
-	 * string terminator or the first character to escape */
-	if(p && *p == '\0')
-		FINALIZE; /* nothing to do in this case! */
+	if(mode == STDSQL_ESCAPE) {
+		cEsc = c1 = c2 = '\'';
+	} else if(mode == SQL_ESCAPE) {
+		cEsc = '\\';
+		c1 = '\'';
+		c2 = '\\';
+	} else if(mode == JSON_ESCAPE) {
+		cEsc = '\\';
+		c1 = c2 = '"';
+	} else {
+		FINALIZE;
+	}
 
-	p = *pp;
+	/* first check if we need to do anything at all... */
 	iLen = *pLen;
-	CHKiRet(cstrConstruct(&pStrB));
+	if(escScanChars(*pp, iLen, c1, c2) == iLen)
+		FINALIZE; /* nothing to do in this case! */
 
-	while(*p) {
-		if((mode == SQL_ESCAPE || mode == STDSQL_ESCAPE) && *p == '\'') {
-			CHKiRet(cstrAppendChar(pStrB, (mode == STDSQL_ESCAPE) ? '\'' : '\\'));
-			iLen++;	/* reflect the extra character */
-		} else if((mode == SQL_ESCAPE) && *p == '\\') {
-			CHKiRet(cstrAppendChar(pStrB, '\\'));
-			iLen++;	/* reflect the extra character */
-		} else if((mode == JSON_ESCAPE) && *p == '"') {
-			CHKiRet(cstrAppendChar(pStrB, '\\'));
-			iLen++;	/* reflect the extra character */
-		}
-		CHKiRet(cstrAppendChar(pStrB, *p));
-		++p;
-	}
-	CHKiRet(cstrFinalize(pStrB));
-	CHKiRet(cstrConvSzStrAndDestruct(pStrB, &pszGenerated, 0));
+	/* worst case: every char needs to be escaped */
+	CHKmalloc(pszGenerated = MALLOC(2 * iLen + 1));
+	iLen = escPrefixChars(pszGenerated, *pp, iLen, cEsc, c1, c2);
+	pszGenerated[iLen] = '\0';
 
 	if(*pbMustBeFreed)
 		free(*pp); /* discard previous value */
@@ -481,11 +987,8 @@ doEscape(uchar **pp, rs_size_t *pLen, unsigned short *pbMustBeFreed, int mode)
 	*pbMustBeFreed = 1;
 
 finalize_it:
-	if(iRet != RS_RET_OK) {
+	if(iRet != RS_RET_OK)
 		doEmergencyEscape(*pp, mode);
-		if(pStrB != NULL)
-			cstrDestruct(&pStrB);
-	}
 
 	RETiRet;
 }
@@ -996,7 +1499,8 @@ static int do_Parameter(unsigned char **pp, struct template *pTpl)
 				if((iRetLocal = objUse(regexp, LM_REGEXP_FILENAME)) == RS_RET_OK) {
 					int iOptions;
 					iOptions = (pTpe->data.field.typeRegex == TPL_REGEX_ERE) ? REG_EXTENDED : 0;
-					if(regexp.regcomp(&(pTpe->data.field.re), (char*) regex_char, iOptions) != 0) {
+					if(regexp.compile(&(pTpe->data.field.re), (char*) regex_char, iOptions,
+							  RS_REGEX_ENGINE_DFLT) != 0) {
 						dbgprintf("error: can not compile regex: '%s'\n", regex_char);
 						pTpe->data.field.has_regex = 2;
 					}
@@ -1609,7 +2113,8 @@ createPropertyTpe(struct template *pTpl, struct cnfobj *o)
 		if((iRetLocal = objUse(regexp, LM_REGEXP_FILENAME)) == RS_RET_OK) {
 			int iOptions;
 			iOptions = (pTpe->data.field.typeRegex == TPL_REGEX_ERE) ? REG_EXTENDED : 0;
-			if(regexp.regcomp(&(pTpe->data.field.re), (char*) re_expr, iOptions) != 0) {
+			if(regexp.compile(&(pTpe->data.field.re), (char*) re_expr, iOptions,
+					  RS_REGEX_ENGINE_DFLT) != 0) {
 				dbgprintf("error: can not compile regex: '%s'\n", re_expr);
 				errmsg.LogError(0, NO_ERRCODE, "error compiling regex '%s'", re_expr);
 				pTpe->data.field.has_regex = 2;
@@ -1890,6 +2395,23 @@ struct template *tplFind(rsconf_t *conf, char *pName, int iLenName)
 	return(pTpl);
 }
 
+/* free the compiled form of a template */
+static void
+tplFreeOps(struct template *pTpl)
+{
+	int i;
+
+	if(pTpl->pOps == NULL)
+		return;
+	for(i = 0 ; i < pTpl->nOps ; ++i)
+		if(pTpl->pOps[i].bFreeConst)
+			free(pTpl->pOps[i].pConst);
+	free(pTpl->pOps);
+	pTpl->pOps = NULL;
+	pTpl->nOps = 0;
+}
+
+
 /* Destroy the template structure. This is for de-initialization
  * at program end. Everything is deleted.
  * rgerhards 2005-02-22
@@ -1925,7 +2447,7 @@ void tplDeleteAll(rsconf_t *conf)
 #ifdef FEATURE_REGEXP
 				if(pTpeDel->data.field.has_regex != 0) {
 					if(objUse(regexp, LM_REGEXP_FILENAME) == RS_RET_OK) {
-						regexp.regfree(&(pTpeDel->data.field.re));
+						regexp.destruct(&(pTpeDel->data.field.re));
 					}
 				}
 				if(pTpeDel->data.field.propName != NULL)
@@ -1939,6 +2461,7 @@ void tplDeleteAll(rsconf_t *conf)
 		}
 		pTplDel = pTpl;
 		pTpl = pTpl->pNext;
+		tplFreeOps(pTplDel);
 		free(pTplDel->pszName);
 		if(pTplDel->subtree != NULL)
 			es_deleteStr(pTplDel->subtree);
@@ -1985,7 +2508,7 @@ void tplDeleteNew(rsconf_t *conf)
 				/* check if we have a regexp and, if so, delete it */
 				if(pTpeDel->data.field.has_regex != 0) {
 					if(objUse(regexp, LM_REGEXP_FILENAME) == RS_RET_OK) {
-						regexp.regfree(&(pTpeDel->data.field.re));
+						regexp.destruct(&(pTpeDel->data.field.re));
 					}
 				}
 				if(pTpeDel->data.field.propName != NULL)
@@ -1998,6 +2521,7 @@ void tplDeleteNew(rsconf_t *conf)
 		}
 		pTplDel = pTpl;
 		pTpl = pTpl->pNext;
+		tplFreeOps(pTplDel);
 		free(pTplDel->pszName);
 		if(pTplDel->subtree != NULL)
 			es_deleteStr(pTplDel->subtree);
@@ -2012,6 +2536,179 @@ void tplLastStaticInit(rsconf_t *conf, struct template *tpl)
 	conf->templates.lastStatic = tpl;
 }
 
+/* count the property references of all templates, so that properties
+ * used more than once (in templates and filters) can be memoized.
+ */
+void tplCountMemoProps(rsconf_t *conf)
+{
+	struct template *pTpl;
+	struct templateEntry *pTpe;
+
+	for(pTpl = conf->templates.root ; pTpl != NULL ; pTpl = pTpl->pNext) {
+		for(pTpe = pTpl->pEntryRoot ; pTpe != NULL ; pTpe = pTpe->pNext) {
+			if(pTpe->eEntryType == FIELD)
+				msgMemoCountRef(pTpe->data.field.propid, pTpe->data.field.propName);
+		}
+	}
+}
+
+/* check if a template entry uses any options, that is if the property
+ * value needs any post-processing inside MsgGetProp().
+ */
+static inline int
+tpeHasOptions(struct templateEntry *pTpe)
+{
+	return pTpe->data.field.iFromPos != 0 || pTpe->data.field.iToPos != 0
+	       || pTpe->data.field.has_fields
+#ifdef FEATURE_REGEXP
+	       || pTpe->data.field.has_regex
+#endif
+	       || pTpe->data.field.eCaseConv != tplCaseConvNo
+	       || pTpe->data.field.options.bDropCC || pTpe->data.field.options.bSpaceCC
+	       || pTpe->data.field.options.bEscapeCC || pTpe->data.field.options.bDropLastLF
+	       || pTpe->data.field.options.bSecPathDrop || pTpe->data.field.options.bSecPathReplace
+	       || pTpe->data.field.options.bSPIffNo1stSP || pTpe->data.field.options.bCSV
+	       || pTpe->data.field.options.bJSON || pTpe->data.field.options.bJSONf;
+}
+
+
+/* return the length of a date format that always renders to the same
+ * size, or 0 if the size varies.
+ */
+static inline int
+fixedDateLen(enum tplFormatTypes eFmt)
+{
+	switch(eFmt) {
+	case tplFmtMySQLDate:
+		return 14; /* YYYYMMDDhhmmss */
+	case tplFmtRFC3164Date:
+	case tplFmtRFC3164BuggyDate:
+		return 15; /* Mmm dd hh:mm:ss */
+	case tplFmtPgSQLDate:
+		return 19; /* YYYY-MM-DD hh:mm:ss */
+	default:
+		return 0;
+	}
+}
+
+
+/* select the op (accessor) to use for a field entry */
+static inline enum tplOpType
+tpeSelectOp(struct templateEntry *pTpe)
+{
+	if(tpeHasOptions(pTpe))
+		return TPLOP_ENTRY;
+	switch(pTpe->data.field.propid) {
+	case PROP_MSG:
+		return TPLOP_MSG;
+	case PROP_HOSTNAME:
+		return TPLOP_HOSTNAME;
+	case PROP_SYSLOGTAG:
+		return TPLOP_SYSLOGTAG;
+	case PROP_RAWMSG:
+		return TPLOP_RAWMSG;
+	case PROP_TIMESTAMP:
+		return TPLOP_TIMESTAMP;
+	case PROP_TIMEGENERATED:
+		/* MsgGetProp() needs the entry for the date format */
+		return (pTpe->data.field.eDateFormat == tplFmtDefault) ? TPLOP_PROP : TPLOP_ENTRY;
+	default:
+		return TPLOP_PROP;
+	}
+}
+
+
+/* compile a single template, see struct tplOp for what this means. Templates
+ * handled by a strgen module or providing a subtree are not compiled, as
+ * they do not use the entry list.
+ */
+static rsRetVal
+tplCompile(struct template *pTpl)
+{
+	struct templateEntry *pTpe;
+	struct templateEntry *pRun;
+	struct tplOp *pOp;
+	uchar *pConst;
+	int lenConst;
+	DEFiRet;
+
+	if(pTpl->pOps != NULL || pTpl->pStrgen != NULL || pTpl->subtree != NULL)
+		FINALIZE;
+
+	/* tpenElements is the upper bound, merging reduces the op count */
+	CHKmalloc(pTpl->pOps = calloc(pTpl->tpenElements + 1, sizeof(struct tplOp)));
+	pTpl->lenFixed = 0;
+	pTpe = pTpl->pEntryRoot;
+	while(pTpe != NULL) {
+		if(pTpe->eEntryType == UNDEFINED) {
+			pTpe = pTpe->pNext;
+			continue;
+		}
+		pOp = pTpl->pOps + pTpl->nOps++;
+		if(pTpe->eEntryType == CONSTANT) {
+			/* merge run of adjacent constants */
+			lenConst = 0;
+			for(pRun = pTpe ; pRun != NULL && pRun->eEntryType == CONSTANT ; pRun = pRun->pNext)
+				lenConst += pRun->data.constant.iLenConstant;
+			pOp->opType = TPLOP_CONST;
+			pOp->lenConst = lenConst;
+			if(pTpe->pNext == pRun) {
+				pOp->pConst = pTpe->data.constant.pConstant;
+			} else {
+				CHKmalloc(pConst = malloc(lenConst + 1));
+				pOp->pConst = pConst;
+				pOp->bFreeConst = 1;
+				for( ; pTpe != pRun ; pTpe = pTpe->pNext) {
+					memcpy(pConst, pTpe->data.constant.pConstant,
+					       pTpe->data.constant.iLenConstant);
+					pConst += pTpe->data.constant.iLenConstant;
+				}
+				*pConst = '\0';
+			}
+			pTpl->lenFixed += lenConst;
+			pTpe = pRun;
+		} else {
+			pOp->opType = tpeSelectOp(pTpe);
+			pOp->pTpe = pTpe;
+			if(   (pTpe->data.field.propid == PROP_TIMESTAMP
+			       || pTpe->data.field.propid == PROP_TIMEGENERATED)
+			   && pOp->opType != TPLOP_ENTRY)
+				pTpl->lenFixed += fixedDateLen(pTpe->data.field.eDateFormat);
+			pTpe = pTpe->pNext;
+		}
+	}
+	DBGPRINTF("template '%s' compiled: %d entries, %d ops, %u fixed bytes\n",
+		  pTpl->pszName, pTpl->tpenElements, pTpl->nOps, (unsigned) pTpl->lenFixed);
+
+finalize_it:
+	if(iRet != RS_RET_OK)
+		tplFreeOps(pTpl);
+	RETiRet;
+}
+
+
+/* compile all templates of a config. Templates which were already compiled
+ * (the hardcoded ones on a config reload) are left as they are. If a
+ * template can not be compiled, it is rendered via the entry list, so
+ * this is not an error.
+ */
+rsRetVal
+tplCompileAll(rsconf_t *conf)
+{
+	struct template *pTpl;
+	rsRetVal localRet;
+	DEFiRet;
+
+	for(pTpl = conf->templates.root ; pTpl != NULL ; pTpl = pTpl->pNext) {
+		localRet = tplCompile(pTpl);
+		if(localRet != RS_RET_OK)
+			DBGPRINTF("template '%s' could not be compiled, error %d - using "
+				  "interpreted mode\n", pTpl->pszName, localRet);
+	}
+	RETiRet;
+}
+
+
 /* Print the template structure. This is more or less a 
  * debug or test aid, but anyhow I think it's worth it...
  */
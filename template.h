@@ -30,11 +30,52 @@
 #ifndef	TEMPLATE_H_INCLUDED
 #define	TEMPLATE_H_INCLUDED 1
 
+#include <sys/uio.h>
 #include <json/json.h>
 #include <libestr.h>
 #include "regexp.h"
 #include "stringbuf.h"
 
+/* compiled template entries. At config load, the entry list is translated
+ * into an array of these "ops": adjacent constants are merged into a single
+ * op and properties without any options are fetched via a specialized
+ * accessor instead of the generic (and much more costly) MsgGetProp()
+ * path. The result is rendered in a single pass over the array.
+ */
+enum tplOpType {
+	TPLOP_CONST = 0,	/* (merged) constant text */
+	TPLOP_MSG = 1,		/* plain properties with a direct accessor */
+	TPLOP_HOSTNAME = 2,
+	TPLOP_SYSLOGTAG = 3,
+	TPLOP_RAWMSG = 4,
+	TPLOP_TIMESTAMP = 5,
+	TPLOP_PROP = 6,		/* other property without options */
+	TPLOP_ENTRY = 7		/* property with options, full MsgGetProp() processing */
+};
+
+struct tplOp {
+	enum tplOpType opType;
+	uchar *pConst;		/* TPLOP_CONST only: constant text ... */
+	int lenConst;		/* ... and its length */
+	sbool bFreeConst;	/* pConst was allocated when merging constants */
+	struct templateEntry *pTpe; /* all other types: the entry to render */
+};
+
+/* a template rendered as scatter list, see tplToIovec() */
+#define TPL_MAX_IOV 64	/* templates with more ops are rendered into a single buffer */
+struct tplIov {
+	struct iovec *iov;	/* entries, pointing to message properties and constants */
+	int nIov;		/* number of entries in use */
+	int maxIov;		/* number of entries allocated */
+	size_t lenTotal;	/* sum of all entry lengths */
+	uchar **ppOwned;	/* values created during rendering, freed on reset */
+	int nOwned;
+	int maxOwned;
+	uchar *pBuf;		/* buffer for templates that are rendered as a whole */
+	size_t lenBuf;
+};
+typedef struct tplIov tplIov_t;
+
 struct template {
 	struct template *pNext;
 	char *pszName;
@@ -44,6 +85,10 @@ struct template {
 	int tpenElements; /* number of elements in templateEntry list */
 	struct templateEntry *pEntryRoot;
 	struct templateEntry *pEntryLast;
+	struct tplOp *pOps;	/* compiled entries, NULL if template is not compiled */
+	int nOps;
+	size_t lenFixed;	/* length of all constant and fixed-width parts */
+	size_t lenHint;		/* length of last rendered string, used as size estimate */
 	char optFormatEscape;	/* in text fields, */
 #	define NO_ESCAPE 0	/* 0 - do not escape, */
 #	define SQL_ESCAPE 1	/* 1 - escape "the MySQL way"  */
@@ -83,7 +128,7 @@ struct templateEntry {
 			unsigned iToPos;	/* up to that one... */
 			unsigned iFieldNr;	/* for field extraction: field to extract */
 #ifdef FEATURE_REGEXP
-			regex_t re;	/* APR: this is the regular expression */
+			rsregex_t *re;	/* APR: this is the regular expression */
 			short has_regex;
 			short iMatchToUse;/* which match should be obtained (10 max) */
 			short iSubMatchToUse;/* which submatch should be obtained (10 max) */
@@ -140,6 +185,8 @@ int tplGetEntryCount(struct template *pTpl);
 void tplDeleteAll(rsconf_t *conf);
 void tplDeleteNew(rsconf_t *conf);
 void tplPrintList(rsconf_t *conf);
+void tplCountMemoProps(rsconf_t *conf);
+rsRetVal tplCompileAll(rsconf_t *conf);
 void tplLastStaticInit(rsconf_t *conf, struct template *tpl);
 rsRetVal ExtendBuf(uchar **pBuf, size_t *pLenBuf, size_t iMinSize);
 /* note: if a compiler warning for undefined type tells you to look at this
@@ -150,6 +197,12 @@ rsRetVal ExtendBuf(uchar **pBuf, size_t *pLenBuf, size_t iMinSize);
 rsRetVal tplToArray(struct template *pTpl, msg_t *pMsg, uchar*** ppArr);
 rsRetVal tplToString(struct template *pTpl, msg_t *pMsg, uchar** ppSz, size_t *);
 rsRetVal tplToJSON(struct template *pTpl, msg_t *pMsg, struct json_object **);
+rsRetVal tplToJSONString(struct template *pTpl, msg_t *pMsg, uchar **ppBuf, size_t *pLenBuf);
+rsRetVal tplToIovec(struct template *pTpl, msg_t *pMsg, tplIov_t **ppIov);
+rsRetVal tplIovToString(tplIov_t *pIov, uchar **ppBuf, size_t *pLenBuf);
+void tplIovTruncate(tplIov_t *pIov, size_t lenMax);
+void tplIovReset(tplIov_t *pIov);
+void tplIovDestruct(tplIov_t *pIov);
 rsRetVal doEscape(uchar **pp, rs_size_t *pLen, unsigned short *pbMustBeFreed, int escapeMode);
 
 rsRetVal templateInit();
@@ -0,0 +1,12 @@
+# check that the windowed dedup suppresses messages with the same key.
+# All messages share the key, so only the first one must be written.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[dedup-window.sh\]: testing windowed duplicate suppression
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup dedup-window.conf
+source $srcdir/diag.sh tcpflood -m10
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 0
+source $srcdir/diag.sh exit
@@ -0,0 +1,22 @@
+# This test writes to several dynafiles via dynafile shards. A message to a
+# file that cannot be opened is mixed in, so that the shards return different
+# per-element results for the same batch. No message may be lost or written
+# twice.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo TEST: \[dynfile_shards.sh\]: test dynafile writing with shards
+source $srcdir/diag.sh init
+# uncomment for debugging support:
+#export RSYSLOG_DEBUG="debug nostdout noprintmutexaction"
+#export RSYSLOG_DEBUGLOG="log"
+source $srcdir/diag.sh startup dynfile_shards.conf
+# the directory of the "nodir" file does not exist and is not created
+source $srcdir/diag.sh tcpflood -m10000 -f8
+./tcpflood -m1 -M "<129>Mar 10 01:00:00 172.20.245.8 tag msgnum:nodir/x:boom:"
+source $srcdir/diag.sh tcpflood -i10000 -m10000 -f8
+./tcpflood -m1 -M "<129>Mar 10 01:00:00 172.20.245.8 tag msgnum:nodir/x:boom:"
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown       # and wait for it to terminate
+cat rsyslog.out.*.log > rsyslog.out.log
+source $srcdir/diag.sh seq-check 0 19999
+source $srcdir/diag.sh exit
@@ -0,0 +1,329 @@
+/* Compares rsyslog's escape kernels (runtime/escape.c) against the
+ * byte-by-byte escaping previously used by templates and JSON encoding.
+ * Typical log payloads (clean syslog lines, lines with quotes and
+ * backslashes, JSON-like payloads with control characters) are escaped
+ * in all modes. The "json-c" mode is the escaping of the template JSON
+ * writer, which matches json-c. Both implementations must deliver identical results,
+ * otherwise the program terminates with a non-zero exit code.
+ *
+ * Params
+ * -n<number of messages> (default 20000)
+ * -b print timing for each payload type and mode (benchmark mode)
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of rsyslog.
+ *
+ * Rsyslog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rsyslog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Rsyslog.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A copy of the GPL can be found in the file "COPYING" in this distribution.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include "escape.h"
+
+typedef unsigned char uchar;
+
+/* escape modes, same as in template.h */
+enum { MODE_SQL = 1, MODE_STDSQL = 2, MODE_JSON = 3, MODE_JSONFULL = 4, MODE_JSONC = 5 };
+static char *modeNames[] = { "", "sql", "stdsql", "json", "json-full", "json-c" };
+
+static char *payloadNames[] = { "clean syslog", "sql quotes", "json payload", "long clean",
+	"random bytes" };
+#define NPAYLOADS 5
+
+static const char hexdigit[16] =
+	{'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+static const char hexdigitLower[16] =
+	{'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+
+static long
+usecDiff(struct timeval *start)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_usec - start->tv_usec);
+}
+
+
+/* the JSON escape sequence for a single char, as done by jsonAddVal()
+ * (hex digits upper case) and the template JSON writer (lower case).
+ */
+static size_t
+jsonEscChar(uchar *dst, uchar c, const char *hex)
+{
+	int j;
+
+	dst[0] = '\\';
+	switch(c) {
+	case '"':  dst[1] = '"'; return 2;
+	case '\\': dst[1] = '\\'; return 2;
+	case '/':  dst[1] = '/'; return 2;
+	case '\010': dst[1] = 'b'; return 2;
+	case '\014': dst[1] = 'f'; return 2;
+	case '\n': dst[1] = 'n'; return 2;
+	case '\r': dst[1] = 'r'; return 2;
+	case '\t': dst[1] = 't'; return 2;
+	default:
+		dst[1] = 'u';
+		for(j = 0 ; j < 4 ; ++j) {
+			dst[5-j] = hex[c % 16];
+			c = c / 16;
+		}
+		return 6;
+	}
+}
+
+
+/* reference: byte-by-byte, as done before by doEscape() and jsonAddVal().
+ * Returns the output length, or 0 if nothing needed to be escaped.
+ */
+static size_t
+escRef(uchar *dst, uchar *src, size_t len, int mode)
+{
+	size_t i;
+	size_t iDst = 0;
+	int bEsc = 0;
+	uchar c;
+
+	for(i = 0 ; i < len ; ++i) {
+		c = src[i];
+		if(mode == MODE_JSONFULL) {
+			if(   (c >= 0x23 && c <= 0x5b) || c >= 0x5d || c == 0x20 || c == 0x21) {
+				dst[iDst++] = c;
+			} else {
+				iDst += jsonEscChar(dst + iDst, c, hexdigit);
+				bEsc = 1;
+			}
+			continue;
+		}
+		if(mode == MODE_JSONC) {
+			if(c < 0x20 || c == '"' || c == '\\' || c == '/') {
+				iDst += jsonEscChar(dst + iDst, c, hexdigitLower);
+				bEsc = 1;
+			} else {
+				dst[iDst++] = c;
+			}
+			continue;
+		}
+		if((mode == MODE_SQL || mode == MODE_STDSQL) && c == '\'') {
+			dst[iDst++] = (mode == MODE_STDSQL) ? '\'' : '\\';
+			bEsc = 1;
+		} else if(mode == MODE_SQL && c == '\\') {
+			dst[iDst++] = '\\';
+			bEsc = 1;
+		} else if(mode == MODE_JSON && c == '"') {
+			dst[iDst++] = '\\';
+			bEsc = 1;
+		}
+		dst[iDst++] = c;
+	}
+	return bEsc ? iDst : 0;
+}
+
+
+/* the same via the escape kernels, as done now */
+static size_t
+escFast(uchar *dst, uchar *src, size_t len, int mode)
+{
+	size_t i;
+	size_t iDst;
+	size_t lenRun;
+
+	switch(mode) {
+	case MODE_SQL:
+		if(escScanChars(src, len, '\'', '\\') == len)
+			return 0;
+		return escPrefixChars(dst, src, len, '\\', '\'', '\\');
+	case MODE_STDSQL:
+		if(escScanChars(src, len, '\'', '\'') == len)
+			return 0;
+		return escPrefixChars(dst, src, len, '\'', '\'', '\'');
+	case MODE_JSON:
+		if(escScanChars(src, len, '"', '"') == len)
+			return 0;
+		return escPrefixChars(dst, src, len, '\\', '"', '"');
+	case MODE_JSONC:
+		if((i = escScanJSONSlash(src, len)) == len)
+			return 0;
+		memcpy(dst, src, i);
+		iDst = i;
+		while(i < len) {
+			iDst += jsonEscChar(dst + iDst, src[i++], hexdigitLower);
+			lenRun = escScanJSONSlash(src + i, len - i);
+			memcpy(dst + iDst, src + i, lenRun);
+			iDst += lenRun;
+			i += lenRun;
+		}
+		return iDst;
+	default: /* MODE_JSONFULL */
+		if((i = escScanJSON(src, len)) == len)
+			return 0;
+		memcpy(dst, src, i);
+		iDst = i;
+		while(i < len) {
+			iDst += jsonEscChar(dst + iDst, src[i++], hexdigit);
+			lenRun = escScanJSON(src + i, len - i);
+			memcpy(dst + iDst, src + i, lenRun);
+			iDst += lenRun;
+			i += lenRun;
+		}
+		return iDst;
+	}
+}
+
+
+/* generate a message of the given payload type */
+static uchar *
+genMsg(int type, unsigned *seed, size_t *pLen)
+{
+	static char *clean[] = { "Oct 15 10:42:01", "host1", "sshd[4711]:", "Accepted", "publickey",
+		"for", "user", "from", "10.0.0.1", "port", "22", "ssh2", "session", "opened" };
+	static char *quoted[] = { "INSERT", "'O''Reilly'", "path=C:\\temp\\x", "it's", "value",
+		"name='x'", "done" };
+	static char *json[] = { "{\"user\":", "\"root\",", "\"cmd\":", "\"ls\\t-l\"", "\n", "\t", "}",
+		"\x01", "text", "more text" };
+	char **words;
+	int nWords;
+	size_t maxLen;
+	size_t len = 0;
+	size_t lenWord;
+	char *word;
+	uchar *msg;
+
+	switch(type) {
+	case 0:  words = clean; nWords = sizeof(clean)/sizeof(char*); maxLen = 200; break;
+	case 1:  words = quoted; nWords = sizeof(quoted)/sizeof(char*); maxLen = 200; break;
+	case 2:  words = json; nWords = sizeof(json)/sizeof(char*); maxLen = 300; break;
+	default: words = clean; nWords = sizeof(clean)/sizeof(char*); maxLen = 4000; break;
+	}
+	if((msg = malloc(maxLen + 1)) == NULL)
+		return NULL;
+	if(type == 4) {
+		/* all byte values, including NUL, to verify the kernels */
+		*seed = *seed * 1103515245 + 12345;
+		maxLen = (*seed >> 16) % 200;
+		for(len = 0 ; len < maxLen ; ++len) {
+			*seed = *seed * 1103515245 + 12345;
+			msg[len] = (*seed >> 16) & 0xff;
+		}
+		msg[len] = '\0';
+		*pLen = len;
+		return msg;
+	}
+	while(1) {
+		*seed = *seed * 1103515245 + 12345;
+		word = words[(*seed >> 16) % nWords];
+		lenWord = strlen(word);
+		if(len + lenWord + 1 > maxLen)
+			break;
+		memcpy(msg + len, word, lenWord);
+		len += lenWord;
+		msg[len++] = ' ';
+	}
+	msg[len] = '\0';
+	*pLen = len;
+	return msg;
+}
+
+
+int main(int argc, char *argv[])
+{
+	uchar **msgs;
+	size_t *lens;
+	uchar *bufRef, *bufFast;
+	size_t lenRef, lenFast;
+	int nMsgs = 20000;
+	int bBench = 0;
+	int opt;
+	int i, type, mode;
+	int nMismatch = 0;
+	long usRef, usFast;
+	unsigned seed = 1;
+	struct timeval start;
+
+	while((opt = getopt(argc, argv, "n:b")) != EOF) {
+		switch((char)opt) {
+		case 'n':
+			nMsgs = atoi(optarg);
+			break;
+		case 'b':
+			bBench = 1;
+			break;
+		default:printf("Invalid call of escapebench\n");
+			printf("Usage: escapebench [-n messages] [-b]\n");
+			exit(1);
+		}
+	}
+
+	msgs = malloc(nMsgs * sizeof(uchar*));
+	lens = malloc(nMsgs * sizeof(size_t));
+	bufRef = malloc(6 * 4000 + 1);
+	bufFast = malloc(6 * 4000 + 1);
+	if(msgs == NULL || lens == NULL || bufRef == NULL || bufFast == NULL) {
+		printf("out of memory\n");
+		exit(1);
+	}
+
+	for(type = 0 ; type < NPAYLOADS ; ++type) {
+		for(i = 0 ; i < nMsgs ; ++i) {
+			if((msgs[i] = genMsg(type, &seed, &lens[i])) == NULL) {
+				printf("out of memory\n");
+				exit(1);
+			}
+		}
+		for(mode = MODE_SQL ; mode <= MODE_JSONC ; ++mode) {
+			gettimeofday(&start, NULL);
+			for(i = 0 ; i < nMsgs ; ++i)
+				escRef(bufRef, msgs[i], lens[i], mode);
+			usRef = usecDiff(&start);
+			gettimeofday(&start, NULL);
+			for(i = 0 ; i < nMsgs ; ++i)
+				escFast(bufFast, msgs[i], lens[i], mode);
+			usFast = usecDiff(&start);
+
+			for(i = 0 ; i < nMsgs ; ++i) {
+				lenRef = escRef(bufRef, msgs[i], lens[i], mode);
+				lenFast = escFast(bufFast, msgs[i], lens[i], mode);
+				if(lenRef != lenFast || memcmp(bufRef, bufFast, lenRef)) {
+					if(nMismatch < 10)
+						printf("MISMATCH: mode %s, msg '%s'\n", modeNames[mode], msgs[i]);
+					++nMismatch;
+				}
+			}
+			if(bBench)
+				printf("%-14s %-10s bytewise %8ld us, kernels %8ld us\n",
+				       payloadNames[type], modeNames[mode], usRef, usFast);
+		}
+		for(i = 0 ; i < nMsgs ; ++i)
+			free(msgs[i]);
+	}
+
+	free(msgs);
+	free(lens);
+	free(bufRef);
+	free(bufFast);
+
+	if(nMismatch > 0) {
+		printf("escapebench: %d mismatches between bytewise and kernel escaping\n", nMismatch);
+		exit(1);
+	}
+	exit(0);
+}
@@ -0,0 +1,10 @@
+# check that the escape kernels deliver the same results as
+# bytewise escaping (see escapebench.c)
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[escapebench.sh\]: testing escape kernels
+./escapebench
+if [ "$?" -ne "0" ]; then
+	echo "escapebench reports differences between escape methods"
+	exit 1
+fi
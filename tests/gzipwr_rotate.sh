@@ -0,0 +1,35 @@
+# This tests gzip file writing with size-based rotation. Each rotated
+# generation must consist of complete gzip members only, and its block
+# index must end exactly at the end of the file.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo TEST: \[gzipwr_rotate.sh\]: test for gzip file writing with rotation
+source $srcdir/diag.sh init
+# uncomment for debugging support:
+#export RSYSLOG_DEBUG="debug nostdout noprintmutexaction"
+#export RSYSLOG_DEBUGLOG="log"
+source $srcdir/diag.sh startup gzipwr_rotate.conf
+# send 4000 messages of 10.000bytes plus header max, randomized
+source $srcdir/diag.sh tcpflood -m4000 -r -d10000 -P129
+sleep 1 # due to large messages, we need this time for the tcp receiver to settle...
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown       # and wait for it to terminate
+if [ ! -f rsyslog.out.log.1 ]; then
+  echo "file was not rotated"
+  exit 1
+fi
+rm -f work-gzip
+for f in rsyslog.out.log rsyslog.out.log.[0-9]*; do
+  case $f in *.idx) continue ;; esac
+  if ! gunzip < $f >> work-gzip; then
+    echo "$f does not consist of complete gzip members"
+    exit 1
+  fi
+  if [ "`tail -n1 $f.idx | awk '{ print $1 + $2 }'`" != "`wc -c < $f | tr -d ' '`" ]; then
+    echo "block index of $f does not match the file"
+    exit 1
+  fi
+done
+mv work-gzip rsyslog.out.log
+source $srcdir/diag.sh seq-check 0 3999 -E
+source $srcdir/diag.sh exit
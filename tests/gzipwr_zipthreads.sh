@@ -0,0 +1,29 @@
+# This tests gzip file writing with several blocks being compressed in
+# parallel. The blocks must be written completely and in order.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo TEST: \[gzipwr_zipthreads.sh\]: test for gzip file writing with compressor threads
+source $srcdir/diag.sh init
+# uncomment for debugging support:
+#export RSYSLOG_DEBUG="debug nostdout noprintmutexaction"
+#export RSYSLOG_DEBUGLOG="log"
+source $srcdir/diag.sh startup gzipwr_zipthreads.conf
+# send 4000 messages of 10.000bytes plus header max, randomized
+source $srcdir/diag.sh tcpflood -m4000 -r -d10000 -P129
+sleep 1 # due to large messages, we need this time for the tcp receiver to settle...
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown       # and wait for it to terminate
+gunzip < rsyslog.out.log > work-gzip
+if [ "$?" -ne "0" ]; then
+  echo "rsyslog.out.log does not consist of complete gzip members"
+  exit 1
+fi
+# the messages arrive in order, so they must still be sorted if the
+# compressed blocks were written in order
+if ! sort -c work-gzip; then
+  echo "compressed blocks were written out of order"
+  exit 1
+fi
+mv work-gzip rsyslog.out.log
+source $srcdir/diag.sh seq-check 0 3999 -E
+source $srcdir/diag.sh exit
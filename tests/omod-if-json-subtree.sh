@@ -0,0 +1,14 @@
+echo \[omod-if-json-subtree.sh\]: test omod-if-json-subtree via udp
+$srcdir/killrsyslog.sh # kill rsyslogd if it runs for some reason
+
+./nettester -tomod-if-json-subtree -iudp -p4711
+if [ "$?" -ne "0" ]; then
+  exit 1
+fi
+
+echo test omod-if-json-subtree via tcp
+./nettester -tomod-if-json-subtree -itcp
+if [ "$?" -ne "0" ]; then
+  exit 1
+fi
+
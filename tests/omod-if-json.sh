@@ -0,0 +1,14 @@
+echo \[omod-if-json.sh\]: test omod-if-json via udp
+$srcdir/killrsyslog.sh # kill rsyslogd if it runs for some reason
+
+./nettester -tomod-if-json -iudp -p4711
+if [ "$?" -ne "0" ]; then
+  exit 1
+fi
+
+echo test omod-if-json via tcp
+./nettester -tomod-if-json -itcp
+if [ "$?" -ne "0" ]; then
+  exit 1
+fi
+
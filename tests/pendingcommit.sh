@@ -0,0 +1,13 @@
+# check that a commit left pending by the output module is completed
+# correctly while the next batch is processed. Every message must be
+# written exactly once (duplicates are detected by chkseq).
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[pendingcommit.sh\]: testing overlapping commits
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup pendingcommit.conf
+source $srcdir/diag.sh injectmsg 0 20000
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 19999
+source $srcdir/diag.sh exit
@@ -0,0 +1,219 @@
+/* Compares rsyslog's own regex engine (runtime/rsregex.c) against the
+ * system's POSIX regexec(). A set of regular expressions, as typically
+ * found in rsyslog configurations, is run over a number of generated
+ * messages of varying length. Both engines must deliver identical
+ * results, otherwise the program terminates with a non-zero exit code.
+ *
+ * Params
+ * -n<number of messages> (default 5000)
+ * -b print timing for each expression and engine (benchmark mode)
+ * -v verbose output
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * Copyright 2012 Adiscon GmbH.
+ *
+ * This file is part of rsyslog.
+ *
+ * Rsyslog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rsyslog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Rsyslog.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A copy of the GPL can be found in the file "COPYING" in this distribution.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <regex.h>
+#include <sys/time.h>
+#include "rsregex.h"
+
+static struct {
+	char *regex;
+	int cflags;
+} regexes[] = {
+	{ "error|fail(ed|ure)?", REG_EXTENDED },
+	{ "^<[0-9]+>", REG_EXTENDED },
+	{ "session (opened|closed) for user [a-z]+", REG_EXTENDED },
+	{ "[0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}", REG_EXTENDED },
+	{ "kernel:.*segfault at [0-9a-f]+", REG_EXTENDED },
+	{ "(sshd|sudo|cron)\\[[0-9]+\\]:", REG_EXTENDED },
+	{ "msgnum:0*[1-9][0-9]?:", REG_EXTENDED },
+	{ "Failed password for (invalid user )?[[:alnum:]_]+ from", REG_EXTENDED },
+	{ "[[:space:]]+$", REG_EXTENDED },
+	{ "^.{0,20}$", REG_EXTENDED },
+	{ "warn(ing)?", REG_EXTENDED | REG_ICASE },
+	{ "\\w+@\\w+\\.(com|org|net)", REG_EXTENDED },
+	{ "UFW BLOCK.*SRC=[0-9.]+ .*DPT=(22|23|3389) ", REG_EXTENDED },
+	{ "^.*ERROR.*$", 0 },
+	{ "id=\\([0-9]*\\) ", 0 },
+	{ "x\\{2,4\\}y", 0 },
+	{ "a\\|b\\|c", 0 },
+	{ "(a|b)\\1", REG_EXTENDED },	/* back-reference: not supported, must be detected */
+	{ NULL, 0 }
+};
+
+static char *words[] = {
+	"error", "failed", "failure", "warning", "WARN", "session", "opened", "closed",
+	"for", "user", "root", "kernel:", "segfault", "at", "7f3a", "sshd[1234]:", "sudo[99]:",
+	"cron[1]:", "msgnum:00000042:", "Failed", "password", "invalid", "from", "192.168.1.10",
+	"10.0.0", "UFW", "BLOCK", "SRC=10.1.2.3", "DPT=22", "DPT=80", "ERROR", "id=42", "xxxy",
+	"mail@example.com", "abc", "<13>", "a", "b", "x", "id=", "", "  "
+};
+
+static long
+usecDiff(struct timeval *start)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_usec - start->tv_usec);
+}
+
+/* generate a message made of random words; some messages are long, as
+ * this is where the engines differ most.
+ */
+static char *
+genMsg(unsigned *seed)
+{
+	char *msg;
+	size_t len = 0, maxLen;
+	char *word;
+	size_t lenWord;
+
+	*seed = *seed * 1103515245 + 12345;
+	maxLen = ((*seed >> 16) % 8 == 0) ? 4096 : 200;
+	if((msg = malloc(maxLen + 1)) == NULL)
+		return NULL;
+	while(1) {
+		*seed = *seed * 1103515245 + 12345;
+		word = words[(*seed >> 16) % (sizeof(words) / sizeof(char*))];
+		lenWord = strlen(word);
+		if(len + lenWord + 1 > maxLen)
+			break;
+		memcpy(msg + len, word, lenWord);
+		len += lenWord;
+		*seed = *seed * 1103515245 + 12345;
+		if((*seed >> 16) % 4 != 0)
+			msg[len++] = ' ';
+		*seed = *seed * 1103515245 + 12345;
+		if(((*seed >> 16) % 64) == 0)
+			break;
+	}
+	msg[len] = '\0';
+	return msg;
+}
+
+int main(int argc, char *argv[])
+{
+	char **msgs;
+	int nMsgs = 5000;
+	int bBench = 0;
+	int verbose = 0;
+	int opt;
+	int i, j;
+	int nMismatch = 0;
+	int nPosixMatch, nFastMatch;
+	int rPosix, rFast;
+	long usPosix, usFast;
+	unsigned seed = 1;
+	regex_t posix;
+	rsrx_t *pFast;
+	rsrxScratch_t *pScratch = NULL;
+	struct timeval start;
+
+	while((opt = getopt(argc, argv, "n:bv")) != EOF) {
+		switch((char)opt) {
+		case 'n':
+			nMsgs = atoi(optarg);
+			break;
+		case 'b':
+			bBench = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:printf("Invalid call of regexbench\n");
+			printf("Usage: regexbench [-n messages] [-b] [-v]\n");
+			exit(1);
+		}
+	}
+
+	if((msgs = malloc(nMsgs * sizeof(char*))) == NULL) {
+		printf("out of memory\n");
+		exit(1);
+	}
+	for(i = 0 ; i < nMsgs ; ++i) {
+		if((msgs[i] = genMsg(&seed)) == NULL) {
+			printf("out of memory\n");
+			exit(1);
+		}
+	}
+
+	for(j = 0 ; regexes[j].regex != NULL ; ++j) {
+		if(regcomp(&posix, regexes[j].regex, regexes[j].cflags | REG_NOSUB) != 0) {
+			printf("regcomp failed for '%s'\n", regexes[j].regex);
+			exit(1);
+		}
+		if(rsrxCompile(&pFast, regexes[j].regex, regexes[j].cflags) != RSRX_OK) {
+			if(verbose || bBench)
+				printf("%-50s not supported by dfa engine\n", regexes[j].regex);
+			regfree(&posix);
+			continue;
+		}
+
+		nPosixMatch = nFastMatch = 0;
+		gettimeofday(&start, NULL);
+		for(i = 0 ; i < nMsgs ; ++i)
+			if(regexec(&posix, msgs[i], 0, NULL, 0) == 0)
+				++nPosixMatch;
+		usPosix = usecDiff(&start);
+		gettimeofday(&start, NULL);
+		for(i = 0 ; i < nMsgs ; ++i)
+			if(rsrxMatch(pFast, (unsigned char*) msgs[i], &pScratch) == RSRX_OK)
+				++nFastMatch;
+		usFast = usecDiff(&start);
+
+		/* the counts may be equal by accident, so check each message */
+		for(i = 0 ; i < nMsgs ; ++i) {
+			rPosix = regexec(&posix, msgs[i], 0, NULL, 0) == 0;
+			rFast = rsrxMatch(pFast, (unsigned char*) msgs[i], &pScratch) == RSRX_OK;
+			if(rPosix != rFast) {
+				if(nMismatch < 10)
+					printf("MISMATCH: regex '%s', posix %d, dfa %d, msg '%s'\n",
+					       regexes[j].regex, rPosix, rFast, msgs[i]);
+				++nMismatch;
+			}
+		}
+		if(bBench) {
+			printf("%-50s %6d/%6d matches, posix %8ld us, dfa %8ld us (%s)\n",
+			       regexes[j].regex, nPosixMatch, nFastMatch, usPosix, usFast,
+			       rsrxHasDFA(pFast) ? "dfa" : "nfa");
+		} else if(verbose) {
+			printf("%-50s %6d matches\n", regexes[j].regex, nPosixMatch);
+		}
+		rsrxFree(pFast);
+		regfree(&posix);
+	}
+
+	rsrxScratchFree(pScratch);
+	for(i = 0 ; i < nMsgs ; ++i)
+		free(msgs[i]);
+	free(msgs);
+
+	if(nMismatch > 0) {
+		printf("regexbench: %d mismatches between posix and dfa engine\n", nMismatch);
+		exit(1);
+	}
+	exit(0);
+}
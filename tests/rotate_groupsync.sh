@@ -0,0 +1,21 @@
+# This tests size-based rotation of a file in group sync mode. The data
+# written since the last sync request must still be synced when the file
+# is rotated, and no message may be lost or duplicated.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo TEST: \[rotate_groupsync.sh\]: test file rotation in group sync mode
+source $srcdir/diag.sh init
+# uncomment for debugging support:
+#export RSYSLOG_DEBUG="debug nostdout noprintmutexaction"
+#export RSYSLOG_DEBUGLOG="log"
+source $srcdir/diag.sh startup rotate_groupsync.conf
+source $srcdir/diag.sh tcpflood -m20000
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown       # and wait for it to terminate
+if [ ! -f rsyslog.out.log.1 ]; then
+  echo "file was not rotated"
+  exit 1
+fi
+cat rsyslog.out.log.* >> rsyslog.out.log
+source $srcdir/diag.sh seq-check 0 19999
+source $srcdir/diag.sh exit
@@ -0,0 +1,14 @@
+# check that the else-part of a nested filter is only executed for
+# messages that were active when the filter was evaluated
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_else.sh\]: testing rainerscript nested if/else
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup rscript_else.conf
+source $srcdir/diag.sh injectmsg  0 5000
+echo doing shutdown
+source $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+source $srcdir/diag.sh wait-shutdown 
+source $srcdir/diag.sh seq-check  0 999
+source $srcdir/diag.sh exit
@@ -0,0 +1,14 @@
+# check that memoized CEE properties are correctly invalidated when
+# the variable is set again
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_memo.sh\]: testing property memoization
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup rscript_memo.conf
+source $srcdir/diag.sh injectmsg  0 100
+echo doing shutdown
+source $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+source $srcdir/diag.sh wait-shutdown 
+source $srcdir/diag.sh seq-check  0 79
+source $srcdir/diag.sh exit
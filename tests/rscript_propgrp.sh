@@ -0,0 +1,14 @@
+# check that grouped contains/startswith filters behave exactly like
+# the individual filters
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_propgrp.sh\]: testing grouped property filters
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup rscript_propgrp.conf
+source $srcdir/diag.sh injectmsg  0 3000
+echo doing shutdown
+source $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+source $srcdir/diag.sh wait-shutdown 
+source $srcdir/diag.sh seq-check  0 999
+source $srcdir/diag.sh exit
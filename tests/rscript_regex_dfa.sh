@@ -0,0 +1,19 @@
+# check that our own regex engine delivers the same results as the POSIX
+# engine, both standalone (regexbench) and inside rsyslogd
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_regex_dfa.sh\]: testing dfa regex engine
+./regexbench
+if [ "$?" -ne "0" ]; then
+	echo "regexbench reports differences between regex engines"
+	exit 1
+fi
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup rscript_regex_dfa.conf
+source $srcdir/diag.sh injectmsg  0 200
+echo doing shutdown
+source $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+source $srcdir/diag.sh wait-shutdown 
+source $srcdir/diag.sh seq-check  0 119
+source $srcdir/diag.sh exit
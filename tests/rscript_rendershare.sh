@@ -0,0 +1,19 @@
+# check that actions using the same template share the rendered string,
+# but re-render after the message was modified
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_rendershare.sh\]: testing shared template rendering
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup rscript_rendershare.conf
+source $srcdir/diag.sh injectmsg  0 5000
+echo doing shutdown
+source $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+source $srcdir/diag.sh wait-shutdown 
+source $srcdir/diag.sh seq-check  0 4999
+cmp rsyslog.out.log rsyslog2.out.log
+if [ ! $? -eq 0 ]; then
+  echo "rscript_rendershare.sh failed: output files differ"
+  exit 1
+fi;
+source $srcdir/diag.sh exit
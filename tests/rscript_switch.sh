@@ -0,0 +1,14 @@
+# check that equality chains dispatched via hash table behave exactly
+# like the individual compares
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_switch.sh\]: testing rainerscript equality dispatch
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup rscript_switch.conf
+source $srcdir/diag.sh injectmsg  0 200
+echo doing shutdown
+source $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+source $srcdir/diag.sh wait-shutdown 
+source $srcdir/diag.sh seq-check  0 19
+source $srcdir/diag.sh exit
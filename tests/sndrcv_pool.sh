@@ -0,0 +1,7 @@
+# This sends and receives messages via TCP, where omfwd uses a pool of
+# four connections to the receiver. The messages may arrive out of order,
+# but none may be lost or duplicated.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[sndrcv_pool.sh\]: testing sending and receiving via a tcp connection pool
+source $srcdir/sndrcv_drvr.sh sndrcv_pool 50000
@@ -0,0 +1,8 @@
+# This tests an omfwd target group where one member is down: nobody
+# listens on its port. Its messages must be sent to the other members,
+# so all messages must be received.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[sndrcv_targets_down.sh\]: testing omfwd target group with a member down
+source $srcdir/sndrcv_targets_drvr.sh sndrcv_targets_down_sender.conf 50000
+source $srcdir/diag.sh exit
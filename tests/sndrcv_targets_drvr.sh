@@ -0,0 +1,23 @@
+# This is the test driver for the omfwd target group tests. Messages are
+# injected into the sender instance, which distributes them over the
+# members of a target group. The receiver instance has one listener per
+# member and writes the messages received by member n to rsyslog.out.<n>.log.
+# After the run, the completeness of all received messages is checked. The
+# caller must call "diag.sh exit" when done.
+# So: $1 sender config file name, $2 number of messages
+# This file is part of the rsyslog project, released  under GPLv3
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup sndrcv_targets_rcvr.conf
+source $srcdir/diag.sh wait-startup
+source $srcdir/diag.sh startup $1 2
+source $srcdir/diag.sh wait-startup 2
+source $srcdir/diag.sh tcpflood -m$2 -i1
+sleep 2 # make sure all data is received in input buffers
+# shut down sender when everything is sent, receiver continues to run concurrently
+source $srcdir/diag.sh shutdown-when-empty 2
+source $srcdir/diag.sh wait-shutdown 2
+# now it is time to stop the receiver as well
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+cat rsyslog.out.*.log > rsyslog.out.log
+source $srcdir/diag.sh seq-check 1 $2
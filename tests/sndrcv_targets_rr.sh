@@ -0,0 +1,11 @@
+# This tests an omfwd target group with balance "roundrobin". All messages
+# must be received, and both members must have been used.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[sndrcv_targets_rr.sh\]: testing omfwd target group, roundrobin
+source $srcdir/sndrcv_targets_drvr.sh sndrcv_targets_rr_sender.conf 50000
+if [ ! -s rsyslog.out.1.log -o ! -s rsyslog.out.2.log ]; then
+  echo "FAIL: not all members of the target group received messages"
+  exit 1
+fi
+source $srcdir/diag.sh exit
@@ -0,0 +1,10 @@
+# This sends and receives messages via UDP, where the sender writes them in
+# transactions of many messages, which omfwd sends as a single batch of
+# datagrams. The action queue is slowed down, so that the batches fill up.
+# Note that with UDP we can always have message loss. While this is
+# less likely in a local environment, we limit the amount of data
+# we send in the hope to not lose any messages.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[sndrcv_udp_batch.sh\]: testing sending and receiving via udp in transactions
+source $srcdir/sndrcv_drvr.sh sndrcv_udp_batch 500
@@ -0,0 +1,6 @@
+# This test is similar to sndrcv_gzip, but it compresses the whole TCP
+# stream (compression.mode "stream:always") instead of single messages.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[sndrcv_zstream.sh\]: testing sending and receiving via tcp with stream compression
+source $srcdir/sndrcv_drvr.sh sndrcv_zstream 50000
@@ -0,0 +1,5 @@
+# This test is the same as sndrcv_zstream, but the receiver uses imptcp.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[sndrcv_zstream_imptcp.sh\]: testing stream compression with an imptcp receiver
+source $srcdir/sndrcv_drvr.sh sndrcv_zstream_imptcp 50000
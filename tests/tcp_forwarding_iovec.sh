@@ -0,0 +1,17 @@
+# check that templates passed as scatter list (iovec) are forwarded
+# correctly via tcp, including the LF that is added by the framing code
+# This file is part of the rsyslog project, released under GPLv3
+echo ===============================================================================
+echo \[tcp_forwarding_iovec.sh\]: test for tcp forwarding of iovec-rendered templates
+source $srcdir/diag.sh init
+./minitcpsrv 127.0.0.1 13514 rsyslog.out.log &
+BGPROCESS=$!
+echo background minitcpsrv process id is $BGPROCESS
+
+source $srcdir/diag.sh startup tcp_forwarding_iovec.conf
+source $srcdir/diag.sh injectmsg 0 10000
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown
+# note: minitcpsrv shuts down automatically if the connection is closed!
+source $srcdir/diag.sh seq-check 0 9999 -E
+source $srcdir/diag.sh exit
@@ -0,0 +1,14 @@
+# check that compiled templates (merged constants, direct property
+# accessors) render the same as the entry list did
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[template-compiled.sh\]: testing compiled templates
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup template-compiled.conf
+source $srcdir/diag.sh injectmsg  0 1000
+echo doing shutdown
+source $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+source $srcdir/diag.sh wait-shutdown 
+source $srcdir/diag.sh seq-check  0 999 -E
+source $srcdir/diag.sh exit
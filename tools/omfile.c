@@ -48,12 +48,11 @@
 #include <libgen.h>
 #include <unistd.h>
 #include <sys/file.h>
+#include <sys/time.h>
 #ifdef OS_SOLARIS
 #	include <fcntl.h>
 #endif
-#ifdef HAVE_ATOMIC_BUILTINS
-#	include <pthread.h>
-#endif
+#include <pthread.h>
 
 
 #include "conf.h"
@@ -68,6 +67,8 @@
 #include "stream.h"
 #include "unicode-helper.h"
 #include "atomic.h"
+#include "statsobj.h"
+#include "hashtable.h"
 
 MODULE_TYPE_OUTPUT
 MODULE_TYPE_NOKEEP
@@ -81,46 +82,37 @@ static rsRetVal resetConfigVariables(uchar __attribute__((unused)) *pp, void __a
 DEF_OMOD_STATIC_DATA
 DEFobjCurrIf(errmsg)
 DEFobjCurrIf(strm)
-
-/* for our current LRU mechanism, we need a monotonically increasing counters. We use
- * it much like a "Lamport logical clock": we do not need the actual time, we just need
- * to know the sequence in which files were accessed. So we use a simple counter to
- * create that sequence. We use an unsigned 64 bit value which is extremely unlike to
- * wrap within the lifetime of a process. If we process 1,000,000 file writes per
- * second, the process could still exist over 500,000 years before a wrap to 0 happens.
- * That should be sufficient (and even than, there would no really bad effect ;)).
- * The variable below is the global counter/clock.
- */
-#if HAVE_ATOMIC_BUILTINS_64BIT
-static uint64 clockFileAccess = 0;
-#else
-static unsigned clockFileAccess = 0;
-#endif
-/* and the "tick" function */
-#ifndef HAVE_ATOMIC_BUILTINS
-static pthread_mutex_t mutClock;
-#endif
-static inline uint64
-getClockFileAccess(void)
-{
-#if HAVE_ATOMIC_BUILTINS_64BIT
-	return ATOMIC_INC_AND_FETCH_uint64(&clockFileAccess, &mutClock);
-#else
-	return ATOMIC_INC_AND_FETCH_unsigned(&clockFileAccess, &mutClock);
-#endif
-}
+DEFobjCurrIf(statsobj)
 
 
 /* The following structure is a dynafile name cache entry.
  */
 struct s_dynaFileCacheEntry {
-	uchar *pName;		/* name currently open, if dynamic name */
+	uchar *pName;		/* name currently open (also the hash table key, owned by it) */
 	strm_t	*pStrm;		/* our output stream */
-	uint64	clkTickAccessed;/* for LRU - based on clockFileAccess */
+	struct s_dynaFileCacheEntry *pPrev; /* LRU list, most recently used first */
+	struct s_dynaFileCacheEntry *pNext;
 };
 typedef struct s_dynaFileCacheEntry dynaFileCacheEntry;
 
 
+/* A writer shard for sharded dynafile writing. The file names are hashed
+ * to the shards, each of which has its own part of the dynafile cache
+ * and its own thread. So writes to different files run in parallel,
+ * while all messages for one file are written by the same shard and
+ * thus stay in order.
+ */
+typedef struct dynaShard_s {
+	struct _instanceData *pOwner;	/* the action this shard belongs to */
+	struct _instanceData *pData;	/* settings (copied from owner), cache and streams */
+	pthread_t thrdID;
+	unsigned iStartGen;		/* batch generation at thread creation, the thread waits for the next one */
+	int	*pIdx;			/* batch elements to be written by this shard */
+	int	nIdx;
+	int	sizeIdx;
+} dynaShard_t;
+
+
 #define IOBUF_DFLT_SIZE 4096	/* default size for io buffers */
 #define FLUSH_INTRVL_DFLT 1 	/* default buffer flush interval (in seconds) */
 #define USE_ASYNCWRITER_DFLT 0 	/* default buffer use async writer */
@@ -136,22 +128,55 @@ typedef struct _instanceData {
 	int	fDirCreateMode;	/* creation mode for mkdir() */
 	int	bCreateDirs;	/* auto-create directories? */
 	int	bSyncFile;	/* should the file by sync()'ed? 1- yes, 0- no */
+	sbool	bGroupSync;	/* sync at end of transaction via the group commit coordinator */
 	uid_t	fileUID;	/* IDs for creation */
 	uid_t	dirUID;
 	gid_t	fileGID;
 	gid_t	dirGID;
 	int	bFailOnChown;	/* fail creation if chown fails? */
-	int	iCurrElt;	/* currently active cache element (-1 = none) */
-	int	iCurrCacheSize;	/* currently cache size (1-based) */
+	int	iCurrCacheSize;	/* current number of cache entries */
 	int	iDynaFileCacheSize; /* size of file handle cache */
-	/* The cache is implemented as an array. An empty element is indicated
-	 * by a NULL pointer. Memory is allocated as needed. The following
-	 * pointer points to the overall structure.
+	/* The cache is a hash table (file name -> entry) for the lookup plus a
+	 * doubly linked list of all entries in LRU order, so that both finding
+	 * a file and evicting the least recently used one do not depend on the
+	 * cache size.
 	 */
-	dynaFileCacheEntry **dynCache;
+	struct hashtable *dynCache;
+	dynaFileCacheEntry *pLRUHead;	/* most recently used */
+	dynaFileCacheEntry *pLRUTail;	/* least recently used, evicted first */
+	dynaFileCacheEntry *pCurrElt;	/* currently active cache element (NULL = none) */
+	statsobj_t *stats;		/* dynafile cache statistics */
+	STATSCOUNTER_DEF(ctrHit, mutCtrHit);
+	STATSCOUNTER_DEF(ctrMiss, mutCtrMiss);
+	STATSCOUNTER_DEF(ctrEvict, mutCtrEvict);
+	intctr_t ctrOpenTime;		/* microseconds spent opening files */
+	intctr_t ctrCloseTime;		/* microseconds spent closing files */
+	/* following fields for sharded dynafile writing */
+	int	nShards;		/* number of writer shards, 0 - not sharded */
+	dynaShard_t *pShards;
+	int	nShardThrds;		/* number of shard threads running */
+	pthread_mutex_t mutShards;
+	pthread_cond_t condShardWork;	/* a new batch is to be written */
+	pthread_cond_t condShardDone;	/* a shard has written its part of the batch */
+	unsigned iShardGen;		/* incremented for each batch */
+	int	nShardsBusy;		/* shards still working on the current batch */
+	sbool	bShardsTerminate;
+	sbool	bShardSuspended;	/* a shard returned RS_RET_SUSPENDED */
+	void	***pppShardParams;	/* the batch currently being written */
+	unsigned *piShardMsgOpts;
+	rsRetVal *pShardRetElem;
 	off_t	iSizeLimit;		/* file size limit, 0 = no limit */
 	uchar	*pszSizeLimitCmd;	/* command to carry out when size limit is reached */
 	int 	iZipLevel;		/* zip mode to use for this selector */
+	int	iZipThreads;		/* number of blocks to compress in parallel, 0 - inline */
+	sbool	bZipIndex;		/* write a block index sidecar file? */
+	int64	iRotateSize;		/* native rotation: size, 0 - off */
+	int	iRotateInterval;	/* native rotation: interval in seconds, 0 - off */
+	int	iRotateKeep;		/* native rotation: generations to keep */
+	sbool	bRotateCompress;	/* native rotation: gzip rotated files */
+	int64	iPreallocSize;		/* preallocate file space in chunks of this size */
+	int64	iSyncRangeSize;		/* start writeback every n bytes */
+	sbool	bDropCache;		/* drop written data from the page cache */
 	int	iIOBufSize;		/* size of associated io buffer */
 	int	iFlushInterval;		/* how fast flush buffer on inactivity? */
 	sbool	bFlushOnTXEnd;		/* flush write buffers when transaction has ended? */
@@ -161,6 +186,7 @@ typedef struct _instanceData {
 
 typedef struct configSettings_s {
 	int iDynaFileCacheSize; /* max cache for dynamic files */
+	int iDynaFileShards;	/* number of writer shards for dynamic files */
 	int fCreateMode; /* mode to use when creating files */
 	int fDirCreateMode; /* mode to use when creating files */
 	int	bFailOnChown;	/* fail if chown fails? */
@@ -170,7 +196,17 @@ typedef struct configSettings_s {
 	uid_t	dirGID;		/* GID to be used for newly created directories */
 	int	bCreateDirs;/* auto-create directories for dynaFiles: 0 - no, 1 - yes */
 	int	bEnableSync;/* enable syncing of files (no dash in front of pathname in conf): 0 - no, 1 - yes */
+	int	bGroupSync;	/* sync files in group commit mode? */
 	int	iZipLevel;	/* zip compression mode (0..9 as usual) */
+	int	iZipThreads;	/* number of blocks to compress in parallel */
+	int	bZipIndex;	/* write a block index for zipped files? */
+	int64	iRotateSize;	/* rotate files at this size, 0 - never */
+	int	iRotateInterval;/* rotate files every n seconds, 0 - never */
+	int	iRotateKeep;	/* number of rotated generations to keep */
+	int	bRotateCompress;/* compress rotated files? */
+	int64	iPreallocSize;	/* preallocation chunk size, 0 - off */
+	int64	iSyncRangeSize;	/* writeback chunk size, 0 - off */
+	int	bDropCache;	/* drop written data from page cache? */
 	sbool	bFlushOnTXEnd;/* flush write buffers when transaction has ended? */
 	int64	iIOBufSize;	/* size of an io buffer */
 	int	iFlushInterval; 	/* how often flush the output buffer on inactivity? */
@@ -202,7 +238,18 @@ static struct cnfparamblk modpblk =
 /* action (instance) parameters */
 static struct cnfparamdescr actpdescr[] = {
 	{ "dynafilecachesize", eCmdHdlrInt, 0 }, /* legacy: dynafilecachesize */
+	{ "dynafileshards", eCmdHdlrInt, 0 }, /* legacy: omfiledynafileshards */
 	{ "ziplevel", eCmdHdlrInt, 0 }, /* legacy: omfileziplevel */
+	{ "zipthreads", eCmdHdlrInt, 0 }, /* legacy: omfilezipthreads */
+	{ "zipindex", eCmdHdlrBinary, 0 }, /* legacy: omfilezipindex */
+	{ "rotatesize", eCmdHdlrSize, 0 }, /* legacy: omfilerotatesize */
+	{ "rotateinterval", eCmdHdlrInt, 0 }, /* legacy: omfilerotateinterval */
+	{ "rotatekeep", eCmdHdlrInt, 0 }, /* legacy: omfilerotatekeep */
+	{ "rotatecompress", eCmdHdlrBinary, 0 }, /* legacy: omfilerotatecompress */
+	{ "preallocsize", eCmdHdlrSize, 0 }, /* legacy: omfilepreallocsize */
+	{ "syncrangesize", eCmdHdlrSize, 0 }, /* legacy: omfilesyncrangesize */
+	{ "dropcache", eCmdHdlrBinary, 0 }, /* legacy: omfiledropcache */
+	{ "groupsync", eCmdHdlrBinary, 0 }, /* legacy: omfilegroupsync */
 	{ "flushinterval", eCmdHdlrInt, 0 }, /* legacy: omfileflushinterval */
 	{ "asyncwriting", eCmdHdlrBinary, 0 }, /* legacy: omfileasyncwriting */
 	{ "flushontxend", eCmdHdlrBinary, 0 }, /* legacy: omfileflushontxend */
@@ -269,6 +316,7 @@ CODESTARTdbgPrintInstInfo
 	dbgprintf("\tflush on TX end=%d\n", pData->bFlushOnTXEnd);
 	dbgprintf("\tflush interval=%d\n", pData->iFlushInterval);
 	dbgprintf("\tfile cache size=%d\n", pData->iDynaFileCacheSize);
+	dbgprintf("\tdynafile writer shards=%d\n", pData->nShards);
 	dbgprintf("\tcreate directories: %s\n", pData->bCreateDirs ? "yes" : "no");
 	dbgprintf("\tfile owner %d, group %d\n", (int) pData->fileUID, (int) pData->fileGID);
 	dbgprintf("\tdirectory owner %d, group %d\n", (int) pData->dirUID, (int) pData->dirGID);
@@ -397,43 +445,75 @@ finalize_it:
 }
 
 
-/* This function deletes an entry from the dynamic file name
- * cache. A pointer to the cache must be passed in as well
- * as the index of the to-be-deleted entry. This index may
- * point to an unallocated entry, in whcih case the
- * function immediately returns. Parameter bFreeEntry is 1
- * if the entry should be d_free()ed and 0 if not.
- */
-static rsRetVal
-dynaFileDelCacheEntry(dynaFileCacheEntry **pCache, int iEntry, int bFreeEntry)
+/* microseconds elapsed since tvStart, for the open/close cost counters */
+static inline intctr_t
+usecsSince(struct timeval *tvStart)
 {
-	DEFiRet;
-	ASSERT(pCache != NULL);
+	struct timeval tvNow;
 
-	if(pCache[iEntry] == NULL)
-		FINALIZE;
+	gettimeofday(&tvNow, NULL);
+	return (intctr_t) (tvNow.tv_sec - tvStart->tv_sec) * 1000000
+	       + tvNow.tv_usec - tvStart->tv_usec;
+}
 
-	DBGPRINTF("Removed entry %d for file '%s' from dynaCache.\n", iEntry,
-		pCache[iEntry]->pName == NULL ? UCHAR_CONSTANT("[OPEN FAILED]") : pCache[iEntry]->pName);
 
-	if(pCache[iEntry]->pName != NULL) {
-		d_free(pCache[iEntry]->pName);
-		pCache[iEntry]->pName = NULL;
-	}
+/* helpers for the LRU list of the dynafile cache */
+static inline void
+dynaFileLRUUnlink(instanceData *pData, dynaFileCacheEntry *pEntry)
+{
+	if(pEntry->pPrev == NULL)
+		pData->pLRUHead = pEntry->pNext;
+	else
+		pEntry->pPrev->pNext = pEntry->pNext;
+	if(pEntry->pNext == NULL)
+		pData->pLRUTail = pEntry->pPrev;
+	else
+		pEntry->pNext->pPrev = pEntry->pPrev;
+	pEntry->pPrev = NULL;
+	pEntry->pNext = NULL;
+}
 
-	if(pCache[iEntry]->pStrm != NULL) {
-		strm.Destruct(&pCache[iEntry]->pStrm);
-		if(pCache[iEntry]->pStrm != NULL) /* safety check -- TODO: remove if no longer necessary */
-			abort();
-	}
+static inline void
+dynaFileLRUPushFront(instanceData *pData, dynaFileCacheEntry *pEntry)
+{
+	pEntry->pPrev = NULL;
+	pEntry->pNext = pData->pLRUHead;
+	if(pData->pLRUHead == NULL)
+		pData->pLRUTail = pEntry;
+	else
+		pData->pLRUHead->pPrev = pEntry;
+	pData->pLRUHead = pEntry;
+}
 
-	if(bFreeEntry) {
-		d_free(pCache[iEntry]);
-		pCache[iEntry] = NULL;
-	}
 
-finalize_it:
-	RETiRet;
+/* This function deletes an entry from the dynamic file name
+ * cache, closes its file and frees it.
+ */
+static void
+dynaFileDelCacheEntry(instanceData *pData, dynaFileCacheEntry *pEntry)
+{
+	struct timeval tvStart;
+
+	ASSERT(pEntry != NULL);
+	DBGPRINTF("Removed entry for file '%s' from dynaCache.\n", pEntry->pName);
+
+	if(pData->pCurrElt == pEntry)
+		pData->pCurrElt = NULL;
+	if(pData->pStrm == pEntry->pStrm)
+		pData->pStrm = NULL;
+
+	dynaFileLRUUnlink(pData, pEntry);
+	hashtable_remove(pData->dynCache, pEntry->pName); /* also frees pName (the key) */
+	--pData->iCurrCacheSize;
+
+	if(pEntry->pStrm != NULL) {
+		if(GatherStats)
+			gettimeofday(&tvStart, NULL);
+		strm.Destruct(&pEntry->pStrm);
+		if(GatherStats)
+			pData->ctrCloseTime += usecsSince(&tvStart);
+	}
+	free(pEntry);
 }
 
 
@@ -444,14 +524,11 @@ finalize_it:
 static inline void
 dynaFileFreeCacheEntries(instanceData *pData)
 {
-	register int i;
 	ASSERT(pData != NULL);
 
 	BEGINfunc;
-	for(i = 0 ; i < pData->iCurrCacheSize ; ++i) {
-		dynaFileDelCacheEntry(pData->dynCache, i, 1);
-	}
-	pData->iCurrElt = -1; /* invalidate current element */
+	while(pData->pLRUHead != NULL)
+		dynaFileDelCacheEntry(pData, pData->pLRUHead);
 	ENDfunc;
 }
 
@@ -463,13 +540,63 @@ static void dynaFileFreeCache(instanceData *pData)
 	ASSERT(pData != NULL);
 
 	BEGINfunc;
-	dynaFileFreeCacheEntries(pData);
-	if(pData->dynCache != NULL)
-		d_free(pData->dynCache);
+	if(pData->dynCache != NULL) {
+		dynaFileFreeCacheEntries(pData);
+		hashtable_destroy(pData->dynCache, 0);
+	}
+	if(pData->stats != NULL)
+		statsobj.Destruct(&pData->stats);
 	ENDfunc;
 }
 
 
+/* create the dynamic file name cache and its statistics counters. iShard
+ * is the number of the writer shard the cache belongs to, -1 if not sharded.
+ */
+static rsRetVal
+dynaFileInitCache(instanceData *pData, int iShard)
+{
+	uchar ctrName[512];
+	DEFiRet;
+
+	pData->iCurrCacheSize = 0;
+	pData->pLRUHead = NULL;
+	pData->pLRUTail = NULL;
+	pData->pCurrElt = NULL;
+	CHKmalloc(pData->dynCache = create_hashtable(pData->iDynaFileCacheSize,
+						     hash_from_string, key_equals_string, NULL));
+
+	if(iShard == -1)
+		snprintf((char*) ctrName, sizeof(ctrName), "dynafile cache %s", pData->f_fname);
+	else
+		snprintf((char*) ctrName, sizeof(ctrName), "dynafile cache %s shard %d",
+			 pData->f_fname, iShard);
+	ctrName[sizeof(ctrName)-1] = '\0'; /* be on the safe side */
+	CHKiRet(statsobj.Construct(&pData->stats));
+	CHKiRet(statsobj.SetName(pData->stats, ctrName));
+	STATSCOUNTER_INIT(pData->ctrHit, pData->mutCtrHit);
+	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("hits"),
+		ctrType_IntCtr, &pData->ctrHit));
+	STATSCOUNTER_INIT(pData->ctrMiss, pData->mutCtrMiss);
+	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("misses"),
+		ctrType_IntCtr, &pData->ctrMiss));
+	STATSCOUNTER_INIT(pData->ctrEvict, pData->mutCtrEvict);
+	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("evicted"),
+		ctrType_IntCtr, &pData->ctrEvict));
+	/* the time counters are only modified while the action is locked */
+	pData->ctrOpenTime = 0;
+	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("opentime.us"),
+		ctrType_IntCtr, &pData->ctrOpenTime));
+	pData->ctrCloseTime = 0;
+	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("closetime.us"),
+		ctrType_IntCtr, &pData->ctrCloseTime));
+	CHKiRet(statsobj.ConstructFinalize(pData->stats));
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* This is now shared code for all types of files. It simply prepares
  * file access, which, among others, means the the file wil be opened
  * and any directories in between will be created (based on config, of
@@ -536,10 +663,20 @@ prepareFile(instanceData *pData, uchar *newFileName)
 	CHKiRet(strm.SetFName(pData->pStrm, szBaseName, ustrlen(szBaseName)));
 	CHKiRet(strm.SetDir(pData->pStrm, szDirName, ustrlen(szDirName)));
 	CHKiRet(strm.SetiZipLevel(pData->pStrm, pData->iZipLevel));
+	CHKiRet(strm.SetiZipThreads(pData->pStrm, pData->iZipThreads));
+	CHKiRet(strm.SetbZipIndex(pData->pStrm, pData->bZipIndex));
+	CHKiRet(strm.SetiRotateSize(pData->pStrm, pData->iRotateSize));
+	CHKiRet(strm.SetiRotateInterval(pData->pStrm, pData->iRotateInterval));
+	CHKiRet(strm.SetiRotateKeep(pData->pStrm, pData->iRotateKeep));
+	CHKiRet(strm.SetbRotateCompress(pData->pStrm, pData->bRotateCompress));
+	CHKiRet(strm.SetiPreallocSize(pData->pStrm, pData->iPreallocSize));
+	CHKiRet(strm.SetiSyncRangeSize(pData->pStrm, pData->iSyncRangeSize));
+	CHKiRet(strm.SetbDropCache(pData->pStrm, pData->bDropCache));
 	CHKiRet(strm.SetsIOBufSize(pData->pStrm, (size_t) pData->iIOBufSize));
 	CHKiRet(strm.SettOperationsMode(pData->pStrm, STREAMMODE_WRITE_APPEND));
 	CHKiRet(strm.SettOpenMode(pData->pStrm, cs.fCreateMode));
 	CHKiRet(strm.SetbSync(pData->pStrm, pData->bSyncFile));
+	CHKiRet(strm.SetbGroupSync(pData->pStrm, pData->bGroupSync));
 	CHKiRet(strm.SetsType(pData->pStrm, STREAMTYPE_FILE_SINGLE));
 	CHKiRet(strm.SetiSizeLimit(pData->pStrm, pData->iSizeLimit));
 	/* set the flush interval only if we actually use it - otherwise it will activate
@@ -573,65 +710,46 @@ finalize_it:
 static inline rsRetVal
 prepareDynFile(instanceData *pData, uchar *newFileName, unsigned iMsgOpts)
 {
-	uint64 ctOldest; /* "timestamp" of oldest element */
-	int iOldest;
-	int i;
-	int iFirstFree;
+	dynaFileCacheEntry *pEntry;
+	uchar *pKey;
+	struct timeval tvStart;
 	rsRetVal localRet;
-	dynaFileCacheEntry **pCache;
 	DEFiRet;
 
 	ASSERT(pData != NULL);
 	ASSERT(newFileName != NULL);
 
-	pCache = pData->dynCache;
-
 	/* first check, if we still have the current file
 	 * I *hope* this will be a performance enhancement.
+	 * Note that the current element always is the head of the LRU list.
 	 */
-	if(   (pData->iCurrElt != -1)
-	   && !ustrcmp(newFileName, pCache[pData->iCurrElt]->pName)) {
+	if(   (pData->pCurrElt != NULL)
+	   && !ustrcmp(newFileName, pData->pCurrElt->pName)) {
 	   	/* great, we are all set */
-		pCache[pData->iCurrElt]->clkTickAccessed = getClockFileAccess();
-		// LRU needs only a strictly monotonically increasing counter, so such a one could do
+		STATSCOUNTER_INC(pData->ctrHit, pData->mutCtrHit);
 		FINALIZE;
 	}
 
-	/* ok, no luck. Now let's search the table if we find a matching spot.
-	 * While doing so, we also prepare for creation of a new one.
-	 */
-	pData->iCurrElt = -1;	/* invalid current element pointer */
-	iFirstFree = -1; /* not yet found */
-	iOldest = 0; /* we assume the first element to be the oldest - that will change as we loop */
-	ctOldest = getClockFileAccess(); /* there must always be an older one */
-	for(i = 0 ; i < pData->iCurrCacheSize ; ++i) {
-		if(pCache[i] == NULL || pCache[i]->pName == NULL) {
-			if(iFirstFree == -1)
-				iFirstFree = i;
-		} else { /* got an element, let's see if it matches */
-			if(!ustrcmp(newFileName, pCache[i]->pName)) {  // RG:  name == NULL?
-				/* we found our element! */
-				pData->pStrm = pCache[i]->pStrm;
-				pData->iCurrElt = i;
-				pCache[i]->clkTickAccessed = getClockFileAccess(); /* update "timestamp" for LRU */
-				FINALIZE;
-			}
-			/* did not find it - so lets keep track of the counters for LRU */
-			if(pCache[i]->clkTickAccessed < ctOldest) {
-				ctOldest = pCache[i]->clkTickAccessed;
-				iOldest = i;
-				}
-		}
+	/* ok, no luck. Now let's see if the file is in the cache. */
+	pEntry = (dynaFileCacheEntry*) hashtable_search(pData->dynCache, newFileName);
+	if(pEntry != NULL) {
+		STATSCOUNTER_INC(pData->ctrHit, pData->mutCtrHit);
+		dynaFileLRUUnlink(pData, pEntry);
+		dynaFileLRUPushFront(pData, pEntry);
+		pData->pStrm = pEntry->pStrm;
+		pData->pCurrElt = pEntry;
+		FINALIZE;
 	}
 
 	/* we have not found an entry */
+	STATSCOUNTER_INC(pData->ctrMiss, pData->mutCtrMiss);
 
-	/* invalidate iCurrElt as we may error-exit out of this function when the currrent
-	 * iCurrElt has been freed or otherwise become unusable. This is a precaution, and
+	/* invalidate pCurrElt as we may error-exit out of this function when the currrent
+	 * pCurrElt has been freed or otherwise become unusable. This is a precaution, and
 	 * performance-wise it may be better to do that in each of the exits. However, that
 	 * is error-prone, so I prefer to do it here. -- rgerhards, 2010-03-02
 	 */
-	pData->iCurrElt = -1;
+	pData->pCurrElt = NULL;
 	/* similarly, we need to set the current pStrm to NULL, because otherwise, if prepareFile() fails,
 	 * we may end up using an old stream. This bug depends on how exactly prepareFile fails,
 	 * but it could be triggered in the common case of a failed open() system call.
@@ -639,28 +757,21 @@ prepareDynFile(instanceData *pData, uchar *newFileName, unsigned iMsgOpts)
 	 */
 	pData->pStrm = NULL;
 
-	if(iFirstFree == -1 && (pData->iCurrCacheSize < pData->iDynaFileCacheSize)) {
-		/* there is space left, so set it to that index */
-		iFirstFree = pData->iCurrCacheSize++;
+	if(pData->iCurrCacheSize >= pData->iDynaFileCacheSize) {
+		/* cache is full, evict the least recently used file */
+		STATSCOUNTER_INC(pData->ctrEvict, pData->mutCtrEvict);
+		dynaFileDelCacheEntry(pData, pData->pLRUTail);
 	}
 
 	/* Note that the following code sequence does not work with the cache entry itself,
 	 * but rather with pData->pStrm, the (sole) stream pointer in the non-dynafile case.
-	 * The cache array is only updated after the open was successful. -- rgerhards, 2010-03-21
+	 * The cache is only updated after the open was successful. -- rgerhards, 2010-03-21
 	 */
-	if(iFirstFree == -1) {
-		dynaFileDelCacheEntry(pCache, iOldest, 0);
-		iFirstFree = iOldest; /* this one *is* now free ;) */
-	} else {
-		/* we need to allocate memory for the cache structure */
-		/* TODO: performance note: we could alloc all entries on startup, thus saving malloc
-		 *       overhead -- this may be something to consider in v5...
-		 */
-		CHKmalloc(pCache[iFirstFree] = (dynaFileCacheEntry*) calloc(1, sizeof(dynaFileCacheEntry)));
-	}
-
-	/* Ok, we finally can open the file */
+	if(GatherStats)
+		gettimeofday(&tvStart, NULL);
 	localRet = prepareFile(pData, newFileName); /* ignore exact error, we check fd below */
+	if(GatherStats)
+		pData->ctrOpenTime += usecsSince(&tvStart);
 
 	/* check if we had an error */
 	if(localRet != RS_RET_OK) {
@@ -677,14 +788,21 @@ prepareDynFile(instanceData *pData, uchar *newFileName, unsigned iMsgOpts)
 		ABORT_FINALIZE(localRet);
 	}
 
-	if((pCache[iFirstFree]->pName = ustrdup(newFileName)) == NULL) {
+	pKey = NULL;
+	if(   (pEntry = (dynaFileCacheEntry*) calloc(1, sizeof(dynaFileCacheEntry))) == NULL
+	   || (pKey = ustrdup(newFileName)) == NULL
+	   || !hashtable_insert(pData->dynCache, pKey, pEntry)) {
+		free(pKey);
+		free(pEntry);
 		strm.Destruct(&pData->pStrm); /* need to free failed entry! */
 		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
 	}
-	pCache[iFirstFree]->pStrm = pData->pStrm;
-	pCache[iFirstFree]->clkTickAccessed = getClockFileAccess();
-	pData->iCurrElt = iFirstFree;
-	DBGPRINTF("Added new entry %d for file cache, file '%s'.\n", iFirstFree, newFileName);
+	pEntry->pName = pKey;
+	pEntry->pStrm = pData->pStrm;
+	dynaFileLRUPushFront(pData, pEntry);
+	++pData->iCurrCacheSize;
+	pData->pCurrElt = pEntry;
+	DBGPRINTF("Added new entry for file cache, file '%s'.\n", newFileName);
 
 finalize_it:
 	RETiRet;
@@ -694,18 +812,20 @@ finalize_it:
 /* do the actual write process. This function is to be called once we are ready for writing.
  * It will do buffered writes and persist data only when the buffer is full. Note that we must
  * be careful to detect when the file handle changed.
+ * The message is passed as scatter list (see tplToIovec()), so it is copied
+ * directly from the message properties into the stream buffer.
  * rgerhards, 2009-06-03
  */
 static  rsRetVal
-doWrite(instanceData *pData, uchar *pszBuf, int lenBuf)
+doWrite(instanceData *pData, tplIov_t *pIov)
 {
 	DEFiRet;
 	ASSERT(pData != NULL);
-	ASSERT(pszBuf != NULL);
+	ASSERT(pIov != NULL);
 
-	DBGPRINTF("write to stream, pData->pStrm %p, lenBuf %d\n", pData->pStrm, lenBuf);
+	DBGPRINTF("write to stream, pData->pStrm %p, lenBuf %d\n", pData->pStrm, (int) pIov->lenTotal);
 	if(pData->pStrm != NULL){
-		CHKiRet(strm.Write(pData->pStrm, pszBuf, lenBuf));
+		CHKiRet(strm.WriteV(pData->pStrm, pIov->iov, pIov->nIov));
 		FINALIZE;
 	}
 
@@ -739,7 +859,261 @@ writeFile(uchar **ppString, unsigned iMsgOpts, instanceData *pData)
 		}
 	}
 
-	CHKiRet(doWrite(pData, ppString[0], strlen(CHAR_CONVERT(ppString[0]))));
+	CHKiRet(doWrite(pData, (tplIov_t*) ppString[0]));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* CODE FOR SHARDED DYNAFILE WRITING */
+
+/* select the shard for a file name */
+static inline dynaShard_t *
+dynaShardSelect(instanceData *pData, uchar *pszFName)
+{
+	return &pData->pShards[hash_from_string(pszFName) % pData->nShards];
+}
+
+
+/* the shard writer thread. It waits for a batch, writes the elements the
+ * action assigned to its shard and then reports back.
+ */
+static void *
+dynaShardThread(void *pArg)
+{
+	dynaShard_t *pShard = (dynaShard_t*) pArg;
+	instanceData *pData = pShard->pOwner;
+	unsigned iGen;
+	int i;
+	int iElt;
+	rsRetVal localRet;
+	sbool bSuspended;
+
+	pthread_mutex_lock(&pData->mutShards);
+	iGen = pShard->iStartGen;
+	while(1) {
+		while(iGen == pData->iShardGen && !pData->bShardsTerminate)
+			pthread_cond_wait(&pData->condShardWork, &pData->mutShards);
+		if(pData->bShardsTerminate)
+			break;
+		iGen = pData->iShardGen;
+		pthread_mutex_unlock(&pData->mutShards);
+
+		bSuspended = 0;
+		for(i = 0 ; i < pShard->nIdx ; ++i) {
+			iElt = pShard->pIdx[i];
+			localRet = writeFile((uchar**) pData->pppShardParams[iElt],
+					     pData->piShardMsgOpts[iElt], pShard->pData);
+			if(localRet == RS_RET_SUSPENDED) {
+				/* this and all following elements of the shard stay unprocessed */
+				bSuspended = 1;
+				break;
+			}
+			pData->pShardRetElem[iElt] = (localRet == RS_RET_OK) ? RS_RET_DEFER_COMMIT : localRet;
+		}
+
+		pthread_mutex_lock(&pData->mutShards);
+		if(bSuspended)
+			pData->bShardSuspended = 1;
+		if(--pData->nShardsBusy == 0)
+			pthread_cond_signal(&pData->condShardDone);
+	}
+	pthread_mutex_unlock(&pData->mutShards);
+	return NULL;
+}
+
+
+/* set up the writer shards of a dynafile action. Each one gets a copy of
+ * the action's settings and its part of the dynafile cache. The threads are
+ * started only when the first batch is written, as we must not create them
+ * before rsyslogd has forked.
+ */
+static rsRetVal
+dynaShardsConstruct(instanceData *pData)
+{
+	instanceData *pShardData;
+	int i;
+	DEFiRet;
+
+	pthread_mutex_init(&pData->mutShards, NULL);
+	pthread_cond_init(&pData->condShardWork, NULL);
+	pthread_cond_init(&pData->condShardDone, NULL);
+	CHKmalloc(pData->pShards = (dynaShard_t*) calloc(pData->nShards, sizeof(dynaShard_t)));
+	for(i = 0 ; i < pData->nShards ; ++i) {
+		pData->pShards[i].pOwner = pData;
+		CHKmalloc(pShardData = (instanceData*) malloc(sizeof(instanceData)));
+		memcpy(pShardData, pData, sizeof(instanceData));
+		pShardData->nShards = 0;
+		pShardData->pShards = NULL;
+		pShardData->pStrm = NULL;
+		pShardData->dynCache = NULL;
+		pShardData->stats = NULL;
+		pShardData->iDynaFileCacheSize =
+			(pData->iDynaFileCacheSize + pData->nShards - 1) / pData->nShards;
+		pData->pShards[i].pData = pShardData;
+		CHKiRet(dynaFileInitCache(pShardData, i));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* set up the dynafile cache (or the shards, which have their own caches)
+ * for a newly created action.
+ */
+static rsRetVal
+dynaFileSetup(instanceData *pData)
+{
+	DEFiRet;
+
+	if(pData->nShards > 1) {
+		CHKiRet(dynaShardsConstruct(pData));
+	} else {
+		pData->nShards = 0;
+		CHKiRet(dynaFileInitCache(pData, -1));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+static rsRetVal
+dynaShardsStartThrds(instanceData *pData)
+{
+	DEFiRet;
+
+	while(pData->nShardThrds < pData->nShards) {
+		/* the thread must not pick up the generation itself: it may run only
+		 * after the batch it is started for has already been announced.
+		 */
+		pData->pShards[pData->nShardThrds].iStartGen = pData->iShardGen;
+		if(pthread_create(&pData->pShards[pData->nShardThrds].thrdID,
+#ifdef HAVE_PTHREAD_SETSCHEDPARAM
+				  &default_thread_attr,
+#else
+				  NULL,
+#endif
+				  dynaShardThread, &pData->pShards[pData->nShardThrds]) != 0) {
+			DBGPRINTF("omfile: could not create writer thread for shard %d\n", pData->nShardThrds);
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+		}
+		++pData->nShardThrds;
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+static void
+dynaShardsDestruct(instanceData *pData)
+{
+	int i;
+
+	if(pData->pShards == NULL)
+		return;
+
+	pthread_mutex_lock(&pData->mutShards);
+	pData->bShardsTerminate = 1;
+	pthread_cond_broadcast(&pData->condShardWork);
+	pthread_mutex_unlock(&pData->mutShards);
+	for(i = 0 ; i < pData->nShardThrds ; ++i)
+		pthread_join(pData->pShards[i].thrdID, NULL);
+
+	for(i = 0 ; i < pData->nShards ; ++i) {
+		if(pData->pShards[i].pData != NULL) {
+			dynaFileFreeCache(pData->pShards[i].pData);
+			free(pData->pShards[i].pData);
+		}
+		free(pData->pShards[i].pIdx);
+	}
+	free(pData->pShards);
+	pData->pShards = NULL;
+	pthread_mutex_destroy(&pData->mutShards);
+	pthread_cond_destroy(&pData->condShardWork);
+	pthread_cond_destroy(&pData->condShardDone);
+}
+
+
+/* hand the batch over to the shard threads and wait until all of them
+ * have finished. Returns 1 if a shard was suspended, 0 otherwise.
+ */
+static sbool
+dynaShardsRun(instanceData *pData, void ***pppParams, unsigned *piMsgOpts, rsRetVal *pRetElem)
+{
+	sbool bSuspended;
+
+	pthread_mutex_lock(&pData->mutShards);
+	pthread_cleanup_push(mutexCancelCleanup, &pData->mutShards);
+	pData->pppShardParams = pppParams;
+	pData->piShardMsgOpts = piMsgOpts;
+	pData->pShardRetElem = pRetElem;
+	pData->bShardSuspended = 0;
+	pData->nShardsBusy = pData->nShards;
+	++pData->iShardGen;
+	pthread_cond_broadcast(&pData->condShardWork);
+	while(pData->nShardsBusy > 0)
+		pthread_cond_wait(&pData->condShardDone, &pData->mutShards);
+	bSuspended = pData->bShardSuspended;
+	pthread_cleanup_pop(1);
+	return bSuspended;
+}
+
+
+/* report the elements already written as committed if the batch was
+ * suspended. Their data is in the stream buffers and must not be
+ * written again when the action retries the suspended elements.
+ */
+static inline void
+commitWrittenElems(int nElem, rsRetVal *pRetElem)
+{
+	int i;
+
+	for(i = 0 ; i < nElem ; ++i)
+		if(pRetElem[i] == RS_RET_DEFER_COMMIT)
+			pRetElem[i] = RS_RET_OK;
+}
+
+
+/* write a batch via the shards. The elements are distributed based on their
+ * file names and all shards write in parallel. We return once all of them
+ * are done, so that the per-element results are available to the caller.
+ * A suspended shard does not stop the others, so written elements may follow
+ * suspended ones in the batch.
+ */
+static rsRetVal
+dynaShardsWriteBatch(instanceData *pData, int nElem, void ***pppParams,
+		     unsigned *piMsgOpts, rsRetVal *pRetElem)
+{
+	dynaShard_t *pShard;
+	int *pNewIdx;
+	int iNewSize;
+	int i;
+	DEFiRet;
+
+	if(pData->nShardThrds < pData->nShards)
+		CHKiRet(dynaShardsStartThrds(pData));
+
+	for(i = 0 ; i < pData->nShards ; ++i)
+		pData->pShards[i].nIdx = 0;
+	for(i = 0 ; i < nElem ; ++i) {
+		pShard = dynaShardSelect(pData, ((uchar**) pppParams[i])[1]);
+		if(pShard->nIdx == pShard->sizeIdx) {
+			iNewSize = (pShard->sizeIdx == 0) ? 64 : pShard->sizeIdx * 2;
+			CHKmalloc(pNewIdx = (int*) realloc(pShard->pIdx, iNewSize * sizeof(int)));
+			pShard->pIdx = pNewIdx;
+			pShard->sizeIdx = iNewSize;
+		}
+		pShard->pIdx[pShard->nIdx++] = i;
+	}
+
+	if(dynaShardsRun(pData, pppParams, piMsgOpts, pRetElem)) {
+		commitWrittenElems(nElem, pRetElem);
+		iRet = RS_RET_SUSPENDED;
+	}
 
 finalize_it:
 	RETiRet;
@@ -823,6 +1197,7 @@ CODESTARTfreeInstance
 	free(pData->tplName);
 	free(pData->f_fname);
 	if(pData->bDynamicName) {
+		dynaShardsDestruct(pData);
 		dynaFileFreeCache(pData);
 	} else if(pData->pStrm != NULL)
 		strm.Destruct(&pData->pStrm);
@@ -839,29 +1214,109 @@ CODESTARTbeginTransaction
 ENDbeginTransaction
 
 
+/* request a sync for all streams of an instance (the static file or all
+ * cached dynafiles). The requests are added to pCtx.
+ */
+static void
+groupSyncRequestInst(instanceData *pData, strmSyncCtx_t *pCtx)
+{
+	dynaFileCacheEntry *pEntry;
+
+	if(pData->pStrm != NULL && !pData->bDynamicName)
+		strm.SyncRequest(pData->pStrm, pCtx);
+	for(pEntry = pData->pLRUHead ; pEntry != NULL ; pEntry = pEntry->pNext)
+		strm.SyncRequest(pEntry->pStrm, pCtx);
+}
+
+
+/* group commit: sync everything written by this action and wait until
+ * this is done. The sync coordinator serves the requests of all actions
+ * that arrive while it is busy in a single round, so concurrent
+ * transactions share the cost of syncing. Sync errors are ignored, just
+ * as in non-group mode.
+ */
+static void
+groupSync(instanceData *pData)
+{
+	strmSyncCtx_t syncCtx;
+	int i;
+
+	syncCtx.nPending = 0;
+	if(pData->nShards == 0) {
+		groupSyncRequestInst(pData, &syncCtx);
+	} else {
+		for(i = 0 ; i < pData->nShards ; ++i)
+			groupSyncRequestInst(pData->pShards[i].pData, &syncCtx);
+	}
+	strm.SyncWait(&syncCtx);
+}
+
+
 BEGINendTransaction
+	int i;
+	strm_t *pStrm;
 CODESTARTendTransaction
-	/* Note: pStrm may be NULL if there was an error opening the stream */
-	if(pData->bFlushOnTXEnd && pData->pStrm != NULL) {
-		CHKiRet(strm.Flush(pData->pStrm));
+	/* Note: pStrm may be NULL if there was an error opening the stream. The
+	 * shards are idle while we are called, so we can access their streams.
+	 */
+	if(pData->bFlushOnTXEnd) {
+		for(i = 0 ; i < ((pData->nShards == 0) ? 1 : pData->nShards) ; ++i) {
+			pStrm = (pData->nShards == 0) ? pData->pStrm : pData->pShards[i].pData->pStrm;
+			if(pStrm != NULL)
+				CHKiRet(strm.Flush(pStrm));
+		}
 	}
+	if(pData->bSyncFile && pData->bGroupSync)
+		groupSync(pData);
 finalize_it:
 ENDendTransaction
 
 
 BEGINdoAction
+	instanceData *pWrtData;
 CODESTARTdoAction
 	DBGPRINTF("file to log to: %s\n", pData->f_fname);
-	CHKiRet(writeFile(ppString, iMsgOpts, pData));
+	/* with shards, single messages are written by the caller's thread */
+	pWrtData = (pData->nShards == 0) ? pData : dynaShardSelect(pData, ppString[1])->pData;
+	CHKiRet(writeFile(ppString, iMsgOpts, pWrtData));
 	if(!bCoreSupportsBatching && pData->bFlushOnTXEnd) {
-		CHKiRet(strm.Flush(pData->pStrm));
+		CHKiRet(strm.Flush(pWrtData->pStrm));
 	}
+	if(!bCoreSupportsBatching && pData->bSyncFile && pData->bGroupSync)
+		groupSync(pData);
 finalize_it:
 	if(iRet == RS_RET_OK)
 		iRet = RS_RET_DEFER_COMMIT;
 ENDdoAction
 
 
+/* batch interface: all messages are written in one go. A message that
+ * cannot be written (e.g. because its dynafile cannot be opened) does not
+ * affect the others, so we continue with the next one in that case.
+ */
+BEGINdoActionBatch
+	int i;
+	rsRetVal localRet;
+CODESTARTdoActionBatch
+	DBGPRINTF("file to log to: %s, %d messages\n", pData->f_fname, nElem);
+	if(pData->nShards > 0) {
+		CHKiRet(dynaShardsWriteBatch(pData, nElem, pppParams, piMsgOpts, pRetElem));
+		FINALIZE;
+	}
+	for(i = 0 ; i < nElem ; ++i) {
+		localRet = writeFile((uchar**) pppParams[i], piMsgOpts[i], pData);
+		if(localRet == RS_RET_SUSPENDED) {
+			commitWrittenElems(i, pRetElem);
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+		}
+		pRetElem[i] = (localRet == RS_RET_OK) ? RS_RET_DEFER_COMMIT : localRet;
+	}
+finalize_it:
+	if(iRet == RS_RET_OK)
+		iRet = RS_RET_DEFER_COMMIT;
+ENDdoActionBatch
+
+
 static inline void
 setInstParamDefaults(instanceData *pData)
 {
@@ -873,11 +1328,22 @@ setInstParamDefaults(instanceData *pData)
 	pData->dirGID = -1;
 	pData->bFailOnChown = 1;
 	pData->iDynaFileCacheSize = 10;
+	pData->nShards = 0;
 	pData->fCreateMode = 0644;
 	pData->fDirCreateMode = 0700;
 	pData->bCreateDirs = 1;
 	pData->bSyncFile = 0;
 	pData->iZipLevel = 0;
+	pData->iZipThreads = 0;
+	pData->bZipIndex = 0;
+	pData->iRotateSize = 0;
+	pData->iRotateInterval = 0;
+	pData->iRotateKeep = STREAM_ROTATE_KEEP_DFLT;
+	pData->bRotateCompress = 0;
+	pData->iPreallocSize = 0;
+	pData->iSyncRangeSize = 0;
+	pData->bDropCache = 0;
+	pData->bGroupSync = 0;
 	pData->bFlushOnTXEnd = FLUSHONTX_DFLT;
 	pData->iIOBufSize = IOBUF_DFLT_SIZE;
 	pData->iFlushInterval = FLUSH_INTRVL_DFLT;
@@ -911,8 +1377,30 @@ CODESTARTnewActInst
 			continue;
 		if(!strcmp(actpblk.descr[i].name, "dynafilecachesize")) {
 			pData->iDynaFileCacheSize = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "dynafileshards")) {
+			pData->nShards = (int) pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "ziplevel")) {
 			pData->iZipLevel = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "zipthreads")) {
+			pData->iZipThreads = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "zipindex")) {
+			pData->bZipIndex = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "rotatesize")) {
+			pData->iRotateSize = pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "rotateinterval")) {
+			pData->iRotateInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "rotatekeep")) {
+			pData->iRotateKeep = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "rotatecompress")) {
+			pData->bRotateCompress = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "preallocsize")) {
+			pData->iPreallocSize = pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "syncrangesize")) {
+			pData->iSyncRangeSize = pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "dropcache")) {
+			pData->bDropCache = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "groupsync")) {
+			pData->bGroupSync = (int) pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "flushinterval")) {
 			pData->iFlushInterval = pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "asyncwriting")) {
@@ -962,7 +1450,7 @@ CODESTARTnewActInst
 	}
 
 	tplToUse = ustrdup((pData->tplName == NULL) ? getDfltTpl() : pData->tplName);
-	CHKiRet(OMSRsetEntry(*ppOMSR, 0, tplToUse, OMSR_NO_RQD_TPL_OPTS));
+	CHKiRet(OMSRsetEntry(*ppOMSR, 0, tplToUse, OMSR_TPL_AS_IOVEC));
 
 	if(pData->bDynamicName) {
 		/* "filename" is actually a template name, we need this as string 1. So let's add it
@@ -970,10 +1458,7 @@ CODESTARTnewActInst
 		 */
 		CHKiRet(OMSRsetEntry(*ppOMSR, 1, ustrdup(pData->f_fname), OMSR_NO_RQD_TPL_OPTS));
 		// TODO: create unified code for this (legacy+v6 system)
-		/* we now allocate the cache table */
-		CHKmalloc(pData->dynCache = (dynaFileCacheEntry**)
-				calloc(cs.iDynaFileCacheSize, sizeof(dynaFileCacheEntry*)));
-		pData->iCurrElt = -1;		  /* no current element */
+		CHKiRet(dynaFileSetup(pData));
 	}
 // TODO: add	pData->iSizeLimit = 0; /* default value, use outchannels to configure! */
 
@@ -1016,7 +1501,7 @@ CODESTARTparseSelectorAct
 		 * rgerhards, 2007-07-24: output-channels will go away. We keep them
 		 * for compatibility reasons, but seems to have been a bad idea.
 		 */
-		CHKiRet(cflineParseOutchannel(pData, p, *ppOMSR, 0, OMSR_NO_RQD_TPL_OPTS));
+		CHKiRet(cflineParseOutchannel(pData, p, *ppOMSR, 0, OMSR_TPL_AS_IOVEC));
 		pData->bDynamicName = 0;
 		break;
 
@@ -1025,23 +1510,19 @@ CODESTARTparseSelectorAct
 		   */
 		CODE_STD_STRING_REQUESTparseSelectorAct(2)
 		++p; /* eat '?' */
-		CHKiRet(cflineParseFileName(p, fname, *ppOMSR, 0, OMSR_NO_RQD_TPL_OPTS, getDfltTpl()));
+		CHKiRet(cflineParseFileName(p, fname, *ppOMSR, 0, OMSR_TPL_AS_IOVEC, getDfltTpl()));
 		pData->f_fname = ustrdup(fname);
 		pData->bDynamicName = 1;
-		pData->iCurrElt = -1;		  /* no current element */
 		/* "filename" is actually a template name, we need this as string 1. So let's add it
 		 * to the pOMSR. -- rgerhards, 2007-07-27
 		 */
 		CHKiRet(OMSRsetEntry(*ppOMSR, 1, ustrdup(pData->f_fname), OMSR_NO_RQD_TPL_OPTS));
-		/* we now allocate the cache table */
-		CHKmalloc(pData->dynCache = (dynaFileCacheEntry**)
-				calloc(cs.iDynaFileCacheSize, sizeof(dynaFileCacheEntry*)));
 		break;
 
 	case '/':
 	case '.':
 		CODE_STD_STRING_REQUESTparseSelectorAct(1)
-		CHKiRet(cflineParseFileName(p, fname, *ppOMSR, 0, OMSR_NO_RQD_TPL_OPTS, getDfltTpl()));
+		CHKiRet(cflineParseFileName(p, fname, *ppOMSR, 0, OMSR_TPL_AS_IOVEC, getDfltTpl()));
 		pData->f_fname = ustrdup(fname);
 		pData->bDynamicName = 0;
 		break;
@@ -1051,6 +1532,7 @@ CODESTARTparseSelectorAct
 
 	/* freeze current paremeters for this action */
 	pData->iDynaFileCacheSize = cs.iDynaFileCacheSize;
+	pData->nShards = cs.iDynaFileShards;
 	pData->fCreateMode = cs.fCreateMode;
 	pData->fDirCreateMode = cs.fDirCreateMode;
 	pData->bCreateDirs = cs.bCreateDirs;
@@ -1060,10 +1542,24 @@ CODESTARTparseSelectorAct
 	pData->dirUID = cs.dirUID;
 	pData->dirGID = cs.dirGID;
 	pData->iZipLevel = cs.iZipLevel;
+	pData->iZipThreads = cs.iZipThreads;
+	pData->bZipIndex = cs.bZipIndex;
+	pData->iRotateSize = cs.iRotateSize;
+	pData->iRotateInterval = cs.iRotateInterval;
+	pData->iRotateKeep = cs.iRotateKeep;
+	pData->bRotateCompress = cs.bRotateCompress;
+	pData->iPreallocSize = cs.iPreallocSize;
+	pData->iSyncRangeSize = cs.iSyncRangeSize;
+	pData->bDropCache = cs.bDropCache;
+	pData->bGroupSync = cs.bGroupSync;
 	pData->bFlushOnTXEnd = cs.bFlushOnTXEnd;
 	pData->iIOBufSize = (int) cs.iIOBufSize;
 	pData->iFlushInterval = cs.iFlushInterval;
 	pData->bUseAsyncWriter = cs.bUseAsyncWriter;
+	if(pData->bDynamicName) {
+		/* we now allocate the cache table */
+		CHKiRet(dynaFileSetup(pData));
+	}
 CODE_STD_FINALIZERparseSelectorAct
 ENDparseSelectorAct
 
@@ -1079,11 +1575,22 @@ static rsRetVal resetConfigVariables(uchar __attribute__((unused)) *pp, void __a
 	cs.dirGID = -1;
 	cs.bFailOnChown = 1;
 	cs.iDynaFileCacheSize = 10;
+	cs.iDynaFileShards = 0;
 	cs.fCreateMode = 0644;
 	cs.fDirCreateMode = 0700;
 	cs.bCreateDirs = 1;
 	cs.bEnableSync = 0;
 	cs.iZipLevel = 0;
+	cs.iZipThreads = 0;
+	cs.bZipIndex = 0;
+	cs.iRotateSize = 0;
+	cs.iRotateInterval = 0;
+	cs.iRotateKeep = STREAM_ROTATE_KEEP_DFLT;
+	cs.bRotateCompress = 0;
+	cs.iPreallocSize = 0;
+	cs.iSyncRangeSize = 0;
+	cs.bDropCache = 0;
+	cs.bGroupSync = 0;
 	cs.bFlushOnTXEnd = FLUSHONTX_DFLT;
 	cs.iIOBufSize = IOBUF_DFLT_SIZE;
 	cs.iFlushInterval = FLUSH_INTRVL_DFLT;
@@ -1096,9 +1603,12 @@ static rsRetVal resetConfigVariables(uchar __attribute__((unused)) *pp, void __a
 
 
 BEGINdoHUP
+	int i;
 CODESTARTdoHUP
 	if(pData->bDynamicName) {
 		dynaFileFreeCacheEntries(pData);
+		for(i = 0 ; i < pData->nShards ; ++i)
+			dynaFileFreeCacheEntries(pData->pShards[i].pData);
 	} else {
 		if(pData->pStrm != NULL) {
 			strm.Destruct(&pData->pStrm);
@@ -1112,7 +1622,7 @@ BEGINmodExit
 CODESTARTmodExit
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(strm, CORE_COMPONENT);
-	DESTROY_ATOMIC_HELPER_MUT(mutClock);
+	objRelease(statsobj, CORE_COMPONENT);
 ENDmodExit
 
 
@@ -1123,6 +1633,7 @@ CODEqueryEtryPt_STD_CONF2_QUERIES
 CODEqueryEtryPt_STD_CONF2_setModCnf_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
 CODEqueryEtryPt_TXIF_OMOD_QUERIES /* we support the transactional interface! */
+CODEqueryEtryPt_BATCHIF_OMOD_QUERIES
 CODEqueryEtryPt_doHUP
 ENDqueryEtryPt
 
@@ -1134,13 +1645,23 @@ CODEmodInit_QueryRegCFSLineHdlr
 INITLegCnfVars
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(strm, CORE_COMPONENT));
-
-	INIT_ATOMIC_HELPER_MUT(mutClock);
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 
 	INITChkCoreFeature(bCoreSupportsBatching, CORE_FEATURE_BATCHING);
 	DBGPRINTF("omfile: %susing transactional output interface.\n", bCoreSupportsBatching ? "" : "not ");
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"dynafilecachesize", 0, eCmdHdlrInt, (void*) setDynaFileCacheSize, NULL, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfiledynafileshards", 0, eCmdHdlrInt, NULL, &cs.iDynaFileShards, STD_LOADABLE_MODULE_ID));
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfileziplevel", 0, eCmdHdlrInt, NULL, &cs.iZipLevel, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfilezipthreads", 0, eCmdHdlrInt, NULL, &cs.iZipThreads, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfilezipindex", 0, eCmdHdlrBinary, NULL, &cs.bZipIndex, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfilerotatesize", 0, eCmdHdlrSize, NULL, &cs.iRotateSize, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfilerotateinterval", 0, eCmdHdlrInt, NULL, &cs.iRotateInterval, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfilerotatekeep", 0, eCmdHdlrInt, NULL, &cs.iRotateKeep, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfilerotatecompress", 0, eCmdHdlrBinary, NULL, &cs.bRotateCompress, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfilepreallocsize", 0, eCmdHdlrSize, NULL, &cs.iPreallocSize, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfilesyncrangesize", 0, eCmdHdlrSize, NULL, &cs.iSyncRangeSize, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfiledropcache", 0, eCmdHdlrBinary, NULL, &cs.bDropCache, STD_LOADABLE_MODULE_ID));
+	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfilegroupsync", 0, eCmdHdlrBinary, NULL, &cs.bGroupSync, STD_LOADABLE_MODULE_ID));
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfileflushinterval", 0, eCmdHdlrInt, NULL, &cs.iFlushInterval, STD_LOADABLE_MODULE_ID));
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfileasyncwriting", 0, eCmdHdlrBinary, NULL, &cs.bUseAsyncWriter, STD_LOADABLE_MODULE_ID));
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"omfileflushontxend", 0, eCmdHdlrBinary, NULL, &cs.bFlushOnTXEnd, STD_LOADABLE_MODULE_ID));
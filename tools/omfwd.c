@@ -56,9 +56,11 @@
 #include "tcpclt.h"
 #include "cfsysline.h"
 #include "module-template.h"
+#include "statsobj.h"
 #include "glbl.h"
 #include "errmsg.h"
 #include "unicode-helper.h"
+#include "atomic.h"
 
 MODULE_TYPE_OUTPUT
 MODULE_TYPE_NOKEEP
@@ -73,6 +75,30 @@ DEFobjCurrIf(net)
 DEFobjCurrIf(netstrms)
 DEFobjCurrIf(netstrm)
 DEFobjCurrIf(tcpclt)
+DEFobjCurrIf(statsobj)
+
+#define UDP_BATCH_MAX 64		/* max datagrams per transmission (sendmmsg() call) */
+#define UDP_BATCH_BUFSIZE (64*1024)	/* buffer for the datagrams of a transmission */
+
+/* UDP send statistics of a target, shared by all worker instances */
+typedef struct udpStats_s {
+	statsobj_t *stats;
+	intctr_t ctrDatagrams;	/* datagrams sent */
+	intctr_t ctrCalls;	/* send system calls needed for them */
+	pthread_mutex_t mut;
+} udpStats_t;
+
+/* load state of a target group member, shared by all worker instances */
+typedef struct targetLoad_s {
+	int nInFlight;	/* messages handed to the member, but not yet committed */
+	DEF_ATOMIC_HELPER_MUT(mutInFlight);
+} targetLoad_t;
+
+/* a point on the hash ring used for consistent hashing */
+typedef struct lbRingEntry_s {
+	unsigned hash;
+	int iMember;	/* index into pMembers */
+} lbRingEntry_t;
 
 typedef struct _instanceData {
 	uchar 	*tplName;	/* name of assigned template */
@@ -86,7 +112,22 @@ typedef struct _instanceData {
 	int *pSockArray;	/* sockets to use for UDP */
 	int bIsConnected;  /* are we connected to remote host? 0 - no, 1 - yes, UDP means addr resolved */
 	struct addrinfo *f_addr;
+	/* the datagrams of the current transaction are buffered and sent in
+	 * one go at its end (or when the buffer is full)
+	 */
+	uchar *pUDPBuf;		/* datagram contents, back to back */
+	size_t offsUDPBuf;	/* next free spot in pUDPBuf */
+	struct iovec *pUDPIov;	/* one entry per datagram */
+	int nUDPMsgs;		/* number of datagrams buffered */
+	udpStats_t *pUDPStats;
 	int compressionLevel;	/* 0 - no compression, else level for zlib */
+	sbool bStreamCompress;	/* compress the whole TCP stream instead of single messages */
+	sbool bZipPending;	/* stream compression: data not yet flushed to the receiver */
+#	ifdef USE_NETZIP
+	z_stream zstrm;		/* stream compression state of the current connection */
+	sbool bzInitDone;	/* zstrm initialized? */
+#	endif
+	sbool bUseIovec;	/* template passed as scatter list? (not with per-message compression) */
 	char *port;
 	int protocol;
 	int iRebindInterval;	/* rebind interval */
@@ -99,6 +140,26 @@ typedef struct _instanceData {
 	tcpclt_t *pTCPClt;	/* our tcpclt object */
 	uchar sndBuf[16*1024];	/* this is intensionally fixed -- see no good reason to make configurable */
 	unsigned offsSndBuf;	/* next free spot in send buffer */
+	/* following fields for target groups, which distribute messages over
+	 * a number of regular targets (the members)
+	 */
+	int nMembers;		/* number of members, 0 - this is not a group */
+	struct _instanceData **pMembers;
+	int iBalanceMode;	/* how to select the member for a message */
+#	define	LB_ROUNDROBIN 0
+#	define	LB_LEASTLOADED 1
+#	define	LB_HASH 2
+	unsigned iNextMember;	/* next member to try (round-robin) */
+	lbRingEntry_t *pRing;	/* hash ring for LB_HASH (shared by worker instances) */
+	int nRing;		/* number of points on the ring */
+	int iMemberRetryInterval; /* seconds before a failed member is tried again */
+	int iPoolSize;		/* number of TCP connections (members) per target */
+	/* following fields for group members */
+	int iPoolConn;		/* index of this connection within the pool of its target */
+	sbool bMemberSuspended;	/* member failed, do not use it until ttMemberRetry */
+	time_t ttMemberRetry;
+	int nUncommitted;	/* messages handed to this member in the current transaction */
+	targetLoad_t *pLoad;
 } instanceData;
 
 /* config data */
@@ -132,6 +193,7 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "protocol", eCmdHdlrGetWord, 0 },
 	{ "tcp_framing", eCmdHdlrGetWord, 0 },
 	{ "ziplevel", eCmdHdlrInt, 0 },
+	{ "compression.mode", eCmdHdlrGetWord, 0 },
 	{ "rebindinterval", eCmdHdlrInt, 0 },
 	{ "streamdriver", eCmdHdlrGetWord, 0 },
 	{ "streamdrivermode", eCmdHdlrInt, 0 },
@@ -139,6 +201,11 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "streamdriverpermittedpeers", eCmdHdlrGetWord, 0 },
 	{ "resendlastmsgonreconnect", eCmdHdlrBinary, 0 },
 	{ "template", eCmdHdlrGetWord, 0 },
+	{ "targets", eCmdHdlrArray, 0 },
+	{ "balance", eCmdHdlrGetWord, 0 },
+	{ "balancekeytemplate", eCmdHdlrGetWord, 0 },
+	{ "targetretryinterval", eCmdHdlrInt, 0 },
+	{ "pool.size", eCmdHdlrPositiveInt, 0 },
 };
 static struct cnfparamblk actpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -244,6 +311,14 @@ DestructTCPInstanceData(instanceData *pData)
 		netstrm.Destruct(&pData->pNetstrm);
 	if(pData->pNS != NULL)
 		netstrms.Destruct(&pData->pNS);
+#	ifdef USE_NETZIP
+	/* a new connection starts a new compressed stream */
+	if(pData->bzInitDone) {
+		deflateEnd(&pData->zstrm);
+		pData->bzInitDone = 0;
+	}
+#	endif
+	pData->bZipPending = 0;
 }
 
 
@@ -325,15 +400,71 @@ CODESTARTisCompatibleWithFeature
 ENDisCompatibleWithFeature
 
 
+/* free the UDP batch buffers of an instance */
+static inline void
+freeUDPBatch(instanceData *pData)
+{
+	free(pData->pUDPBuf);
+	free(pData->pUDPIov);
+	pData->pUDPBuf = NULL;
+	pData->pUDPIov = NULL;
+	pData->nUDPMsgs = 0;
+	pData->offsUDPBuf = 0;
+}
+
+
+static void
+destructUDPStats(instanceData *pData)
+{
+	if(pData->pUDPStats == NULL)
+		return;
+	if(pData->pUDPStats->stats != NULL)
+		statsobj.Destruct(&pData->pUDPStats->stats);
+	pthread_mutex_destroy(&pData->pUDPStats->mut);
+	free(pData->pUDPStats);
+	pData->pUDPStats = NULL;
+}
+
+
+/* free a member of a target group. Settings are shared with the group
+ * and freed together with it.
+ */
+static void
+freeMember(instanceData *pMember)
+{
+	DestructTCPInstanceData(pMember);
+	closeUDPSockets(pMember);
+	if(pMember->pTCPClt != NULL)
+		tcpclt.Destruct(&pMember->pTCPClt);
+	if(pMember->pLoad != NULL) {
+		DESTROY_ATOMIC_HELPER_MUT(pMember->pLoad->mutInFlight);
+		free(pMember->pLoad);
+	}
+	freeUDPBatch(pMember);
+	destructUDPStats(pMember);
+	free(pMember->target);
+	free(pMember->port);
+	free(pMember);
+}
+
+
 BEGINfreeInstance
+	int i;
 CODESTARTfreeInstance
 	/* final cleanup */
 	DestructTCPInstanceData(pData);
 	closeUDPSockets(pData);
 
-	if(pData->protocol == FORW_TCP) {
+	if(pData->pTCPClt != NULL) {
 		tcpclt.Destruct(&pData->pTCPClt);
 	}
+	freeUDPBatch(pData);
+	destructUDPStats(pData);
+
+	for(i = 0 ; i < pData->nMembers ; ++i)
+		freeMember(pData->pMembers[i]);
+	free(pData->pMembers);
+	free(pData->pRing);
 
 	free(pData->port);
 	free(pData->target);
@@ -344,21 +475,47 @@ ENDfreeInstance
 
 
 BEGINdbgPrintInstInfo
+	int i;
 CODESTARTdbgPrintInstInfo
-	dbgprintf("%s", pData->target);
+	if(pData->nMembers > 0) {
+		dbgprintf("target group, balance mode %d:", pData->iBalanceMode);
+		for(i = 0 ; i < pData->nMembers ; ++i)
+			dbgprintf(" %s:%s", pData->pMembers[i]->target, pData->pMembers[i]->port);
+	} else {
+		dbgprintf("%s", pData->target);
+	}
 ENDdbgPrintInstInfo
 
 
+/* account for datagrams sent via UDP */
+static inline void
+UDPAddStats(instanceData *pData, int nDatagrams, int nCalls)
+{
+	if(pData->pUDPStats == NULL || !GatherStats)
+		return;
+	pthread_mutex_lock(&pData->pUDPStats->mut);
+	pData->pUDPStats->ctrDatagrams += nDatagrams;
+	pData->pUDPStats->ctrCalls += nCalls;
+	pthread_mutex_unlock(&pData->pUDPStats->mut);
+}
+
+
 /* Send a message via UDP
  * rgehards, 2007-12-20
+ * The message is given as scatter list, so that iovec-rendered templates
+ * are sent without copying them first (via sendmsg()). This is used for
+ * messages that are too large for the batch buffer, all others are
+ * sent via UDPSendBatch().
  */
-static rsRetVal UDPSend(instanceData *pData, char *msg, size_t len)
+static rsRetVal UDPSend(instanceData *pData, struct iovec *iov, int iovcnt, size_t len)
 {
 	DEFiRet;
 	struct addrinfo *r;
+	struct msghdr mh;
 	int i;
 	unsigned lsent = 0;
 	int bSendSuccess;
+	int nCalls = 0;
 
 	if(pData->iRebindInterval && (pData->nXmit++ % pData->iRebindInterval == 0)) {
 		dbgprintf("omfwd dropping UDP 'connection' (as configured)\n");
@@ -379,16 +536,22 @@ static rsRetVal UDPSend(instanceData *pData, char *msg, size_t len)
 		 * the sendto() succeeded. -- rgerhards, 2007-06-22
 		 */
 		bSendSuccess = RSFALSE;
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_iov = iov;
+		mh.msg_iovlen = iovcnt;
 		for (r = pData->f_addr; r; r = r->ai_next) {
+			mh.msg_name = r->ai_addr;
+			mh.msg_namelen = r->ai_addrlen;
 			for (i = 0; i < *pData->pSockArray; i++) {
-			       lsent = sendto(pData->pSockArray[i+1], msg, len, 0, r->ai_addr, r->ai_addrlen);
+			       lsent = sendmsg(pData->pSockArray[i+1], &mh, 0);
+				++nCalls;
 				if (lsent == len) {
 					bSendSuccess = RSTRUE;
 					break;
 				} else {
 					int eno = errno;
 					char errStr[1024];
-					dbgprintf("sendto() error: %d = %s.\n",
+					dbgprintf("sendmsg() error: %d = %s.\n",
 						eno, rs_strerror_r(eno, errStr, sizeof(errStr)));
 				}
 			}
@@ -396,6 +559,7 @@ static rsRetVal UDPSend(instanceData *pData, char *msg, size_t len)
 			       break;
 		}
 		/* finished looping */
+		UDPAddStats(pData, (bSendSuccess == RSTRUE) ? 1 : 0, nCalls);
 		if (bSendSuccess == RSFALSE) {
 			dbgprintf("error forwarding via udp, suspending\n");
 			iRet = RS_RET_SUSPENDED;
@@ -407,6 +571,181 @@ finalize_it:
 }
 
 
+/* send the datagrams iov[iFirst] ... iov[nMsgs-1] via socket sock to the
+ * address r. Returns the number of datagrams actually sent, which is less
+ * than requested if an error occured. *pnCalls is incremented by the
+ * number of system calls made.
+ */
+static int
+UDPSendMMsg(int sock, struct addrinfo *r, struct iovec *iov, int iFirst, int nMsgs, int *pnCalls)
+{
+	int nSent = 0;
+	int i;
+	ssize_t lsent;
+	struct msghdr mh;
+	char errStr[1024];
+#	ifdef HAVE_SENDMMSG
+	static int bNoSendmmsg = 0;	/* kernel does not support it, set only once */
+	struct mmsghdr mmh[UDP_BATCH_MAX];
+	int n, ret;
+
+	if(!bNoSendmmsg) {
+		n = nMsgs - iFirst;
+		memset(mmh, 0, n * sizeof(struct mmsghdr));
+		for(i = 0 ; i < n ; ++i) {
+			mmh[i].msg_hdr.msg_name = r->ai_addr;
+			mmh[i].msg_hdr.msg_namelen = r->ai_addrlen;
+			mmh[i].msg_hdr.msg_iov = &iov[iFirst + i];
+			mmh[i].msg_hdr.msg_iovlen = 1;
+		}
+		while(nSent < n) {
+			ret = sendmmsg(sock, mmh + nSent, n - nSent, 0);
+			++*pnCalls;
+			if(ret > 0) {
+				nSent += ret; /* partial send: retry with the rest */
+			} else if(ret < 0 && errno == EINTR) {
+				continue;
+			} else if(ret < 0 && errno == ENOSYS && nSent == 0) {
+				DBGPRINTF("omfwd: sendmmsg() not supported by kernel, using sendmsg()\n");
+				bNoSendmmsg = 1;
+				break;
+			} else {
+				int eno = errno;
+				dbgprintf("sendmmsg() error: %d = %s.\n",
+					eno, rs_strerror_r(eno, errStr, sizeof(errStr)));
+				return nSent;
+			}
+		}
+		if(!bNoSendmmsg)
+			return nSent;
+	}
+#	endif
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_name = r->ai_addr;
+	mh.msg_namelen = r->ai_addrlen;
+	for(i = iFirst ; i < nMsgs ; ++i) {
+		mh.msg_iov = &iov[i];
+		mh.msg_iovlen = 1;
+		lsent = sendmsg(sock, &mh, 0);
+		++*pnCalls;
+		if(lsent != (ssize_t) iov[i].iov_len) {
+			int eno = errno;
+			dbgprintf("sendmsg() error: %d = %s.\n",
+				eno, rs_strerror_r(eno, errStr, sizeof(errStr)));
+			break;
+		}
+		++nSent;
+	}
+	return nSent;
+}
+
+
+/* send a batch of datagrams via UDP (one datagram per iovec entry). This
+ * follows the semantics of UDPSend(): the batch is sent to the first
+ * address that works (or to all of them, if send_to_all is set). If a
+ * socket fails after it has sent part of the batch, the remaining
+ * datagrams are tried on the next socket, so none is sent twice to the
+ * same address. If none of the addresses can take the whole batch, the
+ * action is suspended. As the core then retries all messages of the
+ * transaction, some datagrams may be duplicated in that case, but none
+ * is lost.
+ */
+static rsRetVal
+UDPSendBatch(instanceData *pData, struct iovec *iov, int nMsgs)
+{
+	struct addrinfo *r;
+	int i;
+	int nSent;
+	int nCalls = 0;
+	int bSendSuccess;
+	DEFiRet;
+
+	if(pData->iRebindInterval) {
+		if(pData->nXmit == 0 || pData->nXmit >= pData->iRebindInterval) {
+			dbgprintf("omfwd dropping UDP 'connection' (as configured)\n");
+			pData->nXmit = 0;
+			CHKiRet(closeUDPSockets(pData));
+		}
+		pData->nXmit += nMsgs;
+	}
+
+	if(pData->pSockArray == NULL) {
+		CHKiRet(doTryResume(pData));
+	}
+
+	if(pData->pSockArray != NULL) {
+		bSendSuccess = RSFALSE;
+		nSent = 0;
+		for (r = pData->f_addr; r; r = r->ai_next) {
+			nSent = 0;
+			for (i = 0; i < *pData->pSockArray && nSent < nMsgs; i++)
+				nSent += UDPSendMMsg(pData->pSockArray[i+1], r, iov, nSent, nMsgs, &nCalls);
+			if (nSent == nMsgs) {
+				bSendSuccess = RSTRUE;
+				if(!send_to_all)
+					break;
+			}
+		}
+		DBGPRINTF("omfwd: UDP batch of %d datagrams sent with %d calls\n", nMsgs, nCalls);
+		UDPAddStats(pData, (bSendSuccess == RSTRUE) ? nMsgs : nSent, nCalls);
+		if (bSendSuccess == RSFALSE) {
+			dbgprintf("error forwarding via udp, suspending\n");
+			iRet = RS_RET_SUSPENDED;
+		}
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* Add a datagram to the batch of the current transaction. If the batch is
+ * full, it is sent first. Datagrams too large for the buffer are sent
+ * directly. The return states are those of TCPSendFrame().
+ */
+static rsRetVal
+UDPBatchAdd(instanceData *pData, struct iovec *iov, int iovcnt, size_t len)
+{
+	int i;
+	sbool bPrevCommitted = 0;
+	DEFiRet;
+
+	if(pData->pUDPBuf == NULL) {
+		CHKmalloc(pData->pUDPBuf = malloc(UDP_BATCH_BUFSIZE));
+		CHKmalloc(pData->pUDPIov = malloc(UDP_BATCH_MAX * sizeof(struct iovec)));
+	}
+
+	if(   pData->nUDPMsgs != 0
+	   && (pData->nUDPMsgs == UDP_BATCH_MAX || pData->offsUDPBuf + len > UDP_BATCH_BUFSIZE)) {
+		/* no space left, need to commit previous records. On error, they
+		 * are kept, a target group hands them over to another member.
+		 */
+		CHKiRet(UDPSendBatch(pData, pData->pUDPIov, pData->nUDPMsgs));
+		pData->nUDPMsgs = 0;
+		pData->offsUDPBuf = 0;
+		bPrevCommitted = 1;
+	}
+
+	if(len > UDP_BATCH_BUFSIZE) {
+		CHKiRet(UDPSend(pData, iov, iovcnt, len));
+		ABORT_FINALIZE(RS_RET_OK);	/* committed everything so far */
+	}
+
+	pData->pUDPIov[pData->nUDPMsgs].iov_base = pData->pUDPBuf + pData->offsUDPBuf;
+	pData->pUDPIov[pData->nUDPMsgs].iov_len = len;
+	++pData->nUDPMsgs;
+	for(i = 0 ; i < iovcnt ; ++i) {
+		memcpy(pData->pUDPBuf + pData->offsUDPBuf, iov[i].iov_base, iov[i].iov_len);
+		pData->offsUDPBuf += iov[i].iov_len;
+	}
+	iRet = bPrevCommitted ? RS_RET_PREVIOUS_COMMITTED : RS_RET_DEFER_COMMIT;
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* set the permitted peers -- rgerhards, 2008-05-19
  */
 static rsRetVal
@@ -430,7 +769,7 @@ finalize_it:
  * rgerhards, 2011-04-04
  */
 static rsRetVal
-TCPSendBuf(instanceData *pData, uchar *buf, unsigned len)
+TCPSendBufUncompressed(instanceData *pData, uchar *buf, unsigned len)
 {
 	DEFiRet;
 	unsigned alreadySent;
@@ -456,6 +795,93 @@ finalize_it:
 }
 
 
+#ifdef USE_NETZIP
+/* Add data to the compressed stream of the connection (stream compression
+ * mode) and send whatever zlib produces. With Z_SYNC_FLUSH, all data is
+ * flushed, so that the receiver can decompress everything sent so far. We
+ * do this at the end of each transaction. The stream spans the whole
+ * connection, which compresses much better than single messages do.
+ */
+static rsRetVal
+TCPSendZip(instanceData *pData, uchar *buf, unsigned len, int flush)
+{
+	uchar zipBuf[16*1024];
+	unsigned outavail;
+	int zRet;
+	DEFiRet;
+
+	if(!pData->bzInitDone) {
+		pData->zstrm.zalloc = Z_NULL;
+		pData->zstrm.zfree = Z_NULL;
+		pData->zstrm.opaque = Z_NULL;
+		zRet = deflateInit(&pData->zstrm, (pData->compressionLevel == 0) ?
+				   Z_DEFAULT_COMPRESSION : pData->compressionLevel);
+		if(zRet != Z_OK) {
+			DBGPRINTF("omfwd: error %d initializing stream compression\n", zRet);
+			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+		}
+		pData->bzInitDone = 1;
+	}
+
+	pData->zstrm.next_in = (Bytef*) buf;
+	pData->zstrm.avail_in = len;
+	do {
+		pData->zstrm.next_out = zipBuf;
+		pData->zstrm.avail_out = sizeof(zipBuf);
+		zRet = deflate(&pData->zstrm, flush);
+		if(zRet == Z_STREAM_ERROR) {
+			DBGPRINTF("omfwd: error %d during stream compression\n", zRet);
+			ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+		}
+		outavail = sizeof(zipBuf) - pData->zstrm.avail_out;
+		if(outavail > 0)
+			CHKiRet(TCPSendBufUncompressed(pData, zipBuf, outavail));
+	} while(pData->zstrm.avail_out == 0);
+	pData->bZipPending = (flush == Z_NO_FLUSH);
+
+finalize_it:
+	if(iRet != RS_RET_OK) {
+		DestructTCPInstanceData(pData);
+		iRet = RS_RET_SUSPENDED;
+	}
+	RETiRet;
+}
+#endif
+
+
+/* Send a buffer via TCP, compressing it if stream compression is used. */
+static rsRetVal
+TCPSendBuf(instanceData *pData, uchar *buf, unsigned len)
+{
+	DEFiRet;
+#	ifdef USE_NETZIP
+	if(pData->bStreamCompress) {
+		CHKiRet(TCPSendZip(pData, buf, len, Z_NO_FLUSH));
+		FINALIZE;
+	}
+#	endif
+	CHKiRet(TCPSendBufUncompressed(pData, buf, len));
+finalize_it:
+	RETiRet;
+}
+
+
+/* flush the compressed stream at the end of a transaction, so that the
+ * receiver gets all messages. Does nothing without stream compression.
+ */
+static rsRetVal
+TCPZipFlush(instanceData *pData)
+{
+	DEFiRet;
+#	ifdef USE_NETZIP
+	if(pData->bZipPending)
+		CHKiRet(TCPSendZip(pData, NULL, 0, Z_SYNC_FLUSH));
+finalize_it:
+#	endif
+	RETiRet;
+}
+
+
 /* Add frame to send buffer (or send, if requried)
  */
 static rsRetVal TCPSendFrame(void *pvData, char *msg, size_t len)
@@ -488,6 +914,46 @@ finalize_it:
 }
 
 
+/* the same as TCPSendFrame(), but for a frame given as scatter list. The
+ * frame is gathered directly into the send buffer, so the message is
+ * copied only once.
+ */
+static rsRetVal TCPSendFrameV(void *pvData, struct iovec *iov, int iovcnt, size_t len)
+{
+	DEFiRet;
+	instanceData *pData = (instanceData *) pvData;
+	int i;
+
+	DBGPRINTF("omfwd: add %u bytes to send buffer (curr offs %u)\n",
+		(unsigned) len, pData->offsSndBuf);
+	if(pData->offsSndBuf != 0 && pData->offsSndBuf + len >= sizeof(pData->sndBuf)) {
+		/* no buffer space left, need to commit previous records */
+		CHKiRet(TCPSendBuf(pData, pData->sndBuf, pData->offsSndBuf));
+		pData->offsSndBuf = 0;
+		iRet = RS_RET_PREVIOUS_COMMITTED;
+	}
+
+	/* check if the message is too large to fit into buffer */
+	if(len > sizeof(pData->sndBuf)) {
+		for(i = 0 ; i < iovcnt ; ++i) {
+			if(iov[i].iov_len > 0)
+				CHKiRet(TCPSendBuf(pData, iov[i].iov_base, iov[i].iov_len));
+		}
+		ABORT_FINALIZE(RS_RET_OK);	/* committed everything so far */
+	}
+
+	/* we now know the buffer has enough free space */
+	for(i = 0 ; i < iovcnt ; ++i) {
+		memcpy(pData->sndBuf + pData->offsSndBuf, iov[i].iov_base, iov[i].iov_len);
+		pData->offsSndBuf += iov[i].iov_len;
+	}
+	iRet = RS_RET_DEFER_COMMIT;
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* This function is called immediately before a send retry is attempted.
  * It shall clean up whatever makes sense.
  * rgerhards, 2007-12-28
@@ -595,33 +1061,335 @@ finalize_it:
 }
 
 
+/* CODE FOR TARGET GROUPS
+ * A group distributes messages over its members, each of which is a regular
+ * target with its own connection. A member that fails is suspended for
+ * iMemberRetryInterval seconds and its share of messages goes to the
+ * remaining members in the mean time. Only if all members are suspended,
+ * the action itself is suspended.
+ */
+
+#define LB_VNODES 160	/* points per member on the hash ring */
+
+/* hash for the ring and the keys: FNV-1a with a final mix, as FNV alone does
+ * not spread short, similar strings like "host:port#n" well enough.
+ */
+static unsigned
+lbHash(uchar *p, size_t len)
+{
+	unsigned h = 2166136261u;
+	size_t i;
+
+	for(i = 0 ; i < len ; ++i) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+
+static int
+lbRingCmp(const void *p1, const void *p2)
+{
+	const lbRingEntry_t *e1 = (const lbRingEntry_t*) p1;
+	const lbRingEntry_t *e2 = (const lbRingEntry_t*) p2;
+	return (e1->hash < e2->hash) ? -1 : (e1->hash > e2->hash);
+}
+
+
+/* build the hash ring for consistent hashing. Each member gets LB_VNODES
+ * points, so that the share of a suspended member is spread over all
+ * others rather than going to a single one.
+ */
+static rsRetVal
+buildHashRing(instanceData *pData)
+{
+	char szPoint[1024];
+	lbRingEntry_t *pEntry;
+	size_t len;
+	int i, j;
+	DEFiRet;
+
+	pData->nRing = pData->nMembers * LB_VNODES;
+	CHKmalloc(pData->pRing = malloc(pData->nRing * sizeof(lbRingEntry_t)));
+	for(i = 0 ; i < pData->nMembers ; ++i) {
+		for(j = 0 ; j < LB_VNODES ; ++j) {
+			/* the first connection of a pool keeps the points it has
+			 * without a pool, so enabling a pool moves few keys only.
+			 */
+			if(pData->pMembers[i]->iPoolConn == 0) {
+				len = snprintf(szPoint, sizeof(szPoint), "%s:%s#%d",
+					       pData->pMembers[i]->target, pData->pMembers[i]->port, j);
+			} else {
+				len = snprintf(szPoint, sizeof(szPoint), "%s:%s/%d#%d",
+					       pData->pMembers[i]->target, pData->pMembers[i]->port,
+					       pData->pMembers[i]->iPoolConn, j);
+			}
+			if(len >= sizeof(szPoint))
+				len = sizeof(szPoint) - 1;
+			pEntry = &pData->pRing[i * LB_VNODES + j];
+			pEntry->hash = lbHash((uchar*) szPoint, len);
+			pEntry->iMember = i;
+		}
+	}
+	qsort(pData->pRing, pData->nRing, sizeof(lbRingEntry_t), lbRingCmp);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* check if a member can be used. A suspended member is tried again once
+ * its retry interval has expired.
+ */
+static int
+memberIsUsable(instanceData *pData, instanceData *pMember, time_t tNow)
+{
+	if(!pMember->bMemberSuspended)
+		return 1;
+	if(tNow < pMember->ttMemberRetry)
+		return 0;
+	if(doTryResume(pMember) == RS_RET_OK) {
+		DBGPRINTF("omfwd: target group member %s:%s resumed\n", pMember->target, pMember->port);
+		pMember->bMemberSuspended = 0;
+		return 1;
+	}
+	pMember->ttMemberRetry = tNow + pData->iMemberRetryInterval;
+	return 0;
+}
+
+
+static void
+suspendMember(instanceData *pData, instanceData *pMember)
+{
+	DBGPRINTF("omfwd: target group member %s:%s failed, suspending it for %d seconds\n",
+		  pMember->target, pMember->port, pData->iMemberRetryInterval);
+	pMember->bMemberSuspended = 1;
+	pMember->ttMemberRetry = time(NULL) + pData->iMemberRetryInterval;
+}
+
+
+/* select the member a message is to be sent to. pszKey is the rendered key
+ * template for LB_HASH, if it is NULL we select round-robin. Returns NULL
+ * if no member is usable.
+ */
+static instanceData *
+selectMember(instanceData *pData, uchar *pszKey)
+{
+	instanceData *pMember;
+	instanceData *pBest = NULL;
+	time_t tNow;
+	unsigned h;
+	int lo, hi, mid;
+	int i, iMember;
+	int nLoad, nBestLoad = 0;
+
+	tNow = time(NULL);
+	if(pData->iBalanceMode == LB_HASH && pszKey != NULL) {
+		h = lbHash(pszKey, ustrlen(pszKey));
+		lo = 0;
+		hi = pData->nRing;
+		while(lo < hi) { /* first point on the ring >= h */
+			mid = (lo + hi) / 2;
+			if(pData->pRing[mid].hash < h)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		/* walk the ring, so that the share of a suspended member goes to
+		 * its successors while all other keys stay where they are.
+		 */
+		for(i = 0 ; i < pData->nRing ; ++i) {
+			pMember = pData->pMembers[pData->pRing[(lo + i) % pData->nRing].iMember];
+			if(memberIsUsable(pData, pMember, tNow))
+				return pMember;
+		}
+		return NULL;
+	}
+
+	for(i = 0 ; i < pData->nMembers ; ++i) {
+		iMember = (pData->iNextMember + i) % pData->nMembers;
+		pMember = pData->pMembers[iMember];
+		if(!memberIsUsable(pData, pMember, tNow))
+			continue;
+		if(pData->iBalanceMode != LB_LEASTLOADED) {
+			pData->iNextMember = iMember + 1;
+			return pMember;
+		}
+		nLoad = ATOMIC_FETCH_32BIT(&pMember->pLoad->nInFlight, &pMember->pLoad->mutInFlight);
+		if(pBest == NULL || nLoad < nBestLoad) {
+			pBest = pMember;
+			nBestLoad = nLoad;
+		}
+	}
+	++pData->iNextMember; /* spread ties evenly */
+	return pBest;
+}
+
+
+/* send what pMember has buffered (already framed TCP messages or UDP
+ * datagrams) via pTarget, which is pMember itself or the member that takes
+ * over for it.
+ */
+static rsRetVal
+memberSendBuf(instanceData *pTarget, instanceData *pMember)
+{
+	DEFiRet;
+	CHKiRet(doTryResume(pTarget));
+	if(pMember->offsSndBuf != 0)
+		CHKiRet(TCPSendBuf(pTarget, pMember->sndBuf, pMember->offsSndBuf));
+	CHKiRet(TCPZipFlush(pTarget));
+	if(pMember->nUDPMsgs != 0)
+		CHKiRet(UDPSendBatch(pTarget, pMember->pUDPIov, pMember->nUDPMsgs));
+finalize_it:
+	RETiRet;
+}
+
+
+/* try to resume a group. This succeeds as soon as one member is usable. */
+static rsRetVal
+groupTryResume(instanceData *pData)
+{
+	int i;
+	DEFiRet;
+
+	for(i = 0 ; i < pData->nMembers ; ++i) {
+		if(doTryResume(pData->pMembers[i]) == RS_RET_OK) {
+			pData->pMembers[i]->bMemberSuspended = 0;
+			FINALIZE;
+		}
+	}
+	iRet = RS_RET_SUSPENDED;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* commit a transaction of a group. The buffer of a member that fails is
+ * handed over to another member, as the frames are independent of the
+ * connection.
+ */
+static rsRetVal
+groupCommit(instanceData *pData)
+{
+	instanceData *pMember;
+	instanceData *pOther;
+	int i;
+	DEFiRet;
+
+	for(i = 0 ; i < pData->nMembers ; ++i) {
+		pMember = pData->pMembers[i];
+		if(pMember->nUncommitted > 0) {
+			ATOMIC_SUB(&pMember->pLoad->nInFlight, pMember->nUncommitted,
+				   &pMember->pLoad->mutInFlight);
+			pMember->nUncommitted = 0;
+		}
+		if(pMember->offsSndBuf == 0 && pMember->nUDPMsgs == 0 && !pMember->bZipPending)
+			continue;
+		if(   pMember->bMemberSuspended
+		   || memberSendBuf(pMember, pMember) != RS_RET_OK) {
+			if(!pMember->bMemberSuspended)
+				suspendMember(pData, pMember);
+			while((pOther = selectMember(pData, NULL)) != NULL) {
+				if(memberSendBuf(pOther, pMember) == RS_RET_OK)
+					break;
+				suspendMember(pData, pOther);
+			}
+			if(pOther == NULL)
+				iRet = RS_RET_SUSPENDED; /* the core will retry the whole batch */
+		}
+		pMember->offsSndBuf = 0;
+		pMember->nUDPMsgs = 0;
+		pMember->offsUDPBuf = 0;
+	}
+
+	RETiRet;
+}
+
+
 BEGINtryResume
 CODESTARTtryResume
-	iRet = doTryResume(pData);
+	if(pData->nMembers > 0)
+		iRet = groupTryResume(pData);
+	else
+		iRet = doTryResume(pData);
 ENDtryResume
 
 
 BEGINbeginTransaction
+	int i;
 CODESTARTbeginTransaction
 dbgprintf("omfwd: beginTransaction\n");
+	/* datagrams left over from a failed transaction are discarded, the core
+	 * retries all of its messages.
+	 */
+	pData->nUDPMsgs = 0;
+	pData->offsUDPBuf = 0;
+	for(i = 0 ; i < pData->nMembers ; ++i) {
+		pData->pMembers[i]->nUDPMsgs = 0;
+		pData->pMembers[i]->offsUDPBuf = 0;
+	}
 ENDbeginTransaction
 
 
-BEGINdoAction
+/* doAction for templates passed as scatter list, see tplToIovec(). This is
+ * the regular case, compression (which needs a contiguous buffer) is
+ * handled by doAction() itself.
+ */
+static rsRetVal
+doActionIovec(instanceData *pData, tplIov_t *pIov)
+{
+	DEFiRet;
+
+	tplIovTruncate(pIov, glbl.GetMaxLine());
+	if(pData->protocol == FORW_UDP) {
+		/* forward via UDP, sent at the end of the transaction */
+		iRet = UDPBatchAdd(pData, pIov->iov, pIov->nIov, pIov->lenTotal);
+	} else {
+		/* forward via TCP */
+		iRet = tcpclt.SendV(pData->pTCPClt, pData, pIov->iov, pIov->nIov, pIov->lenTotal);
+		if(iRet != RS_RET_OK && iRet != RS_RET_DEFER_COMMIT && iRet != RS_RET_PREVIOUS_COMMITTED) {
+			/* error! */
+			dbgprintf("error forwarding via tcp, suspending\n");
+			DestructTCPInstanceData(pData);
+			iRet = RS_RET_SUSPENDED;
+		}
+	}
+	RETiRet;
+}
+
+
+/* send a message to a single target (which may be a group member) */
+static rsRetVal
+doActionTarget(instanceData *pData, uchar **ppString)
+{
 	char *psz; /* temporary buffering */
 	register unsigned l;
 	int iMaxLine;
+	struct iovec iov;
 #	ifdef	USE_NETZIP
 	Bytef *out = NULL; /* for compression */
 #	endif
-CODESTARTdoAction
-	CHKiRet(doTryResume(pData));
+	DEFiRet;
 
-	iMaxLine = glbl.GetMaxLine();
+	CHKiRet(doTryResume(pData));
 
 	dbgprintf(" %s:%s/%s\n", pData->target, pData->port,
 		 pData->protocol == FORW_UDP ? "udp" : "tcp");
 
+	if(pData->bUseIovec) {
+		CHKiRet(doActionIovec(pData, (tplIov_t*) ppString[0]));
+		FINALIZE;
+	}
+
+	iMaxLine = glbl.GetMaxLine();
+
 	psz = (char*) ppString[0];
 	l = strlen((char*) psz);
 	if((int) l > iMaxLine)
@@ -636,7 +1404,7 @@ CODESTARTdoAction
 	 * hard-coded but this may be changed to a config parameter.
 	 * rgerhards, 2006-11-30
 	 */
-	if(pData->compressionLevel && (l > CONF_MIN_SIZE_FOR_COMPRESS)) {
+	if(pData->compressionLevel && !pData->bStreamCompress && (l > CONF_MIN_SIZE_FOR_COMPRESS)) {
 		uLongf destLen = iMaxLine + iMaxLine/100 +12; /* recommended value from zlib doc */
 		uLong srcLen = l;
 		int ret;
@@ -669,7 +1437,9 @@ CODESTARTdoAction
 
 	if(pData->protocol == FORW_UDP) {
 		/* forward via UDP */
-		CHKiRet(UDPSend(pData, psz, l));
+		iov.iov_base = psz;
+		iov.iov_len = l;
+		iRet = UDPBatchAdd(pData, &iov, 1, l);
 	} else {
 		/* forward via TCP */
 		iRet = tcpclt.Send(pData->pTCPClt, pData, psz, l);
@@ -684,15 +1454,88 @@ finalize_it:
 #	ifdef USE_NETZIP
 	free(out); /* is NULL if it was never used... */
 #	endif
+	RETiRet;
+}
+
+
+/* send a message via a target group. If the selected member fails, the
+ * message is sent to another one.
+ */
+static rsRetVal
+groupDoAction(instanceData *pData, uchar **ppString)
+{
+	instanceData *pMember;
+	rsRetVal localRet;
+	DEFiRet;
+
+	while((pMember = selectMember(pData, (pData->iBalanceMode == LB_HASH) ? ppString[1] : NULL)) != NULL) {
+		localRet = doActionTarget(pMember, ppString);
+		if(localRet == RS_RET_OK)
+			FINALIZE;
+		if(localRet == RS_RET_DEFER_COMMIT || localRet == RS_RET_PREVIOUS_COMMITTED) {
+			/* buffered, the member is committed at the end of the transaction.
+			 * Note that a commit of one member's buffer does not commit what
+			 * the others have buffered, so we must not pass on
+			 * RS_RET_PREVIOUS_COMMITTED.
+			 */
+			++pMember->nUncommitted;
+			ATOMIC_INC(&pMember->pLoad->nInFlight, &pMember->pLoad->mutInFlight);
+			ABORT_FINALIZE(RS_RET_DEFER_COMMIT);
+		}
+		if(localRet != RS_RET_SUSPENDED)
+			ABORT_FINALIZE(localRet);
+		suspendMember(pData, pMember);
+	}
+	DBGPRINTF("omfwd: all members of target group are suspended\n");
+	iRet = RS_RET_SUSPENDED;
+
+finalize_it:
+	RETiRet;
+}
+
+
+BEGINdoAction
+CODESTARTdoAction
+	if(pData->nMembers > 0)
+		iRet = groupDoAction(pData, ppString);
+	else
+		iRet = doActionTarget(pData, ppString);
 ENDdoAction
 
 
+/* batch interface: all messages are sent in one call. Once the connection
+ * breaks, the remaining messages stay unprocessed and the action is
+ * suspended, as there is no point in trying them.
+ */
+BEGINdoActionBatch
+	int i;
+CODESTARTdoActionBatch
+	for(i = 0 ; i < nElem ; ++i) {
+		pRetElem[i] = doAction((uchar**) pppParams[i], piMsgOpts[i], pData);
+		if(pRetElem[i] == RS_RET_SUSPENDED)
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+finalize_it:
+	if(iRet == RS_RET_OK)
+		iRet = RS_RET_DEFER_COMMIT;
+ENDdoActionBatch
+
+
 BEGINendTransaction
 CODESTARTendTransaction
 dbgprintf("omfwd: endTransaction, offsSndBuf %u\n", pData->offsSndBuf);
-	if(pData->offsSndBuf != 0) {
-		iRet = TCPSendBuf(pData, pData->sndBuf, pData->offsSndBuf);
+	if(pData->nMembers > 0) {
+		iRet = groupCommit(pData);
+	} else if(pData->offsSndBuf != 0 || pData->bZipPending) {
+		if(pData->offsSndBuf != 0)
+			iRet = TCPSendBuf(pData, pData->sndBuf, pData->offsSndBuf);
 		pData->offsSndBuf = 0;
+		if(iRet == RS_RET_OK)
+			iRet = TCPZipFlush(pData);
+	} else if(pData->nUDPMsgs != 0) {
+		iRet = UDPSendBatch(pData, pData->pUDPIov, pData->nUDPMsgs);
+		pData->nUDPMsgs = 0;
+		pData->offsUDPBuf = 0;
 	}
 ENDendTransaction
 
@@ -715,6 +1558,25 @@ finalize_it:
 }
 
 
+/* create the tcpclt object for an instance */
+static rsRetVal
+constructTCPClt(instanceData *pData)
+{
+	DEFiRet;
+	CHKiRet(tcpclt.Construct(&pData->pTCPClt));
+	CHKiRet(tcpclt.SetResendLastOnRecon(pData->pTCPClt, pData->bResendLastOnRecon));
+	/* and set callbacks */
+	CHKiRet(tcpclt.SetSendInit(pData->pTCPClt, TCPSendInit));
+	CHKiRet(tcpclt.SetSendFrame(pData->pTCPClt, TCPSendFrame));
+	CHKiRet(tcpclt.SetSendFrameV(pData->pTCPClt, TCPSendFrameV));
+	CHKiRet(tcpclt.SetSendPrepRetry(pData->pTCPClt, TCPSendPrepRetry));
+	CHKiRet(tcpclt.SetFraming(pData->pTCPClt, pData->tcp_framing));
+	CHKiRet(tcpclt.SetRebindInterval(pData->pTCPClt, pData->iRebindInterval));
+finalize_it:
+	RETiRet;
+}
+
+
 /* initialize TCP structures (if necessary) after the instance has been
  * created.
  */
@@ -724,14 +1586,7 @@ initTCP(instanceData *pData)
 	DEFiRet;
 	if(pData->protocol == FORW_TCP) {
 		/* create our tcpclt */
-		CHKiRet(tcpclt.Construct(&pData->pTCPClt));
-		CHKiRet(tcpclt.SetResendLastOnRecon(pData->pTCPClt, pData->bResendLastOnRecon));
-		/* and set callbacks */
-		CHKiRet(tcpclt.SetSendInit(pData->pTCPClt, TCPSendInit));
-		CHKiRet(tcpclt.SetSendFrame(pData->pTCPClt, TCPSendFrame));
-		CHKiRet(tcpclt.SetSendPrepRetry(pData->pTCPClt, TCPSendPrepRetry));
-		CHKiRet(tcpclt.SetFraming(pData->pTCPClt, pData->tcp_framing));
-		CHKiRet(tcpclt.SetRebindInterval(pData->pTCPClt, pData->iRebindInterval));
+		CHKiRet(constructTCPClt(pData));
 		pData->iStrmDrvrMode = cs.iStrmDrvrMode;
 		if(cs.pszStrmDrvr != NULL)
 			CHKmalloc(pData->pszStrmDrvr = (uchar*)strdup((char*)cs.pszStrmDrvr));
@@ -744,6 +1599,109 @@ finalize_it:
 }
 
 
+/* initialize UDP structures (if necessary) after the instance has been
+ * created. Each UDP target gets a statistics object, so that the number
+ * of datagrams sent per system call can be monitored.
+ */
+static rsRetVal
+initUDP(instanceData *pData)
+{
+	uchar ctrName[512];
+	DEFiRet;
+
+	pData->pUDPStats = NULL;
+	if(pData->protocol != FORW_UDP)
+		FINALIZE;
+	CHKmalloc(pData->pUDPStats = calloc(1, sizeof(udpStats_t)));
+	pthread_mutex_init(&pData->pUDPStats->mut, NULL);
+	snprintf((char*) ctrName, sizeof(ctrName), "omfwd udp %s:%s", pData->target,
+		 (pData->port == NULL) ? "514" : pData->port);
+	CHKiRet(statsobj.Construct(&pData->pUDPStats->stats));
+	CHKiRet(statsobj.SetName(pData->pUDPStats->stats, ctrName));
+	CHKiRet(statsobj.AddCounter(pData->pUDPStats->stats, UCHAR_CONSTANT("datagrams"),
+		ctrType_IntCtr, &pData->pUDPStats->ctrDatagrams));
+	CHKiRet(statsobj.AddCounter(pData->pUDPStats->stats, UCHAR_CONSTANT("sendcalls"),
+		ctrType_IntCtr, &pData->pUDPStats->ctrCalls));
+	CHKiRet(statsobj.ConstructFinalize(pData->pUDPStats->stats));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* reset everything that belongs to a connection in an instance that was
+ * copied from another one.
+ */
+static inline void
+resetConnState(instanceData *pData)
+{
+	pData->pNS = NULL;
+	pData->pNetstrm = NULL;
+	pData->pSockArray = NULL;
+	pData->bIsConnected = 0;
+	pData->f_addr = NULL;
+	pData->nXmit = 0;
+	pData->pTCPClt = NULL;
+	pData->offsSndBuf = 0;
+	pData->bZipPending = 0;
+#	ifdef USE_NETZIP
+	pData->bzInitDone = 0;
+#	endif
+	pData->pUDPBuf = NULL;
+	pData->offsUDPBuf = 0;
+	pData->pUDPIov = NULL;
+	pData->nUDPMsgs = 0;
+	pData->bMemberSuspended = 0;
+	pData->nUncommitted = 0;
+}
+
+
+static rsRetVal freeWrkrInstance(void* pModData);
+
+/* worker instances share the target settings, but each one has its own
+ * connection (TCP) or sockets (UDP). For a target group, that means each
+ * one has its own set of members.
+ */
+BEGINcreateWrkrInstance
+	int i;
+CODESTARTcreateWrkrInstance
+	resetConnState(pWrkrData);
+	if(pData->nMembers > 0) {
+		pWrkrData->nMembers = 0;
+		CHKmalloc(pWrkrData->pMembers = calloc(pData->nMembers, sizeof(instanceData*)));
+		for(i = 0 ; i < pData->nMembers ; ++i) {
+			CHKiRet(createWrkrInstance(&pWrkrData->pMembers[i], pData->pMembers[i]));
+			++pWrkrData->nMembers;
+		}
+	} else if(pWrkrData->protocol == FORW_TCP) {
+		CHKiRet(constructTCPClt(pWrkrData));
+	}
+finalize_it:
+	if(iRet != RS_RET_OK && pData->nMembers > 0) {
+		for(i = 0 ; i < pWrkrData->nMembers ; ++i)
+			freeWrkrInstance(pWrkrData->pMembers[i]);
+		free(pWrkrData->pMembers);
+	}
+ENDcreateWrkrInstance
+
+
+BEGINfreeWrkrInstance
+	int i;
+CODESTARTfreeWrkrInstance
+	for(i = 0 ; i < pData->nMembers ; ++i)
+		freeWrkrInstance(pData->pMembers[i]);
+	if(pData->nMembers > 0)
+		free(pData->pMembers);
+	DestructTCPInstanceData(pData);
+	closeUDPSockets(pData);
+	freeUDPBatch(pData);
+	if(pData->f_addr != NULL)
+		freeaddrinfo(pData->f_addr);
+	if(pData->pTCPClt != NULL)
+		tcpclt.Destruct(&pData->pTCPClt);
+ENDfreeWrkrInstance
+
+
 static inline void
 setInstParamDefaults(instanceData *pData)
 {
@@ -757,11 +1715,125 @@ setInstParamDefaults(instanceData *pData)
 	pData->bResendLastOnRecon = 0; 
 	pData->pPermPeers = NULL;
 	pData->compressionLevel = 0;
+	pData->bStreamCompress = 0;
+	pData->iBalanceMode = LB_ROUNDROBIN;
+	pData->iMemberRetryInterval = 30;
+	pData->iPoolSize = 1;
+}
+
+
+/* add a member for host:port to a group. pMembers must already be large
+ * enough. All other settings are inherited from the group.
+ */
+static rsRetVal
+addGroupMember(instanceData *pData, char *pHost, char *pPort, int iPoolConn)
+{
+	instanceData *pMember;
+	DEFiRet;
+
+	CHKmalloc(pMember = malloc(sizeof(instanceData)));
+	memcpy(pMember, pData, sizeof(instanceData));
+	resetConnState(pMember);
+	pMember->nMembers = 0;
+	pMember->pMembers = NULL;
+	pMember->pRing = NULL;
+	pMember->target = NULL;
+	pMember->port = NULL;
+	pMember->pLoad = NULL;
+	pMember->pUDPStats = NULL;
+	pMember->iPoolConn = iPoolConn;
+	pData->pMembers[pData->nMembers++] = pMember; /* from now on, freeInstance() cleans up */
+	CHKmalloc(pMember->pLoad = calloc(1, sizeof(targetLoad_t)));
+	INIT_ATOMIC_HELPER_MUT(pMember->pLoad->mutInFlight);
+
+	CHKmalloc(pMember->target = strdup(pHost));
+	CHKmalloc(pMember->port = strdup((pPort == NULL) ? "514" : pPort));
+	if(pMember->protocol == FORW_TCP)
+		CHKiRet(constructTCPClt(pMember));
+	CHKiRet(initUDP(pMember));
+	DBGPRINTF("omfwd: target group member %s:%s (connection %d)\n", pMember->target,
+		  pMember->port, iPoolConn);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* create the members of a target group. Each entry of the "targets" array
+ * is "host", "host:port" or "[ipv6-address]:port". With a connection pool,
+ * each target contributes iPoolSize members.
+ */
+static rsRetVal
+createGroupMembers(instanceData *pData, struct cnfarray *ar)
+{
+	uchar *spec = NULL;
+	uchar *p, *pHost, *pPort;
+	int i, j;
+	DEFiRet;
+
+	CHKmalloc(pData->pMembers = calloc(ar->nmemb * pData->iPoolSize, sizeof(instanceData*)));
+	for(i = 0 ; i < ar->nmemb ; ++i) {
+		CHKmalloc(spec = (uchar*) es_str2cstr(ar->arr[i], NULL));
+		p = spec;
+		if(*p == '[') { /* everything is hostname upto ']' */
+			pHost = ++p;
+			while(*p && *p != ']')
+				++p;
+			if(*p == ']')
+				*p++ = '\0';
+		} else {
+			pHost = p;
+			while(*p && *p != ':')
+				++p;
+		}
+		pPort = NULL;
+		if(*p == ':') {
+			*p++ = '\0';
+			pPort = p;
+		}
+		if(*pHost == '\0') {
+			errmsg.LogError(0, RS_RET_INVALID_PARAMS, "omfwd: empty host in \"targets\" "
+					"entry %d", i + 1);
+			ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+		}
+		if(pPort == NULL || *pPort == '\0')
+			pPort = (uchar*) pData->port;
+		for(j = 0 ; j < pData->iPoolSize ; ++j)
+			CHKiRet(addGroupMember(pData, (char*) pHost, (char*) pPort, j));
+		free(spec);
+		spec = NULL;
+	}
+
+finalize_it:
+	free(spec);
+	RETiRet;
+}
+
+
+/* create the connection pool of a single target. It is a target group
+ * whose members all connect to the same host, so each connection fails
+ * and is reconnected on its own.
+ */
+static rsRetVal
+createPoolMembers(instanceData *pData)
+{
+	int j;
+	DEFiRet;
+
+	CHKmalloc(pData->pMembers = calloc(pData->iPoolSize, sizeof(instanceData*)));
+	for(j = 0 ; j < pData->iPoolSize ; ++j)
+		CHKiRet(addGroupMember(pData, pData->target, pData->port, j));
+
+finalize_it:
+	RETiRet;
 }
 
 BEGINnewActInst
 	struct cnfparamvals *pvals;
 	uchar *tplToUse;
+	uchar *keyTplToUse = NULL;
+	struct cnfarray *arTargets = NULL;
+	sbool bIsGroup;
 	int i;
 	rsRetVal localRet;
 CODESTARTnewActInst
@@ -872,22 +1944,112 @@ CODESTARTnewActInst
 			errmsg.LogError(0, NO_ERRCODE, "Compression requested, but rsyslogd is not compiled "
 				 "with compression support - request ignored.");
 #			endif /* #ifdef USE_NETZIP */
+		} else if(!strcmp(actpblk.descr[i].name, "compression.mode")) {
+			if(!es_strcasebufcmp(pvals[i].val.d.estr, (uchar*)"single", 6)) {
+				pData->bStreamCompress = 0;
+			} else if(!es_strcasebufcmp(pvals[i].val.d.estr, (uchar*)"stream:always", 13)) {
+#				ifdef USE_NETZIP
+				pData->bStreamCompress = 1;
+#				else
+				errmsg.LogError(0, NO_ERRCODE, "Compression requested, but rsyslogd is not "
+					 "compiled with compression support - request ignored.");
+#				endif
+			} else {
+				uchar *str;
+				str = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+				errmsg.LogError(0, RS_RET_INVALID_PARAMS,
+						"omfwd: invalid compression.mode \"%s\"", str);
+				free(str);
+				ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+			}
 		} else if(!strcmp(actpblk.descr[i].name, "resendlastmsgonreconnect")) {
 			pData->bResendLastOnRecon = (int) pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "template")) {
 			pData->tplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(actpblk.descr[i].name, "targets")) {
+			arTargets = pvals[i].val.d.ar;
+		} else if(!strcmp(actpblk.descr[i].name, "balance")) {
+			if(!es_strcasebufcmp(pvals[i].val.d.estr, (uchar*)"roundrobin", 10)) {
+				pData->iBalanceMode = LB_ROUNDROBIN;
+			} else if(!es_strcasebufcmp(pvals[i].val.d.estr, (uchar*)"leastloaded", 11)) {
+				pData->iBalanceMode = LB_LEASTLOADED;
+			} else if(!es_strcasebufcmp(pvals[i].val.d.estr, (uchar*)"hash", 4)) {
+				pData->iBalanceMode = LB_HASH;
+			} else {
+				uchar *str;
+				str = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+				errmsg.LogError(0, RS_RET_INVALID_PARAMS,
+						"omfwd: invalid balance mode \"%s\"", str);
+				free(str);
+				ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+			}
+		} else if(!strcmp(actpblk.descr[i].name, "balancekeytemplate")) {
+			keyTplToUse = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(actpblk.descr[i].name, "targetretryinterval")) {
+			pData->iMemberRetryInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "pool.size")) {
+			pData->iPoolSize = (int) pvals[i].val.d.n;
 		} else {
 			DBGPRINTF("omfwd: program error, non-handled "
 			  "param '%s'\n", actpblk.descr[i].name);
 		}
 	}
-	CODE_STD_STRING_REQUESTnewActInst(1)
+	if(arTargets != NULL && pData->target != NULL) {
+		errmsg.LogError(0, RS_RET_DUP_PARAM, "omfwd: only one of \"target\" and "
+				"\"targets\" can be given");
+		ABORT_FINALIZE(RS_RET_DUP_PARAM);
+	}
+	if(pData->iPoolSize > 1 && pData->protocol != FORW_TCP) {
+		errmsg.LogError(0, RS_RET_INVALID_PARAMS, "omfwd: \"pool.size\" is only "
+				"supported for TCP - using a single socket");
+		pData->iPoolSize = 1;
+	}
+	if(pData->iPoolSize > 1 && pData->target == NULL && arTargets == NULL) {
+		errmsg.LogError(0, RS_RET_MISSING_CNFPARAMS, "omfwd: \"pool.size\" requires "
+				"\"target\" or \"targets\"");
+		ABORT_FINALIZE(RS_RET_MISSING_CNFPARAMS);
+	}
+	bIsGroup = (arTargets != NULL || pData->iPoolSize > 1);
+	if(bIsGroup && pData->iBalanceMode == LB_HASH && keyTplToUse == NULL) {
+		errmsg.LogError(0, RS_RET_MISSING_CNFPARAMS, "omfwd: balance mode \"hash\" "
+				"requires \"balancekeytemplate\"");
+		ABORT_FINALIZE(RS_RET_MISSING_CNFPARAMS);
+	}
+	if(!bIsGroup || pData->iBalanceMode != LB_HASH) {
+		free(keyTplToUse);
+		keyTplToUse = NULL;
+	}
+	if(pData->bStreamCompress && pData->protocol != FORW_TCP) {
+		errmsg.LogError(0, RS_RET_INVALID_PARAMS, "omfwd: compression.mode \"stream:always\" "
+				"is only supported for TCP - using single message compression");
+		pData->bStreamCompress = 0;
+	}
+
+	CODE_STD_STRING_REQUESTnewActInst((keyTplToUse == NULL) ? 1 : 2)
 
 	tplToUse = ustrdup((pData->tplName == NULL) ? getDfltTpl() : pData->tplName);
-	CHKiRet(OMSRsetEntry(*ppOMSR, 0, tplToUse, OMSR_NO_RQD_TPL_OPTS));
+	pData->bUseIovec = (pData->compressionLevel == 0 || pData->bStreamCompress);
+	CHKiRet(OMSRsetEntry(*ppOMSR, 0, tplToUse,
+			     pData->bUseIovec ? OMSR_TPL_AS_IOVEC : OMSR_NO_RQD_TPL_OPTS));
+	if(keyTplToUse != NULL) {
+		CHKiRet(OMSRsetEntry(*ppOMSR, 1, keyTplToUse, OMSR_NO_RQD_TPL_OPTS));
+		keyTplToUse = NULL; /* now owned by the OMSR */
+	}
 
-	CHKiRet(initTCP(pData));
+	if(bIsGroup) {
+		if(arTargets != NULL) {
+			CHKiRet(createGroupMembers(pData, arTargets));
+		} else {
+			CHKiRet(createPoolMembers(pData));
+		}
+		if(pData->iBalanceMode == LB_HASH)
+			CHKiRet(buildHashRing(pData));
+	} else {
+		CHKiRet(initTCP(pData));
+		CHKiRet(initUDP(pData));
+	}
 CODE_STD_FINALIZERnewActInst
+	free(keyTplToUse);
 	cnfparamvalsDestruct(pvals, &actpblk);
 ENDnewActInst
 
@@ -1040,7 +2202,9 @@ CODE_STD_STRING_REQUESTparseSelectorAct(1)
 				 cs.iTCPRebindInterval : cs.iUDPRebindInterval;
 
 	/* process template */
-	CHKiRet(cflineParseTemplateName(&p, *ppOMSR, 0, OMSR_NO_RQD_TPL_OPTS, getDfltTpl()));
+	pData->bUseIovec = (pData->compressionLevel == 0);
+	CHKiRet(cflineParseTemplateName(&p, *ppOMSR, 0,
+			pData->bUseIovec ? OMSR_TPL_AS_IOVEC : OMSR_NO_RQD_TPL_OPTS, getDfltTpl()));
 
 	if(pData->protocol == FORW_TCP) {
 		pData->bResendLastOnRecon = cs.bResendLastOnRecon;
@@ -1056,6 +2220,7 @@ CODE_STD_STRING_REQUESTparseSelectorAct(1)
 		}
 	}
 	CHKiRet(initTCP(pData));
+	CHKiRet(initUDP(pData));
 CODE_STD_FINALIZERparseSelectorAct
 ENDparseSelectorAct
 
@@ -1084,6 +2249,7 @@ CODESTARTmodExit
 	objRelease(netstrm, LM_NETSTRMS_FILENAME);
 	objRelease(netstrms, LM_NETSTRMS_FILENAME);
 	objRelease(tcpclt, LM_TCPCLT_FILENAME);
+	objRelease(statsobj, CORE_COMPONENT);
 	freeConfigVars();
 ENDmodExit
 
@@ -1095,6 +2261,8 @@ CODEqueryEtryPt_STD_CONF2_QUERIES
 CODEqueryEtryPt_STD_CONF2_setModCnf_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
 CODEqueryEtryPt_TXIF_OMOD_QUERIES /* we support the transactional interface! */
+CODEqueryEtryPt_BATCHIF_OMOD_QUERIES
+CODEqueryEtryPt_WRKRINST_OMOD_QUERIES
 ENDqueryEtryPt
 
 
@@ -1123,6 +2291,7 @@ CODEmodInit_QueryRegCFSLineHdlr
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(net,LM_NET_FILENAME));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 
 	CHKiRet(regCfSysLineHdlr((uchar *)"actionforwarddefaulttemplate", 0, eCmdHdlrGetWord, setLegacyDfltTpl, NULL, NULL));
 	CHKiRet(regCfSysLineHdlr((uchar *)"actionsendtcprebindinterval", 0, eCmdHdlrInt, NULL, &cs.iTCPRebindInterval, NULL));
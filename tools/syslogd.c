@@ -723,6 +723,7 @@ DEFFUNC_llExecFunc(flushRptdMsgsActions)
 		actionWriteToAction(pAction);
 		BACKOFF(pAction);
 	}
+	actionDedupFlush(pAction);
 	d_pthread_mutex_unlock(&pAction->mutAction);
 
 	ENDfunc
@@ -1337,7 +1338,8 @@ mainloop(void)
 		 * powertop, for example). In that case, we primarily wait for a signal,
 		 * but a once-a-day wakeup should be quite acceptable. -- rgerhards, 2008-06-09
 		 */
-		tvSelectTimeout.tv_sec = (runConf->globals.bReduceRepeatMsgs == 1) ? TIMERINTVL : 86400 /*1 day*/;
+		tvSelectTimeout.tv_sec = (runConf->globals.bReduceRepeatMsgs == 1 || runConf->actions.nbrDedup > 0)
+					 ? TIMERINTVL : 86400 /*1 day*/;
 		//tvSelectTimeout.tv_sec = TIMERINTVL; /* TODO: change this back to the above code when we have a better solution for apc */
 		tvSelectTimeout.tv_usec = 0;
 		select(1, NULL, NULL, NULL, &tvSelectTimeout);
@@ -1365,7 +1367,7 @@ mainloop(void)
 		 * for the time being, I think the remaining risk can be accepted.
 		 * rgerhards, 2008-01-10
  		 */
-		if(runConf->globals.bReduceRepeatMsgs == 1)
+		if(runConf->globals.bReduceRepeatMsgs == 1 || runConf->actions.nbrDedup > 0)
 			doFlushRptdMsgs();
 
 		if(bHadHUP) {